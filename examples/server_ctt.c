@@ -195,6 +195,7 @@ main(int argc, char **argv) {
     UA_DataSource dateDataSource;
     dateDataSource.read = readTimeData;
     dateDataSource.write = NULL;
+    dateDataSource.sessionDependent = false;
     UA_VariableAttributes v_attr = UA_VariableAttributes_default;
     v_attr.description = UA_LOCALIZEDTEXT("en-US", "current time");
     v_attr.displayName = UA_LOCALIZEDTEXT("en-US", "current time");
@@ -145,6 +145,7 @@ addCurrentTimeDataSourceVariable(UA_Server *server) {
     UA_DataSource timeDataSource;
     timeDataSource.read = readCurrentTime;
     timeDataSource.write = writeCurrentTime;
+    timeDataSource.sessionDependent = false;
     UA_Server_addDataSourceVariableNode(server, currentNodeId, parentNodeId,
                                         parentReferenceNodeId, currentName,
                                         variableTypeNodeId, attr,
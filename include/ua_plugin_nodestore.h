@@ -183,6 +183,10 @@ typedef struct {
     UA_Byte accessLevel;
     UA_Double minimumSamplingInterval;
     UA_Boolean historizing; /* currently unsupported */
+
+    /* If the value source is a data source, the value can be read in batches
+     * via the bulk data source */
+    UA_BulkDataSource *bulkDataSource;
 } UA_VariableNode;
 
 /**
@@ -231,6 +235,7 @@ typedef struct {
 
     /* Members specific to open62541 */
     UA_MethodCallback method;
+    UA_Boolean async; /* Calls are queued as asynchronous operations */
 } UA_MethodNode;
 
 /**
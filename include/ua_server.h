@@ -703,12 +703,79 @@ typedef struct {
                            void *sessionContext, const UA_NodeId *nodeId,
                            void *nodeContext, const UA_NumericRange *range,
                            const UA_DataValue *value);
+
+    /* Values read with a maxAge are cached and served to all sessions. Set
+     * this if the returned value depends on the session. Then a cached value
+     * is only served to the session it was read for. */
+    UA_Boolean sessionDependent;
 } UA_DataSource;
 
 UA_StatusCode UA_EXPORT
 UA_Server_setVariableNode_dataSource(UA_Server *server, const UA_NodeId nodeId,
                                      const UA_DataSource dataSource);
 
+/**
+ * Bulk Data Source
+ * ^^^^^^^^^^^^^^^^
+ * Several variables can share a bulk data source. The server then collects the
+ * value reads that go to the same source and calls the source once for the
+ * entire batch. Batching happens for all operations of a Read request and for
+ * the MonitoredItems of a session that are sampled with the same interval.
+ * This is useful when one transaction with the underlying device (e.g. a
+ * fieldbus) costs the same as reading a single value.
+ *
+ * The bulk data source is referenced by pointer from the variable nodes and
+ * must outlive them. */
+typedef struct {
+    const UA_NodeId *nodeId;
+    void *nodeContext;
+    const UA_NumericRange *range; /* NULL if no range is requested */
+    UA_DataValue value;           /* Set by the data source */
+} UA_BulkReadValue;
+
+typedef struct UA_BulkDataSource UA_BulkDataSource;
+
+struct UA_BulkDataSource {
+    /* Copies the data for a batch of nodes from the source. Every entry of the
+     * batch has the semantics of the read callback in UA_DataSource
+     * (including zero-copy). The values are initialized before the call.
+     *
+     * @param source The bulk data source itself. Can be used to access the
+     *        context.
+     * @param includeSourceTimeStamp If true, then the datasource is expected to
+     *        set the source timestamp in the returned values
+     * @param valuesSize The number of values in the batch
+     * @param values The values to be read
+     * @return Returns a status code for logging. An error code is set in all
+     *         values of the batch. The server releases the content of all
+     *         values after the call, also if an error is returned. So values
+     *         that point to memory of the source (zero-copy) must be marked
+     *         with UA_VARIANT_DATA_NODELETE, and the source must not release
+     *         partially filled values itself. */
+    UA_StatusCode (*read)(UA_Server *server, UA_BulkDataSource *source,
+                          const UA_NodeId *sessionId, void *sessionContext,
+                          UA_Boolean includeSourceTimeStamp,
+                          size_t valuesSize, UA_BulkReadValue *values);
+
+    /* Write into the data source. Writes are not batched. Same as the write
+     * callback in UA_DataSource. This method pointer can be NULL if the
+     * operation is unsupported. */
+    UA_StatusCode (*write)(UA_Server *server, const UA_NodeId *sessionId,
+                           void *sessionContext, const UA_NodeId *nodeId,
+                           void *nodeContext, const UA_NumericRange *range,
+                           const UA_DataValue *value);
+
+    void *context;
+
+    /* Same as in UA_DataSource. Taken over when the bulk data source is
+     * attached to a node. */
+    UA_Boolean sessionDependent;
+};
+
+UA_StatusCode UA_EXPORT
+UA_Server_setVariableNode_bulkDataSource(UA_Server *server, const UA_NodeId nodeId,
+                                         UA_BulkDataSource *bulkDataSource);
+
 /**
  * .. _value-callback:
  *
@@ -782,6 +849,60 @@ UA_Server_setMethodNode_callback(UA_Server *server,
 UA_CallMethodResult UA_EXPORT
 UA_Server_call(UA_Server *server, const UA_CallMethodRequest *request);
 
+/**
+ * Asynchronous Operations
+ * ^^^^^^^^^^^^^^^^^^^^^^^
+ * A long-running method stalls the server main loop and thereby all clients.
+ * Calls to methods marked as asynchronous are therefore not executed in the
+ * Call service. After the usual checks (access rights, input arguments), the
+ * operation is put in a queue and the response to the client is deferred.
+ *
+ * The application takes operations from the queue (possibly in a thread of its
+ * own), executes them (e.g. with ``UA_Server_call``) and sets the result. Once
+ * all operations of a request are done, the response is sent from the server
+ * main loop. The number of outstanding operations per session is limited in
+ * the server configuration. Operations without a result after
+ * ``asyncOperationTimeout`` return ``UA_STATUSCODE_BADTIMEOUT``. If the session
+ * is closed in the meantime, the results are discarded. */
+
+UA_StatusCode UA_EXPORT
+UA_Server_setMethodNode_async(UA_Server *server, const UA_NodeId methodNodeId,
+                              UA_Boolean isAsync);
+
+typedef enum {
+    UA_ASYNCOPERATIONTYPE_INVALID,
+    UA_ASYNCOPERATIONTYPE_CALL
+} UA_AsyncOperationType;
+
+typedef union {
+    UA_CallMethodRequest callMethodRequest;
+} UA_AsyncOperationRequest;
+
+typedef union {
+    UA_CallMethodResult callMethodResult;
+} UA_AsyncOperationResponse;
+
+/* Take the next operation from the queue. Returns false if the queue is empty.
+ * The request remains valid until the result is set.
+ *
+ * @param server The server object.
+ * @param type Set to the type of the operation.
+ * @param request Set to the request of the operation.
+ * @param context Set to the handle that identifies the operation when the
+ *        result is set.
+ * @return Indicates whether an operation was taken from the queue. */
+UA_Boolean UA_EXPORT
+UA_Server_getAsyncOperation(UA_Server *server, UA_AsyncOperationType *type,
+                            const UA_AsyncOperationRequest **request,
+                            void **context);
+
+/* Set the result of an operation taken from the queue. The response is copied.
+ * Results for operations that have timed out in the meantime are ignored. */
+void UA_EXPORT
+UA_Server_setAsyncOperationResult(UA_Server *server,
+                                  const UA_AsyncOperationResponse *response,
+                                  void *context);
+
 #endif
 
 /**
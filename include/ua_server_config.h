@@ -60,6 +60,12 @@ typedef struct {
 
 struct UA_ServerConfig {
     UA_UInt16 nThreads; /* only if multithreading is enabled */
+
+    /* Requests with at least this many operations are split up between the
+     * worker threads (Read, Write and Call). 0 -> disabled. Only if
+     * multithreading is enabled. */
+    UA_UInt32 parallelOperationsThreshold;
+
     UA_Logger logger;
 
     /* Server Description */
@@ -144,14 +150,38 @@ struct UA_ServerConfig {
     UA_UInt32 maxNotificationsPerPublish;
     UA_UInt32 maxRetransmissionQueueSize; /* 0 -> unlimited size */
 
+    /* Sent NotificationMessages are retained in their binary encoding until
+     * acknowledged. If the retained messages of a session exceed this size,
+     * the least recently sent or republished messages are dropped first. The
+     * message that was just sent is always retained. */
+    UA_UInt32 maxRetransmissionBytesPerSession; /* in bytes, 0 -> unlimited */
+
     /* Limits for MonitoredItems */
     UA_UInt32 maxMonitoredItemsPerSubscription;
     UA_DurationRange samplingIntervalLimits;
     UA_UInt32Range queueSizeLimits; /* Negotiated with the client */
 
+    /* Sample MonitoredItems on the Value attribute when the variable is
+     * written instead of polling in the sampling interval. Only applies to
+     * variables that store the value in the node and have no onRead callback.
+     * Variables with a DataSource are always polled. */
+    UA_Boolean sampleMonitoredItemsOnWrite;
+
+    /* Polled MonitoredItems on the Value attribute of the same node, with the
+     * same index range and sampling interval, share one read per interval.
+     * This also applies across sessions. The access rights are still checked
+     * for every session. Only applies to variables that store the value in the
+     * node and have no onRead callback. DataSources are always read with the
+     * session of the MonitoredItem. */
+    UA_Boolean shareMonitoredItemSamples;
+
     /* Limits for PublishRequests */
     UA_UInt32 maxPublishReqPerSession;
 
+    /* Asynchronous operations */
+    UA_UInt32 maxAsyncOperationsPerSession; /* 0 -> unlimited */
+    UA_Double asyncOperationTimeout; /* in ms, 0 -> no timeout */
+
     /* Discovery */
 #ifdef UA_ENABLE_DISCOVERY
     /* Timeout in seconds when to automatically remove a registered server from
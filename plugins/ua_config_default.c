@@ -201,6 +201,7 @@ createDefaultConfig(void) {
 
     /* --> Start setting the default static config <-- */
     conf->nThreads = 1;
+    conf->parallelOperationsThreshold = 1000;
     conf->logger = UA_Log_Stdout;
 
     /* Server Description */
@@ -268,10 +269,17 @@ createDefaultConfig(void) {
     conf->keepAliveCountLimits = UA_UINT32RANGE(1, 100);
     conf->maxNotificationsPerPublish = 1000;
     conf->maxRetransmissionQueueSize = 0; /* unlimited */
+    conf->maxRetransmissionBytesPerSession = 1024 * 1024; /* 1MB */
 
     /* Limits for MonitoredItems */
     conf->samplingIntervalLimits = UA_DURATIONRANGE(50.0, 24.0 * 3600.0 * 1000.0);
     conf->queueSizeLimits = UA_UINT32RANGE(1, 100);
+    conf->sampleMonitoredItemsOnWrite = false;
+    conf->shareMonitoredItemSamples = true;
+
+    /* Asynchronous operations */
+    conf->maxAsyncOperationsPerSession = 100;
+    conf->asyncOperationTimeout = 120.0 * 1000.0; /* 2min */
 
 #ifdef UA_ENABLE_DISCOVERY
     conf->discoveryCleanupTimeout = 60 * 60;
@@ -112,6 +112,9 @@ static inline int gethostname_freertos(char* name, size_t len){
 # if !defined(__CYGWIN__) && !defined(UA_FREERTOS)
 #  include <netinet/tcp.h>
 # endif
+# if defined(__linux__)
+#  include <sys/epoll.h>
+# endif
 #endif /* _WIN32 */
 
 #ifndef UA_sleep_ms
@@ -374,9 +377,10 @@ ServerNetworkLayerTCP_close(UA_Connection *connection) {
     connection->state = UA_CONNECTION_CLOSED;
 }
 
+/* Prepare an accepted socket for the connection */
 static UA_StatusCode
-ServerNetworkLayerTCP_add(ServerNetworkLayerTCP *layer, UA_Int32 newsockfd,
-                          struct sockaddr_storage *remote) {
+ServerNetworkLayerTCP_setupSocket(ServerNetworkLayerTCP *layer, UA_Int32 newsockfd,
+                                  struct sockaddr_storage *remote) {
     /* Set nonblocking */
     socket_set_nonblocking(newsockfd);
 
@@ -409,14 +413,12 @@ ServerNetworkLayerTCP_add(ServerNetworkLayerTCP *layer, UA_Int32 newsockfd,
                                                 (int)newsockfd, errno_str));
     }
 #endif
-    /* Allocate and initialize the connection */
-    ConnectionEntry *e = (ConnectionEntry*)UA_malloc(sizeof(ConnectionEntry));
-    if(!e){
-        CLOSESOCKET(newsockfd);
-        return UA_STATUSCODE_BADOUTOFMEMORY;
-    }
+    return UA_STATUSCODE_GOOD;
+}
 
-    UA_Connection *c = &e->connection;
+static void
+ServerNetworkLayerTCP_initConnection(ServerNetworkLayerTCP *layer, UA_Connection *c,
+                                     UA_Int32 newsockfd) {
     memset(c, 0, sizeof(UA_Connection));
     c->sockfd = newsockfd;
     c->handle = layer;
@@ -430,6 +432,22 @@ ServerNetworkLayerTCP_add(ServerNetworkLayerTCP *layer, UA_Int32 newsockfd,
     c->releaseRecvBuffer = connection_releaserecvbuffer;
     c->state = UA_CONNECTION_OPENING;
     c->openingDate = UA_DateTime_nowMonotonic();
+}
+
+static UA_StatusCode
+ServerNetworkLayerTCP_add(ServerNetworkLayerTCP *layer, UA_Int32 newsockfd,
+                          struct sockaddr_storage *remote) {
+    UA_StatusCode retval = ServerNetworkLayerTCP_setupSocket(layer, newsockfd, remote);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* Allocate and initialize the connection */
+    ConnectionEntry *e = (ConnectionEntry*)UA_malloc(sizeof(ConnectionEntry));
+    if(!e){
+        CLOSESOCKET(newsockfd);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    ServerNetworkLayerTCP_initConnection(layer, &e->connection, newsockfd);
 
     /* Add to the linked list */
     LIST_INSERT_HEAD(&layer->connections, e, pointers);
@@ -760,6 +778,359 @@ UA_ServerNetworkLayerTCP(UA_ConnectionConfig conf, UA_UInt16 port, UA_Logger log
     return nl;
 }
 
+#if defined(__linux__)
+
+/*********************************/
+/* Server NetworkLayer TCP epoll */
+/*********************************/
+
+/* The epoll variant waits only for the sockets that have pending events.
+ * Sockets are registered edge-triggered. So every notification is followed by
+ * reading (accepting) until the socket would block. The connections do not pass
+ * through an fd_set and are not limited by FD_SETSIZE. */
+
+#define EPOLL_MAXEVENTS 64
+
+typedef struct EpollConnectionEntry {
+    UA_Connection connection;
+    UA_ByteString recvBuffer; /* Reused for every receive on the connection */
+    UA_Boolean opening;       /* Member of the opening queue */
+    LIST_ENTRY(EpollConnectionEntry) pointers;
+    TAILQ_ENTRY(EpollConnectionEntry) openingPointers;
+} EpollConnectionEntry;
+
+typedef struct {
+    ServerNetworkLayerTCP tcp; /* The server sockets are set up as for the
+                                * select-based layer. Must be the first
+                                * member. */
+    int epollfd;
+    LIST_HEAD(, EpollConnectionEntry) connections;
+
+    /* Connections that have not received a Hello message yet. Ordered by the
+     * openingDate. So the timeout check stops at the first recent entry. */
+    TAILQ_HEAD(, EpollConnectionEntry) openingConnections;
+} ServerNetworkLayerTCPEpoll;
+
+static void
+ServerNetworkLayerTCPEpoll_freeConnection(UA_Connection *connection) {
+    EpollConnectionEntry *e = (EpollConnectionEntry*)connection;
+    UA_ByteString_deleteMembers(&e->recvBuffer);
+    UA_Connection_deleteMembers(connection);
+    UA_free(e);
+}
+
+static void
+ServerNetworkLayerTCPEpoll_releaseRecvBuffer(UA_Connection *connection,
+                                             UA_ByteString *buf) {
+    EpollConnectionEntry *e = (EpollConnectionEntry*)connection;
+    if(buf->data != e->recvBuffer.data)
+        UA_ByteString_deleteMembers(buf);
+}
+
+static void
+ServerNetworkLayerTCPEpoll_remove(ServerNetworkLayerTCPEpoll *layer, UA_Server *server,
+                                  EpollConnectionEntry *e) {
+    LIST_REMOVE(e, pointers);
+    if(e->opening)
+        TAILQ_REMOVE(&layer->openingConnections, e, openingPointers);
+    /* Closing the socket also removes it from the epoll set */
+    CLOSESOCKET(e->connection.sockfd);
+    UA_Server_removeConnection(server, &e->connection);
+}
+
+static void
+ServerNetworkLayerTCPEpoll_add(ServerNetworkLayerTCPEpoll *layer, UA_Int32 newsockfd,
+                               struct sockaddr_storage *remote) {
+    if(ServerNetworkLayerTCP_setupSocket(&layer->tcp, newsockfd, remote) != UA_STATUSCODE_GOOD)
+        return;
+
+    EpollConnectionEntry *e = (EpollConnectionEntry*)UA_malloc(sizeof(EpollConnectionEntry));
+    if(!e) {
+        CLOSESOCKET(newsockfd);
+        return;
+    }
+    ServerNetworkLayerTCP_initConnection(&layer->tcp, &e->connection, newsockfd);
+    e->connection.free = ServerNetworkLayerTCPEpoll_freeConnection;
+    e->connection.releaseRecvBuffer = ServerNetworkLayerTCPEpoll_releaseRecvBuffer;
+    e->recvBuffer = UA_BYTESTRING_NULL;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = e;
+    if(epoll_ctl(layer->epollfd, EPOLL_CTL_ADD, newsockfd, &event) < 0) {
+        UA_LOG_SOCKET_ERRNO_WRAP(
+            UA_LOG_WARNING(layer->tcp.logger, UA_LOGCATEGORY_NETWORK,
+                           "Connection %i | Could not be added to epoll: %s",
+                           (int)newsockfd, errno_str));
+        CLOSESOCKET(newsockfd);
+        UA_free(e);
+        return;
+    }
+
+    LIST_INSERT_HEAD(&layer->connections, e, pointers);
+    e->opening = true;
+    TAILQ_INSERT_TAIL(&layer->openingConnections, e, openingPointers);
+}
+
+/* Accept until the server sockets would block. The event does not carry the
+ * server socket. But there are only a few of them. */
+static void
+ServerNetworkLayerTCPEpoll_accept(ServerNetworkLayerTCPEpoll *layer) {
+    for(UA_UInt16 i = 0; i < layer->tcp.serverSocketsSize; i++) {
+        while(true) {
+            struct sockaddr_storage remote;
+            socklen_t remote_size = sizeof(remote);
+            int newsockfd = accept(layer->tcp.serverSockets[i],
+                                   (struct sockaddr*)&remote, &remote_size);
+            if(newsockfd < 0) {
+                if(errno == INTERRUPTED)
+                    continue;
+                break;
+            }
+
+            UA_LOG_TRACE(layer->tcp.logger, UA_LOGCATEGORY_NETWORK,
+                         "Connection %i | New TCP connection on server socket %i",
+                         newsockfd, layer->tcp.serverSockets[i]);
+            ServerNetworkLayerTCPEpoll_add(layer, (UA_Int32)newsockfd, &remote);
+        }
+    }
+}
+
+/* Receive into the reusable buffer of the connection. An empty buffer is
+ * returned when the socket would block. With multithreading, the message is
+ * processed asynchronously and a fresh buffer is used for every receive. */
+static UA_StatusCode
+ServerNetworkLayerTCPEpoll_recv(EpollConnectionEntry *e, UA_ByteString *buf) {
+    UA_Connection *c = &e->connection;
+    if(c->state == UA_CONNECTION_CLOSED)
+        return UA_STATUSCODE_BADCONNECTIONCLOSED;
+
+#ifndef UA_ENABLE_MULTITHREADING
+    if(!e->recvBuffer.data) {
+        UA_StatusCode retval =
+            UA_ByteString_allocBuffer(&e->recvBuffer, c->localConf.recvBufferSize);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+    }
+    *buf = e->recvBuffer;
+#else
+    UA_StatusCode retval = UA_ByteString_allocBuffer(buf, c->localConf.recvBufferSize);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+#endif
+
+    ssize_t ret;
+    do {
+        ret = recv(c->sockfd, (char*)buf->data, c->localConf.recvBufferSize, 0);
+    } while(ret < 0 && errno == INTERRUPTED);
+
+    if(ret > 0) {
+        buf->length = (size_t)ret;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    ServerNetworkLayerTCPEpoll_releaseRecvBuffer(c, buf);
+    *buf = UA_BYTESTRING_NULL;
+
+    /* Everything was read */
+    if(ret < 0 && (errno == AGAIN || errno == WOULDBLOCK))
+        return UA_STATUSCODE_GOOD;
+
+    /* The remote side closed the connection or an error occured */
+    c->close(c);
+    return UA_STATUSCODE_BADCONNECTIONCLOSED;
+}
+
+static void
+ServerNetworkLayerTCPEpoll_process(ServerNetworkLayerTCPEpoll *layer, UA_Server *server,
+                                   EpollConnectionEntry *e, uint32_t events) {
+    UA_LOG_TRACE(layer->tcp.logger, UA_LOGCATEGORY_NETWORK,
+                 "Connection %i | Activity on the socket",
+                 e->connection.sockfd);
+
+    if(events & EPOLLERR)
+        ServerNetworkLayerTCP_close(&e->connection);
+
+    /* Edge-triggered: Read until the socket would block */
+    while(true) {
+        UA_ByteString buf = UA_BYTESTRING_NULL;
+        UA_StatusCode retval = ServerNetworkLayerTCPEpoll_recv(e, &buf);
+        if(retval == UA_STATUSCODE_BADCONNECTIONCLOSED) {
+            /* The socket is shutdown but not closed */
+            UA_LOG_INFO(layer->tcp.logger, UA_LOGCATEGORY_NETWORK,
+                        "Connection %i | Closed", e->connection.sockfd);
+            ServerNetworkLayerTCPEpoll_remove(layer, server, e);
+            return;
+        }
+        if(retval != UA_STATUSCODE_GOOD || buf.length == 0)
+            return;
+
+        UA_Server_processBinaryMessage(server, &e->connection, &buf);
+        ServerNetworkLayerTCPEpoll_releaseRecvBuffer(&e->connection, &buf);
+    }
+}
+
+/* Close connections that did not send a Hello message in time */
+static void
+ServerNetworkLayerTCPEpoll_checkOpening(ServerNetworkLayerTCPEpoll *layer,
+                                        UA_Server *server) {
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    EpollConnectionEntry *e;
+    while((e = TAILQ_FIRST(&layer->openingConnections))) {
+        if(e->connection.state != UA_CONNECTION_OPENING) {
+            TAILQ_REMOVE(&layer->openingConnections, e, openingPointers);
+            e->opening = false;
+            continue;
+        }
+        if(now <= e->connection.openingDate + (NOHELLOTIMEOUT * UA_DATETIME_MSEC))
+            break;
+        UA_LOG_INFO(layer->tcp.logger, UA_LOGCATEGORY_NETWORK,
+                    "Connection %i | Closed by the server (no Hello Message)",
+                    e->connection.sockfd);
+        ServerNetworkLayerTCPEpoll_remove(layer, server, e);
+    }
+}
+
+static UA_StatusCode
+ServerNetworkLayerTCPEpoll_start(UA_ServerNetworkLayer *nl, const UA_String *customHostname) {
+    ServerNetworkLayerTCPEpoll *layer = (ServerNetworkLayerTCPEpoll *)nl->handle;
+    layer->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if(layer->epollfd < 0) {
+        UA_LOG_SOCKET_ERRNO_WRAP(
+            UA_LOG_ERROR(layer->tcp.logger, UA_LOGCATEGORY_NETWORK,
+                         "Could not create the epoll instance: %s", errno_str));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    UA_StatusCode retval = ServerNetworkLayerTCP_start(nl, customHostname);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* Register the server sockets. The event data is NULL to distinguish them
+     * from the connections. */
+    for(UA_UInt16 i = 0; i < layer->tcp.serverSocketsSize; i++) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(struct epoll_event));
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = NULL;
+        if(epoll_ctl(layer->epollfd, EPOLL_CTL_ADD,
+                     layer->tcp.serverSockets[i], &event) < 0) {
+            UA_LOG_SOCKET_ERRNO_WRAP(
+                UA_LOG_WARNING(layer->tcp.logger, UA_LOGCATEGORY_NETWORK,
+                               "Could not add server socket %i to epoll: %s",
+                               layer->tcp.serverSockets[i], errno_str));
+        }
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+ServerNetworkLayerTCPEpoll_listen(UA_ServerNetworkLayer *nl, UA_Server *server,
+                                  UA_UInt16 timeout) {
+    ServerNetworkLayerTCPEpoll *layer = (ServerNetworkLayerTCPEpoll *)nl->handle;
+    if(layer->tcp.serverSocketsSize == 0)
+        return UA_STATUSCODE_GOOD;
+
+    struct epoll_event events[EPOLL_MAXEVENTS];
+    int n = epoll_wait(layer->epollfd, events, EPOLL_MAXEVENTS, (int)timeout);
+    if(n < 0 && errno != INTERRUPTED) {
+        UA_LOG_SOCKET_ERRNO_WRAP(
+            UA_LOG_WARNING(layer->tcp.logger, UA_LOGCATEGORY_NETWORK,
+                           "Socket epoll_wait failed with %s", errno_str));
+        // we will retry, so do not return bad
+        return UA_STATUSCODE_GOOD;
+    }
+
+    /* Every file descriptor appears at most once in the events. So removing a
+     * connection does not invalidate the remaining events. */
+    for(int i = 0; i < n; i++) {
+        if(!events[i].data.ptr)
+            ServerNetworkLayerTCPEpoll_accept(layer);
+        else
+            ServerNetworkLayerTCPEpoll_process(layer, server,
+                                               (EpollConnectionEntry*)events[i].data.ptr,
+                                               events[i].events);
+    }
+
+    ServerNetworkLayerTCPEpoll_checkOpening(layer, server);
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+ServerNetworkLayerTCPEpoll_stop(UA_ServerNetworkLayer *nl, UA_Server *server) {
+    ServerNetworkLayerTCPEpoll *layer = (ServerNetworkLayerTCPEpoll *)nl->handle;
+    UA_LOG_INFO(layer->tcp.logger, UA_LOGCATEGORY_NETWORK,
+                "Shutting down the TCP network layer");
+
+    /* Close the server sockets */
+    for(UA_UInt16 i = 0; i < layer->tcp.serverSocketsSize; i++) {
+        shutdown(layer->tcp.serverSockets[i], 2);
+        CLOSESOCKET(layer->tcp.serverSockets[i]);
+    }
+    layer->tcp.serverSocketsSize = 0;
+
+    /* Close and remove the open connections */
+    EpollConnectionEntry *e, *e_tmp;
+    LIST_FOREACH_SAFE(e, &layer->connections, pointers, e_tmp) {
+        ServerNetworkLayerTCP_close(&e->connection);
+        ServerNetworkLayerTCPEpoll_remove(layer, server, e);
+    }
+
+    CLOSESOCKET(layer->epollfd);
+    layer->epollfd = -1;
+}
+
+/* run only when the server is stopped */
+static void
+ServerNetworkLayerTCPEpoll_deleteMembers(UA_ServerNetworkLayer *nl) {
+    ServerNetworkLayerTCPEpoll *layer = (ServerNetworkLayerTCPEpoll *)nl->handle;
+    UA_String_deleteMembers(&nl->discoveryUrl);
+
+    /* Hard-close and remove remaining connections. The server is no longer
+     * running. So this is safe. */
+    EpollConnectionEntry *e, *e_tmp;
+    LIST_FOREACH_SAFE(e, &layer->connections, pointers, e_tmp) {
+        LIST_REMOVE(e, pointers);
+        CLOSESOCKET(e->connection.sockfd);
+        UA_ByteString_deleteMembers(&e->recvBuffer);
+        UA_free(e);
+    }
+
+    if(layer->epollfd >= 0)
+        CLOSESOCKET(layer->epollfd);
+
+    /* Free the layer */
+    UA_free(layer);
+}
+
+UA_ServerNetworkLayer
+UA_ServerNetworkLayerTCP_epoll(UA_ConnectionConfig conf, UA_UInt16 port,
+                               UA_Logger logger) {
+    UA_ServerNetworkLayer nl;
+    memset(&nl, 0, sizeof(UA_ServerNetworkLayer));
+    ServerNetworkLayerTCPEpoll *layer = (ServerNetworkLayerTCPEpoll*)
+        UA_calloc(1,sizeof(ServerNetworkLayerTCPEpoll));
+    if(!layer)
+        return nl;
+
+    layer->tcp.logger = (logger != NULL ? logger : UA_Log_Stdout);
+    layer->tcp.conf = conf;
+    layer->tcp.port = port;
+    layer->epollfd = -1;
+    LIST_INIT(&layer->connections);
+    TAILQ_INIT(&layer->openingConnections);
+
+    nl.handle = layer;
+    nl.start = ServerNetworkLayerTCPEpoll_start;
+    nl.listen = ServerNetworkLayerTCPEpoll_listen;
+    nl.stop = ServerNetworkLayerTCPEpoll_stop;
+    nl.deleteMembers = ServerNetworkLayerTCPEpoll_deleteMembers;
+    return nl;
+}
+
+#endif /* defined(__linux__) */
+
 /***************************/
 /* Client NetworkLayer TCP */
 /***************************/
@@ -18,6 +18,16 @@ extern "C" {
 UA_ServerNetworkLayer UA_EXPORT
 UA_ServerNetworkLayerTCP(UA_ConnectionConfig conf, UA_UInt16 port, UA_Logger logger);
 
+#if defined(__linux__)
+/* Same as UA_ServerNetworkLayerTCP. But uses edge-triggered epoll instead of
+ * select. Only the sockets with pending events are visited and the number of
+ * connections is not limited by FD_SETSIZE. Every connection reuses its receive
+ * buffer. */
+UA_ServerNetworkLayer UA_EXPORT
+UA_ServerNetworkLayerTCP_epoll(UA_ConnectionConfig conf, UA_UInt16 port,
+                               UA_Logger logger);
+#endif
+
 UA_Connection UA_EXPORT
 UA_ClientConnectionTCP(UA_ConnectionConfig conf, const char *endpointUrl, const UA_UInt32 timeout, UA_Logger logger);
 
@@ -12,13 +12,23 @@
 #define container_of(ptr, type, member) \
     (type *)((uintptr_t)ptr - offsetof(type,member))
 
+/* Critical sections for the writers. When the section is left, retired entries
+ * are reclaimed if the grace period has passed. Readers only register for the
+ * current epoch and never block. */
 #ifdef UA_ENABLE_MULTITHREADING
 #include <pthread.h>
 #define BEGIN_CRITSECT(NODEMAP) pthread_mutex_lock(&(NODEMAP)->mutex)
-#define END_CRITSECT(NODEMAP) pthread_mutex_unlock(&(NODEMAP)->mutex)
+#define END_CRITSECT(NODEMAP) do {                  \
+        reclaim(NODEMAP);                           \
+        pthread_mutex_unlock(&(NODEMAP)->mutex);    \
+    } while(0)
+#define BEGIN_READ(NODEMAP) volatile UA_UInt32 *readCounter = readBegin(NODEMAP)
+#define END_READ(NODEMAP) UA_NODEMAP_DEC(readCounter)
 #else
 #define BEGIN_CRITSECT(NODEMAP)
 #define END_CRITSECT(NODEMAP)
+#define BEGIN_READ(NODEMAP)
+#define END_READ(NODEMAP)
 #endif
 
 /* The default Nodestore is simply a hash-map from NodeIds to Nodes. To find an
@@ -26,25 +36,89 @@
  *
  * - Tombstone or non-matching NodeId: continue searching
  * - Matching NodeId: Return the entry
- * - NULL: Abort the search */
+ * - NULL: Abort the search
+ *
+ * With multithreading, the hash-map is read-mostly in the style of RCU. Readers
+ * (getNode, getNodeCopy, iterate) take no lock. Writers are serialized by a
+ * mutex and never modify a published entry. Instead, they publish a new entry
+ * (or a new slot table on resize) with an atomic pointer store. The unlinked
+ * versions are retired and freed only after a grace period has passed and no
+ * consumer holds a reference (refCount == 0).
+ *
+ * The grace period is tracked with a global epoch. Readers register in one of
+ * two counters (by epoch parity) for the duration of their critical section.
+ * The counters are striped over cache lines to avoid contention between the
+ * reader threads. The epoch advances from e to e+1 only when no reader is left
+ * in epoch e-1. So an entry retired in epoch e can no longer be seen by any
+ * reader once the epoch has reached e+2. */
 
 typedef struct UA_NodeMapEntry {
     struct UA_NodeMapEntry *orig; /* the version this is a copy from (or NULL) */
-    UA_UInt16 refCount; /* How many consumers have a reference to the node? */
+    UA_UInt32 refCount; /* How many consumers have a reference to the node? */
     UA_Boolean deleted; /* Node was marked as deleted and can be deleted when refCount == 0 */
+#ifdef UA_ENABLE_MULTITHREADING
+    struct UA_NodeMapEntry *retiredNext; /* List of entries awaiting reclamation */
+    UA_UInt32 retiredEpoch; /* The epoch when the entry was unlinked */
+#endif
     UA_Node node;
 } UA_NodeMapEntry;
 
 #define UA_NODEMAP_MINSIZE 64
 #define UA_NODEMAP_TOMBSTONE ((UA_NodeMapEntry*)0x01)
 
-typedef struct {
-    UA_NodeMapEntry **entries;
+/* The slots are allocated together with their size. So a reader always sees a
+ * consistent pair when the table is swapped out during a resize. */
+typedef struct UA_NodeMapTable {
     UA_UInt32 size;
+#ifdef UA_ENABLE_MULTITHREADING
+    struct UA_NodeMapTable *retiredNext; /* List of tables awaiting reclamation */
+    UA_UInt32 retiredEpoch; /* The epoch when the table was swapped out */
+#endif
+    UA_NodeMapEntry *entries[];
+} UA_NodeMapTable;
+
+#ifdef UA_ENABLE_MULTITHREADING
+
+#define UA_NODEMAP_READERSTRIPES 16
+
+/* Reader counters for the two epoch parities. Aligned to separate cache
+ * lines. */
+typedef struct {
+    volatile UA_UInt32 active[2];
+    char padding[64 - (2 * sizeof(UA_UInt32))];
+} UA_NodeMapReaders;
+
+/* Plugins cannot use the internal atomics from ua_util.h */
+# ifdef _MSC_VER /* Visual Studio */
+#  define UA_NODEMAP_THREAD_LOCAL __declspec(thread)
+#  define UA_NODEMAP_SYNC() MemoryBarrier()
+#  define UA_NODEMAP_INC(ADDR) ((UA_UInt32)_InterlockedIncrement((volatile long*)(ADDR)))
+#  define UA_NODEMAP_DEC(ADDR) ((UA_UInt32)_InterlockedDecrement((volatile long*)(ADDR)))
+# else /* GCC/Clang */
+#  define UA_NODEMAP_THREAD_LOCAL __thread
+#  define UA_NODEMAP_SYNC() __sync_synchronize()
+#  define UA_NODEMAP_INC(ADDR) __sync_add_and_fetch(ADDR, 1)
+#  define UA_NODEMAP_DEC(ADDR) __sync_sub_and_fetch(ADDR, 1)
+# endif
+
+#else
+
+# define UA_NODEMAP_SYNC()
+# define UA_NODEMAP_INC(ADDR) (++(*(ADDR)))
+# define UA_NODEMAP_DEC(ADDR) (--(*(ADDR)))
+
+#endif
+
+typedef struct {
+    UA_NodeMapTable * volatile table;
     UA_UInt32 count;
     UA_UInt32 sizePrimeIndex;
 #ifdef UA_ENABLE_MULTITHREADING
-    pthread_mutex_t mutex; /* Protect access */
+    pthread_mutex_t mutex; /* Serialize the writers */
+    volatile UA_UInt32 epoch;
+    UA_NodeMapReaders readers[UA_NODEMAP_READERSTRIPES];
+    UA_NodeMapEntry *retiredEntries;
+    UA_NodeMapTable *retiredTables;
 #endif
 } UA_NodeMap;
 
@@ -81,19 +155,19 @@ higher_prime_index(UA_UInt32 n) {
 
 /* returns an empty slot or null if the nodeid exists */
 static UA_NodeMapEntry **
-findFreeSlot(const UA_NodeMap *ns, const UA_NodeId *nodeid) {
+findFreeSlot(UA_NodeMapTable *t, const UA_NodeId *nodeid) {
     UA_UInt32 h = UA_NodeId_hash(nodeid);
-    UA_UInt32 size = ns->size;
+    UA_UInt32 size = t->size;
     UA_UInt32 idx = mod(h, size);
     UA_UInt32 hash2 = mod2(h, size);
 
     while(true) {
-        UA_NodeMapEntry *e = ns->entries[idx];
+        UA_NodeMapEntry *e = t->entries[idx];
         if(e > UA_NODEMAP_TOMBSTONE &&
            UA_NodeId_equal(&e->node.nodeId, nodeid))
             return NULL;
-        if(ns->entries[idx] <= UA_NODEMAP_TOMBSTONE)
-            return &ns->entries[idx];
+        if(t->entries[idx] <= UA_NODEMAP_TOMBSTONE)
+            return &t->entries[idx];
         idx += hash2;
         if(idx >= size)
             idx -= size;
@@ -103,39 +177,14 @@ findFreeSlot(const UA_NodeMap *ns, const UA_NodeId *nodeid) {
     return NULL;
 }
 
-/* The occupancy of the table after the call will be about 50% */
-static UA_StatusCode
-expand(UA_NodeMap *ns) {
-    UA_UInt32 osize = ns->size;
-    UA_UInt32 count = ns->count;
-    /* Resize only when table after removal of unused elements is either too
-       full or too empty */
-    if(count * 2 < osize && (count * 8 > osize || osize <= UA_NODEMAP_MINSIZE))
-        return UA_STATUSCODE_GOOD;
-
-    UA_NodeMapEntry **oentries = ns->entries;
-    UA_UInt32 nindex = higher_prime_index(count * 2);
-    UA_UInt32 nsize = primes[nindex];
-    UA_NodeMapEntry **nentries = (UA_NodeMapEntry **)UA_calloc(nsize, sizeof(UA_NodeMapEntry*));
-    if(!nentries)
-        return UA_STATUSCODE_BADOUTOFMEMORY;
-
-    ns->entries = nentries;
-    ns->size = nsize;
-    ns->sizePrimeIndex = nindex;
-
-    /* recompute the position of every entry and insert the pointer */
-    for(size_t i = 0, j = 0; i < osize && j < count; ++i) {
-        if(oentries[i] <= UA_NODEMAP_TOMBSTONE)
-            continue;
-        UA_NodeMapEntry **e = findFreeSlot(ns, &oentries[i]->node.nodeId);
-        UA_assert(e);
-        *e = oentries[i];
-        ++j;
-    }
-
-    UA_free(oentries);
-    return UA_STATUSCODE_GOOD;
+static UA_NodeMapTable *
+newTable(UA_UInt32 size) {
+    UA_NodeMapTable *t = (UA_NodeMapTable*)
+        UA_calloc(1, sizeof(UA_NodeMapTable) + (size * sizeof(UA_NodeMapEntry*)));
+    if(!t)
+        return NULL;
+    t->size = size;
+    return t;
 }
 
 static UA_NodeMapEntry *
@@ -182,38 +231,208 @@ deleteEntry(UA_NodeMapEntry *entry) {
     UA_free(entry);
 }
 
+#ifndef UA_ENABLE_MULTITHREADING
+
 static void
 cleanupEntry(UA_NodeMapEntry *entry) {
     if(entry->deleted && entry->refCount == 0)
         deleteEntry(entry);
 }
 
+/* Without concurrent readers, the entry is deleted right away unless a
+ * consumer still holds a reference */
+static void
+unlinkEntry(UA_NodeMap *ns, UA_NodeMapEntry *entry) {
+    entry->deleted = true;
+    cleanupEntry(entry);
+}
+
+static void
+unlinkTable(UA_NodeMap *ns, UA_NodeMapTable *t) {
+    UA_free(t);
+}
+
+#else /* UA_ENABLE_MULTITHREADING */
+
+/* Every thread takes the next stripe (round-robin) on its first read. Stored
+ * with an offset of one, so that zero means "not yet assigned". */
+static volatile UA_UInt32 nextReaderStripe = 0;
+static UA_NODEMAP_THREAD_LOCAL UA_UInt32 readerStripe = 0;
+
+/* Enter the read-side critical section. Returns the counter that needs to be
+ * decremented when leaving. */
+static volatile UA_UInt32 *
+readBegin(UA_NodeMap *ns) {
+    if(readerStripe == 0)
+        readerStripe = UA_NODEMAP_INC(&nextReaderStripe);
+    volatile UA_UInt32 *counter;
+    UA_NodeMapReaders *readers =
+        &ns->readers[(readerStripe - 1) % UA_NODEMAP_READERSTRIPES];
+    while(true) {
+        UA_UInt32 epoch = ns->epoch;
+        counter = &readers->active[epoch & 1];
+        UA_NODEMAP_INC(counter);
+        if(ns->epoch == epoch)
+            return counter;
+        /* The epoch advanced in between. Retry with the new epoch. */
+        UA_NODEMAP_DEC(counter);
+    }
+}
+
+/* The epoch advances from e to e+1 only if no reader is left in e-1. Both have
+ * the same parity. Readers that still try to enter with e-1 will notice the
+ * change and retry. Called with the writer mutex held. */
+static void
+tryAdvanceEpoch(UA_NodeMap *ns) {
+    UA_NODEMAP_SYNC();
+    UA_UInt32 next = ns->epoch + 1;
+    for(size_t i = 0; i < UA_NODEMAP_READERSTRIPES; ++i) {
+        if(ns->readers[i].active[next & 1] > 0)
+            return;
+    }
+    ns->epoch = next;
+    UA_NODEMAP_SYNC();
+}
+
+/* Free the retired entries and tables after the grace period. Entries are kept
+ * as long as a consumer holds a reference. Called with the writer mutex
+ * held. */
+static void
+reclaim(UA_NodeMap *ns) {
+    tryAdvanceEpoch(ns);
+    UA_UInt32 epoch = ns->epoch;
+
+    UA_NodeMapEntry **entryPos = &ns->retiredEntries;
+    while(*entryPos) {
+        UA_NodeMapEntry *entry = *entryPos;
+        if(epoch - entry->retiredEpoch >= 2 && entry->refCount == 0) {
+            *entryPos = entry->retiredNext;
+            deleteEntry(entry);
+        } else {
+            entryPos = &entry->retiredNext;
+        }
+    }
+
+    UA_NodeMapTable **tablePos = &ns->retiredTables;
+    while(*tablePos) {
+        UA_NodeMapTable *t = *tablePos;
+        if(epoch - t->retiredEpoch >= 2) {
+            *tablePos = t->retiredNext;
+            UA_free(t);
+        } else {
+            tablePos = &t->retiredNext;
+        }
+    }
+}
+
+/* The entry is no longer reachable from the table. Readers may still access it
+ * until the grace period has passed. */
+static void
+unlinkEntry(UA_NodeMap *ns, UA_NodeMapEntry *entry) {
+    entry->deleted = true;
+    UA_NODEMAP_SYNC(); /* Unlink before sampling the epoch */
+    entry->retiredEpoch = ns->epoch;
+    entry->retiredNext = ns->retiredEntries;
+    ns->retiredEntries = entry;
+}
+
+static void
+unlinkTable(UA_NodeMap *ns, UA_NodeMapTable *t) {
+    UA_NODEMAP_SYNC(); /* Unlink before sampling the epoch */
+    t->retiredEpoch = ns->epoch;
+    t->retiredNext = ns->retiredTables;
+    ns->retiredTables = t;
+}
+
+#endif /* UA_ENABLE_MULTITHREADING */
+
+/* The occupancy of the table after the call will be about 50% */
+static UA_StatusCode
+expand(UA_NodeMap *ns) {
+    UA_NodeMapTable *otable = ns->table;
+    UA_UInt32 osize = otable->size;
+    UA_UInt32 count = ns->count;
+    /* Resize only when table after removal of unused elements is either too
+       full or too empty */
+    if(count * 2 < osize && (count * 8 > osize || osize <= UA_NODEMAP_MINSIZE))
+        return UA_STATUSCODE_GOOD;
+
+    UA_UInt32 nindex = higher_prime_index(count * 2);
+    UA_UInt32 nsize = primes[nindex];
+    UA_NodeMapTable *ntable = newTable(nsize);
+    if(!ntable)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    /* recompute the position of every entry and insert the pointer */
+    for(size_t i = 0, j = 0; i < osize && j < count; ++i) {
+        if(otable->entries[i] <= UA_NODEMAP_TOMBSTONE)
+            continue;
+        UA_NodeMapEntry **e = findFreeSlot(ntable, &otable->entries[i]->node.nodeId);
+        UA_assert(e);
+        *e = otable->entries[i];
+        ++j;
+    }
+
+    /* Publish the filled table */
+    UA_NODEMAP_SYNC();
+    ns->table = ntable;
+    ns->sizePrimeIndex = nindex;
+    unlinkTable(ns, otable);
+    return UA_STATUSCODE_GOOD;
+}
+
 static UA_StatusCode
 clearSlot(UA_NodeMap *ns, UA_NodeMapEntry **slot) {
-    (*slot)->deleted = true;
-    cleanupEntry(*slot);
+    UA_NodeMapEntry *entry = *slot;
     *slot = UA_NODEMAP_TOMBSTONE;
+    unlinkEntry(ns, entry);
     --ns->count;
     /* Downsize the hashmap if it is very empty */
-    if(ns->count * 8 < ns->size && ns->size > 32)
+    if(ns->count * 8 < ns->table->size && ns->table->size > 32)
         expand(ns); /* Can fail. Just continue with the bigger hashmap. */
     return UA_STATUSCODE_GOOD;
 }
 
+/* Lookup for the writers. The slot may be modified. */
 static UA_NodeMapEntry **
-findOccupiedSlot(const UA_NodeMap *ns, const UA_NodeId *nodeid) {
+findOccupiedSlot(UA_NodeMapTable *t, const UA_NodeId *nodeid) {
+    UA_UInt32 h = UA_NodeId_hash(nodeid);
+    UA_UInt32 size = t->size;
+    UA_UInt32 idx = mod(h, size);
+    UA_UInt32 hash2 = mod2(h, size);
+
+    while(true) {
+        UA_NodeMapEntry *e = t->entries[idx];
+        if(!e)
+            return NULL;
+        if(e > UA_NODEMAP_TOMBSTONE &&
+           UA_NodeId_equal(&e->node.nodeId, nodeid))
+            return &t->entries[idx];
+        idx += hash2;
+        if(idx >= size)
+            idx -= size;
+    }
+
+    /* NOTREACHED */
+    return NULL;
+}
+
+/* Lookup for the readers. Every slot is loaded only once, as writers may
+ * replace the content concurrently. */
+static UA_NodeMapEntry *
+findEntry(const UA_NodeMapTable *t, const UA_NodeId *nodeid) {
     UA_UInt32 h = UA_NodeId_hash(nodeid);
-    UA_UInt32 size = ns->size;
+    UA_UInt32 size = t->size;
     UA_UInt32 idx = mod(h, size);
     UA_UInt32 hash2 = mod2(h, size);
 
     while(true) {
-        UA_NodeMapEntry *e = ns->entries[idx];
+        UA_NodeMapEntry *e = ((UA_NodeMapEntry * const volatile *)t->entries)[idx];
         if(!e)
             return NULL;
         if(e > UA_NODEMAP_TOMBSTONE &&
            UA_NodeId_equal(&e->node.nodeId, nodeid))
-            return &ns->entries[idx];
+            return e;
         idx += hash2;
         if(idx >= size)
             idx -= size;
@@ -235,62 +454,65 @@ UA_NodeMap_newNode(void *context, UA_NodeClass nodeClass) {
     return &entry->node;
 }
 
+/* Only called for nodes that were not (yet) inserted */
 static void
 UA_NodeMap_deleteNode(void *context, UA_Node *node) {
-#ifdef UA_ENABLE_MULTITHREADING
-    UA_NodeMap *ns = (UA_NodeMap*)context;
-#endif
-    BEGIN_CRITSECT(ns);
     UA_NodeMapEntry *entry = container_of(node, UA_NodeMapEntry, node);
     UA_assert(&entry->node == node);
     deleteEntry(entry);
-    END_CRITSECT(ns);
 }
 
 static const UA_Node *
 UA_NodeMap_getNode(void *context, const UA_NodeId *nodeid) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
-    BEGIN_CRITSECT(ns);
-    UA_NodeMapEntry **entry = findOccupiedSlot(ns, nodeid);
+    BEGIN_READ(ns);
+    UA_NodeMapEntry *entry = findEntry(ns->table, nodeid);
     if(!entry) {
-        END_CRITSECT(ns);
+        END_READ(ns);
         return NULL;
     }
-    ++(*entry)->refCount;
-    END_CRITSECT(ns);
-    return (const UA_Node*)&(*entry)->node;
+    UA_NODEMAP_INC(&entry->refCount);
+    END_READ(ns);
+    return (const UA_Node*)&entry->node;
 }
 
 static void
 UA_NodeMap_releaseNode(void *context, const UA_Node *node) {
     if (!node)
         return;
-#ifdef UA_ENABLE_MULTITHREADING
-    UA_NodeMap *ns = (UA_NodeMap*)context;
-#endif
-    BEGIN_CRITSECT(ns);
     UA_NodeMapEntry *entry = container_of(node, UA_NodeMapEntry, node);
     UA_assert(&entry->node == node);
     UA_assert(entry->refCount > 0);
+#ifndef UA_ENABLE_MULTITHREADING
     --entry->refCount;
     cleanupEntry(entry);
-    END_CRITSECT(ns);
+#else
+    /* Read the flag before giving up the reference. Afterwards, the entry can
+     * be reclaimed at any time. */
+    UA_Boolean deleted = entry->deleted;
+    if(UA_NODEMAP_DEC(&entry->refCount) > 0 || !deleted)
+        return;
+    /* Don't block if a writer is active. The reclamation is then retried
+     * during the next write. */
+    UA_NodeMap *ns = (UA_NodeMap*)context;
+    if(pthread_mutex_trylock(&ns->mutex) == 0)
+        END_CRITSECT(ns);
+#endif
 }
 
 static UA_StatusCode
 UA_NodeMap_getNodeCopy(void *context, const UA_NodeId *nodeid,
                        UA_Node **outNode) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
-    BEGIN_CRITSECT(ns);
-    UA_NodeMapEntry **slot = findOccupiedSlot(ns, nodeid);
-    if(!slot) {
-        END_CRITSECT(ns);
+    BEGIN_READ(ns);
+    UA_NodeMapEntry *entry = findEntry(ns->table, nodeid);
+    if(!entry) {
+        END_READ(ns);
         return UA_STATUSCODE_BADNODEIDUNKNOWN;
     }
-    UA_NodeMapEntry *entry = *slot;
     UA_NodeMapEntry *newItem = newEntry(entry->node.nodeClass);
     if(!newItem) {
-        END_CRITSECT(ns);
+        END_READ(ns);
         return UA_STATUSCODE_BADOUTOFMEMORY;
     }
     UA_StatusCode retval = UA_Node_copy(&entry->node, &newItem->node);
@@ -300,7 +522,7 @@ UA_NodeMap_getNodeCopy(void *context, const UA_NodeId *nodeid,
     } else {
         deleteEntry(newItem);
     }
-    END_CRITSECT(ns);
+    END_READ(ns);
     return retval;
 }
 
@@ -308,7 +530,7 @@ static UA_StatusCode
 UA_NodeMap_removeNode(void *context, const UA_NodeId *nodeid) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
     BEGIN_CRITSECT(ns);
-    UA_NodeMapEntry **slot = findOccupiedSlot(ns, nodeid);
+    UA_NodeMapEntry **slot = findOccupiedSlot(ns->table, nodeid);
     UA_StatusCode retval = UA_STATUSCODE_GOOD;
     if(slot)
         retval = clearSlot(ns, slot);
@@ -323,7 +545,7 @@ UA_NodeMap_insertNode(void *context, UA_Node *node,
                       UA_NodeId *addedNodeId) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
     BEGIN_CRITSECT(ns);
-    if(ns->size * 3 <= ns->count * 4) {
+    if(ns->table->size * 3 <= ns->count * 4) {
         if(expand(ns) != UA_STATUSCODE_GOOD) {
             END_CRITSECT(ns);
             return UA_STATUSCODE_BADINTERNALERROR;
@@ -338,11 +560,11 @@ UA_NodeMap_insertNode(void *context, UA_Node *node,
         /* E.g. adding a nodeset will create children while there are still other nodes which need to be created */
         /* Thus the node id's may collide */
         UA_UInt32 identifier = 50000 + ns->count+1; // start value
-        UA_UInt32 size = ns->size;
+        UA_UInt32 size = ns->table->size;
         UA_UInt32 increase = mod2(ns->count+1, size);
         while(true) {
             node->nodeId.identifier.numeric = identifier;
-            slot = findFreeSlot(ns, &node->nodeId);
+            slot = findFreeSlot(ns->table, &node->nodeId);
             if(slot)
                 break;
             identifier += increase;
@@ -350,7 +572,7 @@ UA_NodeMap_insertNode(void *context, UA_Node *node,
                 identifier -= size;
         }
     } else {
-        slot = findFreeSlot(ns, &node->nodeId);
+        slot = findFreeSlot(ns->table, &node->nodeId);
         if(!slot) {
             deleteEntry(container_of(node, UA_NodeMapEntry, node));
             END_CRITSECT(ns);
@@ -358,6 +580,8 @@ UA_NodeMap_insertNode(void *context, UA_Node *node,
         }
     }
 
+    /* Publish the fully initialized node */
+    UA_NODEMAP_SYNC();
     *slot = container_of(node, UA_NodeMapEntry, node);
     ++ns->count;
     UA_assert(&(*slot)->node == node);
@@ -377,7 +601,7 @@ static UA_StatusCode
 UA_NodeMap_replaceNode(void *context, UA_Node *node) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
     BEGIN_CRITSECT(ns);
-    UA_NodeMapEntry **slot = findOccupiedSlot(ns, &node->nodeId);
+    UA_NodeMapEntry **slot = findOccupiedSlot(ns->table, &node->nodeId);
     if(!slot) {
         END_CRITSECT(ns);
         return UA_STATUSCODE_BADNODEIDUNKNOWN;
@@ -389,9 +613,12 @@ UA_NodeMap_replaceNode(void *context, UA_Node *node) {
         END_CRITSECT(ns);
         return UA_STATUSCODE_BADINTERNALERROR;
     }
-    (*slot)->deleted = true;
-    cleanupEntry(*slot);
+
+    /* Publish the new version and unlink the old one */
+    UA_NodeMapEntry *oldEntry = *slot;
+    UA_NODEMAP_SYNC();
     *slot = newEntryContainer;
+    unlinkEntry(ns, oldEntry);
     END_CRITSECT(ns);
     return UA_STATUSCODE_GOOD;
 }
@@ -400,19 +627,18 @@ static void
 UA_NodeMap_iterate(void *context, void *visitorContext,
                    UA_NodestoreVisitor visitor) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
-    BEGIN_CRITSECT(ns);
-    for(UA_UInt32 i = 0; i < ns->size; ++i) {
-        if(ns->entries[i] > UA_NODEMAP_TOMBSTONE) {
-            END_CRITSECT(ns);
-            UA_NodeMapEntry *entry = ns->entries[i];
-            entry->refCount++;
-            visitor(visitorContext, &entry->node);
-            entry->refCount--;
-            cleanupEntry(entry);
-            BEGIN_CRITSECT(ns);
-        }
+    BEGIN_READ(ns);
+    /* The visitor may modify the nodestore. So the table is reloaded for every
+     * step. */
+    for(UA_UInt32 i = 0; i < ns->table->size; ++i) {
+        UA_NodeMapEntry *entry = ns->table->entries[i];
+        if(entry <= UA_NODEMAP_TOMBSTONE)
+            continue;
+        UA_NODEMAP_INC(&entry->refCount);
+        visitor(visitorContext, &entry->node);
+        UA_NodeMap_releaseNode(context, &entry->node);
     }
-    END_CRITSECT(ns);
+    END_READ(ns);
 }
 
 static void
@@ -420,9 +646,19 @@ UA_NodeMap_delete(void *context) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
 #ifdef UA_ENABLE_MULTITHREADING
     pthread_mutex_destroy(&ns->mutex);
+    while(ns->retiredEntries) {
+        UA_NodeMapEntry *entry = ns->retiredEntries;
+        ns->retiredEntries = entry->retiredNext;
+        deleteEntry(entry);
+    }
+    while(ns->retiredTables) {
+        UA_NodeMapTable *t = ns->retiredTables;
+        ns->retiredTables = t->retiredNext;
+        UA_free(t);
+    }
 #endif
-    UA_UInt32 size = ns->size;
-    UA_NodeMapEntry **entries = ns->entries;
+    UA_UInt32 size = ns->table->size;
+    UA_NodeMapEntry **entries = ns->table->entries;
     for(UA_UInt32 i = 0; i < size; ++i) {
         if(entries[i] > UA_NODEMAP_TOMBSTONE) {
             /* On debugging builds, check that all nodes were release */
@@ -431,22 +667,20 @@ UA_NodeMap_delete(void *context) {
             deleteEntry(entries[i]);
         }
     }
-    UA_free(ns->entries);
+    UA_free(ns->table);
     UA_free(ns);
 }
 
 UA_StatusCode
 UA_Nodestore_default_new(UA_Nodestore *ns) {
     /* Allocate and initialize the nodemap */
-    UA_NodeMap *nodemap = (UA_NodeMap*)UA_malloc(sizeof(UA_NodeMap));
+    UA_NodeMap *nodemap = (UA_NodeMap*)UA_calloc(1, sizeof(UA_NodeMap));
     if(!nodemap)
         return UA_STATUSCODE_BADOUTOFMEMORY;
     nodemap->sizePrimeIndex = higher_prime_index(UA_NODEMAP_MINSIZE);
-    nodemap->size = primes[nodemap->sizePrimeIndex];
     nodemap->count = 0;
-    nodemap->entries = (UA_NodeMapEntry**)
-        UA_calloc(nodemap->size, sizeof(UA_NodeMapEntry*));
-    if(!nodemap->entries) {
+    nodemap->table = newTable(primes[nodemap->sizePrimeIndex]);
+    if(!nodemap->table) {
         UA_free(nodemap);
         return UA_STATUSCODE_BADOUTOFMEMORY;
     }
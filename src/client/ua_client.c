@@ -36,6 +36,7 @@
 static void
 UA_Client_init(UA_Client* client, UA_ClientConfig config) {
     memset(client, 0, sizeof(UA_Client));
+    UA_SECURECHANNEL_SENDLOCK_INIT(&client->channel);
     /* TODO: Select policy according to the endpoint */
     UA_SecurityPolicy_None(&client->securityPolicy, NULL, UA_BYTESTRING_NULL, config.logger);
     client->channel.securityPolicy = &client->securityPolicy;
@@ -82,6 +83,7 @@ UA_Client_secure_init(UA_Client* client, UA_ClientConfig config,
         return STATUS_CODE_BAD_POINTER;
 
     memset(client, 0, sizeof(UA_Client));
+    UA_SECURECHANNEL_SENDLOCK_INIT(&client->channel);
     /* Allocate memory for certificate verification */
     client->securityPolicy.certificateVerification =
                            (UA_CertificateVerification *)
@@ -179,6 +181,7 @@ UA_Client_deleteMembers(UA_Client* client) {
     /* Commented as UA_SecureChannel_deleteMembers already done
      * in UA_Client_disconnect function */
     //UA_SecureChannel_deleteMembersCleanup(&client->channel);
+    UA_SECURECHANNEL_SENDLOCK_DESTROY(&client->channel);
     UA_Connection_deleteMembers(&client->connection);
     if(client->endpointUrl.data)
         UA_String_deleteMembers(&client->endpointUrl);
@@ -94,6 +94,7 @@ UA_VariableNode_copy(const UA_VariableNode *src, UA_VariableNode *dst) {
     dst->accessLevel = src->accessLevel;
     dst->minimumSamplingInterval = src->minimumSamplingInterval;
     dst->historizing = src->historizing;
+    dst->bulkDataSource = src->bulkDataSource;
     return retval;
 }
 
@@ -110,6 +111,7 @@ static UA_StatusCode
 UA_MethodNode_copy(const UA_MethodNode *src, UA_MethodNode *dst) {
     dst->executable = src->executable;
     dst->method = src->method;
+    dst->async = src->async;
     return UA_STATUSCODE_GOOD;
 }
 
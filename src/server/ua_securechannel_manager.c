@@ -35,6 +35,7 @@ UA_SecureChannelManager_deleteMembers(UA_SecureChannelManager *cm) {
     LIST_FOREACH_SAFE(entry, &cm->channels, pointers, temp) {
         LIST_REMOVE(entry, pointers);
         UA_SecureChannel_deleteMembersCleanup(&entry->channel);
+        UA_SECURECHANNEL_SENDLOCK_DESTROY(&entry->channel);
         UA_free(entry);
     }
 }
@@ -43,6 +44,7 @@ static void
 removeSecureChannelCallback(UA_Server *server, void *entry) {
     channel_list_entry *centry = (channel_list_entry *)entry;
     UA_SecureChannel_deleteMembersCleanup(&centry->channel);
+    UA_SECURECHANNEL_SENDLOCK_DESTROY(&centry->channel);
     UA_free(entry);
 }
 
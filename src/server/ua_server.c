@@ -105,6 +105,11 @@ void UA_Server_delete(UA_Server *server) {
     UA_SessionManager_deleteMembers(&server->sessionManager);
     UA_Array_delete(server->namespaces, server->namespacesSize, &UA_TYPES[UA_TYPES_STRING]);
 
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    UA_free(server->monitoredNodes);
+    UA_free(server->sampleGroups);
+#endif
+
 #ifdef UA_ENABLE_PUBSUB
     UA_PubSubManager_delete(server, &server->pubSubManager);
 #endif
@@ -151,9 +156,10 @@ void UA_Server_delete(UA_Server *server) {
 #ifdef UA_ENABLE_MULTITHREADING
     /* Process new delayed callbacks from the cleanup */
     UA_Server_cleanupDispatchQueue(server);
-    pthread_mutex_destroy(&server->dispatchQueue_accessMutex);
     pthread_cond_destroy(&server->dispatchQueue_condition);
     pthread_mutex_destroy(&server->dispatchQueue_conditionMutex);
+    pthread_mutex_destroy(&server->delayedCallbacks_accessMutex);
+    pthread_mutex_destroy(&server->parallelJobs_mutex);
 #else
     /* Process new delayed callbacks from the cleanup */
     UA_Server_cleanupDelayedCallbacks(server);
@@ -162,6 +168,13 @@ void UA_Server_delete(UA_Server *server) {
     /* Delete the timed work */
     UA_Timer_deleteMembers(&server->timer);
 
+    UA_TypeHierarchyCache_delete(server->referenceTypeCache);
+    UA_TypeHierarchyCache_delete(server->dataTypeCache);
+    UA_ValueCache_deleteMembers(&server->valueCache);
+#ifdef UA_ENABLE_METHODCALLS
+    UA_AsyncManager_deleteMembers(&server->asyncManager);
+#endif
+
     /* Delete the server itself */
     UA_free(server);
 }
@@ -172,6 +185,7 @@ UA_Server_cleanup(UA_Server *server, void *_) {
     UA_DateTime nowMonotonic = UA_DateTime_nowMonotonic();
     UA_SessionManager_cleanupTimedOut(&server->sessionManager, nowMonotonic);
     UA_SecureChannelManager_cleanupTimedOut(&server->secureChannelManager, nowMonotonic);
+    UA_ValueCache_cleanup(&server->valueCache, nowMonotonic);
 #ifdef UA_ENABLE_DISCOVERY
     UA_Discovery_cleanupTimedOut(server, nowMonotonic);
 #endif
@@ -219,9 +233,15 @@ UA_Server_new(const UA_ServerConfig *config) {
     SLIST_INIT(&server->delayedCallbacks);
 #endif
 
-    /* Initialized the dispatch queue for worker threads */
+    /* Initialized the dispatch for worker threads. The dispatch queues are
+     * created together with the workers. */
 #ifdef UA_ENABLE_MULTITHREADING
-    SIMPLEQ_INIT(&server->dispatchQueue);
+    SIMPLEQ_INIT(&server->delayedCallbacks);
+    pthread_mutex_init(&server->delayedCallbacks_accessMutex, NULL);
+    pthread_cond_init(&server->dispatchQueue_condition, NULL);
+    pthread_mutex_init(&server->dispatchQueue_conditionMutex, NULL);
+    LIST_INIT(&server->parallelJobs);
+    pthread_mutex_init(&server->parallelJobs_mutex, NULL);
 #endif
 
     /* Create Namespaces 0 and 1 */
@@ -234,6 +254,15 @@ UA_Server_new(const UA_ServerConfig *config) {
     UA_SecureChannelManager_init(&server->secureChannelManager, server);
     UA_SessionManager_init(&server->sessionManager, server);
 
+    UA_ValueCache_init(&server->valueCache);
+#ifdef UA_ENABLE_METHODCALLS
+    UA_AsyncManager_init(&server->asyncManager);
+#endif
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    LIST_INIT(&server->bulkSampleGroups);
+#endif
+
     /* Add a regular callback for cleanup and maintenance */
     UA_Server_addRepeatedCallback(server, (UA_ServerCallback)UA_Server_cleanup, NULL,
                                   10000, NULL);
@@ -0,0 +1,347 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ua_server_internal.h"
+#include "ua_types_generated_handling.h"
+
+#ifdef UA_ENABLE_METHODCALLS /* conditional compilation */
+
+/* Asynchronous operations are created by a service (on the thread processing
+ * the request) and executed by the application. The results can be set from
+ * any thread. The deferred responses are sent from the server main loop. Only
+ * the queues and the per-session counters are protected by the lock. */
+
+#ifdef UA_ENABLE_MULTITHREADING
+# define UA_ASYNC_LOCK(AM) pthread_mutex_lock(&(AM)->mutex)
+# define UA_ASYNC_UNLOCK(AM) pthread_mutex_unlock(&(AM)->mutex)
+#else
+# define UA_ASYNC_LOCK(AM)
+# define UA_ASYNC_UNLOCK(AM)
+#endif
+
+void
+UA_AsyncManager_init(UA_AsyncManager *am) {
+    memset(am, 0, sizeof(UA_AsyncManager));
+    TAILQ_INIT(&am->responses);
+    TAILQ_INIT(&am->newQueue);
+    TAILQ_INIT(&am->dispatchedQueue);
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_init(&am->mutex, NULL);
+#endif
+}
+
+static void
+deleteAsyncOperation(UA_AsyncOperation *op) {
+    switch(op->type) {
+    case UA_ASYNCOPERATIONTYPE_CALL:
+        UA_CallMethodRequest_deleteMembers(&op->request.callMethodRequest);
+        break;
+    default:
+        break;
+    }
+    UA_free(op);
+}
+
+static void
+deleteAsyncResponse(UA_AsyncResponse *ar) {
+    UA_AsyncOperation *op, *op_tmp;
+    TAILQ_FOREACH_SAFE(op, &ar->ops, pointers, op_tmp) {
+        TAILQ_REMOVE(&ar->ops, op, pointers);
+        deleteAsyncOperation(op);
+    }
+    UA_NodeId_deleteMembers(&ar->sessionId);
+    UA_delete(ar->response, ar->responseType);
+    UA_free(ar);
+}
+
+static void
+deleteAsyncOperationQueue(UA_AsyncOperationQueue *queue) {
+    UA_AsyncOperation *op, *op_tmp;
+    TAILQ_FOREACH_SAFE(op, queue, pointers, op_tmp) {
+        TAILQ_REMOVE(queue, op, pointers);
+        deleteAsyncOperation(op);
+    }
+}
+
+void
+UA_AsyncManager_deleteMembers(UA_AsyncManager *am) {
+    deleteAsyncOperationQueue(&am->newQueue);
+    deleteAsyncOperationQueue(&am->dispatchedQueue);
+    UA_AsyncResponse *ar, *ar_tmp;
+    TAILQ_FOREACH_SAFE(ar, &am->responses, pointers, ar_tmp) {
+        TAILQ_REMOVE(&am->responses, ar, pointers);
+        deleteAsyncResponse(ar);
+    }
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_destroy(&am->mutex);
+#endif
+}
+
+/* Set the result of the operation in the parent response. Without a response,
+ * the result only carries the statuscode. */
+static void
+setAsyncOperationResult(UA_AsyncOperation *op, const UA_AsyncOperationResponse *response,
+                        UA_StatusCode statusCode) {
+    switch(op->type) {
+    case UA_ASYNCOPERATIONTYPE_CALL: {
+        UA_CallResponse *cr = (UA_CallResponse*)op->parent->response;
+        UA_CallMethodResult *result = &cr->results[op->index];
+        UA_CallMethodResult_deleteMembers(result);
+        if(response)
+            statusCode = UA_CallMethodResult_copy(&response->callMethodResult, result);
+        if(statusCode != UA_STATUSCODE_GOOD)
+            result->statusCode = statusCode;
+        break;
+    }
+    default:
+        break;
+    }
+    op->parent->opsPending--;
+}
+
+static UA_AsyncResponse *
+newAsyncResponse(UA_Server *server, UA_Session *session, UA_UInt32 requestId,
+                 const UA_RequestHeader *requestHeader,
+                 const UA_DataType *responseType) {
+    UA_AsyncResponse *ar = (UA_AsyncResponse*)UA_calloc(1, sizeof(UA_AsyncResponse));
+    if(!ar)
+        return NULL;
+    ar->response = UA_new(responseType);
+    if(!ar->response) {
+        UA_free(ar);
+        return NULL;
+    }
+    ar->responseType = responseType;
+    if(UA_NodeId_copy(&session->sessionId, &ar->sessionId) != UA_STATUSCODE_GOOD) {
+        UA_delete(ar->response, responseType);
+        UA_free(ar);
+        return NULL;
+    }
+    if(session->header.channel)
+        ar->channelId = session->header.channel->securityToken.channelId;
+    ar->requestId = requestId;
+    ar->requestHandle = requestHeader->requestHandle;
+    if(server->config.asyncOperationTimeout > 0.0)
+        ar->timeout = UA_DateTime_nowMonotonic() + (UA_DateTime)
+            (server->config.asyncOperationTimeout * UA_DATETIME_MSEC);
+    TAILQ_INIT(&ar->ops);
+    return ar;
+}
+
+UA_StatusCode
+UA_AsyncManager_createOperation(UA_Server *server, UA_Session *session,
+                                UA_AsyncResponse **ar, UA_UInt32 requestId,
+                                const UA_RequestHeader *requestHeader,
+                                const UA_DataType *responseType,
+                                UA_AsyncOperationType type,
+                                const void *request, size_t index) {
+    /* The operations of a request can be processed in parallel. So the
+     * response is also created under the lock. */
+    UA_AsyncOperation *op = NULL;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_ASYNC_LOCK(&server->asyncManager);
+
+    /* Check the limit of outstanding operations */
+    UA_UInt32 limit = server->config.maxAsyncOperationsPerSession;
+    if(limit > 0 && session->asyncOperations >= limit) {
+        retval = UA_STATUSCODE_BADTOOMANYOPERATIONS;
+        goto cleanup;
+    }
+
+    /* Copy the request. It is decoded into memory that is released after the
+     * service returns. */
+    op = (UA_AsyncOperation*)UA_calloc(1, sizeof(UA_AsyncOperation));
+    if(!op) {
+        retval = UA_STATUSCODE_BADOUTOFMEMORY;
+        goto cleanup;
+    }
+    op->type = type;
+    switch(type) {
+    case UA_ASYNCOPERATIONTYPE_CALL:
+        retval = UA_CallMethodRequest_copy((const UA_CallMethodRequest*)request,
+                                           &op->request.callMethodRequest);
+        break;
+    default:
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+        break;
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+        goto cleanup;
+
+    /* Create the response with the first operation */
+    if(!*ar) {
+        *ar = newAsyncResponse(server, session, requestId, requestHeader, responseType);
+        if(!*ar) {
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            goto cleanup;
+        }
+    }
+
+    /* Queued for the application when the response is deferred */
+    op->parent = *ar;
+    op->index = index;
+    TAILQ_INSERT_TAIL(&(*ar)->ops, op, pointers);
+    (*ar)->opsSize++;
+    (*ar)->opsPending++;
+    session->asyncOperations++;
+    op = NULL;
+
+ cleanup:
+    UA_ASYNC_UNLOCK(&server->asyncManager);
+    if(op)
+        deleteAsyncOperation(op);
+    return retval;
+}
+
+void
+UA_AsyncManager_deferResponse(UA_Server *server, UA_AsyncResponse *ar,
+                              void *response) {
+    /* Move the content. The results of the synchronous operations are already
+     * in place. */
+    memcpy(ar->response, response, ar->responseType->memSize);
+    UA_init(response, ar->responseType);
+
+    UA_AsyncManager *am = &server->asyncManager;
+    UA_ASYNC_LOCK(am);
+    UA_AsyncOperation *op;
+    while((op = TAILQ_FIRST(&ar->ops))) {
+        TAILQ_REMOVE(&ar->ops, op, pointers);
+        TAILQ_INSERT_TAIL(&am->newQueue, op, pointers);
+    }
+    TAILQ_INSERT_TAIL(&am->responses, ar, pointers);
+    UA_ASYNC_UNLOCK(am);
+}
+
+UA_Boolean
+UA_Server_getAsyncOperation(UA_Server *server, UA_AsyncOperationType *type,
+                            const UA_AsyncOperationRequest **request,
+                            void **context) {
+    UA_AsyncManager *am = &server->asyncManager;
+    UA_ASYNC_LOCK(am);
+    UA_AsyncOperation *op = TAILQ_FIRST(&am->newQueue);
+    if(op) {
+        TAILQ_REMOVE(&am->newQueue, op, pointers);
+        TAILQ_INSERT_TAIL(&am->dispatchedQueue, op, pointers);
+    }
+    UA_ASYNC_UNLOCK(am);
+    if(!op)
+        return false;
+
+    *type = op->type;
+    *request = &op->request;
+    *context = op;
+    return true;
+}
+
+void
+UA_Server_setAsyncOperationResult(UA_Server *server,
+                                  const UA_AsyncOperationResponse *response,
+                                  void *context) {
+    UA_AsyncManager *am = &server->asyncManager;
+    UA_ASYNC_LOCK(am);
+    UA_AsyncOperation *op;
+    TAILQ_FOREACH(op, &am->dispatchedQueue, pointers) {
+        if(op == context)
+            break;
+    }
+    if(op) {
+        TAILQ_REMOVE(&am->dispatchedQueue, op, pointers);
+        /* Has the operation timed out in the meantime? */
+        if(op->parent)
+            setAsyncOperationResult(op, response, UA_STATUSCODE_GOOD);
+    }
+    UA_ASYNC_UNLOCK(am);
+
+    if(!op) {
+        UA_LOG_WARNING(server->config.logger, UA_LOGCATEGORY_SERVER,
+                       "Setting the result of an unknown asynchronous operation");
+        return;
+    }
+    deleteAsyncOperation(op);
+}
+
+/* Set a timeout result for the operations that are still pending. Operations
+ * that were taken by the application stay in the queue without parent until
+ * their result is set. Then the request is no longer referenced. */
+static void
+timeoutAsyncResponse(UA_AsyncManager *am, UA_AsyncResponse *ar) {
+    UA_AsyncOperation *op, *op_tmp;
+    TAILQ_FOREACH_SAFE(op, &am->newQueue, pointers, op_tmp) {
+        if(op->parent != ar)
+            continue;
+        TAILQ_REMOVE(&am->newQueue, op, pointers);
+        setAsyncOperationResult(op, NULL, UA_STATUSCODE_BADTIMEOUT);
+        deleteAsyncOperation(op);
+    }
+    TAILQ_FOREACH(op, &am->dispatchedQueue, pointers) {
+        if(op->parent != ar)
+            continue;
+        setAsyncOperationResult(op, NULL, UA_STATUSCODE_BADTIMEOUT);
+        op->parent = NULL;
+    }
+}
+
+static void
+sendAsyncResponse(UA_Server *server, UA_AsyncResponse *ar) {
+    /* The session was closed in the meantime. Discard the results. */
+    UA_Session *session =
+        UA_SessionManager_getSessionById(&server->sessionManager, &ar->sessionId);
+    if(!session)
+        return;
+
+    /* Release the operations from the session limit */
+    UA_ASYNC_LOCK(&server->asyncManager);
+    session->asyncOperations -= (UA_UInt32)ar->opsSize;
+    UA_ASYNC_UNLOCK(&server->asyncManager);
+
+    /* The requestId is only meaningful in the SecureChannel of the request */
+    UA_SecureChannel *channel = session->header.channel;
+    if(!channel || channel->securityToken.channelId != ar->channelId) {
+        UA_LOG_DEBUG_SESSION(server->config.logger, session, "The SecureChannel of "
+                             "a deferred response was closed. Discard the response.");
+        return;
+    }
+
+    UA_ResponseHeader *rh = (UA_ResponseHeader*)ar->response;
+    rh->requestHandle = ar->requestHandle;
+    rh->timestamp = UA_DateTime_now();
+    UA_StatusCode retval =
+        UA_SecureChannel_sendSymmetricMessage(channel, ar->requestId, UA_MESSAGETYPE_MSG,
+                                              ar->response, ar->responseType);
+    if(retval != UA_STATUSCODE_GOOD)
+        UA_LOG_INFO_SESSION(server->config.logger, session,
+                            "Could not send a deferred response with StatusCode %s",
+                            UA_StatusCode_name(retval));
+}
+
+void
+UA_AsyncManager_process(UA_Server *server) {
+    UA_AsyncManager *am = &server->asyncManager;
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    UA_AsyncResponseQueue done;
+    TAILQ_INIT(&done);
+
+    /* Collect the finished responses */
+    UA_ASYNC_LOCK(am);
+    UA_AsyncResponse *ar, *ar_tmp;
+    TAILQ_FOREACH_SAFE(ar, &am->responses, pointers, ar_tmp) {
+        if(ar->opsPending > 0) {
+            if(ar->timeout == 0 || now < ar->timeout)
+                continue;
+            timeoutAsyncResponse(am, ar);
+        }
+        TAILQ_REMOVE(&am->responses, ar, pointers);
+        TAILQ_INSERT_TAIL(&done, ar, pointers);
+    }
+    UA_ASYNC_UNLOCK(am);
+
+    /* Send outside of the lock */
+    while((ar = TAILQ_FIRST(&done))) {
+        TAILQ_REMOVE(&done, ar, pointers);
+        sendAsyncResponse(server, ar);
+        deleteAsyncResponse(ar);
+    }
+}
+
+#endif /* UA_ENABLE_METHODCALLS */
@@ -71,7 +71,8 @@ sendServiceFault(UA_SecureChannel *channel, const UA_ByteString *msg,
 typedef enum {
     UA_SERVICETYPE_NORMAL,
     UA_SERVICETYPE_INSITU,
-    UA_SERVICETYPE_CUSTOM
+    UA_SERVICETYPE_CUSTOM,
+    UA_SERVICETYPE_ASYNC
 } UA_ServiceType;
 
 static void
@@ -146,11 +147,13 @@ getServicePointers(UA_UInt32 requestTypeId, const UA_DataType **requestType,
         *service = (UA_Service)Service_Browse;
         *requestType = &UA_TYPES[UA_TYPES_BROWSEREQUEST];
         *responseType = &UA_TYPES[UA_TYPES_BROWSERESPONSE];
+        *serviceType = UA_SERVICETYPE_INSITU;
         break;
     case UA_NS0ID_BROWSENEXTREQUEST_ENCODING_DEFAULTBINARY:
         *service = (UA_Service)Service_BrowseNext;
         *requestType = &UA_TYPES[UA_TYPES_BROWSENEXTREQUEST];
         *responseType = &UA_TYPES[UA_TYPES_BROWSENEXTRESPONSE];
+        *serviceType = UA_SERVICETYPE_INSITU;
         break;
     case UA_NS0ID_REGISTERNODESREQUEST_ENCODING_DEFAULTBINARY:
         *service = (UA_Service)Service_RegisterNodes;
@@ -182,6 +185,7 @@ getServicePointers(UA_UInt32 requestTypeId, const UA_DataType **requestType,
         *service = (UA_Service)Service_Republish;
         *requestType = &UA_TYPES[UA_TYPES_REPUBLISHREQUEST];
         *responseType = &UA_TYPES[UA_TYPES_REPUBLISHRESPONSE];
+        *serviceType = UA_SERVICETYPE_INSITU;
         break;
     case UA_NS0ID_MODIFYSUBSCRIPTIONREQUEST_ENCODING_DEFAULTBINARY:
         *service = (UA_Service)Service_ModifySubscription;
@@ -225,6 +229,7 @@ getServicePointers(UA_UInt32 requestTypeId, const UA_DataType **requestType,
         *service = (UA_Service)Service_Call;
         *requestType = &UA_TYPES[UA_TYPES_CALLREQUEST];
         *responseType = &UA_TYPES[UA_TYPES_CALLRESPONSE];
+        *serviceType = UA_SERVICETYPE_ASYNC;
         break;
 #endif
 
@@ -380,6 +385,17 @@ processOPN(UA_Server *server, UA_SecureChannel *channel,
     return retval;
 }
 
+/* With multithreading, several messages of a channel may be processed in
+ * parallel. Then every message gets an arena of its own. */
+static void
+releaseRequestArena(UA_Arena *arena) {
+#ifdef UA_ENABLE_MULTITHREADING
+    UA_Arena_deleteMembers(arena);
+#else
+    UA_Arena_reset(arena);
+#endif
+}
+
 static UA_StatusCode
 processMSG(UA_Server *server, UA_SecureChannel *channel,
            UA_UInt32 requestId, const UA_ByteString *msg) {
@@ -421,13 +437,25 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
     }
     UA_assert(responseType);
 
-    /* Decode the request */
+    /* Decode the request. All memory of the decoded request is taken from an
+     * arena. The request is released in one go after the response was sent
+     * (instead of UA_deleteMembers). Strings, ByteStrings and arrays of
+     * overlayable types point into msg, which outlives the service call.
+     * Services copy what they retain (e.g. the value written into a node). */
+#ifdef UA_ENABLE_MULTITHREADING
+    UA_Arena requestArena;
+    UA_Arena_init(&requestArena, 0);
+    UA_Arena *arena = &requestArena;
+#else
+    UA_Arena *arena = &channel->decodeArena;
+#endif
     UA_STACKARRAY(UA_Byte, request, requestType->memSize);
     UA_RequestHeader *requestHeader = (UA_RequestHeader*)request;
-    retval = UA_decodeBinary(msg, &offset, request, requestType,
-                             server->config.customDataTypesSize,
-                             server->config.customDataTypes);
+    retval = UA_decodeBinaryBorrowed(msg, &offset, request, requestType,
+                                     server->config.customDataTypesSize,
+                                     server->config.customDataTypes, arena);
     if(retval != UA_STATUSCODE_GOOD) {
+        releaseRequestArena(arena);
         UA_LOG_DEBUG_CHANNEL(server->config.logger, channel,
                              "Could not decode the request");
         return sendServiceFault(channel, msg, requestPos, responseType, requestId, retval);
@@ -455,9 +483,9 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
 
     #ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
     // set the authenticationToken from the create session request to help fuzzing cover more lines
-    UA_NodeId_deleteMembers(&requestHeader->authenticationToken);
+    /* The token lives in the arena. No need to free it. */
     if(!UA_NodeId_isNull(&unsafe_fuzz_authenticationToken))
-        UA_NodeId_copy(&unsafe_fuzz_authenticationToken, &requestHeader->authenticationToken);
+        requestHeader->authenticationToken = unsafe_fuzz_authenticationToken;
     #endif
 
     /* Find the matching session */
@@ -471,7 +499,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
             UA_LOG_DEBUG_CHANNEL(server->config.logger, channel,
                                  "Trying to activate a session that is " \
                                  "not known in the server");
-            UA_deleteMembers(request, requestType);
+            releaseRequestArena(arena);
             return sendServiceFault(channel, msg, requestPos, responseType,
                                     requestId, UA_STATUSCODE_BADSESSIONIDINVALID);
         }
@@ -488,7 +516,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
             UA_LOG_WARNING_CHANNEL(server->config.logger, channel,
                                    "Service request %i without a valid session",
                                    requestType->binaryEncodingId);
-            UA_deleteMembers(request, requestType);
+            releaseRequestArena(arena);
             return sendServiceFault(channel, msg, requestPos, responseType,
                                     requestId, UA_STATUSCODE_BADSESSIONIDINVALID);
         }
@@ -506,7 +534,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
                                requestType->binaryEncodingId);
         UA_SessionManager_removeSession(&server->sessionManager,
                                         &session->header.authenticationToken);
-        UA_deleteMembers(request, requestType);
+        releaseRequestArena(arena);
         return sendServiceFault(channel, msg, requestPos, responseType,
                                 requestId, UA_STATUSCODE_BADSESSIONNOTACTIVATED);
     }
@@ -516,7 +544,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
         UA_LOG_WARNING_CHANNEL(server->config.logger, channel,
                                "Client tries to use a Session that is not "
                                "bound to this SecureChannel");
-        UA_deleteMembers(request, requestType);
+        releaseRequestArena(arena);
         return sendServiceFault(channel, msg, requestPos, responseType,
                                 requestId, UA_STATUSCODE_BADSESSIONNOTACTIVATED);
     }
@@ -529,11 +557,21 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
     if(requestType == &UA_TYPES[UA_TYPES_PUBLISHREQUEST]) {
         Service_Publish(server, session,
             (const UA_PublishRequest*)request, requestId);
-        UA_deleteMembers(request, requestType);
+        releaseRequestArena(arena);
         return UA_STATUSCODE_GOOD;
     }
 #endif
 
+    /* The response is deferred if the service hands over operations to the
+     * application */
+    if(serviceType == UA_SERVICETYPE_ASYNC) {
+        if(((UA_AsyncService)service)(server, session, requestId, request, response)) {
+            releaseRequestArena(arena);
+            return UA_STATUSCODE_GOOD;
+        }
+        serviceType = UA_SERVICETYPE_CUSTOM;
+    }
+
     send_response:
 
     /* Prepare the ResponseHeader */
@@ -585,7 +623,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
                             "Could not send the message over the SecureChannel "
                             "with StatusCode %s", UA_StatusCode_name(retval));
     /* Clean up */
-    UA_deleteMembers(request, requestType);
+    releaseRequestArena(arena);
     UA_deleteMembers(response, responseType);
     return retval;
 }
@@ -40,8 +40,8 @@ typedef struct UA_Worker UA_Worker;
 struct UA_WorkerCallback;
 typedef struct UA_WorkerCallback UA_WorkerCallback;
 
-SIMPLEQ_HEAD(UA_DispatchQueue, UA_WorkerCallback);
-typedef struct UA_DispatchQueue UA_DispatchQueue;
+SIMPLEQ_HEAD(UA_DelayedQueue, UA_WorkerCallback);
+typedef struct UA_DelayedQueue UA_DelayedQueue;
 
 #endif /* UA_ENABLE_MULTITHREADING */
 
@@ -81,6 +81,91 @@ typedef struct serverOnNetwork_hash_entry {
 #endif /* UA_ENABLE_DISCOVERY_MULTICAST */
 #endif /* UA_ENABLE_DISCOVERY */
 
+/* Cached subtype relation of a type hierarchy (ReferenceTypes or DataTypes).
+ * The types below the root are interned to a dense index. For every type, a
+ * bitset marks its (transitive) subtypes including itself. The cache is built
+ * on demand and dropped when the hierarchy changes. */
+typedef struct {
+    size_t version;      /* typeHierarchyCacheVersion before the build. Stale
+                          * if the version has advanced since. */
+    size_t typesSize;
+    UA_NodeId *types;
+    size_t hashSize;     /* Power of two, open addressing */
+    size_t *hash;        /* Index+1 into types. Zero for empty slots. */
+    size_t words;        /* Bitset words per type */
+    UA_UInt32 *subtypes; /* typesSize * words */
+} UA_TypeHierarchyCache;
+
+/* Values of data source variables that were read with a maxAge. The entry of
+ * a node is shared by all sessions (null sessionId). Session dependent data
+ * sources have one entry per node and session. Chained hash table over the
+ * NodeId, all entries of a node are in the same bucket. The number of buckets
+ * is a power of two. Entries older than the largest maxAge they were read
+ * with are dropped in the regular server cleanup and before the table
+ * grows. */
+typedef struct UA_CachedValue {
+    struct UA_CachedValue *next;
+    UA_UInt32 hash;
+    UA_NodeId nodeId;
+    UA_NodeId sessionId;
+    UA_DateTime readTime; /* Monotonic time of the read from the source */
+    UA_DateTime maxAge;   /* Largest maxAge of the reads for the entry */
+    UA_DataValue value;
+} UA_CachedValue;
+
+typedef struct {
+    UA_CachedValue **buckets;
+    size_t bucketsSize;
+    size_t entries;
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_t mutex;
+#endif
+} UA_ValueCache;
+
+#ifdef UA_ENABLE_METHODCALLS
+
+/* Operations that are executed by the application outside of the service
+ * (see ua_server_async.c). The response is deferred until the results of all
+ * operations are set. */
+struct UA_AsyncResponse;
+
+typedef struct UA_AsyncOperation {
+    TAILQ_ENTRY(UA_AsyncOperation) pointers;
+    UA_AsyncOperationType type;
+    UA_AsyncOperationRequest request;
+    struct UA_AsyncResponse *parent;
+    size_t index; /* Position of the result in the parent response */
+} UA_AsyncOperation;
+
+typedef TAILQ_HEAD(UA_AsyncOperationQueue, UA_AsyncOperation) UA_AsyncOperationQueue;
+
+typedef struct UA_AsyncResponse {
+    TAILQ_ENTRY(UA_AsyncResponse) pointers;
+    UA_NodeId sessionId;
+    UA_UInt32 channelId; /* The requestId is only meaningful in the channel */
+    UA_UInt32 requestId;
+    UA_UInt32 requestHandle;
+    UA_DateTime timeout; /* Monotonic. 0 -> no timeout */
+    size_t opsSize;      /* Counted against the session limit */
+    size_t opsPending;   /* Operations without a result */
+    UA_AsyncOperationQueue ops; /* Until the response is deferred */
+    const UA_DataType *responseType;
+    void *response;
+} UA_AsyncResponse;
+
+typedef TAILQ_HEAD(UA_AsyncResponseQueue, UA_AsyncResponse) UA_AsyncResponseQueue;
+
+typedef struct {
+    UA_AsyncResponseQueue responses;
+    UA_AsyncOperationQueue newQueue;        /* Not yet taken */
+    UA_AsyncOperationQueue dispatchedQueue; /* Taken, waiting for the result */
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_t mutex;
+#endif
+} UA_AsyncManager;
+
+#endif /* UA_ENABLE_METHODCALLS */
+
 struct UA_Server {
     /* Meta */
     UA_DateTime startTime;
@@ -130,21 +215,70 @@ struct UA_Server {
     UA_Timer timer;
 
     /* Delayed callbacks */
+#ifndef UA_ENABLE_MULTITHREADING
     SLIST_HEAD(DelayedCallbacksList, UA_DelayedCallback) delayedCallbacks;
+#endif
 
     /* Worker threads */
 #ifdef UA_ENABLE_MULTITHREADING
     UA_Worker *workers; /* there are nThread workers in a running server */
-    UA_DispatchQueue dispatchQueue; /* Dispatch queue for the worker threads */
-    pthread_mutex_t dispatchQueue_accessMutex; /* mutex for access to queue */
-    pthread_cond_t dispatchQueue_condition; /* so the workers don't spin if the queue is empty */
+    size_t dispatchNext; /* round-robin position for the next dispatch */
+    volatile UA_UInt32 idleWorkers; /* workers waiting for the condition */
+    pthread_cond_t dispatchQueue_condition; /* so the workers don't spin if the queues are empty */
     pthread_mutex_t dispatchQueue_conditionMutex; /* mutex for access to condition variable */
+    UA_DelayedQueue delayedCallbacks; /* delayed callbacks waiting for the workers */
+    volatile size_t delayedCallbacksSize;
+    volatile UA_UInt32 delayedCallbacksAdded; /* to detect additions while going idle */
+    pthread_mutex_t delayedCallbacks_accessMutex; /* mutex for access to the delayed queue */
+    LIST_HEAD(UA_ParallelJobs, UA_ParallelJob) parallelJobs; /* ranges for idle workers */
+    volatile size_t parallelJobsSize;
+    pthread_mutex_t parallelJobs_mutex;
 #endif
 
     /* For bootstrapping, omit some consistency checks, creating a reference to
      * the parent and member instantiation */
     UA_Boolean bootstrapNS0;
 
+    /* Subtype relation of the ReferenceTypes (for browsing with
+     * includeSubtypes) and the DataTypes (for type checks of written values).
+     * The version is increased with every invalidation. */
+    UA_TypeHierarchyCache * volatile referenceTypeCache;
+    UA_TypeHierarchyCache * volatile dataTypeCache;
+    volatile size_t typeHierarchyCacheVersion;
+
+    /* Cached values of data source variables. Served by the Read service if
+     * they are younger than the requested maxAge. */
+    UA_ValueCache valueCache;
+
+#ifdef UA_ENABLE_METHODCALLS
+    /* Operations executed outside of the services and their deferred
+     * responses */
+    UA_AsyncManager asyncManager;
+#endif
+
+    /* Set once a bulk data source is attached to a node. Until then, the Read
+     * service does not prepare its operations for batching. */
+    UA_Boolean bulkDataSourceSet;
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    /* MonitoredItems that are sampled when the monitored node is written.
+     * Chained hash table over the NodeId. The number of buckets is a power of
+     * two. */
+    struct UA_MonitoredItemBucket *monitoredNodes;
+    size_t monitoredNodesSize;
+    size_t monitoredNodesItems;
+
+    /* MonitoredItems on a bulk data source that are sampled together */
+    LIST_HEAD(UA_BulkSampleGroups, UA_BulkSampleGroup) bulkSampleGroups;
+
+    /* Sample groups shared by the MonitoredItems of all sessions. Chained hash
+     * table over the NodeId and the sampling interval. The number of buckets
+     * is a power of two. */
+    struct UA_SampleGroupBucket *sampleGroups;
+    size_t sampleGroupsSize;
+    size_t sampleGroupsCount;
+#endif
+
 #ifdef UA_ENABLE_PUBSUB
     /* Publish/Subscribe toplevel container */
     UA_PubSubManager pubSubManager;
@@ -210,10 +344,42 @@ void UA_Server_cleanupDispatchQueue(UA_Server *server);
 #endif
 
 /* Callback is executed in the same thread or, if possible, dispatched to one of
- * the worker threads. */
+ * the worker threads. With multithreading, the main loop thread is the only
+ * producer for the dispatch queues. So this must not be called from the
+ * worker threads. */
 void
 UA_Server_workerCallback(UA_Server *server, UA_ServerCallback callback, void *data);
 
+/* Split the indices [0, count) into ranges and process them in parallel with
+ * the worker threads that are idle. The calling thread works on the ranges as
+ * well and returns when all ranges are done. Without multithreading, the
+ * callback is called once with the entire range. Unlike
+ * UA_Server_workerCallback, this can be called from the worker threads. */
+typedef void (*UA_ParallelCallback)(UA_Server *server, void *context,
+                                    size_t start, size_t end);
+
+void
+UA_Server_parallelFor(UA_Server *server, size_t count,
+                      UA_ParallelCallback callback, void *context);
+
+/* Are the operations of a request with the given number of operations split up
+ * between the workers? (See parallelOperationsThreshold in the config) */
+UA_Boolean
+UA_Server_parallelOperations(UA_Server *server, size_t operations);
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+/* Sample the MonitoredItems that are registered for the written node (see the
+ * sampleMonitoredItemsOnWrite option in the server config) */
+void
+UA_Server_sampleWrittenNode(UA_Server *server, const UA_NodeId *nodeId);
+
+/* The value source or the value callback of the node has changed. The
+ * MonitoredItems on the node that are sampled on write or share samples are
+ * registered again. Those that no longer qualify fall back to polling. */
+void
+UA_Server_valueSourceChanged(UA_Server *server, const UA_NodeId *nodeId);
+#endif
+
 /*********************/
 /* Utility Functions */
 /*********************/
@@ -235,6 +401,26 @@ isNodeInTree(UA_Nodestore *ns, const UA_NodeId *leafNode,
              const UA_NodeId *nodeToFind, const UA_NodeId *referenceTypeIds,
              size_t referenceTypeIdsSize);
 
+/* Tests whether refType is superType or one of its subtypes. Uses the cached
+ * ReferenceType hierarchy of the server. */
+UA_Boolean
+isReferenceTypeSubtype(UA_Server *server, const UA_NodeId *refType,
+                       const UA_NodeId *superType);
+
+/* Same for the DataType hierarchy below BaseDataType */
+UA_Boolean
+isDataTypeSubtype(UA_Server *server, const UA_NodeId *dataType,
+                  const UA_NodeId *superType);
+
+/* Drop the cached hierarchy for the node class (ReferenceType or DataType;
+ * ignored otherwise). Call whenever a type node or a HasSubtype reference
+ * between type nodes is added or removed. */
+void
+UA_Server_invalidateTypeHierarchyCache(UA_Server *server, UA_NodeClass nodeClass);
+
+void
+UA_TypeHierarchyCache_delete(UA_TypeHierarchyCache *cache);
+
 /* Returns an array with the hierarchy of type nodes. The returned array starts
  * at the leaf and continues "upwards" in the hierarchy based on the
  * ``hasSubType`` references. Since multiple-inheritance is possible in general,
@@ -264,6 +450,20 @@ UA_Server_processServiceOperations(UA_Server *server, UA_Session *session,
                                    const UA_DataType *responseOperationsType)
     UA_FUNC_ATTR_WARN_UNUSED_RESULT;
 
+/* The same for services where the operations are independent of each other.
+ * Large requests are processed by several worker threads in parallel. The
+ * operation callback needs to be thread-safe and may only write to its own
+ * result. */
+UA_StatusCode
+UA_Server_processServiceOperationsParallel(UA_Server *server, UA_Session *session,
+                                           UA_ServiceOperation operationCallback,
+                                           void *context,
+                                           const size_t *requestOperations,
+                                           const UA_DataType *requestOperationsType,
+                                           size_t *responseOperations,
+                                           const UA_DataType *responseOperationsType)
+    UA_FUNC_ATTR_WARN_UNUSED_RESULT;
+
 /***************************************/
 /* Check Information Model Consistency */
 /***************************************/
@@ -272,6 +472,49 @@ UA_StatusCode
 readValueAttribute(UA_Server *server, UA_Session *session,
                    const UA_VariableNode *vn, UA_DataValue *v);
 
+void UA_ValueCache_init(UA_ValueCache *cache);
+void UA_ValueCache_deleteMembers(UA_ValueCache *cache);
+
+/* Drop the entries that are older than their maxAge */
+void UA_ValueCache_cleanup(UA_ValueCache *cache, UA_DateTime nowMonotonic);
+
+/* Drop the cached values of the node (shared and per session). Call when the
+ * node is removed, written or gets a new data source. */
+void
+UA_Server_removeCachedValue(UA_Server *server, const UA_NodeId *nodeId);
+
+/* Drop the values cached for a session that is removed */
+void
+UA_Server_removeSessionCachedValues(UA_Server *server, const UA_NodeId *sessionId);
+
+#ifdef UA_ENABLE_METHODCALLS
+
+void UA_AsyncManager_init(UA_AsyncManager *am);
+void UA_AsyncManager_deleteMembers(UA_AsyncManager *am);
+
+/* Add an operation to the async response. The response is created with the
+ * first operation. Fails with UA_STATUSCODE_BADTOOMANYOPERATIONS if the
+ * session has reached its limit of outstanding operations. */
+UA_StatusCode
+UA_AsyncManager_createOperation(UA_Server *server, UA_Session *session,
+                                UA_AsyncResponse **ar, UA_UInt32 requestId,
+                                const UA_RequestHeader *requestHeader,
+                                const UA_DataType *responseType,
+                                UA_AsyncOperationType type,
+                                const void *request, size_t index);
+
+/* Move the response content into the async response and queue its operations
+ * for the application. The response is sent once all operations are done. */
+void
+UA_AsyncManager_deferResponse(UA_Server *server, UA_AsyncResponse *ar,
+                              void *response);
+
+/* Send the deferred responses whose operations are done or have timed out.
+ * Called from the server main loop. */
+void UA_AsyncManager_process(UA_Server *server);
+
+#endif
+
 /* Test whether the value matches a variable definition given by
  * - datatype
  * - valueranke
@@ -314,6 +557,46 @@ UA_Server_readWithSession(UA_Server *server, UA_Session *session,
                           const UA_ReadValueId *item,
                           UA_TimestampsToReturn timestampsToReturn);
 
+/* Read operations can be prepared together. The preparation takes the node
+ * from the nodestore. Values from a bulk data source are then read with one
+ * call for all operations on the same source. */
+typedef struct {
+    UA_ReadValueId id; /* Shallow copy */
+    UA_Double maxAge;  /* in ms; Zero to always read from data sources */
+    const UA_Node *node;
+    UA_BulkDataSource *bulkDataSource; /* Used during the preparation */
+    UA_Boolean prefetched;
+    UA_StatusCode prefetchResult;
+    UA_DataValue prefetchedValue;
+} UA_ReadOperation;
+
+/* Takes the nodes and reads the values from bulk data sources. The id of the
+ * operations has to be set. */
+void
+Read_prepare(UA_Server *server, UA_Session *session,
+             UA_Boolean includeSourceTimeStamp,
+             UA_ReadOperation *ops, size_t opsSize);
+
+/* The returned DataValue can point into the node (UA_VARIANT_DATA_NODELETE).
+ * Don't access it after the operation has been released. */
+void
+Read_perform(UA_Server *server, UA_Session *session,
+             UA_TimestampsToReturn timestampsToReturn,
+             UA_ReadOperation *op, UA_DataValue *v);
+
+void
+Read_release(UA_Server *server, UA_ReadOperation *op);
+
+/* Can the session read the value of the node? */
+UA_StatusCode
+checkValueReadable(UA_Server *server, UA_Session *session, const UA_Node *node);
+
+/* Performs and releases the operation. The result is a deep copy. */
+UA_DataValue
+Read_performCopy(UA_Server *server, UA_Session *session,
+                 UA_TimestampsToReturn timestampsToReturn,
+                 UA_ReadOperation *op);
+
 /* Checks if a registration timed out and removes that registration.
  * Should be called periodically in main loop */
 void UA_Discovery_cleanupTimedOut(UA_Server *server, UA_DateTime nowMonotonic);
@@ -177,6 +177,282 @@ isNodeInTree(UA_Nodestore *ns, const UA_NodeId *leafNode, const UA_NodeId *nodeT
     return isNodeInTreeNoCircular(ns, leafNode, nodeToFind, &visitedRefs, referenceTypeIds, referenceTypeIdsSize);
 }
 
+/************************/
+/* Type Hierarchy Cache */
+/************************/
+
+void
+UA_TypeHierarchyCache_delete(UA_TypeHierarchyCache *cache) {
+    if(!cache)
+        return;
+    UA_Array_delete(cache->types, cache->typesSize, &UA_TYPES[UA_TYPES_NODEID]);
+    UA_free(cache->hash);
+    UA_free(cache->subtypes);
+    UA_free(cache);
+}
+
+static void
+deleteTypeHierarchyCacheCallback(UA_Server *server, void *data) {
+    UA_TypeHierarchyCache_delete((UA_TypeHierarchyCache*)data);
+}
+
+/* Returns typesSize if the NodeId is not interned */
+static size_t
+TypeHierarchyCache_find(const UA_TypeHierarchyCache *cache, const UA_NodeId *id) {
+    size_t mask = cache->hashSize - 1;
+    size_t slot = UA_NodeId_hash(id) & mask;
+    while(cache->hash[slot] != 0) {
+        size_t index = cache->hash[slot] - 1;
+        if(UA_NodeId_equal(&cache->types[index], id))
+            return index;
+        slot = (slot + 1) & mask;
+    }
+    return cache->typesSize;
+}
+
+static void
+TypeHierarchyCache_hashInsert(UA_TypeHierarchyCache *cache, size_t index) {
+    size_t mask = cache->hashSize - 1;
+    size_t slot = UA_NodeId_hash(&cache->types[index]) & mask;
+    while(cache->hash[slot] != 0)
+        slot = (slot + 1) & mask;
+    cache->hash[slot] = index + 1;
+}
+
+/* Add the NodeId to the interned types. The hash table is kept at least twice
+ * the size of the capacity. */
+static UA_StatusCode
+TypeHierarchyCache_intern(UA_TypeHierarchyCache *cache, size_t *capacity,
+                          const UA_NodeId *id, size_t *index) {
+    *index = TypeHierarchyCache_find(cache, id);
+    if(*index < cache->typesSize)
+        return UA_STATUSCODE_GOOD;
+
+    if(cache->typesSize == *capacity) {
+        size_t newCapacity = *capacity * 2;
+        UA_NodeId *newTypes = (UA_NodeId*)
+            UA_realloc(cache->types, newCapacity * sizeof(UA_NodeId));
+        if(!newTypes)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        cache->types = newTypes;
+        size_t *newHash = (size_t*)UA_calloc(newCapacity * 2, sizeof(size_t));
+        if(!newHash)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        UA_free(cache->hash);
+        cache->hash = newHash;
+        cache->hashSize = newCapacity * 2;
+        *capacity = newCapacity;
+        for(size_t i = 0; i < cache->typesSize; i++)
+            TypeHierarchyCache_hashInsert(cache, i);
+    }
+
+    UA_StatusCode retval = UA_NodeId_copy(id, &cache->types[cache->typesSize]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    *index = cache->typesSize;
+    cache->typesSize++;
+    TypeHierarchyCache_hashInsert(cache, *index);
+    return UA_STATUSCODE_GOOD;
+}
+
+/* Walk down from the root along the HasSubtype references. The interned array
+ * doubles as the queue for the breadth-first search. Every found HasSubtype
+ * relation is recorded as an edge. Then the subtype bitsets are propagated
+ * upwards along the edges until a fixpoint is reached. (Usually after one
+ * iteration. More are needed only for multiple inheritance.) */
+static UA_TypeHierarchyCache *
+TypeHierarchyCache_build(UA_Server *server, const UA_NodeId *root,
+                         UA_NodeClass nodeClass) {
+    UA_TypeHierarchyCache *cache = (UA_TypeHierarchyCache*)
+        UA_calloc(1, sizeof(UA_TypeHierarchyCache));
+    if(!cache)
+        return NULL;
+
+    size_t capacity = 64;
+    size_t edgesSize = 0, edgesCapacity = 64;
+    size_t *edges = (size_t*)UA_malloc(2 * edgesCapacity * sizeof(size_t));
+    cache->types = (UA_NodeId*)UA_malloc(capacity * sizeof(UA_NodeId));
+    cache->hashSize = capacity * 2;
+    cache->hash = (size_t*)UA_calloc(cache->hashSize, sizeof(size_t));
+    if(!edges || !cache->types || !cache->hash)
+        goto error;
+
+    size_t index;
+    if(TypeHierarchyCache_intern(cache, &capacity, root, &index) != UA_STATUSCODE_GOOD)
+        goto error;
+
+    for(size_t pos = 0; pos < cache->typesSize; pos++) {
+        const UA_Node *node = UA_Nodestore_get(server, &cache->types[pos]);
+        if(!node)
+            continue;
+        if(node->nodeClass != nodeClass) {
+            UA_Nodestore_release(server, node);
+            continue;
+        }
+        UA_StatusCode retval = UA_STATUSCODE_GOOD;
+        for(size_t i = 0; i < node->referencesSize; i++) {
+            const UA_NodeReferenceKind *rk = &node->references[i];
+            if(rk->isInverse || !UA_NodeId_equal(&rk->referenceTypeId, &subtypeId))
+                continue;
+            for(size_t j = 0; j < rk->targetIdsSize; j++) {
+                retval = TypeHierarchyCache_intern(cache, &capacity,
+                                                   &rk->targetIds[j].nodeId, &index);
+                if(retval != UA_STATUSCODE_GOOD)
+                    break;
+                if(edgesSize == edgesCapacity) {
+                    size_t *newEdges = (size_t*)
+                        UA_realloc(edges, 4 * edgesCapacity * sizeof(size_t));
+                    if(!newEdges) {
+                        retval = UA_STATUSCODE_BADOUTOFMEMORY;
+                        break;
+                    }
+                    edges = newEdges;
+                    edgesCapacity *= 2;
+                }
+                edges[2 * edgesSize] = index; /* subtype */
+                edges[(2 * edgesSize) + 1] = pos; /* supertype */
+                edgesSize++;
+            }
+            if(retval != UA_STATUSCODE_GOOD)
+                break;
+        }
+        UA_Nodestore_release(server, node);
+        if(retval != UA_STATUSCODE_GOOD)
+            goto error;
+    }
+
+    /* Every type is a subtype of itself */
+    cache->words = (cache->typesSize + 31) / 32;
+    cache->subtypes = (UA_UInt32*)
+        UA_calloc(cache->typesSize * cache->words, sizeof(UA_UInt32));
+    if(!cache->subtypes)
+        goto error;
+    for(size_t i = 0; i < cache->typesSize; i++)
+        cache->subtypes[(i * cache->words) + (i / 32)] |= (UA_UInt32)1 << (i % 32);
+
+    /* Propagate the subtypes to the supertypes. Edges are in breadth-first
+     * order. Going backwards, the subtypes are mostly complete before they
+     * are merged into the supertype. */
+    UA_Boolean changed = true;
+    while(changed) {
+        changed = false;
+        for(size_t e = edgesSize; e > 0; e--) {
+            UA_UInt32 *sub = &cache->subtypes[edges[2 * (e - 1)] * cache->words];
+            UA_UInt32 *super = &cache->subtypes[edges[(2 * (e - 1)) + 1] * cache->words];
+            for(size_t w = 0; w < cache->words; w++) {
+                UA_UInt32 merged = super[w] | sub[w];
+                if(merged != super[w]) {
+                    super[w] = merged;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    UA_free(edges);
+    return cache;
+
+ error:
+    UA_free(edges);
+    UA_TypeHierarchyCache_delete(cache);
+    return NULL;
+}
+
+static void
+retireTypeHierarchyCache(UA_Server *server, UA_TypeHierarchyCache *old) {
+#ifdef UA_ENABLE_MULTITHREADING
+    /* Worker threads may still use the cache */
+    if(UA_Server_delayedCallback(server, deleteTypeHierarchyCacheCallback,
+                                 old) == UA_STATUSCODE_GOOD)
+        return;
+    /* Leak rather than risk a use-after-free */
+    UA_LOG_WARNING(server->config.logger, UA_LOGCATEGORY_SERVER,
+                   "Could not free the cached type hierarchy");
+#else
+    deleteTypeHierarchyCacheCallback(server, old);
+#endif
+}
+
+void
+UA_Server_invalidateTypeHierarchyCache(UA_Server *server, UA_NodeClass nodeClass) {
+    UA_TypeHierarchyCache * volatile *cachePtr;
+    if(nodeClass == UA_NODECLASS_REFERENCETYPE)
+        cachePtr = &server->referenceTypeCache;
+    else if(nodeClass == UA_NODECLASS_DATATYPE)
+        cachePtr = &server->dataTypeCache;
+    else
+        return;
+
+    UA_atomic_addSize(&server->typeHierarchyCacheVersion, 1);
+    UA_TypeHierarchyCache *old = (UA_TypeHierarchyCache*)
+        UA_atomic_xchg((void * volatile *)cachePtr, NULL);
+    if(old)
+        retireTypeHierarchyCache(server, old);
+}
+
+static UA_Boolean
+isTypeSubtype(UA_Server *server, UA_TypeHierarchyCache * volatile *cachePtr,
+              const UA_NodeId *root, UA_NodeClass nodeClass,
+              const UA_NodeId *type, const UA_NodeId *superType) {
+    if(UA_NodeId_equal(type, superType))
+        return true;
+
+    /* A cache that was built from an older hierarchy can still be published
+     * if the invalidation happens between the build and the publication. So
+     * the version is checked on every use. A stale cache is swapped out. */
+    UA_TypeHierarchyCache *cache = *cachePtr;
+    if(cache && cache->version != server->typeHierarchyCacheVersion) {
+        if(UA_atomic_cmpxchg((void * volatile *)cachePtr, cache, NULL) == cache)
+            retireTypeHierarchyCache(server, cache);
+        cache = NULL;
+    }
+
+    /* Build the cache if required */
+    UA_TypeHierarchyCache *ownCache = NULL;
+    if(!cache) {
+        size_t version = server->typeHierarchyCacheVersion;
+        cache = TypeHierarchyCache_build(server, root, nodeClass);
+        ownCache = cache;
+        if(cache) {
+            cache->version = version;
+            if(UA_atomic_cmpxchg((void * volatile *)cachePtr, NULL, cache) == NULL)
+                ownCache = NULL; /* Now owned by the server */
+        }
+    }
+
+    /* Fall back to walking the nodestore if the types are not below the root
+     * or the cache could not be built */
+    UA_Boolean result;
+    size_t sub = cache ? TypeHierarchyCache_find(cache, type) : 0;
+    size_t super = cache ? TypeHierarchyCache_find(cache, superType) : 0;
+    if(!cache || sub == cache->typesSize || super == cache->typesSize) {
+        result = isNodeInTree(&server->config.nodestore, type,
+                              superType, &subtypeId, 1);
+    } else {
+        UA_UInt32 word = cache->subtypes[(super * cache->words) + (sub / 32)];
+        result = ((word >> (sub % 32)) & 1) != 0;
+    }
+
+    UA_TypeHierarchyCache_delete(ownCache);
+    return result;
+}
+
+UA_Boolean
+isReferenceTypeSubtype(UA_Server *server, const UA_NodeId *refType,
+                       const UA_NodeId *superType) {
+    const UA_NodeId references = UA_NODEID_NUMERIC(0, UA_NS0ID_REFERENCES);
+    return isTypeSubtype(server, &server->referenceTypeCache, &references,
+                         UA_NODECLASS_REFERENCETYPE, refType, superType);
+}
+
+UA_Boolean
+isDataTypeSubtype(UA_Server *server, const UA_NodeId *dataType,
+                  const UA_NodeId *superType) {
+    const UA_NodeId baseDataType = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATATYPE);
+    return isTypeSubtype(server, &server->dataTypeCache, &baseDataType,
+                         UA_NODECLASS_DATATYPE, dataType, superType);
+}
+
 const UA_Node *
 getNodeType(UA_Server *server, const UA_Node *node) {
     /* The reference to the parent is different for variable and variabletype */
@@ -410,6 +686,66 @@ UA_Server_processServiceOperations(UA_Server *server, UA_Session *session,
     return UA_STATUSCODE_GOOD;
 }
 
+typedef struct {
+    UA_Session *session;
+    UA_ServiceOperation operationCallback;
+    void *context;
+    uintptr_t reqOps;
+    const UA_DataType *requestOperationsType;
+    uintptr_t respOps;
+    const UA_DataType *responseOperationsType;
+} UA_ServiceOperationsRange;
+
+static void
+processServiceOperationsRange(UA_Server *server, UA_ServiceOperationsRange *r,
+                              size_t start, size_t end) {
+    uintptr_t reqOp = r->reqOps + (start * r->requestOperationsType->memSize);
+    uintptr_t respOp = r->respOps + (start * r->responseOperationsType->memSize);
+    for(size_t i = start; i < end; i++) {
+        r->operationCallback(server, r->session, r->context, (void*)reqOp, (void*)respOp);
+        reqOp += r->requestOperationsType->memSize;
+        respOp += r->responseOperationsType->memSize;
+    }
+}
+
+UA_StatusCode
+UA_Server_processServiceOperationsParallel(UA_Server *server, UA_Session *session,
+                                           UA_ServiceOperation operationCallback,
+                                           void *context,
+                                           const size_t *requestOperations,
+                                           const UA_DataType *requestOperationsType,
+                                           size_t *responseOperations,
+                                           const UA_DataType *responseOperationsType) {
+    size_t ops = *requestOperations;
+    if(!UA_Server_parallelOperations(server, ops))
+        return UA_Server_processServiceOperations(server, session, operationCallback,
+                                                  context, requestOperations,
+                                                  requestOperationsType,
+                                                  responseOperations,
+                                                  responseOperationsType);
+
+    /* No padding after size_t */
+    void **respPos = (void**)((uintptr_t)responseOperations + sizeof(size_t));
+    *respPos = UA_Array_new(ops, responseOperationsType);
+    if(!(*respPos))
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    *responseOperations = ops;
+
+    /* The operations run in several workers at once. They may only write to
+     * their own result. Changes to shared server state (e.g. sampling
+     * MonitoredItems) are left to the caller after the operations return. */
+    UA_ServiceOperationsRange r;
+    r.session = session;
+    r.operationCallback = operationCallback;
+    r.context = context;
+    r.reqOps = *(uintptr_t*)((uintptr_t)requestOperations + sizeof(size_t));
+    r.requestOperationsType = requestOperationsType;
+    r.respOps = (uintptr_t)*respPos;
+    r.responseOperationsType = responseOperationsType;
+    UA_Server_parallelFor(server, ops, (UA_ParallelCallback)processServiceOperationsRange, &r);
+    return UA_STATUSCODE_GOOD;
+}
+
 /*********************************/
 /* Default attribute definitions */
 /*********************************/
@@ -16,6 +16,9 @@
 
 #include "ua_util.h"
 #include "ua_server_internal.h"
+#ifdef UA_ENABLE_MULTITHREADING
+#include <sched.h>
+#endif
 #ifdef UA_ENABLE_VALGRIND_INTERACTIVE
 #include <valgrind/memcheck.h>
 #endif
@@ -23,28 +26,59 @@
 #define UA_MAXTIMEOUT 50 /* Max timeout in ms between main-loop iterations */
 
 /**
- * Worker Threads and Dispatch Queue
- * ---------------------------------
- * The worker threads dequeue callbacks from a central Multi-Producer
- * Multi-Consumer Queue (MPMC). When there are no callbacks, workers go idle.
- * The condition to wake them up is triggered whenever a callback is
- * dispatched.
+ * Worker Threads and Dispatch Queues
+ * ----------------------------------
+ * Every worker has a work-stealing deque in the style of Chase and Lev. The
+ * main loop thread is the only producer and pushes callbacks round-robin at the
+ * bottom of the deques. The workers take callbacks from the top of their own
+ * deque. If that is empty, they steal from the top of the other deques. Taking
+ * from the top is synchronized with a single compare-and-swap. So the workers
+ * contend only when they access the same deque.
+ *
+ * The callbacks are stored by value in a circular buffer. No memory is
+ * allocated for the dispatch, except when a buffer needs to grow. The old
+ * buffers are kept until shutdown as other workers might still read from them.
+ *
+ * When there are no callbacks, workers go idle. The condition to wake them up
+ * is only signaled if a worker is idle.
  *
- * Future Plans: Use work-stealing to load-balance between cores.
  * Le, Nhat Minh, et al. "Correct and efficient work-stealing for weak memory
  * models." ACM SIGPLAN Notices. Vol. 48. No. 8. ACM, 2013. */
 
 #ifdef UA_ENABLE_MULTITHREADING
 
+#define UA_DISPATCHQUEUE_MINSIZE 64 /* must be a power of two */
+
+/* Busy workers process the delayed callbacks after this many callbacks. So
+ * delayed frees are not postponed indefinitely under sustained load. */
+#define UA_WORKER_DELAYEDCALLBACKSINTERVAL 64
+
+typedef struct {
+    UA_ServerCallback callback;
+    void *data;
+} UA_DispatchEntry;
+
+typedef struct UA_DispatchBuffer {
+    struct UA_DispatchBuffer *prev; /* Replaced buffers are kept until shutdown */
+    size_t mask; /* size - 1 */
+    UA_DispatchEntry entries[];
+} UA_DispatchBuffer;
+
 struct UA_Worker {
     UA_Server *server;
     pthread_t thr;
-    UA_UInt32 counter;
+    volatile UA_UInt32 counter; /* Increased after every callback */
     volatile UA_Boolean running;
+    volatile UA_Boolean busy; /* Is the worker taking or executing a callback? */
+
+    /* The deque. Only the main loop thread changes the bottom. */
+    volatile size_t bottom;
+    UA_DispatchBuffer * volatile buffer;
 
-    /* separate cache lines */
-    char padding[64 - sizeof(void*) - sizeof(pthread_t) -
-                 sizeof(UA_UInt32) - sizeof(UA_Boolean)];
+    /* Workers compete for the top. Keep it on a separate cache line. */
+    char padding1[64];
+    volatile size_t top;
+    char padding2[64];
 };
 
 struct UA_WorkerCallback {
@@ -52,20 +86,118 @@ struct UA_WorkerCallback {
     UA_ServerCallback callback;
     void *data;
 
-    UA_Boolean delayed;         /* Is it a delayed callback? */
     UA_Boolean countersSampled; /* Have the worker counters been sampled? */
+    size_t *dispatchPositions;  /* Bottom of each deque when dispatched */
     UA_UInt32 workerCounters[]; /* Counter value for each worker */
 };
 typedef struct UA_WorkerCallback WorkerCallback;
 
+static UA_DispatchBuffer *
+UA_DispatchBuffer_new(size_t size) {
+    UA_DispatchBuffer *buf = (UA_DispatchBuffer*)
+        UA_malloc(sizeof(UA_DispatchBuffer) + (size * sizeof(UA_DispatchEntry)));
+    if(!buf)
+        return NULL;
+    buf->prev = NULL;
+    buf->mask = size - 1;
+    return buf;
+}
+
+/* Only called from the main loop thread */
+static UA_Boolean
+dispatchPush(UA_Worker *worker, UA_ServerCallback callback, void *data) {
+    size_t b = worker->bottom;
+    size_t t = worker->top;
+    UA_DispatchBuffer *buf = worker->buffer;
+    if(b - t > buf->mask) {
+        /* Grow the buffer. Entries that were taken in between are copied
+         * without harm. */
+        UA_DispatchBuffer *newBuf = UA_DispatchBuffer_new((buf->mask + 1) * 2);
+        if(!newBuf)
+            return false;
+        for(size_t i = t; i < b; ++i)
+            newBuf->entries[i & newBuf->mask] = buf->entries[i & buf->mask];
+        newBuf->prev = buf;
+        UA_atomic_sync();
+        worker->buffer = newBuf;
+        buf = newBuf;
+    }
+    buf->entries[b & buf->mask].callback = callback;
+    buf->entries[b & buf->mask].data = data;
+    UA_atomic_sync(); /* Publish the entry before the bottom is moved */
+    worker->bottom = b + 1;
+    UA_atomic_sync();
+    return true;
+}
+
+/* Take an entry from the top. Returns false if the deque is empty. */
+static UA_Boolean
+dispatchSteal(UA_Worker *worker, UA_DispatchEntry *entry) {
+    while(true) {
+        size_t t = worker->top;
+        UA_atomic_sync();
+        size_t b = worker->bottom;
+        if(t == b)
+            return false;
+        UA_DispatchBuffer *buf = worker->buffer;
+        *entry = buf->entries[t & buf->mask];
+        /* The entry is valid only if no other worker has taken it */
+        if(UA_atomic_cmpxchgSize(&worker->top, t, t + 1) == t)
+            return true;
+    }
+}
+
+static UA_Boolean
+dispatchEmpty(const UA_Worker *worker) {
+    return worker->top == worker->bottom;
+}
+
+/* Take a callback from the own deque first. Then try to steal from the other
+ * workers. */
+static UA_Boolean
+takeCallback(UA_Server *server, UA_Worker *worker, UA_DispatchEntry *entry) {
+    if(dispatchSteal(worker, entry))
+        return true;
+    size_t nThreads = server->config.nThreads;
+    size_t self = (size_t)(worker - server->workers);
+    for(size_t i = 1; i < nThreads; ++i) {
+        if(dispatchSteal(&server->workers[(self + i) % nThreads], entry))
+            return true;
+    }
+    return false;
+}
+
+static UA_Boolean
+hasCallbacks(UA_Server *server) {
+    for(size_t i = 0; i < server->config.nThreads; ++i) {
+        if(!dispatchEmpty(&server->workers[i]))
+            return true;
+    }
+    return false;
+}
+
+/* Wake up an idle worker. The idle count is read after the dispatch was
+ * published. */
+static void
+wakeupWorker(UA_Server *server) {
+    if(server->idleWorkers == 0)
+        return;
+    pthread_mutex_lock(&server->dispatchQueue_conditionMutex);
+    pthread_cond_signal(&server->dispatchQueue_condition);
+    pthread_mutex_unlock(&server->dispatchQueue_conditionMutex);
+}
+
 /* Forward Declaration */
 static void
-processDelayedCallback(UA_Server *server, WorkerCallback *dc);
+processDelayedCallbacks(UA_Server *server, UA_Worker *worker);
+
+/* Forward Declaration */
+static UA_Boolean
+helpParallelJob(UA_Server *server);
 
 static void *
 workerLoop(UA_Worker *worker) {
     UA_Server *server = worker->server;
-    UA_UInt32 *counter = &worker->counter;
     volatile UA_Boolean *running = &worker->running;
 
     /* Initialize the (thread local) random seed with the ram address
@@ -73,29 +205,45 @@ workerLoop(UA_Worker *worker) {
     UA_random_seed((uintptr_t)worker);
 
     while(*running) {
-        UA_atomic_addUInt32(counter, 1);
-        pthread_mutex_lock(&server->dispatchQueue_accessMutex);
-        WorkerCallback *dc = SIMPLEQ_FIRST(&server->dispatchQueue);
-        if(dc) {
-            SIMPLEQ_REMOVE_HEAD(&server->dispatchQueue, next);
-        }
-        pthread_mutex_unlock(&server->dispatchQueue_accessMutex);
-        if(!dc) {
-            /* Nothing to do. Sleep until a callback is dispatched */
-            pthread_mutex_lock(&server->dispatchQueue_conditionMutex);
-            pthread_cond_wait(&server->dispatchQueue_condition,
-                              &server->dispatchQueue_conditionMutex);
-            pthread_mutex_unlock(&server->dispatchQueue_conditionMutex);
+        /* Mark as busy before taking. So the delayed callbacks wait until the
+         * callback taken here has finished. */
+        worker->busy = true;
+        UA_atomic_sync();
+        UA_DispatchEntry entry;
+        if(takeCallback(server, worker, &entry)) {
+            entry.callback(server, entry.data);
+            UA_UInt32 processed = UA_atomic_addUInt32(&worker->counter, 1);
+            worker->busy = false;
+            if(processed % UA_WORKER_DELAYEDCALLBACKSINTERVAL == 0 &&
+               server->delayedCallbacksSize > 0) {
+                UA_atomic_sync();
+                processDelayedCallbacks(server, worker);
+            }
             continue;
         }
+        worker->busy = false;
+        UA_atomic_sync();
 
-        if(dc->delayed) {
-            processDelayedCallback(server, dc);
+        /* Help with the operations of a large request */
+        if(helpParallelJob(server))
             continue;
-        }
 
-        dc->callback(server, dc->data);
-        UA_free(dc);
+        /* Process delayed callbacks that are ready */
+        UA_UInt32 delayedAdded = server->delayedCallbacksAdded;
+        if(server->delayedCallbacksSize > 0)
+            processDelayedCallbacks(server, worker);
+
+        /* Nothing to do. Sleep until a callback is dispatched. The idle count
+         * is increased before checking the queues. So a callback dispatched in
+         * between will signal the condition. */
+        pthread_mutex_lock(&server->dispatchQueue_conditionMutex);
+        UA_atomic_addUInt32(&server->idleWorkers, 1);
+        if(*running && !hasCallbacks(server) && server->parallelJobsSize == 0 &&
+           delayedAdded == server->delayedCallbacksAdded)
+            pthread_cond_wait(&server->dispatchQueue_condition,
+                              &server->dispatchQueue_conditionMutex);
+        UA_atomic_subUInt32(&server->idleWorkers, 1);
+        pthread_mutex_unlock(&server->dispatchQueue_conditionMutex);
     }
 
     UA_LOG_DEBUG(server->config.logger, UA_LOGCATEGORY_SERVER,
@@ -103,18 +251,37 @@ workerLoop(UA_Worker *worker) {
     return NULL;
 }
 
+/* Forward Declaration */
+static void
+freeDelayedCallback(WorkerCallback *dc);
+
 void UA_Server_cleanupDispatchQueue(UA_Server *server) {
+    /* Execute the dispatched callbacks. They may dispatch new callbacks. */
+    UA_DispatchEntry entry;
+    UA_Boolean found = true;
+    while(found && server->workers) {
+        found = false;
+        for(size_t i = 0; i < server->config.nThreads; ++i) {
+            while(dispatchSteal(&server->workers[i], &entry)) {
+                entry.callback(server, entry.data);
+                found = true;
+            }
+        }
+    }
+
+    /* Execute the delayed callbacks */
     while(true) {
-        pthread_mutex_lock(&server->dispatchQueue_accessMutex);
-        WorkerCallback *dc = SIMPLEQ_FIRST(&server->dispatchQueue);
+        pthread_mutex_lock(&server->delayedCallbacks_accessMutex);
+        WorkerCallback *dc = SIMPLEQ_FIRST(&server->delayedCallbacks);
         if(!dc) {
-            pthread_mutex_unlock(&server->dispatchQueue_accessMutex);
+            pthread_mutex_unlock(&server->delayedCallbacks_accessMutex);
             break;
         }
-        SIMPLEQ_REMOVE_HEAD(&server->dispatchQueue, next);
-        pthread_mutex_unlock(&server->dispatchQueue_accessMutex);
+        SIMPLEQ_REMOVE_HEAD(&server->delayedCallbacks, next);
+        UA_atomic_subSize(&server->delayedCallbacksSize, 1);
+        pthread_mutex_unlock(&server->delayedCallbacks_accessMutex);
         dc->callback(server, dc->data);
-        UA_free(dc);
+        freeDelayedCallback(dc);
     }
 }
 
@@ -134,26 +301,146 @@ UA_Server_workerCallback(UA_Server *server, UA_ServerCallback callback,
     /* Execute immediately */
     callback(server, data);
 #else
-    /* Execute immediately if memory could not be allocated */
-    WorkerCallback *dc = (WorkerCallback*)UA_malloc(sizeof(WorkerCallback));
-    if(!dc) {
+    /* Execute immediately if there are no workers or memory could not be
+     * allocated */
+    if(!server->workers) {
         callback(server, data);
         return;
     }
 
-    /* Enqueue for the worker threads */
-    dc->callback = callback;
-    dc->data = data;
-    dc->delayed = false;
-    pthread_mutex_lock(&server->dispatchQueue_accessMutex);
-    SIMPLEQ_INSERT_TAIL(&server->dispatchQueue, dc, next);
-    pthread_mutex_unlock(&server->dispatchQueue_accessMutex);
+    /* Enqueue round-robin for the worker threads */
+    UA_Worker *worker = &server->workers[server->dispatchNext];
+    server->dispatchNext = (server->dispatchNext + 1) % server->config.nThreads;
+    if(!dispatchPush(worker, callback, data)) {
+        callback(server, data);
+        return;
+    }
+
+    /* Wake up a sleeping worker */
+    wakeupWorker(server);
+#endif
+}
+
+/**
+ * Parallel Operations
+ * -------------------
+ * Large requests are split into ranges of operations. The thread processing
+ * the request publishes a job and wakes up the idle workers. Then all of them
+ * claim ranges with an atomic increment until none are left. The job lives on
+ * the stack of the publishing thread. It is removed from the list once all
+ * ranges are claimed. Then the publishing thread waits until the helping
+ * workers have finished their last range. Workers never wait for each other,
+ * so the fan-out cannot deadlock if no worker is idle. */
+
+#ifdef UA_ENABLE_MULTITHREADING
 
-    /* Wake up sleeping workers */
-    pthread_cond_broadcast(&server->dispatchQueue_condition);
+/* Ranges per thread. More (smaller) ranges even out operations of different
+ * cost. */
+#define UA_PARALLEL_RANGES_PER_THREAD 4
+
+typedef struct UA_ParallelJob {
+    LIST_ENTRY(UA_ParallelJob) pointers;
+    UA_ParallelCallback callback;
+    void *context;
+    size_t count;
+    size_t rangeSize;
+    volatile size_t next;       /* Start of the next unclaimed range */
+    volatile UA_UInt32 helpers; /* Workers processing ranges of the job */
+} UA_ParallelJob;
+
+/* Returns whether a range was processed */
+static UA_Boolean
+processParallelRanges(UA_Server *server, UA_ParallelJob *job) {
+    UA_Boolean processed = false;
+    while(true) {
+        size_t end = UA_atomic_addSize(&job->next, job->rangeSize);
+        size_t start = end - job->rangeSize;
+        if(start >= job->count)
+            break;
+        if(end > job->count)
+            end = job->count;
+        job->callback(server, job->context, start, end);
+        processed = true;
+    }
+    return processed;
+}
+
+static UA_Boolean
+helpParallelJob(UA_Server *server) {
+    if(server->parallelJobsSize == 0)
+        return false;
+    pthread_mutex_lock(&server->parallelJobs_mutex);
+    UA_ParallelJob *job;
+    LIST_FOREACH(job, &server->parallelJobs, pointers) {
+        if(job->next < job->count) {
+            UA_atomic_addUInt32(&job->helpers, 1);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&server->parallelJobs_mutex);
+    if(!job)
+        return false;
+    UA_Boolean processed = processParallelRanges(server, job);
+    UA_atomic_subUInt32(&job->helpers, 1);
+    return processed;
+}
+
+#endif
+
+UA_Boolean
+UA_Server_parallelOperations(UA_Server *server, size_t operations) {
+#ifdef UA_ENABLE_MULTITHREADING
+    return (server->workers && server->config.nThreads > 1 &&
+            server->config.parallelOperationsThreshold > 0 &&
+            operations >= server->config.parallelOperationsThreshold);
+#else
+    return false;
 #endif
 }
 
+void
+UA_Server_parallelFor(UA_Server *server, size_t count,
+                      UA_ParallelCallback callback, void *context) {
+#ifdef UA_ENABLE_MULTITHREADING
+    if(server->workers && count > 1) {
+        UA_ParallelJob job;
+        memset(&job, 0, sizeof(UA_ParallelJob));
+        job.callback = callback;
+        job.context = context;
+        job.count = count;
+        job.rangeSize = count / ((size_t)(server->config.nThreads + 1) *
+                                 UA_PARALLEL_RANGES_PER_THREAD);
+        if(job.rangeSize == 0)
+            job.rangeSize = 1;
+
+        /* Publish the job and wake up all idle workers */
+        pthread_mutex_lock(&server->parallelJobs_mutex);
+        LIST_INSERT_HEAD(&server->parallelJobs, &job, pointers);
+        UA_atomic_addSize(&server->parallelJobsSize, 1);
+        pthread_mutex_unlock(&server->parallelJobs_mutex);
+        if(server->idleWorkers > 0) {
+            pthread_mutex_lock(&server->dispatchQueue_conditionMutex);
+            pthread_cond_broadcast(&server->dispatchQueue_condition);
+            pthread_mutex_unlock(&server->dispatchQueue_conditionMutex);
+        }
+
+        /* Work on the ranges until all are claimed */
+        processParallelRanges(server, &job);
+
+        /* No new helpers after the job is removed. Wait for the workers that
+         * still process a range. */
+        pthread_mutex_lock(&server->parallelJobs_mutex);
+        LIST_REMOVE(&job, pointers);
+        UA_atomic_subSize(&server->parallelJobsSize, 1);
+        pthread_mutex_unlock(&server->parallelJobs_mutex);
+        while(job.helpers > 0)
+            sched_yield();
+        return;
+    }
+#endif
+    callback(server, context, 0, count);
+}
+
 /**
  * Delayed Callbacks
  * -----------------
@@ -161,16 +448,18 @@ UA_Server_workerCallback(UA_Server *server, UA_ServerCallback callback,
  * Delayed Callbacks are called only when all callbacks that were dispatched
  * prior are finished. In the single-threaded case, the callback is added to a
  * singly-linked list that is processed at the end of the server's main-loop. In
- * the multi-threaded case, the delay is ensure by a three-step procedure:
+ * the multi-threaded case, the delay is ensured by a three-step procedure:
  *
- * 1. The delayed callback is dispatched to the worker queue. So it is only
- *    dequeued when all prior callbacks have been dequeued.
+ * 1. The delayed callback is added to a separate queue. The current bottom
+ *    position of every dispatch deque is sampled.
  *
- * 2. When the callback is first dequeued by a worker, sample the counter of all
- *    workers. Once all counters have advanced, the callback is ready.
+ * 2. Once the tops of all deques have moved past the sampled positions, all
+ *    prior callbacks have been taken. Then sample the counter of all workers.
+ *    Once the counters of all busy workers have advanced, the callback is
+ *    ready.
  *
- * 3. Check regularly if the callback is ready by adding it back to the dispatch
- *    queue. */
+ * 3. The workers check if the callbacks are ready before they go idle. The last
+ *    worker to finish a prior callback always does the check. */
 
 /* Delayed callback to free the subscription memory */
 static void
@@ -218,6 +507,12 @@ void UA_Server_cleanupDelayedCallbacks(UA_Server *server) {
 
 #else /* UA_ENABLE_MULTITHREADING */
 
+static void
+freeDelayedCallback(WorkerCallback *dc) {
+    UA_free(dc->dispatchPositions);
+    UA_free(dc);
+}
+
 UA_StatusCode
 UA_Server_delayedCallback(UA_Server *server, UA_ServerCallback callback,
                           void *data) {
@@ -226,65 +521,86 @@ UA_Server_delayedCallback(UA_Server *server, UA_ServerCallback callback,
     WorkerCallback *dc = (WorkerCallback*)UA_malloc(dcsize);
     if(!dc)
         return UA_STATUSCODE_BADOUTOFMEMORY;
-
-    /* Enqueue for the worker threads */
     dc->callback = callback;
     dc->data = data;
-    dc->delayed = true;
     dc->countersSampled = false;
-    pthread_mutex_lock(&server->dispatchQueue_accessMutex);
-    SIMPLEQ_INSERT_TAIL(&server->dispatchQueue, dc, next);
-    pthread_mutex_unlock(&server->dispatchQueue_accessMutex);
+    dc->dispatchPositions = NULL;
+
+    /* Sample the dispatch positions. Callbacks dispatched before need to be
+     * taken before the delayed callback is ready. */
+    if(server->workers) {
+        dc->dispatchPositions = (size_t*)
+            UA_malloc(sizeof(size_t) * server->config.nThreads);
+        if(!dc->dispatchPositions) {
+            UA_free(dc);
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+        UA_atomic_sync();
+        for(size_t i = 0; i < server->config.nThreads; ++i)
+            dc->dispatchPositions[i] = server->workers[i].bottom;
+    }
 
-    /* Wake up sleeping workers */
-    pthread_cond_broadcast(&server->dispatchQueue_condition);
+    /* Enqueue for the worker threads */
+    pthread_mutex_lock(&server->delayedCallbacks_accessMutex);
+    SIMPLEQ_INSERT_TAIL(&server->delayedCallbacks, dc, next);
+    UA_atomic_addSize(&server->delayedCallbacksSize, 1);
+    UA_atomic_addUInt32(&server->delayedCallbacksAdded, 1);
+    pthread_mutex_unlock(&server->delayedCallbacks_accessMutex);
+
+    /* Wake up a sleeping worker */
+    if(server->workers)
+        wakeupWorker(server);
     return UA_STATUSCODE_GOOD;
 }
 
-/* Called from the worker loop */
-static void
-processDelayedCallback(UA_Server *server, WorkerCallback *dc) {
-    /* Set the worker counters */
+/* The delayed callback is ready when all callbacks dispatched prior have been
+ * taken from the deques and the workers that were busy at that moment have
+ * finished. The calling worker is not busy. */
+static UA_Boolean
+delayedCallbackReady(UA_Server *server, UA_Worker *self, WorkerCallback *dc) {
+    size_t nThreads = server->config.nThreads;
     if(!dc->countersSampled) {
-        for(size_t i = 0; i < server->config.nThreads; ++i)
+        /* No positions if added before the workers were started */
+        for(size_t i = 0; dc->dispatchPositions && i < nThreads; ++i) {
+            if(server->workers[i].top < dc->dispatchPositions[i])
+                return false;
+        }
+        UA_atomic_sync();
+        for(size_t i = 0; i < nThreads; ++i)
             dc->workerCounters[i] = server->workers[i].counter;
         dc->countersSampled = true;
-
-        /* Re-add to the dispatch queue */
-        pthread_mutex_lock(&server->dispatchQueue_accessMutex);
-        SIMPLEQ_INSERT_TAIL(&server->dispatchQueue, dc, next);
-        pthread_mutex_unlock(&server->dispatchQueue_accessMutex);
-
-        /* Wake up sleeping workers */
-        pthread_cond_broadcast(&server->dispatchQueue_condition);
-        return;
     }
 
-    /* Have all other jobs finished? */
-    UA_Boolean ready = true;
-    for(size_t i = 0; i < server->config.nThreads; ++i) {
-        if(dc->workerCounters[i] == server->workers[i].counter) {
-            ready = false;
-            break;
-        }
+    UA_atomic_sync();
+    for(size_t i = 0; i < nThreads; ++i) {
+        UA_Worker *worker = &server->workers[i];
+        if(worker != self && worker->busy &&
+           dc->workerCounters[i] == worker->counter)
+            return false;
     }
+    return true;
+}
 
-    /* Re-add to the dispatch queue.
-     * TODO: What is the impact of this loop?
-     * Can we add a small delay here? */
-    if(!ready) {
-        pthread_mutex_lock(&server->dispatchQueue_accessMutex);
-        SIMPLEQ_INSERT_TAIL(&server->dispatchQueue, dc, next);
-        pthread_mutex_unlock(&server->dispatchQueue_accessMutex);
+/* Called from the worker loop */
+static void
+processDelayedCallbacks(UA_Server *server, UA_Worker *worker) {
+    while(true) {
+        /* Take the first callback if it is ready. The callbacks become ready
+         * in the order of the queue. */
+        pthread_mutex_lock(&server->delayedCallbacks_accessMutex);
+        WorkerCallback *dc = SIMPLEQ_FIRST(&server->delayedCallbacks);
+        if(!dc || !delayedCallbackReady(server, worker, dc)) {
+            pthread_mutex_unlock(&server->delayedCallbacks_accessMutex);
+            return;
+        }
+        SIMPLEQ_REMOVE_HEAD(&server->delayedCallbacks, next);
+        UA_atomic_subSize(&server->delayedCallbacksSize, 1);
+        pthread_mutex_unlock(&server->delayedCallbacks_accessMutex);
 
-        /* Wake up sleeping workers */
-        pthread_cond_broadcast(&server->dispatchQueue_condition);
-        return;
+        /* Execute the callback */
+        dc->callback(server, dc->data);
+        freeDelayedCallback(dc);
     }
-
-    /* Execute the callback */
-    dc->callback(server, dc->data);
-    UA_free(dc);
 }
 
 #endif
@@ -323,16 +639,24 @@ UA_Server_run_startup(UA_Server *server) {
 #ifdef UA_ENABLE_MULTITHREADING
     UA_LOG_INFO(server->config.logger, UA_LOGCATEGORY_SERVER,
                 "Spinning up %u worker thread(s)", server->config.nThreads);
-    pthread_mutex_init(&server->dispatchQueue_accessMutex, NULL);
-    pthread_cond_init(&server->dispatchQueue_condition, NULL);
-    pthread_mutex_init(&server->dispatchQueue_conditionMutex, NULL);
-    server->workers = (UA_Worker*)UA_malloc(server->config.nThreads * sizeof(UA_Worker));
-    if(!server->workers)
+    UA_Worker *workers = (UA_Worker*)
+        UA_calloc(server->config.nThreads, sizeof(UA_Worker));
+    if(!workers)
         return UA_STATUSCODE_BADOUTOFMEMORY;
+    for(size_t i = 0; i < server->config.nThreads; ++i) {
+        workers[i].buffer = UA_DispatchBuffer_new(UA_DISPATCHQUEUE_MINSIZE);
+        if(!workers[i].buffer) {
+            for(size_t j = 0; j < i; ++j)
+                UA_free(workers[j].buffer);
+            UA_free(workers);
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+    }
+    server->dispatchNext = 0;
+    server->workers = workers;
     for(size_t i = 0; i < server->config.nThreads; ++i) {
         UA_Worker *worker = &server->workers[i];
         worker->server = server;
-        worker->counter = 0;
         worker->running = true;
         pthread_create(&worker->thr, NULL, (void* (*)(void*))workerLoop, worker);
     }
@@ -373,6 +697,11 @@ UA_Server_run_iterate(UA_Server *server, UA_Boolean waitInternal) {
         nl->listen(nl, server, timeout);
     }
 
+#ifdef UA_ENABLE_METHODCALLS
+    /* Send the responses of finished asynchronous operations */
+    UA_AsyncManager_process(server);
+#endif
+
 #ifndef UA_ENABLE_MULTITHREADING
     /* Process delayed callbacks when all callbacks and network events are done.
      * If multithreading is enabled, the cleanup of delayed values is attempted
@@ -416,17 +745,32 @@ UA_Server_run_shutdown(UA_Server *server) {
         UA_LOG_INFO(server->config.logger, UA_LOGCATEGORY_SERVER,
                     "Shutting down %u worker thread(s)",
                     server->config.nThreads);
+        pthread_mutex_lock(&server->dispatchQueue_conditionMutex);
         for(size_t i = 0; i < server->config.nThreads; ++i)
             server->workers[i].running = false;
         pthread_cond_broadcast(&server->dispatchQueue_condition);
+        pthread_mutex_unlock(&server->dispatchQueue_conditionMutex);
         for(size_t i = 0; i < server->config.nThreads; ++i)
             pthread_join(server->workers[i].thr, NULL);
+
+        /* Execute the remaining callbacks in the dispatch queues. Also
+         * executes delayed callbacks. */
+        UA_Server_cleanupDispatchQueue(server);
+
+        /* Free the dispatch queues */
+        for(size_t i = 0; i < server->config.nThreads; ++i) {
+            UA_DispatchBuffer *buf = server->workers[i].buffer;
+            while(buf) {
+                UA_DispatchBuffer *prev = buf->prev;
+                UA_free(buf);
+                buf = prev;
+            }
+        }
         UA_free(server->workers);
         server->workers = NULL;
     }
 
-    /* Execute the remaining callbacks in the dispatch queue. Also executes
-     * delayed callbacks. */
+    /* Execute delayed callbacks that were added without workers */
     UA_Server_cleanupDispatchQueue(server);
 #else
     /* Process remaining delayed callbacks */
@@ -51,6 +51,11 @@ typedef void (*UA_Service)(UA_Server*, UA_Session*,
 typedef UA_StatusCode (*UA_InSituService)(UA_Server*, UA_Session*, UA_MessageContext *mc,
                                           const void *request, UA_ResponseHeader *rh);
 
+/* Services that can defer their response get the requestId. They return true
+ * if the response was taken over and is sent later (see ua_server_async.c). */
+typedef UA_Boolean (*UA_AsyncService)(UA_Server*, UA_Session*, UA_UInt32 requestId,
+                                      const void *request, void *response);
+
 /**
  * Discovery Service Set
  * ---------------------
@@ -228,9 +233,8 @@ void Service_DeleteReferences(UA_Server *server, UA_Session *session,
  * Used to discover the References of a specified Node. The browse can be
  * further limited by the use of a View. This Browse Service also supports a
  * primitive filtering capability. */
-void Service_Browse(UA_Server *server, UA_Session *session,
-                    const UA_BrowseRequest *request,
-                    UA_BrowseResponse *response);
+UA_StatusCode Service_Browse(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+                             const UA_BrowseRequest *request, UA_ResponseHeader *responseHeader);
 
 /**
  * BrowseNext Service
@@ -240,9 +244,9 @@ void Service_Browse(UA_Server *server, UA_Session *session,
  * context means that the Server is not able to return a larger response or that
  * the number of results to return exceeds the maximum number of results to
  * return that was specified by the Client in the original Browse request. */
-void Service_BrowseNext(UA_Server *server, UA_Session *session,
-                        const UA_BrowseNextRequest *request,
-                        UA_BrowseNextResponse *response);
+UA_StatusCode Service_BrowseNext(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+                                 const UA_BrowseNextRequest *request,
+                                 UA_ResponseHeader *responseHeader);
 
 /**
  * TranslateBrowsePathsToNodeIds Service
@@ -349,10 +353,12 @@ void Service_Write(UA_Server *server, UA_Session *session,
  * ^^^^^^^^^^^^
  * Used to call (invoke) a methods. Each method call is invoked within the
  * context of an existing Session. If the Session is terminated, the results of
- * the method's execution cannot be returned to the Client and are discarded. */
-void Service_Call(UA_Server *server, UA_Session *session,
-                  const UA_CallRequest *request,
-                  UA_CallResponse *response);
+ * the method's execution cannot be returned to the Client and are discarded.
+ * Calls to asynchronous methods are queued for the application. Then the
+ * response is deferred until their results are set. */
+UA_Boolean Service_Call(UA_Server *server, UA_Session *session,
+                        UA_UInt32 requestId, const UA_CallRequest *request,
+                        UA_CallResponse *response);
 
 /**
  * MonitoredItem Service Set
@@ -458,10 +464,11 @@ void Service_Publish(UA_Server *server, UA_Session *session,
  * Republish Service
  * ^^^^^^^^^^^^^^^^^
  * Requests the Subscription to republish a NotificationMessage from its
- * retransmission queue. */
-void Service_Republish(UA_Server *server, UA_Session *session,
-                       const UA_RepublishRequest *request,
-                       UA_RepublishResponse *response);
+ * retransmission queue. The message is retained in binary encoding and
+ * streamed into the response as-is. */
+UA_StatusCode Service_Republish(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+                                const UA_RepublishRequest *request,
+                                UA_ResponseHeader *responseHeader);
 
 /**
  * DeleteSubscriptions Service
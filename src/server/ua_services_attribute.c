@@ -67,6 +67,278 @@ getUserExecutable(UA_Server *server, const UA_Session *session,
                                                        &node->nodeId, node->context);
 }
 
+/***************/
+/* Value Cache */
+/***************/
+
+#define UA_VALUECACHE_MINSIZE 64
+
+#ifdef UA_ENABLE_MULTITHREADING
+# define UA_VALUECACHE_LOCK(CACHE) pthread_mutex_lock(&(CACHE)->mutex)
+# define UA_VALUECACHE_UNLOCK(CACHE) pthread_mutex_unlock(&(CACHE)->mutex)
+#else
+# define UA_VALUECACHE_LOCK(CACHE)
+# define UA_VALUECACHE_UNLOCK(CACHE)
+#endif
+
+void
+UA_ValueCache_init(UA_ValueCache *cache) {
+    memset(cache, 0, sizeof(UA_ValueCache));
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_init(&cache->mutex, NULL);
+#endif
+}
+
+static void
+CachedValue_delete(UA_CachedValue *cv) {
+    UA_NodeId_deleteMembers(&cv->nodeId);
+    UA_NodeId_deleteMembers(&cv->sessionId);
+    UA_DataValue_deleteMembers(&cv->value);
+    UA_free(cv);
+}
+
+void
+UA_ValueCache_deleteMembers(UA_ValueCache *cache) {
+    for(size_t i = 0; i < cache->bucketsSize; i++) {
+        UA_CachedValue *cv = cache->buckets[i];
+        while(cv) {
+            UA_CachedValue *next = cv->next;
+            CachedValue_delete(cv);
+            cv = next;
+        }
+    }
+    UA_free(cache->buckets);
+    cache->buckets = NULL;
+    cache->bucketsSize = 0;
+    cache->entries = 0;
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_destroy(&cache->mutex);
+#endif
+}
+
+/* Returns the link to the entry. Or the link at the end of the chain if the
+ * entry does not exist. NULL if the cache has no buckets. */
+static UA_CachedValue **
+ValueCache_find(UA_ValueCache *cache, const UA_NodeId *nodeId,
+                const UA_NodeId *sessionId, UA_UInt32 hash) {
+    if(cache->bucketsSize == 0)
+        return NULL;
+    UA_CachedValue **cv = &cache->buckets[hash & (cache->bucketsSize - 1)];
+    while(*cv && ((*cv)->hash != hash || !UA_NodeId_equal(&(*cv)->nodeId, nodeId) ||
+                  !UA_NodeId_equal(&(*cv)->sessionId, sessionId)))
+        cv = &(*cv)->next;
+    return cv;
+}
+
+static void
+ValueCache_rehash(UA_ValueCache *cache, size_t newSize) {
+    UA_CachedValue **buckets = (UA_CachedValue**)
+        UA_calloc(newSize, sizeof(UA_CachedValue*));
+    if(!buckets)
+        return; /* Continue with longer chains */
+    for(size_t i = 0; i < cache->bucketsSize; i++) {
+        UA_CachedValue *cv = cache->buckets[i];
+        while(cv) {
+            UA_CachedValue *next = cv->next;
+            cv->next = buckets[cv->hash & (newSize - 1)];
+            buckets[cv->hash & (newSize - 1)] = cv;
+            cv = next;
+        }
+    }
+    UA_free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucketsSize = newSize;
+}
+
+/* Values of session dependent data sources are cached per session. All other
+ * values are shared under the null NodeId. */
+static const UA_NodeId *
+cacheSessionId(const UA_Node *node, const UA_Session *session) {
+    const UA_VariableNode *vn = (const UA_VariableNode*)node;
+    if(vn->value.dataSource.sessionDependent)
+        return &session->sessionId;
+    return &UA_NODEID_NULL;
+}
+
+/* maxAge in ms. Saturates for huge values. */
+static UA_DateTime
+maxAgeToDateTime(UA_Double maxAge) {
+    if(maxAge >= (UA_Double)UA_INT64_MAX / UA_DATETIME_MSEC)
+        return UA_INT64_MAX;
+    return (UA_DateTime)(maxAge * UA_DATETIME_MSEC);
+}
+
+static UA_Boolean
+CachedValue_expired(const UA_CachedValue *cv, UA_DateTime nowMonotonic) {
+    return (nowMonotonic - cv->readTime >= cv->maxAge);
+}
+
+static void
+ValueCache_removeExpired(UA_ValueCache *cache, UA_DateTime nowMonotonic) {
+    for(size_t i = 0; i < cache->bucketsSize && cache->entries > 0; i++) {
+        UA_CachedValue **cv = &cache->buckets[i];
+        while(*cv) {
+            UA_CachedValue *entry = *cv;
+            if(CachedValue_expired(entry, nowMonotonic)) {
+                *cv = entry->next;
+                cache->entries--;
+                CachedValue_delete(entry);
+                continue;
+            }
+            cv = &entry->next;
+        }
+    }
+}
+
+void
+UA_ValueCache_cleanup(UA_ValueCache *cache, UA_DateTime nowMonotonic) {
+    UA_VALUECACHE_LOCK(cache);
+    ValueCache_removeExpired(cache, nowMonotonic);
+    UA_VALUECACHE_UNLOCK(cache);
+}
+
+/* Copies the cached value if it is younger than maxAge (in ms). Values without
+ * a source timestamp are a miss if one is required. */
+static UA_Boolean
+readCachedValue(UA_Server *server, const UA_NodeId *sessionId,
+                const UA_NodeId *nodeId, UA_Double maxAge,
+                UA_Boolean sourceTimeStamp, const UA_NumericRange *range,
+                UA_DataValue *v) {
+    if(maxAge <= 0.0)
+        return false;
+    UA_ValueCache *cache = &server->valueCache;
+    UA_DateTime age = maxAgeToDateTime(maxAge);
+    UA_Boolean found = false;
+    UA_VALUECACHE_LOCK(cache);
+    UA_CachedValue **cv = ValueCache_find(cache, nodeId, sessionId,
+                                          UA_NodeId_hash(nodeId));
+    if(!cv || !*cv)
+        goto unlock;
+
+    /* The entry is kept as long as the largest maxAge it is read with */
+    if((*cv)->maxAge < age)
+        (*cv)->maxAge = age;
+
+    if((!sourceTimeStamp || (*cv)->value.hasSourceTimestamp) &&
+       UA_DateTime_nowMonotonic() - (*cv)->readTime < age) {
+        UA_StatusCode retval;
+        if(range) {
+            /* The other members of the DataValue contain no heap memory */
+            *v = (*cv)->value;
+            UA_Variant_init(&v->value);
+            retval = UA_Variant_copyRange(&(*cv)->value.value, &v->value, *range);
+        } else {
+            retval = UA_DataValue_copy(&(*cv)->value, v);
+        }
+        found = (retval == UA_STATUSCODE_GOOD);
+        if(!found)
+            UA_DataValue_init(v);
+    }
+
+ unlock:
+    UA_VALUECACHE_UNLOCK(cache);
+    return found;
+}
+
+/* Store the value freshly read from the data source. Existing entries are
+ * always updated. New entries are only created for reads with a maxAge. */
+static void
+cacheValue(UA_Server *server, const UA_NodeId *sessionId, const UA_NodeId *nodeId,
+           const UA_DataValue *v, UA_Double maxAge) {
+    /* Don't cache errors */
+    if(v->hasStatus && v->status != UA_STATUSCODE_GOOD)
+        return;
+
+    UA_ValueCache *cache = &server->valueCache;
+    UA_UInt32 hash = UA_NodeId_hash(nodeId);
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    UA_VALUECACHE_LOCK(cache);
+    UA_CachedValue **cv = ValueCache_find(cache, nodeId, sessionId, hash);
+    UA_CachedValue *entry = (cv) ? *cv : NULL;
+    if(!entry) {
+        if(maxAge <= 0.0)
+            goto unlock;
+        entry = (UA_CachedValue*)UA_calloc(1, sizeof(UA_CachedValue));
+        if(!entry)
+            goto unlock;
+        if(UA_NodeId_copy(nodeId, &entry->nodeId) != UA_STATUSCODE_GOOD ||
+           UA_NodeId_copy(sessionId, &entry->sessionId) != UA_STATUSCODE_GOOD) {
+            CachedValue_delete(entry);
+            goto unlock;
+        }
+        entry->hash = hash;
+        entry->maxAge = maxAgeToDateTime(maxAge);
+        /* Drop the expired entries before the table grows */
+        if(cache->entries >= cache->bucketsSize)
+            ValueCache_removeExpired(cache, now);
+        if(cache->entries >= cache->bucketsSize) {
+            size_t newSize = cache->bucketsSize * 2;
+            if(newSize < UA_VALUECACHE_MINSIZE)
+                newSize = UA_VALUECACHE_MINSIZE;
+            ValueCache_rehash(cache, newSize);
+            if(cache->bucketsSize == 0) {
+                CachedValue_delete(entry);
+                goto unlock;
+            }
+        }
+        entry->next = cache->buckets[hash & (cache->bucketsSize - 1)];
+        cache->buckets[hash & (cache->bucketsSize - 1)] = entry;
+        cache->entries++;
+    }
+
+    /* Replace the value. A missing source timestamp is not made up here. Reads
+     * that require one go to the source instead. */
+    UA_DataValue_deleteMembers(&entry->value);
+    if(UA_DataValue_copy(v, &entry->value) != UA_STATUSCODE_GOOD) {
+        entry->readTime = 0; /* Too old for any maxAge */
+        goto unlock;
+    }
+    entry->readTime = now;
+
+ unlock:
+    UA_VALUECACHE_UNLOCK(cache);
+}
+
+/* Removes the entries of a node (nodeId != NULL) or of a session from the
+ * chain */
+static void
+ValueCache_removeChain(UA_ValueCache *cache, UA_CachedValue **cv,
+                       const UA_NodeId *nodeId, const UA_NodeId *sessionId) {
+    while(*cv) {
+        UA_CachedValue *entry = *cv;
+        if((nodeId && UA_NodeId_equal(&entry->nodeId, nodeId)) ||
+           (sessionId && UA_NodeId_equal(&entry->sessionId, sessionId))) {
+            *cv = entry->next;
+            cache->entries--;
+            CachedValue_delete(entry);
+            continue;
+        }
+        cv = &entry->next;
+    }
+}
+
+void
+UA_Server_removeCachedValue(UA_Server *server, const UA_NodeId *nodeId) {
+    UA_ValueCache *cache = &server->valueCache;
+    UA_VALUECACHE_LOCK(cache);
+    /* The entries of all sessions are in the bucket of the node */
+    if(cache->bucketsSize > 0) {
+        UA_UInt32 hash = UA_NodeId_hash(nodeId);
+        ValueCache_removeChain(cache, &cache->buckets[hash & (cache->bucketsSize - 1)],
+                               nodeId, NULL);
+    }
+    UA_VALUECACHE_UNLOCK(cache);
+}
+
+void
+UA_Server_removeSessionCachedValues(UA_Server *server, const UA_NodeId *sessionId) {
+    UA_ValueCache *cache = &server->valueCache;
+    UA_VALUECACHE_LOCK(cache);
+    for(size_t i = 0; i < cache->bucketsSize && cache->entries > 0; i++)
+        ValueCache_removeChain(cache, &cache->buckets[i], NULL, sessionId);
+    UA_VALUECACHE_UNLOCK(cache);
+}
+
 /****************/
 /* Read Service */
 /****************/
@@ -135,19 +407,46 @@ static UA_StatusCode
 readValueAttributeFromDataSource(UA_Server *server, UA_Session *session,
                                  const UA_VariableNode *vn, UA_DataValue *v,
                                  UA_TimestampsToReturn timestamps,
-                                 UA_NumericRange *rangeptr) {
-    if(!vn->value.dataSource.read)
-        return UA_STATUSCODE_BADINTERNALERROR;
+                                 UA_NumericRange *rangeptr, UA_Double maxAge) {
     UA_Boolean sourceTimeStamp = (timestamps == UA_TIMESTAMPSTORETURN_SOURCE ||
                                   timestamps == UA_TIMESTAMPSTORETURN_BOTH);
-    return vn->value.dataSource.read(server, &session->sessionId, session->sessionHandle,
-                                     &vn->nodeId, vn->context, sourceTimeStamp, rangeptr, v);
+
+    /* Serve the value from the cache if it is recent enough */
+    const UA_NodeId *cacheSession = cacheSessionId((const UA_Node*)vn, session);
+    if(readCachedValue(server, cacheSession, &vn->nodeId, maxAge,
+                       sourceTimeStamp, rangeptr, v))
+        return UA_STATUSCODE_GOOD;
+
+    UA_StatusCode retval;
+    if(vn->bulkDataSource) {
+        /* A batch with a single value */
+        UA_BulkReadValue brv;
+        brv.nodeId = &vn->nodeId;
+        brv.nodeContext = vn->context;
+        brv.range = rangeptr;
+        UA_DataValue_init(&brv.value);
+        retval = vn->bulkDataSource->read(server, vn->bulkDataSource, &session->sessionId,
+                                          session->sessionHandle, sourceTimeStamp, 1, &brv);
+        *v = brv.value;
+    } else {
+        if(!vn->value.dataSource.read)
+            return UA_STATUSCODE_BADINTERNALERROR;
+        retval = vn->value.dataSource.read(server, &session->sessionId,
+                                           session->sessionHandle, &vn->nodeId,
+                                           vn->context, sourceTimeStamp, rangeptr, v);
+    }
+
+    /* Only complete values are cached */
+    if(retval == UA_STATUSCODE_GOOD && !rangeptr)
+        cacheValue(server, cacheSession, &vn->nodeId, v, maxAge);
+    return retval;
 }
 
 static UA_StatusCode
 readValueAttributeComplete(UA_Server *server, UA_Session *session,
                            const UA_VariableNode *vn, UA_TimestampsToReturn timestamps,
-                           const UA_String *indexRange, UA_DataValue *v) {
+                           const UA_String *indexRange, UA_Double maxAge,
+                           UA_DataValue *v) {
     /* Compute the index range */
     UA_NumericRange range;
     UA_NumericRange *rangeptr = NULL;
@@ -163,7 +462,8 @@ readValueAttributeComplete(UA_Server *server, UA_Session *session,
     if(vn->valueSource == UA_VALUESOURCE_DATA)
         retval = readValueAttributeFromNode(server, session, vn, v, rangeptr);
     else
-        retval = readValueAttributeFromDataSource(server, session, vn, v, timestamps, rangeptr);
+        retval = readValueAttributeFromDataSource(server, session, vn, v, timestamps,
+                                                  rangeptr, maxAge);
 
     /* Clean up */
     if(rangeptr)
@@ -174,7 +474,8 @@ readValueAttributeComplete(UA_Server *server, UA_Session *session,
 UA_StatusCode
 readValueAttribute(UA_Server *server, UA_Session *session,
                    const UA_VariableNode *vn, UA_DataValue *v) {
-    return readValueAttributeComplete(server, session, vn, UA_TIMESTAMPSTORETURN_NEITHER, NULL, v);
+    return readValueAttributeComplete(server, session, vn, UA_TIMESTAMPSTORETURN_NEITHER,
+                                      NULL, 0.0, v);
 }
 
 static const UA_String binEncoding = {sizeof("Default Binary")-1, (UA_Byte*)"Default Binary"};
@@ -187,13 +488,31 @@ static const UA_String jsonEncoding = {sizeof("Default JSON")-1, (UA_Byte*)"Defa
         break;                                                  \
     }
 
+/* The access to a value variable is granted via the AccessLevel and
+ * UserAccessLevel attributes. VariableTypes don't have the AccessLevel
+ * concept. Always allow reading the value. */
+UA_StatusCode
+checkValueReadable(UA_Server *server, UA_Session *session, const UA_Node *node) {
+    if(node->nodeClass != UA_NODECLASS_VARIABLE)
+        return UA_STATUSCODE_GOOD;
+    UA_Byte accessLevel = getAccessLevel(server, session, (const UA_VariableNode*)node);
+    if(!(accessLevel & (UA_ACCESSLEVELMASK_READ)))
+        return UA_STATUSCODE_BADNOTREADABLE;
+    accessLevel = getUserAccessLevel(server, session, (const UA_VariableNode*)node);
+    if(!(accessLevel & (UA_ACCESSLEVELMASK_READ)))
+        return UA_STATUSCODE_BADUSERACCESSDENIED;
+    return UA_STATUSCODE_GOOD;
+}
+
 /* Returns a datavalue that may point into the node via the
  * UA_VARIANT_DATA_NODELETE tag. Don't access the returned DataValue once the
- * node has been released! */
+ * node has been released! If the value was prefetched from a bulk data
+ * source, then the value is taken from there. */
 static void
-Read(const UA_Node *node, UA_Server *server, UA_Session *session,
-     UA_TimestampsToReturn timestampsToReturn,
-     const UA_ReadValueId *id, UA_DataValue *v) {
+Read(UA_Server *server, UA_Session *session, UA_TimestampsToReturn timestampsToReturn,
+     UA_ReadOperation *op, UA_DataValue *v) {
+    const UA_Node *node = op->node;
+    const UA_ReadValueId *id = &op->id;
     UA_LOG_DEBUG_SESSION(server->config.logger, session,
                          "Read the attribute %i", id->attributeId);
 
@@ -266,24 +585,19 @@ Read(const UA_Node *node, UA_Server *server, UA_Session *session,
         break;
     case UA_ATTRIBUTEID_VALUE: {
         CHECK_NODECLASS(UA_NODECLASS_VARIABLE | UA_NODECLASS_VARIABLETYPE);
-        /* VariableTypes don't have the AccessLevel concept. Always allow reading the value. */
-        if(node->nodeClass == UA_NODECLASS_VARIABLE) {
-            /* The access to a value variable is granted via the AccessLevel
-             * and UserAccessLevel attributes */
-            UA_Byte accessLevel = getAccessLevel(server, session, (const UA_VariableNode*)node);
-            if(!(accessLevel & (UA_ACCESSLEVELMASK_READ))) {
-                retval = UA_STATUSCODE_BADNOTREADABLE;
-                break;
-            }
-            accessLevel = getUserAccessLevel(server, session,
-                                             (const UA_VariableNode*)node);
-            if(!(accessLevel & (UA_ACCESSLEVELMASK_READ))) {
-                retval = UA_STATUSCODE_BADUSERACCESSDENIED;
-                break;
-            }
+        if(op->prefetched) {
+            /* Access was checked before prefetching. Move the value. */
+            *v = op->prefetchedValue;
+            op->prefetched = false;
+            retval = op->prefetchResult;
+            break;
         }
+        retval = checkValueReadable(server, session, node);
+        if(retval != UA_STATUSCODE_GOOD)
+            break;
         retval = readValueAttributeComplete(server, session, (const UA_VariableNode*)node,
-                                            timestampsToReturn, &id->indexRange, v);
+                                            timestampsToReturn, &id->indexRange,
+                                            op->maxAge, v);
         break;
     }
     case UA_ATTRIBUTEID_DATATYPE:
@@ -365,29 +679,271 @@ Read(const UA_Node *node, UA_Server *server, UA_Session *session,
     }
 }
 
-static UA_StatusCode
-Operation_Read(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
-               UA_TimestampsToReturn timestampsToReturn, const UA_ReadValueId *id) {
+/* Read the values of a batch of prepared operations on the same bulk data
+ * source. The indices of the operations are in ids. */
+static void
+readBulkBatch(UA_Server *server, UA_Session *session, UA_BulkDataSource *source,
+              UA_Boolean includeSourceTimeStamp, UA_ReadOperation *ops,
+              size_t *ids, UA_BulkReadValue *values, UA_NumericRange *ranges,
+              size_t batchSize) {
+    /* Parse the index ranges. Operations with an invalid range are not part
+     * of the batch. */
+    size_t valuesSize = 0;
+    for(size_t i = 0; i < batchSize; i++) {
+        UA_ReadOperation *op = &ops[ids[i]];
+        UA_BulkReadValue *brv = &values[valuesSize];
+        brv->range = NULL;
+        if(op->id.indexRange.length > 0) {
+            UA_StatusCode retval =
+                UA_NumericRange_parseFromString(&ranges[valuesSize], &op->id.indexRange);
+            if(retval != UA_STATUSCODE_GOOD) {
+                op->prefetched = true;
+                op->prefetchResult = retval;
+                continue;
+            }
+            brv->range = &ranges[valuesSize];
+        }
+        /* Served from the cache */
+        if(readCachedValue(server, cacheSessionId(op->node, session),
+                           &op->node->nodeId, op->maxAge,
+                           includeSourceTimeStamp, brv->range, &op->prefetchedValue)) {
+            op->prefetched = true;
+            op->prefetchResult = UA_STATUSCODE_GOOD;
+            if(brv->range)
+                UA_free(ranges[valuesSize].dimensions);
+            continue;
+        }
+        brv->nodeId = &op->node->nodeId;
+        brv->nodeContext = op->node->context;
+        UA_DataValue_init(&brv->value);
+        ids[valuesSize] = ids[i];
+        valuesSize++;
+    }
+    if(valuesSize == 0)
+        return;
+
+    /* Call the data source once for the batch */
+    UA_StatusCode retval =
+        source->read(server, source, &session->sessionId, session->sessionHandle,
+                     includeSourceTimeStamp, valuesSize, values);
+
+    /* Move the values into the operations */
+    for(size_t i = 0; i < valuesSize; i++) {
+        UA_ReadOperation *op = &ops[ids[i]];
+        op->prefetched = true;
+        op->prefetchResult = retval;
+        if(retval == UA_STATUSCODE_GOOD) {
+            op->prefetchedValue = values[i].value;
+            if(!values[i].range)
+                cacheValue(server, cacheSessionId(op->node, session),
+                           &op->node->nodeId, &op->prefetchedValue, op->maxAge);
+        } else {
+            /* The source may have filled some values before failing */
+            UA_DataValue_deleteMembers(&values[i].value);
+        }
+        if(values[i].range)
+            UA_free(values[i].range->dimensions);
+    }
+}
+
+void
+Read_prepare(UA_Server *server, UA_Session *session,
+             UA_Boolean includeSourceTimeStamp,
+             UA_ReadOperation *ops, size_t opsSize) {
+    /* Get the nodes and find the values that are read from a bulk data
+     * source */
+    size_t bulkSize = 0;
+    for(size_t i = 0; i < opsSize; i++) {
+        UA_ReadOperation *op = &ops[i];
+        op->node = UA_Nodestore_get(server, &op->id.nodeId);
+        op->bulkDataSource = NULL;
+        op->prefetched = false;
+        UA_DataValue_init(&op->prefetchedValue);
+        if(!op->node || op->node->nodeClass != UA_NODECLASS_VARIABLE ||
+           op->id.attributeId != UA_ATTRIBUTEID_VALUE)
+            continue;
+        const UA_VariableNode *vn = (const UA_VariableNode*)op->node;
+        if(vn->valueSource != UA_VALUESOURCE_DATASOURCE || !vn->bulkDataSource)
+            continue;
+        /* Don't read values from the source that cannot be returned. The
+         * operation returns the error when it is performed. */
+        if(checkValueReadable(server, session, op->node) != UA_STATUSCODE_GOOD)
+            continue;
+        op->bulkDataSource = vn->bulkDataSource;
+        bulkSize++;
+    }
+    if(bulkSize == 0)
+        return;
+
+    /* Allocate the batch. Without memory, the operations read individually
+     * from the bulk data source when they are performed. */
+    size_t *ids = (size_t*)UA_malloc(sizeof(size_t) * bulkSize);
+    UA_BulkReadValue *values = (UA_BulkReadValue*)
+        UA_malloc(sizeof(UA_BulkReadValue) * bulkSize);
+    UA_NumericRange *ranges = (UA_NumericRange*)
+        UA_malloc(sizeof(UA_NumericRange) * bulkSize);
+    if(!ids || !values || !ranges)
+        goto cleanup;
+
+    /* Call every bulk data source once with the operations that use it */
+    for(size_t i = 0; i < opsSize; i++) {
+        UA_BulkDataSource *source = ops[i].bulkDataSource;
+        if(!source)
+            continue;
+        size_t batchSize = 0;
+        for(size_t j = i; j < opsSize; j++) {
+            if(ops[j].bulkDataSource != source)
+                continue;
+            ops[j].bulkDataSource = NULL;
+            ids[batchSize] = j;
+            batchSize++;
+        }
+        readBulkBatch(server, session, source, includeSourceTimeStamp,
+                      ops, ids, values, ranges, batchSize);
+    }
+
+ cleanup:
+    UA_free(ids);
+    UA_free(values);
+    UA_free(ranges);
+}
+
+void
+Read_perform(UA_Server *server, UA_Session *session,
+             UA_TimestampsToReturn timestampsToReturn,
+             UA_ReadOperation *op, UA_DataValue *v) {
+    if(!op->node) {
+        v->hasStatus = true;
+        v->status = UA_STATUSCODE_BADNODEIDUNKNOWN;
+        return;
+    }
+    Read(server, session, timestampsToReturn, op, v);
+}
+
+void
+Read_release(UA_Server *server, UA_ReadOperation *op) {
+    /* The prefetched value was not used */
+    if(op->prefetched) {
+        UA_DataValue_deleteMembers(&op->prefetchedValue);
+        op->prefetched = false;
+    }
+    if(op->node) {
+        UA_Nodestore_release(server, op->node);
+        op->node = NULL;
+    }
+}
+
+UA_DataValue
+Read_performCopy(UA_Server *server, UA_Session *session,
+                 UA_TimestampsToReturn timestampsToReturn,
+                 UA_ReadOperation *op) {
     UA_DataValue dv;
     UA_DataValue_init(&dv);
+    Read_perform(server, session, timestampsToReturn, op, &dv);
+
+    /* Do we have to copy the result before releasing the node? */
+    if(dv.hasValue && dv.value.storageType == UA_VARIANT_DATA_NODELETE) {
+        UA_DataValue dv2;
+        UA_StatusCode retval = UA_DataValue_copy(&dv, &dv2);
+        if(retval == UA_STATUSCODE_GOOD) {
+            dv = dv2;
+        } else {
+            UA_DataValue_init(&dv);
+            dv.hasStatus = true;
+            dv.status = retval;
+        }
+    }
 
-    /* Get the node */
-    const UA_Node *node = UA_Nodestore_get(server, &id->nodeId);
+    Read_release(server, op);
+    return dv;
+}
 
-    /* Perform the read operation */
-    if(node) {
-        Read(node, server, session, timestampsToReturn, id, &dv);
+typedef struct {
+    UA_Session *session;
+    UA_TimestampsToReturn timestampsToReturn;
+    UA_ReadOperation *ops;
+    UA_DataValue *results;
+} UA_ReadRange;
+
+static void
+readRange(UA_Server *server, UA_ReadRange *rr, size_t start, size_t end) {
+    for(size_t i = start; i < end; i++) {
+        UA_DataValue_init(&rr->results[i]);
+        Read_perform(server, rr->session, rr->timestampsToReturn,
+                     &rr->ops[i], &rr->results[i]);
+    }
+}
+
+/* Prepare all operations of the request together. So the values of every bulk
+ * data source are read with a single call. With parallel, the operations are
+ * evaluated by several workers and the results are encoded in order
+ * afterwards. */
+static UA_StatusCode
+readPrepared(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+             const UA_ReadRequest *request, UA_ReadOperation *ops,
+             UA_Boolean parallel) {
+    size_t opsSize = request->nodesToReadSize;
+    for(size_t i = 0; i < opsSize; i++) {
+        ops[i].id = request->nodesToRead[i];
+        ops[i].maxAge = request->maxAge;
+    }
+    UA_Boolean sourceTimeStamp =
+        (request->timestampsToReturn == UA_TIMESTAMPSTORETURN_SOURCE ||
+         request->timestampsToReturn == UA_TIMESTAMPSTORETURN_BOTH);
+    Read_prepare(server, session, sourceTimeStamp, ops, opsSize);
+
+    UA_DataValue *results = NULL;
+    if(parallel)
+        results = (UA_DataValue*)UA_malloc(sizeof(UA_DataValue) * opsSize);
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(results) {
+        UA_ReadRange rr = {session, request->timestampsToReturn, ops, results};
+        UA_Server_parallelFor(server, opsSize, (UA_ParallelCallback)readRange, &rr);
+        for(size_t i = 0; i < opsSize; i++) {
+            if(retval == UA_STATUSCODE_GOOD)
+                retval = UA_MessageContext_encode(mc, &results[i],
+                                                  &UA_TYPES[UA_TYPES_DATAVALUE]);
+            UA_Variant_deleteMembers(&results[i].value);
+        }
+        UA_free(results);
     } else {
-        dv.hasStatus = true;
-        dv.status = UA_STATUSCODE_BADNODEIDUNKNOWN;
+        /* Encode the results in order */
+        for(size_t i = 0; i < opsSize && retval == UA_STATUSCODE_GOOD; i++) {
+            UA_DataValue dv;
+            UA_DataValue_init(&dv);
+            Read_perform(server, session, request->timestampsToReturn, &ops[i], &dv);
+            retval = UA_MessageContext_encode(mc, &dv, &UA_TYPES[UA_TYPES_DATAVALUE]);
+            UA_Variant_deleteMembers(&dv.value);
+        }
     }
 
+    for(size_t i = 0; i < opsSize; i++)
+        Read_release(server, &ops[i]);
+    return retval;
+}
+
+static UA_StatusCode
+Operation_Read(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+               UA_TimestampsToReturn timestampsToReturn, UA_Double maxAge,
+               const UA_ReadValueId *id) {
+    UA_ReadOperation op;
+    memset(&op, 0, sizeof(UA_ReadOperation));
+    op.id = *id;
+    op.maxAge = maxAge;
+    op.node = UA_Nodestore_get(server, &id->nodeId);
+
+    /* Perform the read operation */
+    UA_DataValue dv;
+    UA_DataValue_init(&dv);
+    Read_perform(server, session, timestampsToReturn, &op, &dv);
+
     /* Encode (and send) the results */
     UA_StatusCode retval = UA_MessageContext_encode(mc, &dv, &UA_TYPES[UA_TYPES_DATAVALUE]);
 
     /* Free copied data and release the node */
     UA_Variant_deleteMembers(&dv.value);
-    UA_Nodestore_release(server, node);
+    Read_release(server, &op);
     return retval;
 }
 
@@ -428,11 +984,24 @@ UA_StatusCode Service_Read(UA_Server *server, UA_Session *session, UA_MessageCon
     if(retval != UA_STATUSCODE_GOOD)
         return retval;
 
-    for(UA_Int32 i = 0; i < arraySize; i++) {
-        retval = Operation_Read(server, session, mc, request->timestampsToReturn,
-                                &request->nodesToRead[i]);
+    /* Batch the reads from bulk data sources if they are in use. Large
+     * requests are split up between the worker threads. */
+    UA_Boolean parallel = UA_Server_parallelOperations(server, (size_t)arraySize);
+    UA_ReadOperation *ops = NULL;
+    if((server->bulkDataSourceSet || parallel) && arraySize > 0)
+        ops = (UA_ReadOperation*)UA_malloc(sizeof(UA_ReadOperation) * (size_t)arraySize);
+    if(ops) {
+        retval = readPrepared(server, session, mc, request, ops, parallel);
+        UA_free(ops);
         if(retval != UA_STATUSCODE_GOOD)
             return retval;
+    } else {
+        for(UA_Int32 i = 0; i < arraySize; i++) {
+            retval = Operation_Read(server, session, mc, request->timestampsToReturn,
+                                    request->maxAge, &request->nodesToRead[i]);
+            if(retval != UA_STATUSCODE_GOOD)
+                return retval;
+        }
     }
 
     /* Don't return any DiagnosticInfo */
@@ -444,36 +1013,11 @@ UA_DataValue
 UA_Server_readWithSession(UA_Server *server, UA_Session *session,
                           const UA_ReadValueId *item,
                           UA_TimestampsToReturn timestampsToReturn) {
-    UA_DataValue dv;
-    UA_DataValue_init(&dv);
-
-    /* Get the node */
-    const UA_Node *node = UA_Nodestore_get(server, &item->nodeId);
-    if(!node) {
-        dv.hasStatus = true;
-        dv.status = UA_STATUSCODE_BADNODEIDUNKNOWN;
-        return dv;
-    }
-
-    /* Perform the read operation */
-    Read(node, server, session, timestampsToReturn, item, &dv);
-
-    /* Do we have to copy the result before releasing the node? */
-    if(dv.hasValue && dv.value.storageType == UA_VARIANT_DATA_NODELETE) {
-        UA_DataValue dv2;
-        UA_StatusCode retval = UA_DataValue_copy(&dv, &dv2);
-        if(retval == UA_STATUSCODE_GOOD) {
-            dv = dv2;
-        } else {
-            UA_DataValue_init(&dv);
-            dv.hasStatus = true;
-            dv.status = retval;
-        }
-    }
-
-    /* Release the node and return */
-    UA_Nodestore_release(server, node);
-    return dv;
+    UA_ReadOperation op;
+    memset(&op, 0, sizeof(UA_ReadOperation));
+    op.id = *item;
+    op.node = UA_Nodestore_get(server, &item->nodeId);
+    return Read_performCopy(server, session, timestampsToReturn, &op);
 }
 
 /* Exposes the Read service to local users */
@@ -562,12 +1106,12 @@ compatibleDataType(UA_Server *server, const UA_NodeId *dataType,
         return true;
 
     /* Is the value-type a subtype of the required type? */
-    if(isNodeInTree(&server->config.nodestore, dataType, constraintDataType, &subtypeId, 1))
+    if(isDataTypeSubtype(server, dataType, constraintDataType))
         return true;
 
     /* Enum allows Int32 (only) */
     if(UA_NodeId_equal(dataType, &UA_TYPES[UA_TYPES_INT32].typeId) &&
-       isNodeInTree(&server->config.nodestore, constraintDataType, &enumNodeId, &subtypeId, 1))
+       isDataTypeSubtype(server, constraintDataType, &enumNodeId))
         return true;
 
     /* More checks for the data type of real values (variants) */
@@ -579,8 +1123,7 @@ compatibleDataType(UA_Server *server, const UA_NodeId *dataType,
         if(dataType->namespaceIndex == 0 &&
            dataType->identifierType == UA_NODEIDTYPE_NUMERIC &&
            dataType->identifier.numeric <= 25 &&
-           isNodeInTree(&server->config.nodestore, constraintDataType,
-                        dataType, &subtypeId, 1))
+           isDataTypeSubtype(server, constraintDataType, dataType))
             return true;
     }
 
@@ -1056,6 +1599,7 @@ writeValueAttribute(UA_Server *server, UA_Session *session,
             retval = node->value.dataSource.write(server, &session->sessionId,
                                                   session->sessionHandle, &node->nodeId,
                                                   node->context, rangeptr, &adjustedValue);
+            UA_Server_removeCachedValue(server, &node->nodeId);
         } else {
             retval = UA_STATUSCODE_BADWRITENOTSUPPORTED;
         }
@@ -1286,11 +1830,19 @@ copyAttributeIntoNode(UA_Server *server, UA_Session *session,
     return retval;
 }
 
+/* The context is non-NULL if the written nodes are sampled after all
+ * operations. Sampling enqueues into the subscriptions and cannot run in the
+ * workers of a parallel Write. */
 static void
 Operation_Write(UA_Server *server, UA_Session *session, void *context,
                 UA_WriteValue *wv, UA_StatusCode *result) {
     *result = UA_Server_editNode(server, session, &wv->nodeId,
                         (UA_EditNodeCallback)copyAttributeIntoNode, wv);
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    if(!context && *result == UA_STATUSCODE_GOOD &&
+       wv->attributeId == UA_ATTRIBUTEID_VALUE)
+        UA_Server_sampleWrittenNode(server, &wv->nodeId);
+#endif
 }
 
 void
@@ -1306,10 +1858,24 @@ Service_Write(UA_Server *server, UA_Session *session,
         return;
     }
 
+    UA_Boolean sampleAfter = UA_Server_parallelOperations(server, request->nodesToWriteSize);
     response->responseHeader.serviceResult =
-        UA_Server_processServiceOperations(server, session, (UA_ServiceOperation)Operation_Write, NULL,
-                                           &request->nodesToWriteSize, &UA_TYPES[UA_TYPES_WRITEVALUE],
-                                           &response->resultsSize, &UA_TYPES[UA_TYPES_STATUSCODE]);
+        UA_Server_processServiceOperationsParallel(server, session, (UA_ServiceOperation)Operation_Write,
+                                                   sampleAfter ? &sampleAfter : NULL,
+                                                   &request->nodesToWriteSize, &UA_TYPES[UA_TYPES_WRITEVALUE],
+                                                   &response->resultsSize, &UA_TYPES[UA_TYPES_STATUSCODE]);
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    /* Sample the written nodes in the calling thread */
+    if(!sampleAfter || response->resultsSize != request->nodesToWriteSize)
+        return;
+    for(size_t i = 0; i < request->nodesToWriteSize; i++) {
+        const UA_WriteValue *wv = &request->nodesToWrite[i];
+        if(response->results[i] == UA_STATUSCODE_GOOD &&
+           wv->attributeId == UA_ATTRIBUTEID_VALUE)
+            UA_Server_sampleWrittenNode(server, &wv->nodeId);
+    }
+#endif
 }
 
 UA_StatusCode
@@ -1319,6 +1885,10 @@ UA_Server_write(UA_Server *server, const UA_WriteValue *value) {
                   (UA_EditNodeCallback)copyAttributeIntoNode,
                    /* casting away const qualifier because callback uses const anyway */
                    (UA_WriteValue *)(uintptr_t)value);
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    if(retval == UA_STATUSCODE_GOOD && value->attributeId == UA_ATTRIBUTEID_VALUE)
+        UA_Server_sampleWrittenNode(server, &value->nodeId);
+#endif
     return retval;
 }
 
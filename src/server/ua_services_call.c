@@ -105,13 +105,22 @@ validMethodArguments(UA_Server *server, const UA_MethodNode *method,
     return retval;
 }
 
+/* Method nodes marked as async are not executed within the Call service. The
+ * operation is queued for the application and the response is deferred. */
+typedef struct {
+    UA_UInt32 requestId;
+    const UA_CallRequest *request;
+    UA_CallResponse *response;
+    UA_AsyncResponse *asyncResponse; /* Created for the first async method */
+} UA_CallContext;
+
 static const UA_NodeId hasComponentNodeId = {0, UA_NODEIDTYPE_NUMERIC, {UA_NS0ID_HASCOMPONENT}};
-static const UA_NodeId hasSubTypeNodeId = {0, UA_NODEIDTYPE_NUMERIC, {UA_NS0ID_HASSUBTYPE}};
 
 static void
 callWithMethodAndObject(UA_Server *server, UA_Session *session,
-                        const UA_CallMethodRequest *request, UA_CallMethodResult *result,
-                        const UA_MethodNode *method, const UA_ObjectNode *object) {
+                        UA_CallContext *cc, const UA_CallMethodRequest *request,
+                        UA_CallMethodResult *result, const UA_MethodNode *method,
+                        const UA_ObjectNode *object) {
     /* Verify the object's NodeClass */
     if(object->nodeClass != UA_NODECLASS_OBJECT &&
        object->nodeClass != UA_NODECLASS_OBJECTTYPE) {
@@ -140,8 +149,7 @@ callWithMethodAndObject(UA_Server *server, UA_Session *session,
         UA_NodeReferenceKind *rk = &object->references[i];
         if(rk->isInverse)
             continue;
-        if(!isNodeInTree(&server->config.nodestore, &rk->referenceTypeId,
-                         &hasComponentNodeId, &hasSubTypeNodeId, 1))
+        if(!isReferenceTypeSubtype(server, &rk->referenceTypeId, &hasComponentNodeId))
             continue;
         for(size_t j = 0; j < rk->targetIdsSize; ++j) {
             if(UA_NodeId_equal(&rk->targetIds[j].nodeId, &request->methodId)) {
@@ -173,6 +181,17 @@ callWithMethodAndObject(UA_Server *server, UA_Session *session,
     if(result->statusCode != UA_STATUSCODE_GOOD)
         return;
 
+    /* Queue the call for the application. The result is set later. */
+    if(method->async && cc) {
+        result->statusCode =
+            UA_AsyncManager_createOperation(server, session, &cc->asyncResponse,
+                                            cc->requestId, &cc->request->requestHeader,
+                                            &UA_TYPES[UA_TYPES_CALLRESPONSE],
+                                            UA_ASYNCOPERATIONTYPE_CALL, request,
+                                            (size_t)(result - cc->response->results));
+        return;
+    }
+
     /* Get the output arguments node */
     const UA_VariableNode *outputArguments =
         getArgumentsVariableNode(server, method, UA_STRING("OutputArguments"));
@@ -205,7 +224,7 @@ callWithMethodAndObject(UA_Server *server, UA_Session *session,
 }
 
 static void
-Operation_CallMethod(UA_Server *server, UA_Session *session, void *context,
+Operation_CallMethod(UA_Server *server, UA_Session *session, UA_CallContext *cc,
                      const UA_CallMethodRequest *request, UA_CallMethodResult *result) {
     /* Get the method node */
     const UA_MethodNode *method = (const UA_MethodNode*)
@@ -228,7 +247,7 @@ Operation_CallMethod(UA_Server *server, UA_Session *session, void *context,
     }
 
     /* Continue with method and object as context */
-    callWithMethodAndObject(server, session, request, result, method, object);
+    callWithMethodAndObject(server, session, cc, request, result, method, object);
 
     /* Release the method and object node */
     server->config.nodestore.releaseNode(server->config.nodestore.context,
@@ -237,22 +256,30 @@ Operation_CallMethod(UA_Server *server, UA_Session *session, void *context,
                                          (const UA_Node*)object);
 }
 
-void Service_Call(UA_Server *server, UA_Session *session,
-                  const UA_CallRequest *request,
-                  UA_CallResponse *response) {
+UA_Boolean
+Service_Call(UA_Server *server, UA_Session *session, UA_UInt32 requestId,
+             const UA_CallRequest *request, UA_CallResponse *response) {
     UA_LOG_DEBUG_SESSION(server->config.logger, session,
                          "Processing CallRequest");
 
     if(server->config.maxNodesPerMethodCall != 0 &&
        request->methodsToCallSize > server->config.maxNodesPerMethodCall) {
         response->responseHeader.serviceResult = UA_STATUSCODE_BADTOOMANYOPERATIONS;
-        return;
+        return false;
     }
 
+    UA_CallContext cc = {requestId, request, response, NULL};
     response->responseHeader.serviceResult =
-        UA_Server_processServiceOperations(server, session, (UA_ServiceOperation)Operation_CallMethod, NULL,
-                                           &request->methodsToCallSize, &UA_TYPES[UA_TYPES_CALLMETHODREQUEST],
-                                           &response->resultsSize, &UA_TYPES[UA_TYPES_CALLMETHODRESULT]);
+        UA_Server_processServiceOperationsParallel(server, session, (UA_ServiceOperation)Operation_CallMethod, &cc,
+                                                   &request->methodsToCallSize, &UA_TYPES[UA_TYPES_CALLMETHODREQUEST],
+                                                   &response->resultsSize, &UA_TYPES[UA_TYPES_CALLMETHODRESULT]);
+    if(!cc.asyncResponse)
+        return false;
+
+    /* Some methods are executed by the application. The response is sent once
+     * their results are set. */
+    UA_AsyncManager_deferResponse(server, cc.asyncResponse, response);
+    return true;
 }
 
 UA_CallMethodResult UA_EXPORT
@@ -145,8 +145,7 @@ checkParentReference(UA_Server *server, UA_Session *session, UA_NodeClass nodeCl
     /* Test if the referencetype is hierarchical */
     const UA_NodeId hierarchicalReference =
         UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
-    if(!isNodeInTree(&server->config.nodestore, referenceTypeId,
-                     &hierarchicalReference, &subtypeId, 1)) {
+    if(!isReferenceTypeSubtype(server, referenceTypeId, &hierarchicalReference)) {
         UA_LOG_INFO_SESSION(server->config.logger, session,
                             "AddNodes: Reference type is not hierarchical");
         return UA_STATUSCODE_BADREFERENCETYPEIDINVALID;
@@ -948,6 +947,9 @@ AddNode_raw(UA_Server *server, UA_Session *session, void *nodeContext,
         }
     }
 
+    /* The node may come with HasSubtype references already set */
+    UA_Server_invalidateTypeHierarchyCache(server, node->nodeClass);
+
     /* Add the node to the nodestore */
     retval = UA_Nodestore_insert(server, node, outNewNodeId);
     if(retval != UA_STATUSCODE_GOOD)
@@ -1287,6 +1289,9 @@ deleteNodeOperation(UA_Server *server, UA_Session *session, void *context,
 
     deconstructNode(server, session, node);
     removeDeconstructedNode(server, session, node, item->deleteTargetReferences);
+    UA_Server_invalidateTypeHierarchyCache(server, node->nodeClass);
+    if(node->nodeClass == UA_NODECLASS_VARIABLE)
+        UA_Server_removeCachedValue(server, &node->nodeId);
     UA_Nodestore_release(server, node);
 }
 
@@ -1326,12 +1331,16 @@ UA_Server_deleteNode(UA_Server *server, const UA_NodeId nodeId,
 static UA_StatusCode
 addOneWayReference(UA_Server *server, UA_Session *session,
              UA_Node *node, const UA_AddReferencesItem *item) {
+    if(UA_NodeId_equal(&item->referenceTypeId, &subtypeId))
+        UA_Server_invalidateTypeHierarchyCache(server, node->nodeClass);
     return UA_Node_addReference(node, item);
 }
 
 static UA_StatusCode
 deleteOneWayReference(UA_Server *server, UA_Session *session, UA_Node *node,
                       const UA_DeleteReferencesItem *item) {
+    if(UA_NodeId_equal(&item->referenceTypeId, &subtypeId))
+        UA_Server_invalidateTypeHierarchyCache(server, node->nodeClass);
     return UA_Node_deleteReference(node, item);
 }
 
@@ -1523,10 +1532,16 @@ UA_StatusCode
 UA_Server_setVariableNode_valueCallback(UA_Server *server,
                                         const UA_NodeId nodeId,
                                         const UA_ValueCallback callback) {
-    return UA_Server_editNode(server, &adminSession, &nodeId,
-                              (UA_EditNodeCallback)setValueCallback,
-                              /* cast away const because callback uses const anyway */
-                              (UA_ValueCallback *)(uintptr_t) &callback);
+    UA_StatusCode retval =
+        UA_Server_editNode(server, &adminSession, &nodeId,
+                           (UA_EditNodeCallback)setValueCallback,
+                           /* cast away const because callback uses const anyway */
+                           (UA_ValueCallback *)(uintptr_t) &callback);
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    if(retval == UA_STATUSCODE_GOOD)
+        UA_Server_valueSourceChanged(server, &nodeId);
+#endif
+    return retval;
 }
 
 /***************************************************/
@@ -1592,16 +1607,55 @@ setDataSource(UA_Server *server, UA_Session *session,
         UA_DataValue_deleteMembers(&node->value.data.value);
     node->value.dataSource = *dataSource;
     node->valueSource = UA_VALUESOURCE_DATASOURCE;
+    node->bulkDataSource = NULL;
+    UA_Server_removeCachedValue(server, &node->nodeId);
     return UA_STATUSCODE_GOOD;
 }
 
 UA_StatusCode
 UA_Server_setVariableNode_dataSource(UA_Server *server, const UA_NodeId nodeId,
                                      const UA_DataSource dataSource) {
-    return UA_Server_editNode(server, &adminSession, &nodeId,
-                              (UA_EditNodeCallback)setDataSource,
-                            /* casting away const because callback casts it back anyway */
-                              (UA_DataSource *) (uintptr_t)&dataSource);
+    UA_StatusCode retval =
+        UA_Server_editNode(server, &adminSession, &nodeId,
+                           (UA_EditNodeCallback)setDataSource,
+                           /* casting away const because callback casts it back anyway */
+                           (UA_DataSource *) (uintptr_t)&dataSource);
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    if(retval == UA_STATUSCODE_GOOD)
+        UA_Server_valueSourceChanged(server, &nodeId);
+#endif
+    return retval;
+}
+
+static UA_StatusCode
+setBulkDataSource(UA_Server *server, UA_Session *session,
+                  UA_VariableNode* node, UA_BulkDataSource *bulkDataSource) {
+    /* Reads go to the bulk data source. Writes use the data source. */
+    UA_DataSource dataSource;
+    dataSource.read = NULL;
+    dataSource.write = bulkDataSource->write;
+    dataSource.sessionDependent = bulkDataSource->sessionDependent;
+    UA_StatusCode retval = setDataSource(server, session, node, &dataSource);
+    if(retval == UA_STATUSCODE_GOOD)
+        node->bulkDataSource = bulkDataSource;
+    return retval;
+}
+
+UA_StatusCode
+UA_Server_setVariableNode_bulkDataSource(UA_Server *server, const UA_NodeId nodeId,
+                                         UA_BulkDataSource *bulkDataSource) {
+    if(!bulkDataSource || !bulkDataSource->read)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    UA_StatusCode retval =
+        UA_Server_editNode(server, &adminSession, &nodeId,
+                           (UA_EditNodeCallback)setBulkDataSource, bulkDataSource);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    server->bulkDataSourceSet = true;
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    UA_Server_valueSourceChanged(server, &nodeId);
+#endif
+    return UA_STATUSCODE_GOOD;
 }
 
 /************************************/
@@ -1783,6 +1837,23 @@ UA_Server_setMethodNode_callback(UA_Server *server,
                               (void*)(uintptr_t)methodCallback);
 }
 
+static UA_StatusCode
+editMethodAsync(UA_Server *server, UA_Session* session,
+                UA_Node* node, void* handle) {
+    if(node->nodeClass != UA_NODECLASS_METHOD)
+        return UA_STATUSCODE_BADNODECLASSINVALID;
+    UA_MethodNode *mnode = (UA_MethodNode*) node;
+    mnode->async = *(UA_Boolean*)handle;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+UA_Server_setMethodNode_async(UA_Server *server, const UA_NodeId methodNodeId,
+                              UA_Boolean isAsync) {
+    return UA_Server_editNode(server, &adminSession, &methodNodeId,
+                              (UA_EditNodeCallback)editMethodAsync, &isAsync);
+}
+
 #endif
 
 /************************/
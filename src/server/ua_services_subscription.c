@@ -153,12 +153,150 @@ Service_SetPublishingMode(UA_Server *server, UA_Session *session,
                                            &response->resultsSize, &UA_TYPES[UA_TYPES_STATUSCODE]);
 }
 
-static void
+/* Deadbands are only allowed for variables of a numeric DataType. For the
+ * abstract BaseDataType, the type of the current value decides. */
+static UA_Boolean
+isNumericVariable(UA_Server *server, const UA_NodeId *nodeId) {
+    const UA_Node *node = UA_Nodestore_get(server, nodeId);
+    if(!node)
+        return false;
+    UA_NodeId dataType = UA_NODEID_NULL;
+    if(node->nodeClass == UA_NODECLASS_VARIABLE)
+        dataType = ((const UA_VariableNode*)node)->dataType;
+    UA_Nodestore_release(server, node);
+
+    const UA_NodeId number = UA_NODEID_NUMERIC(0, UA_NS0ID_NUMBER);
+    const UA_NodeId baseDataType = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATATYPE);
+    if(isDataTypeSubtype(server, &dataType, &number))
+        return true;
+    if(!UA_NodeId_equal(&dataType, &baseDataType))
+        return false;
+
+    UA_ReadValueId rvid;
+    UA_ReadValueId_init(&rvid);
+    rvid.nodeId = *nodeId;
+    rvid.attributeId = UA_ATTRIBUTEID_VALUE;
+    UA_DataValue v = UA_Server_readWithSession(server, &adminSession, &rvid,
+                                               UA_TIMESTAMPSTORETURN_NEITHER);
+    UA_Boolean numeric = (v.hasValue && v.value.type &&
+                          isDataTypeSubtype(server, &v.value.type->typeId, &number));
+    UA_DataValue_deleteMembers(&v);
+    return numeric;
+}
+
+/* Get the EURange property of an analog variable */
+static UA_StatusCode
+getEURange(UA_Server *server, const UA_NodeId *nodeId, UA_Range *range) {
+    static const UA_QualifiedName euRangeName = {0, {sizeof("EURange") - 1, (UA_Byte*)"EURange"}};
+    const UA_Node *node = UA_Nodestore_get(server, nodeId);
+    if(!node)
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+
+    /* Find the property with the browsename */
+    UA_NodeId propertyId = UA_NODEID_NULL;
+    UA_NodeId hasProperty = UA_NODEID_NUMERIC(0, UA_NS0ID_HASPROPERTY);
+    for(size_t i = 0; i < node->referencesSize && UA_NodeId_isNull(&propertyId); ++i) {
+        const UA_NodeReferenceKind *rk = &node->references[i];
+        if(rk->isInverse || !UA_NodeId_equal(&rk->referenceTypeId, &hasProperty))
+            continue;
+        for(size_t j = 0; j < rk->targetIdsSize; ++j) {
+            const UA_Node *property = UA_Nodestore_get(server, &rk->targetIds[j].nodeId);
+            if(!property)
+                continue;
+            UA_Boolean found = UA_QualifiedName_equal(&property->browseName, &euRangeName);
+            UA_Nodestore_release(server, property);
+            if(found) {
+                propertyId = rk->targetIds[j].nodeId;
+                break;
+            }
+        }
+    }
+    UA_Nodestore_release(server, node);
+    if(UA_NodeId_isNull(&propertyId))
+        return UA_STATUSCODE_BADMONITOREDITEMFILTERUNSUPPORTED;
+
+    /* Read the range */
+    UA_ReadValueId rvid;
+    UA_ReadValueId_init(&rvid);
+    rvid.nodeId = propertyId;
+    rvid.attributeId = UA_ATTRIBUTEID_VALUE;
+    UA_DataValue v = UA_Server_readWithSession(server, &adminSession, &rvid,
+                                               UA_TIMESTAMPSTORETURN_NEITHER);
+    UA_StatusCode retval = UA_STATUSCODE_BADMONITOREDITEMFILTERUNSUPPORTED;
+    if(v.hasValue && UA_Variant_hasScalarType(&v.value, &UA_TYPES[UA_TYPES_RANGE])) {
+        *range = *(UA_Range*)v.value.data;
+        retval = UA_STATUSCODE_GOOD;
+    }
+    UA_DataValue_deleteMembers(&v);
+    return retval;
+}
+
+/* Validate the filter and compute the absolute deadband */
+static UA_StatusCode
+checkDataChangeFilter(UA_Server *server, const UA_MonitoredItem *mon,
+                      const UA_DataChangeFilter *filter, UA_Double *deadband) {
+    *deadband = 0.0;
+    if(filter->trigger > UA_DATACHANGETRIGGER_STATUSVALUETIMESTAMP)
+        return UA_STATUSCODE_BADMONITOREDITEMFILTERINVALID;
+    if(filter->deadbandType == UA_DEADBANDTYPE_NONE)
+        return UA_STATUSCODE_GOOD;
+    if(mon->attributeId != UA_ATTRIBUTEID_VALUE ||
+       !isNumericVariable(server, &mon->monitoredNodeId))
+        return UA_STATUSCODE_BADFILTERNOTALLOWED;
+
+    UA_Double value = filter->deadbandValue;
+    if(value != value || value < 0.0) /* Check for nan */
+        return UA_STATUSCODE_BADDEADBANDFILTERINVALID;
+
+    if(filter->deadbandType == UA_DEADBANDTYPE_ABSOLUTE) {
+        *deadband = value;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    if(filter->deadbandType != UA_DEADBANDTYPE_PERCENT || value > 100.0)
+        return UA_STATUSCODE_BADDEADBANDFILTERINVALID;
+
+    /* The percent deadband is relative to the EURange of the variable. The
+     * range is looked up once when the filter is set. */
+    UA_Range range;
+    UA_StatusCode retval = getEURange(server, &mon->monitoredNodeId, &range);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    *deadband = (value / 100.0) * (range.high - range.low);
+    if(*deadband < 0.0)
+        *deadband = -*deadband;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
 setMonitoredItemSettings(UA_Server *server, UA_MonitoredItem *mon,
                          UA_MonitoringMode monitoringMode,
                          const UA_MonitoringParameters *params) {
+    /* Filter */
+    UA_DataChangeTrigger trigger = UA_DATACHANGETRIGGER_STATUSVALUE;
+    UA_Double deadband = 0.0;
+    if(params->filter.encoding == UA_EXTENSIONOBJECT_DECODED &&
+       params->filter.content.decoded.type == &UA_TYPES[UA_TYPES_DATACHANGEFILTER]) {
+        const UA_DataChangeFilter *filter = (const UA_DataChangeFilter *)
+            params->filter.content.decoded.data;
+        UA_StatusCode retval = checkDataChangeFilter(server, mon, filter, &deadband);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+        trigger = filter->trigger;
+    }
+
+    /* QueueSize and DiscardOldest. Reallocates the queue. */
+    UA_UInt32 queueSize;
+    UA_BOUNDEDVALUE_SETWBOUNDS(server->config.queueSizeLimits,
+                               params->queueSize, queueSize);
+    UA_StatusCode retval = MonitoredItem_setQueueSize(mon, queueSize, params->discardOldest);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
     MonitoredItem_unregisterSampleCallback(server, mon);
     mon->monitoringMode = monitoringMode;
+    mon->trigger = trigger;
+    mon->deadband = deadband;
 
     /* ClientHandle */
     mon->clientHandle = params->clientHandle;
@@ -184,26 +322,10 @@ setMonitoredItemSettings(UA_Server *server, UA_MonitoredItem *mon,
     if(samplingInterval != samplingInterval) /* Check for nan */
         mon->samplingInterval = server->config.samplingIntervalLimits.min;
 
-    /* Filter */
-    if(params->filter.encoding != UA_EXTENSIONOBJECT_DECODED ||
-       params->filter.content.decoded.type != &UA_TYPES[UA_TYPES_DATACHANGEFILTER]) {
-        /* Default: Trigger only on the value and the statuscode */
-        mon->trigger = UA_DATACHANGETRIGGER_STATUSVALUE;
-    } else {
-        UA_DataChangeFilter *filter = (UA_DataChangeFilter *)params->filter.content.decoded.data;
-        mon->trigger = filter->trigger;
-    }
-
-    /* QueueSize */
-    UA_BOUNDEDVALUE_SETWBOUNDS(server->config.queueSizeLimits,
-                               params->queueSize, mon->maxQueueSize);
-
-    /* DiscardOldest */
-    mon->discardOldest = params->discardOldest;
-
     /* Register sample callback if reporting is enabled */
     if(monitoringMode == UA_MONITORINGMODE_REPORTING)
         MonitoredItem_registerSampleCallback(server, mon);
+    return UA_STATUSCODE_GOOD;
 }
 
 static const UA_String binaryEncoding = {sizeof("Default Binary") - 1, (UA_Byte *)"Default Binary"};
@@ -276,10 +398,14 @@ Operation_CreateMonitoredItem(UA_Server *server, UA_Session *session, struct cre
     UA_String_copy(&request->itemToMonitor.indexRange, &newMon->indexRange);
     newMon->monitoredItemId = ++cmc->sub->lastMonitoredItemId;
     newMon->timestampsToReturn = cmc->timestampsToReturn;
-    setMonitoredItemSettings(server, newMon, request->monitoringMode,
-                             &request->requestedParameters);
-
     UA_Subscription_addMonitoredItem(cmc->sub, newMon);
+    retval = setMonitoredItemSettings(server, newMon, request->monitoringMode,
+                                      &request->requestedParameters);
+    if(retval != UA_STATUSCODE_GOOD) {
+        result->statusCode = retval;
+        UA_Subscription_deleteMonitoredItem(server, cmc->sub, newMon->monitoredItemId);
+        return;
+    }
 
     /* Create the first sample */
     if(request->monitoringMode == UA_MONITORINGMODE_REPORTING)
@@ -338,12 +464,14 @@ Operation_ModifyMonitoredItem(UA_Server *server, UA_Session *session, UA_Subscri
         return;
     }
 
-    setMonitoredItemSettings(server, mon, mon->monitoringMode, &request->requestedParameters);
+    UA_StatusCode retval = setMonitoredItemSettings(server, mon, mon->monitoringMode,
+                                                    &request->requestedParameters);
+    if(retval != UA_STATUSCODE_GOOD) {
+        result->statusCode = retval;
+        return;
+    }
     result->revisedSamplingInterval = mon->samplingInterval;
     result->revisedQueueSize = mon->maxQueueSize;
-
-    /* Remove some notifications if the queue is now too small */
-    MonitoredItem_ensureQueueSpace(mon);
 }
 
 void
@@ -417,19 +545,10 @@ Operation_SetMonitoringMode(UA_Server *server, UA_Session *session,
 
         // TODO correctly implement SAMPLING
         /*  Setting the mode to DISABLED or SAMPLING causes all queued Notifications to be deleted */
-        UA_Notification *notification, *notification_tmp;
-        TAILQ_FOREACH_SAFE(notification, &mon->queue, listEntry, notification_tmp) {
-            TAILQ_REMOVE(&mon->queue, notification, listEntry);
-            TAILQ_REMOVE(&smc->sub->notificationQueue, notification, globalEntry);
-            --smc->sub->notificationQueueSize;
-
-            UA_DataValue_deleteMembers(&notification->data.value);
-            UA_free(notification);
-        }
-        mon->queueSize = 0;
+        MonitoredItem_clearQueue(mon);
 
-        /* Initialize lastSampledValue */
-        UA_ByteString_deleteMembers(&mon->lastSampledValue);
+        /* The next sample is reported in any case */
+        MonitoredItem_resetLastValue(mon);
     }
 }
 
@@ -670,34 +789,37 @@ Service_DeleteMonitoredItems(UA_Server *server, UA_Session *session,
                   &response->resultsSize, &UA_TYPES[UA_TYPES_STATUSCODE]);
 }
 
-void
-Service_Republish(UA_Server *server, UA_Session *session, const UA_RepublishRequest *request,
-                  UA_RepublishResponse *response) {
+UA_StatusCode
+Service_Republish(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+                  const UA_RepublishRequest *request, UA_ResponseHeader *responseHeader) {
     UA_LOG_DEBUG_SESSION(server->config.logger, session, "Processing RepublishRequest");
 
-    /* Get the subscription */
+    /* Get the subscription and find the notification in the retransmission
+     * queue */
+    UA_NotificationMessageEntry *entry = NULL;
     UA_Subscription *sub = UA_Session_getSubscriptionById(session, request->subscriptionId);
-    if(!sub) {
-        response->responseHeader.serviceResult = UA_STATUSCODE_BADSUBSCRIPTIONIDINVALID;
-        return;
+    if(sub) {
+        /* Reset the subscription lifetime */
+        sub->currentLifetimeCount = 0;
+        entry = UA_Subscription_getRetransmissionMessage(sub, request->retransmitSequenceNumber);
+        if(!entry)
+            responseHeader->serviceResult = UA_STATUSCODE_BADMESSAGENOTAVAILABLE;
+    } else {
+        responseHeader->serviceResult = UA_STATUSCODE_BADSUBSCRIPTIONIDINVALID;
     }
 
-    /* Reset the subscription lifetime */
-    sub->currentLifetimeCount = 0;
+    UA_StatusCode retval =
+        UA_MessageContext_encode(mc, responseHeader, &UA_TYPES[UA_TYPES_RESPONSEHEADER]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
 
-    /* Find the notification in the retransmission queue  */
-    UA_NotificationMessageEntry *entry;
-    TAILQ_FOREACH(entry, &sub->retransmissionQueue, listEntry) {
-        if(entry->message.sequenceNumber == request->retransmitSequenceNumber)
-            break;
-    }
-    if(!entry) {
-        response->responseHeader.serviceResult = UA_STATUSCODE_BADMESSAGENOTAVAILABLE;
-        return;
-    }
+    /* Stream the retained encoding of the message */
+    if(entry)
+        return UA_MessageContext_encodeRaw(mc, &entry->encoded);
 
-    response->responseHeader.serviceResult =
-        UA_NotificationMessage_copy(&entry->message, &response->notificationMessage);
+    UA_NotificationMessage empty;
+    UA_NotificationMessage_init(&empty);
+    return UA_MessageContext_encode(mc, &empty, &UA_TYPES[UA_TYPES_NOTIFICATIONMESSAGE]);
 }
 
 #endif /* UA_ENABLE_SUBSCRIPTIONS */
@@ -19,100 +19,121 @@
 #include "ua_server_internal.h"
 #include "ua_services.h"
 
-/* Target node on top of the stack */
-static UA_StatusCode
-fillReferenceDescription(UA_Server *server, const UA_Node *curr,
-                         const UA_NodeReferenceKind *ref,
-                         UA_UInt32 mask, UA_ReferenceDescription *descr) {
+/* Shallow description of the reference to the target. Points into the nodes.
+ * The TypeDefinition node (if any) is returned in *type and has to be released
+ * after the description is used. */
+static void
+describeReference(UA_Server *server, const UA_Node *target,
+                  const UA_NodeReferenceKind *ref, UA_UInt32 mask,
+                  UA_ReferenceDescription *descr, const UA_Node **type) {
     UA_ReferenceDescription_init(descr);
-    UA_StatusCode retval = UA_NodeId_copy(&curr->nodeId, &descr->nodeId.nodeId);
+    *type = NULL;
+    descr->nodeId.nodeId = target->nodeId;
     if(mask & UA_BROWSERESULTMASK_REFERENCETYPEID)
-        retval |= UA_NodeId_copy(&ref->referenceTypeId, &descr->referenceTypeId);
+        descr->referenceTypeId = ref->referenceTypeId;
     if(mask & UA_BROWSERESULTMASK_ISFORWARD)
         descr->isForward = !ref->isInverse;
     if(mask & UA_BROWSERESULTMASK_NODECLASS)
-        retval |= UA_NodeClass_copy(&curr->nodeClass, &descr->nodeClass);
+        descr->nodeClass = target->nodeClass;
     if(mask & UA_BROWSERESULTMASK_BROWSENAME)
-        retval |= UA_QualifiedName_copy(&curr->browseName, &descr->browseName);
+        descr->browseName = target->browseName;
     if(mask & UA_BROWSERESULTMASK_DISPLAYNAME)
-        retval |= UA_LocalizedText_copy(&curr->displayName, &descr->displayName);
+        descr->displayName = target->displayName;
     if(mask & UA_BROWSERESULTMASK_TYPEDEFINITION) {
-        if(curr->nodeClass == UA_NODECLASS_OBJECT ||
-           curr->nodeClass == UA_NODECLASS_VARIABLE) {
-            const UA_Node *type = getNodeType(server, curr);
-            if(type) {
-                retval |= UA_NodeId_copy(&type->nodeId, &descr->typeDefinition.nodeId);
-                UA_Nodestore_release(server, type);
-            }
+        if(target->nodeClass == UA_NODECLASS_OBJECT ||
+           target->nodeClass == UA_NODECLASS_VARIABLE) {
+            *type = getNodeType(server, target);
+            if(*type)
+                descr->typeDefinition.nodeId = (*type)->nodeId;
         }
     }
-    return retval;
 }
 
 static void
-removeCp(ContinuationPointEntry *cp, UA_Session* session) {
-    LIST_REMOVE(cp, pointers);
+deleteCp(ContinuationPointEntry *cp) {
     UA_ByteString_deleteMembers(&cp->identifier);
     UA_BrowseDescription_deleteMembers(&cp->browseDescription);
     UA_free(cp);
+}
+
+static void
+removeCp(ContinuationPointEntry *cp, UA_Session* session) {
+    LIST_REMOVE(cp, pointers);
+    deleteCp(cp);
     ++session->availableContinuationPoints;
 }
 
+
 static UA_Boolean
 relevantReference(UA_Server *server, UA_Boolean includeSubtypes,
                   const UA_NodeId *rootRef, const UA_NodeId *testRef) {
     if(!includeSubtypes)
         return UA_NodeId_equal(rootRef, testRef);
 
-    const UA_NodeId hasSubType = UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE);
-    return isNodeInTree(&server->config.nodestore, testRef, rootRef, &hasSubType, 1);
+    return isReferenceTypeSubtype(server, testRef, rootRef);
 }
 
-/* Returns whether the node / continuationpoint is done */
-static UA_Boolean
-browseReferences(UA_Server *server, const UA_Node *node,
-                 ContinuationPointEntry *cp, UA_BrowseResult *result) {
-    UA_assert(cp != NULL);
-    const UA_BrowseDescription *descr = &cp->browseDescription;
+/* A target that matches the BrowseDescription. The target node is held until
+ * the result is delivered. */
+typedef struct {
+    const UA_Node *target;
+    const UA_NodeReferenceKind *rk;
+} UA_BrowseTarget;
+
+/* A single browse operation for Browse and BrowseNext. The ContinuationPoint
+ * contains all the data used. Including the BrowseDescription. The matching
+ * targets are collected before the result is encoded. So the size of the
+ * results is known before the first ReferenceDescription is encoded. */
+typedef struct {
+    ContinuationPointEntry *cp;
+    const UA_Node *node;
 
-    /* If the node has no references, just return */
-    if(node->referencesSize == 0) {
-        result->referencesSize = 0;
-        return true;;
-    }
+    UA_BrowseTarget *targets;
+    size_t targetsSize;
+    size_t targetsCapacity;
 
-    /* Follow all references? */
-    UA_Boolean browseAll = UA_NodeId_isNull(&descr->referenceTypeId);
+    /* Position behind the collected targets. Written to the ContinuationPoint
+     * only once the result is delivered. */
+    size_t referenceKindIndex;
+    size_t targetIndex;
+    UA_Boolean done; /* No references remain for a ContinuationPoint */
+} UA_BrowseOperation;
 
-    /* How many references can we return at most? */
-    size_t maxrefs = cp->maxReferences;
-    if(maxrefs == 0) {
-        if(server->config.maxReferencesPerNode != 0) {
-            maxrefs = server->config.maxReferencesPerNode;
-        } else {
-            maxrefs = UA_INT32_MAX;
-        }
-    } else {
-        if(server->config.maxReferencesPerNode != 0 && maxrefs > server->config.maxReferencesPerNode) {
-            maxrefs = server->config.maxReferencesPerNode;
-        }
-    }
+static UA_StatusCode
+addBrowseTarget(UA_BrowseOperation *op, const UA_Node *target,
+                const UA_NodeReferenceKind *rk) {
+    if(op->targetsSize >= op->targetsCapacity) {
+        size_t newCapacity = op->targetsCapacity * 2;
+        if(newCapacity == 0)
+            newCapacity = 16;
+        UA_BrowseTarget *targets = (UA_BrowseTarget*)
+            UA_realloc(op->targets, newCapacity * sizeof(UA_BrowseTarget));
+        if(!targets)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        op->targets = targets;
+        op->targetsCapacity = newCapacity;
+    }
+    op->targets[op->targetsSize].target = target;
+    op->targets[op->targetsSize].rk = rk;
+    op->targetsSize++;
+    return UA_STATUSCODE_GOOD;
+}
 
-    /* Allocate the results array */
-    size_t refs_size = 2; /* True size of the array */
-    result->references = (UA_ReferenceDescription*)
-        UA_Array_new(refs_size, &UA_TYPES[UA_TYPES_REFERENCEDESCRIPTION]);
-    if(!result->references) {
-        result->statusCode = UA_STATUSCODE_BADOUTOFMEMORY;
-        return false;
-    }
+/* Collects at most maxrefs matching targets starting at the position of the
+ * ContinuationPoint. Every target is taken from the Nodestore once. */
+static UA_StatusCode
+browseReferences(UA_Server *server, UA_BrowseOperation *op, size_t maxrefs) {
+    const UA_BrowseDescription *descr = &op->cp->browseDescription;
+    const UA_Node *node = op->node;
 
-    size_t referenceKindIndex = cp->referenceKindIndex;
-    size_t targetIndex = cp->targetIndex;
+    /* Follow all references? */
+    UA_Boolean browseAll = UA_NodeId_isNull(&descr->referenceTypeId);
 
     /* Loop over the node's references */
-    for(; referenceKindIndex < node->referencesSize; ++referenceKindIndex) {
-        UA_NodeReferenceKind *rk = &node->references[referenceKindIndex];
+    size_t rkIndex = op->cp->referenceKindIndex;
+    size_t tIndex = op->cp->targetIndex;
+    for(; rkIndex < node->referencesSize; ++rkIndex) {
+        UA_NodeReferenceKind *rk = &node->references[rkIndex];
 
         /* Reference in the right direction? */
         if(rk->isInverse && descr->browseDirection == UA_BROWSEDIRECTION_FORWARD)
@@ -126,9 +147,9 @@ browseReferences(UA_Server *server, const UA_Node *node,
             continue;
 
         /* Loop over the targets */
-        for(; targetIndex < rk->targetIdsSize; ++targetIndex) {
+        for(; tIndex < rk->targetIdsSize; ++tIndex) {
             /* Get the node */
-            const UA_Node *target = UA_Nodestore_get(server, &rk->targetIds[targetIndex].nodeId);
+            const UA_Node *target = UA_Nodestore_get(server, &rk->targetIds[tIndex].nodeId);
             if(!target)
                 continue;
 
@@ -139,136 +160,120 @@ browseReferences(UA_Server *server, const UA_Node *node,
             }
 
             /* A match! Can we return it? */
-            if(result->referencesSize >= maxrefs) {
+            if(op->targetsSize >= maxrefs) {
                 /* There are references we could not return */
-                cp->referenceKindIndex = referenceKindIndex;
-                cp->targetIndex = targetIndex;
+                op->referenceKindIndex = rkIndex;
+                op->targetIndex = tIndex;
+                op->done = false;
                 UA_Nodestore_release(server, target);
-                return false;
+                return UA_STATUSCODE_GOOD;
             }
 
-            /* Make enough space in the array */
-            if(result->referencesSize >= refs_size) {
-                refs_size *= 2;
-                if(refs_size > maxrefs)
-                    refs_size = maxrefs;
-                UA_ReferenceDescription *rd = (UA_ReferenceDescription*)
-                    UA_realloc(result->references, sizeof(UA_ReferenceDescription) * refs_size);
-                if(!rd) {
-                    result->statusCode = UA_STATUSCODE_BADOUTOFMEMORY;
-                    UA_Nodestore_release(server, target);
-                    goto error_recovery;
-                }
-                result->references = rd;
+            /* Keep the target until the result is delivered */
+            UA_StatusCode retval = addBrowseTarget(op, target, rk);
+            if(retval != UA_STATUSCODE_GOOD) {
+                UA_Nodestore_release(server, target);
+                return retval;
             }
-
-            /* Copy the node description. Target is on top of the stack */
-            result->statusCode =
-                fillReferenceDescription(server, target, rk, descr->resultMask,
-                                         &result->references[result->referencesSize]);
-
-            UA_Nodestore_release(server, target);
-
-            if(result->statusCode != UA_STATUSCODE_GOOD)
-                goto error_recovery;
-
-            /* Increase the counter */
-            result->referencesSize++;
         }
 
-        targetIndex = 0; /* Start at index 0 for the next reference kind */
-    }
-
-    /* No relevant references, return array of length zero */
-    if(result->referencesSize == 0) {
-        UA_free(result->references);
-        result->references = (UA_ReferenceDescription*)UA_EMPTY_ARRAY_SENTINEL;
+        tIndex = 0; /* Start at index 0 for the next reference kind */
     }
 
     /* The node is done */
-    return true;
+    return UA_STATUSCODE_GOOD;
+}
 
- error_recovery:
-    if(result->referencesSize == 0)
-        UA_free(result->references);
-    else
-        UA_Array_delete(result->references, result->referencesSize,
-                        &UA_TYPES[UA_TYPES_REFERENCEDESCRIPTION]);
-    result->references = NULL;
-    result->referencesSize = 0;
-    return false;
+static void
+Browse_clear(UA_Server *server, UA_BrowseOperation *op) {
+    for(size_t i = 0; i < op->targetsSize; i++)
+        UA_Nodestore_release(server, op->targets[i].target);
+    UA_free(op->targets);
+    op->targets = NULL;
+    op->targetsSize = 0;
+    op->targetsCapacity = 0;
+    if(op->node)
+        UA_Nodestore_release(server, op->node);
+    op->node = NULL;
 }
 
-/* Results for a single browsedescription. This is the inner loop for both
- * Browse and BrowseNext. The ContinuationPoint contains all the data used.
- * Including the BrowseDescription. Returns whether there are remaining
- * references. */
-static UA_Boolean
-browseWithContinuation(UA_Server *server, UA_Session *session,
-                       ContinuationPointEntry *cp, UA_BrowseResult *result) {
+/* Collects the targets to return. Returns the StatusCode of the result. The
+ * operation holds the browsed node and the targets until Browse_clear. The
+ * ContinuationPoint is not modified. */
+static UA_StatusCode
+Browse_prepare(UA_Server *server, UA_BrowseOperation *op) {
+    ContinuationPointEntry *cp = op->cp;
     const UA_BrowseDescription *descr = &cp->browseDescription;
+    op->node = NULL;
+    op->targets = NULL;
+    op->targetsSize = 0;
+    op->targetsCapacity = 0;
+    op->done = true;
 
     /* Is the browsedirection valid? */
     if(descr->browseDirection != UA_BROWSEDIRECTION_BOTH &&
        descr->browseDirection != UA_BROWSEDIRECTION_FORWARD &&
-       descr->browseDirection != UA_BROWSEDIRECTION_INVERSE) {
-        result->statusCode = UA_STATUSCODE_BADBROWSEDIRECTIONINVALID;
-        return true;
-    }
+       descr->browseDirection != UA_BROWSEDIRECTION_INVERSE)
+        return UA_STATUSCODE_BADBROWSEDIRECTIONINVALID;
 
     /* Is the reference type valid? */
     if(!UA_NodeId_isNull(&descr->referenceTypeId)) {
         const UA_Node *reftype = UA_Nodestore_get(server, &descr->referenceTypeId);
-        if(!reftype) {
-            result->statusCode = UA_STATUSCODE_BADREFERENCETYPEIDINVALID;
-            return true;
-        }
+        if(!reftype)
+            return UA_STATUSCODE_BADREFERENCETYPEIDINVALID;
 
         UA_Boolean isRef = (reftype->nodeClass == UA_NODECLASS_REFERENCETYPE);
         UA_Nodestore_release(server, reftype);
 
-        if(!isRef) {
-            result->statusCode = UA_STATUSCODE_BADREFERENCETYPEIDINVALID;
-            return true;
-        }
+        if(!isRef)
+            return UA_STATUSCODE_BADREFERENCETYPEIDINVALID;
     }
 
-    const UA_Node *node = UA_Nodestore_get(server, &descr->nodeId);
-    if(!node) {
-        result->statusCode = UA_STATUSCODE_BADNODEIDUNKNOWN;
-        return true;
+    op->node = UA_Nodestore_get(server, &descr->nodeId);
+    if(!op->node)
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+
+    /* How many references can we return at most? */
+    size_t maxrefs = cp->maxReferences;
+    if(maxrefs == 0) {
+        if(server->config.maxReferencesPerNode != 0) {
+            maxrefs = server->config.maxReferencesPerNode;
+        } else {
+            maxrefs = UA_INT32_MAX;
+        }
+    } else {
+        if(server->config.maxReferencesPerNode != 0 && maxrefs > server->config.maxReferencesPerNode) {
+            maxrefs = server->config.maxReferencesPerNode;
+        }
     }
 
-    /* Browse the references */
-    UA_Boolean done = browseReferences(server, node, cp, result);
-    UA_Nodestore_release(server, node);
-    return done;
+    /* Collect the targets */
+    UA_StatusCode retval = browseReferences(server, op, maxrefs);
+    if(retval != UA_STATUSCODE_GOOD) {
+        Browse_clear(server, op);
+        op->done = true;
+    }
+    return retval;
 }
 
-/* Start to browse with no previous cp */
-void
-Operation_Browse(UA_Server *server, UA_Session *session, UA_UInt32 *maxrefs,
-                 const UA_BrowseDescription *descr, UA_BrowseResult *result) {
-    /* Stack-allocate a temporary cp */
-    UA_STACKARRAY(ContinuationPointEntry, cp, 1);
-    memset(cp, 0, sizeof(ContinuationPointEntry));
-    cp->maxReferences = *maxrefs;
-    cp->browseDescription = *descr; /* Shallow copy. Deep-copy later if we persist the cp. */
-
-    UA_Boolean done = browseWithContinuation(server, session, cp, result);
-
-    /* Exit early if done or an error occurred */
-    if(done || result->statusCode != UA_STATUSCODE_GOOD)
-        return;
+/* Forward the ContinuationPoint behind the delivered references */
+static void
+Browse_commit(UA_BrowseOperation *op) {
+    op->cp->referenceKindIndex = op->referenceKindIndex;
+    op->cp->targetIndex = op->targetIndex;
+}
 
-    /* Persist the new continuation point */
+/* Create a ContinuationPoint for a new browse that is not done. It is attached
+ * to the session only once the result is delivered. */
+static UA_StatusCode
+newContinuationPoint(UA_Session *session, const ContinuationPointEntry *cp,
+                     const UA_BrowseDescription *descr,
+                     ContinuationPointEntry **newCp) {
     ContinuationPointEntry *cp2 = NULL;
     UA_StatusCode retval = UA_STATUSCODE_GOOD;
     if(session->availableContinuationPoints <= 0 ||
-       !(cp2 = (ContinuationPointEntry *)UA_malloc(sizeof(ContinuationPointEntry)))) {
-        retval = UA_STATUSCODE_BADNOCONTINUATIONPOINTS;
-        goto cleanup;
-    }
+       !(cp2 = (ContinuationPointEntry *)UA_malloc(sizeof(ContinuationPointEntry))))
+        return UA_STATUSCODE_BADNOCONTINUATIONPOINTS;
     memset(cp2, 0, sizeof(ContinuationPointEntry));
     cp2->referenceKindIndex = cp->referenceKindIndex;
     cp2->targetIndex = cp->targetIndex;
@@ -286,43 +291,114 @@ Operation_Browse(UA_Server *server, UA_Session *session, UA_UInt32 *maxrefs,
     *ident = UA_Guid_random();
     cp2->identifier.data = (UA_Byte*)ident;
     cp2->identifier.length = sizeof(UA_Guid);
+    *newCp = cp2;
+    return UA_STATUSCODE_GOOD;
 
-    /* Return the cp identifier */
-    retval = UA_ByteString_copy(&cp2->identifier, &result->continuationPoint);
-    if(retval != UA_STATUSCODE_GOOD)
-        goto cleanup;
+ cleanup:
+    deleteCp(cp2);
+    return retval;
+}
 
-    /* Attach the cp to the session */
-    LIST_INSERT_HEAD(&session->continuationPoints, cp2, pointers);
+static void
+attachContinuationPoint(UA_Session *session, ContinuationPointEntry *cp) {
+    LIST_INSERT_HEAD(&session->continuationPoints, cp, pointers);
     --session->availableContinuationPoints;
-    return;
+}
 
- cleanup:
-    if(cp2) {
-        UA_ByteString_deleteMembers(&cp2->identifier);
-        UA_BrowseDescription_deleteMembers(&cp2->browseDescription);
-        UA_free(cp2);
+static ContinuationPointEntry *
+findContinuationPoint(UA_Session *session, const UA_ByteString *continuationPoint) {
+    ContinuationPointEntry *cp;
+    LIST_FOREACH(cp, &session->continuationPoints, pointers) {
+        if(UA_ByteString_equal(&cp->identifier, continuationPoint))
+            break;
     }
-    UA_BrowseResult_deleteMembers(result);
-    result->statusCode = retval;
+    return cp;
 }
 
-void Service_Browse(UA_Server *server, UA_Session *session,
-                    const UA_BrowseRequest *request, UA_BrowseResponse *response) {
-    UA_LOG_DEBUG_SESSION(server->config.logger, session, "Processing BrowseRequest");
+/**********************************/
+/* Browse Results for Local Users */
+/**********************************/
 
-    /* No views supported at the moment */
-    if(!UA_NodeId_isNull(&request->view.viewId)) {
-        response->responseHeader.serviceResult = UA_STATUSCODE_BADVIEWIDUNKNOWN;
+/* Allocates the references array and copies the ReferenceDescriptions of the
+ * collected targets into it */
+static void
+Browse_copyResult(UA_Server *server, UA_BrowseOperation *op, UA_BrowseResult *result) {
+    if(op->targetsSize == 0) {
+        result->references = (UA_ReferenceDescription*)UA_EMPTY_ARRAY_SENTINEL;
         return;
     }
 
-    UA_UInt32 requestedMaxReferencesPerNode = request->requestedMaxReferencesPerNode;
-    response->responseHeader.serviceResult =
-        UA_Server_processServiceOperations(server, session, (UA_ServiceOperation)Operation_Browse,
-                                           &requestedMaxReferencesPerNode,
-                                           &request->nodesToBrowseSize, &UA_TYPES[UA_TYPES_BROWSEDESCRIPTION],
-                                           &response->resultsSize, &UA_TYPES[UA_TYPES_BROWSERESULT]);
+    result->references = (UA_ReferenceDescription*)
+        UA_Array_new(op->targetsSize, &UA_TYPES[UA_TYPES_REFERENCEDESCRIPTION]);
+    if(!result->references) {
+        result->statusCode = UA_STATUSCODE_BADOUTOFMEMORY;
+        return;
+    }
+
+    UA_UInt32 mask = op->cp->browseDescription.resultMask;
+    for(size_t i = 0; i < op->targetsSize; i++) {
+        const UA_Node *type;
+        UA_ReferenceDescription descr;
+        describeReference(server, op->targets[i].target, op->targets[i].rk,
+                          mask, &descr, &type);
+        UA_StatusCode retval =
+            UA_ReferenceDescription_copy(&descr, &result->references[i]);
+        if(type)
+            UA_Nodestore_release(server, type);
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_Array_delete(result->references, op->targetsSize,
+                            &UA_TYPES[UA_TYPES_REFERENCEDESCRIPTION]);
+            result->references = NULL;
+            result->statusCode = retval;
+            return;
+        }
+    }
+    result->referencesSize = op->targetsSize;
+}
+
+/* Start to browse with no previous cp */
+void
+Operation_Browse(UA_Server *server, UA_Session *session, UA_UInt32 *maxrefs,
+                 const UA_BrowseDescription *descr, UA_BrowseResult *result) {
+    /* Stack-allocate a temporary cp */
+    UA_STACKARRAY(ContinuationPointEntry, cp, 1);
+    memset(cp, 0, sizeof(ContinuationPointEntry));
+    cp->maxReferences = *maxrefs;
+    cp->browseDescription = *descr; /* Shallow copy. Deep-copy later if we persist the cp. */
+
+    ContinuationPointEntry *newCp = NULL;
+    UA_BrowseOperation op;
+    op.cp = cp;
+    result->statusCode = Browse_prepare(server, &op);
+    if(result->statusCode != UA_STATUSCODE_GOOD)
+        goto cleanup;
+
+    /* Create the new continuation point and return the cp identifier */
+    if(!op.done) {
+        Browse_commit(&op);
+        result->statusCode = newContinuationPoint(session, cp, descr, &newCp);
+        if(result->statusCode != UA_STATUSCODE_GOOD)
+            goto cleanup;
+        result->statusCode = UA_ByteString_copy(&newCp->identifier,
+                                                &result->continuationPoint);
+        if(result->statusCode != UA_STATUSCODE_GOOD)
+            goto cleanup;
+    }
+
+    Browse_copyResult(server, &op, result);
+
+ cleanup:
+    Browse_clear(server, &op);
+
+    /* Keep the continuation point only if the result is complete */
+    if(newCp) {
+        if(result->statusCode == UA_STATUSCODE_GOOD) {
+            attachContinuationPoint(session, newCp);
+        } else {
+            deleteCp(newCp);
+            UA_ByteString_deleteMembers(&result->continuationPoint);
+        }
+    }
 }
 
 UA_BrowseResult
@@ -334,53 +410,42 @@ UA_Server_browse(UA_Server *server, UA_UInt32 maxrefs, const UA_BrowseDescriptio
 }
 
 static void
-Operation_BrowseNext(UA_Server *server, UA_Session *session, UA_Boolean *releaseContinuationPoints,
+Operation_BrowseNext(UA_Server *server, UA_Session *session, UA_Boolean releaseContinuationPoints,
                      const UA_ByteString *continuationPoint, UA_BrowseResult *result) {
     /* Find the continuation point */
-    ContinuationPointEntry *cp;
-    LIST_FOREACH(cp, &session->continuationPoints, pointers) {
-        if(UA_ByteString_equal(&cp->identifier, continuationPoint))
-            break;
-    }
+    ContinuationPointEntry *cp = findContinuationPoint(session, continuationPoint);
     if(!cp) {
         result->statusCode = UA_STATUSCODE_BADCONTINUATIONPOINTINVALID;
         return;
     }
 
     /* Remove the cp */
-    if(*releaseContinuationPoints) {
+    if(releaseContinuationPoints) {
         removeCp(cp, session);
         return;
     }
 
     /* Continue browsing */
-    UA_Boolean done = browseWithContinuation(server, session, cp, result);
-
-    if(done) {
-        /* Remove the cp if there are no references left */
+    UA_BrowseOperation op;
+    op.cp = cp;
+    result->statusCode = Browse_prepare(server, &op);
+    if(result->statusCode == UA_STATUSCODE_GOOD) {
+        if(!op.done)
+            result->statusCode = UA_ByteString_copy(&cp->identifier,
+                                                    &result->continuationPoint);
+        if(result->statusCode == UA_STATUSCODE_GOOD)
+            Browse_copyResult(server, &op, result);
+    }
+    Browse_clear(server, &op);
+
+    /* Remove the cp if there are no references left. Otherwise forward it if
+     * the references are returned. */
+    if(op.done)
         removeCp(cp, session);
-    } else {
-        /* Return the cp identifier */
-        UA_StatusCode retval = UA_ByteString_copy(&cp->identifier, &result->continuationPoint);
-        if(retval != UA_STATUSCODE_GOOD) {
-            UA_BrowseResult_deleteMembers(result);
-            result->statusCode = retval;
-        }
-    }
-}
-
-void
-Service_BrowseNext(UA_Server *server, UA_Session *session,
-                   const UA_BrowseNextRequest *request,
-                   UA_BrowseNextResponse *response) {
-    UA_LOG_DEBUG_SESSION(server->config.logger, session,
-                         "Processing BrowseNextRequest");
-    UA_Boolean releaseContinuationPoints = request->releaseContinuationPoints; /* request is const */
-    response->responseHeader.serviceResult =
-        UA_Server_processServiceOperations(server, session, (UA_ServiceOperation)Operation_BrowseNext,
-                                           &releaseContinuationPoints,
-                                           &request->continuationPointsSize, &UA_TYPES[UA_TYPES_BYTESTRING],
-                                           &response->resultsSize, &UA_TYPES[UA_TYPES_BROWSERESULT]);
+    else if(result->statusCode == UA_STATUSCODE_GOOD)
+        Browse_commit(&op);
+    else
+        UA_ByteString_deleteMembers(&result->continuationPoint);
 }
 
 UA_BrowseResult
@@ -388,11 +453,197 @@ UA_Server_browseNext(UA_Server *server, UA_Boolean releaseContinuationPoint,
                      const UA_ByteString *continuationPoint) {
     UA_BrowseResult result;
     UA_BrowseResult_init(&result);
-    Operation_BrowseNext(server, &adminSession, &releaseContinuationPoint,
+    Operation_BrowseNext(server, &adminSession, releaseContinuationPoint,
                          continuationPoint, &result);
     return result;
 }
 
+/***************************/
+/* Streamed Browse Results */
+/***************************/
+
+/* The ReferenceDescriptions are encoded straight from the nodes into the
+ * outgoing chunks. No BrowseResult is assembled in memory. */
+
+static UA_StatusCode
+encodeReferenceDescription(UA_Server *server, UA_MessageContext *mc,
+                           const UA_BrowseTarget *bt, UA_UInt32 resultMask) {
+    const UA_Node *type;
+    UA_ReferenceDescription descr;
+    describeReference(server, bt->target, bt->rk, resultMask, &descr, &type);
+    UA_StatusCode retval =
+        UA_MessageContext_encode(mc, &descr, &UA_TYPES[UA_TYPES_REFERENCEDESCRIPTION]);
+    if(type)
+        UA_Nodestore_release(server, type);
+    return retval;
+}
+
+/* Encodes the BrowseResult. The op is prepared if the StatusCode is good. */
+static UA_StatusCode
+encodeBrowseResult(UA_Server *server, UA_MessageContext *mc, UA_StatusCode statusCode,
+                   const UA_ByteString *continuationPoint, UA_BrowseOperation *op) {
+    UA_StatusCode retval =
+        UA_MessageContext_encode(mc, &statusCode, &UA_TYPES[UA_TYPES_STATUSCODE]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    if(!continuationPoint)
+        continuationPoint = &UA_BYTESTRING_NULL;
+    retval = UA_MessageContext_encode(mc, continuationPoint, &UA_TYPES[UA_TYPES_BYTESTRING]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* No references for a bad StatusCode */
+    UA_Int32 refsSize = -1;
+    if(statusCode == UA_STATUSCODE_GOOD)
+        refsSize = (UA_Int32)op->targetsSize;
+    retval = UA_MessageContext_encode(mc, &refsSize, &UA_TYPES[UA_TYPES_INT32]);
+    for(UA_Int32 i = 0; i < refsSize && retval == UA_STATUSCODE_GOOD; i++)
+        retval = encodeReferenceDescription(server, mc, &op->targets[i],
+                                            op->cp->browseDescription.resultMask);
+    return retval;
+}
+
+static UA_StatusCode
+Operation_BrowseEncode(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+                       UA_UInt32 maxrefs, const UA_BrowseDescription *descr) {
+    /* Stack-allocate a temporary cp */
+    UA_STACKARRAY(ContinuationPointEntry, cp, 1);
+    memset(cp, 0, sizeof(ContinuationPointEntry));
+    cp->maxReferences = maxrefs;
+    cp->browseDescription = *descr; /* Shallow copy. Deep-copy later if we persist the cp. */
+
+    UA_BrowseOperation op;
+    op.cp = cp;
+    ContinuationPointEntry *newCp = NULL;
+    UA_StatusCode statusCode = Browse_prepare(server, &op);
+    if(statusCode == UA_STATUSCODE_GOOD && !op.done) {
+        Browse_commit(&op);
+        statusCode = newContinuationPoint(session, cp, descr, &newCp);
+    }
+
+    UA_StatusCode retval = encodeBrowseResult(server, mc, statusCode,
+                                              newCp ? &newCp->identifier : NULL, &op);
+    Browse_clear(server, &op);
+
+    /* Keep the continuation point only if the result was encoded */
+    if(newCp) {
+        if(retval == UA_STATUSCODE_GOOD)
+            attachContinuationPoint(session, newCp);
+        else
+            deleteCp(newCp);
+    }
+    return retval;
+}
+
+static UA_StatusCode
+Operation_BrowseNextEncode(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+                           UA_Boolean releaseContinuationPoints,
+                           const UA_ByteString *continuationPoint) {
+    UA_BrowseOperation op;
+    memset(&op, 0, sizeof(UA_BrowseOperation));
+
+    /* Find the continuation point */
+    ContinuationPointEntry *cp = findContinuationPoint(session, continuationPoint);
+    if(!cp)
+        return encodeBrowseResult(server, mc, UA_STATUSCODE_BADCONTINUATIONPOINTINVALID,
+                                  NULL, &op);
+
+    /* Remove the cp */
+    if(releaseContinuationPoints) {
+        removeCp(cp, session);
+        return encodeBrowseResult(server, mc, UA_STATUSCODE_GOOD, NULL, &op);
+    }
+
+    /* Continue browsing */
+    op.cp = cp;
+    UA_StatusCode statusCode = Browse_prepare(server, &op);
+    const UA_ByteString *identifier = NULL;
+    if(statusCode == UA_STATUSCODE_GOOD && !op.done)
+        identifier = &cp->identifier;
+    UA_StatusCode retval = encodeBrowseResult(server, mc, statusCode, identifier, &op);
+    Browse_clear(server, &op);
+
+    /* The cp is left as it was if the result could not be encoded. Otherwise
+     * remove it if there are no references left, or forward it. The
+     * BrowseDescription of the cp is used until the result is encoded. */
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    if(op.done)
+        removeCp(cp, session);
+    else
+        Browse_commit(&op);
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+checkBrowseRequest(UA_Server *server, UA_MessageContext *mc, size_t operations,
+                   UA_ResponseHeader *responseHeader, UA_Int32 *arraySize) {
+    if(operations == 0)
+        responseHeader->serviceResult = UA_STATUSCODE_BADNOTHINGTODO;
+
+    /* Check if there are too many operations */
+    if(server->config.maxNodesPerBrowse != 0 &&
+       operations > server->config.maxNodesPerBrowse)
+        responseHeader->serviceResult = UA_STATUSCODE_BADTOOMANYOPERATIONS;
+
+    /* Encode the response header */
+    UA_StatusCode retval =
+        UA_MessageContext_encode(mc, responseHeader, &UA_TYPES[UA_TYPES_RESPONSEHEADER]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* Process nothing if we return an error code for the entire service */
+    *arraySize = (UA_Int32)operations;
+    if(responseHeader->serviceResult != UA_STATUSCODE_GOOD)
+        *arraySize = 0;
+    return UA_MessageContext_encode(mc, arraySize, &UA_TYPES[UA_TYPES_INT32]);
+}
+
+UA_StatusCode
+Service_Browse(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+               const UA_BrowseRequest *request, UA_ResponseHeader *responseHeader) {
+    UA_LOG_DEBUG_SESSION(server->config.logger, session, "Processing BrowseRequest");
+
+    /* No views supported at the moment */
+    if(!UA_NodeId_isNull(&request->view.viewId))
+        responseHeader->serviceResult = UA_STATUSCODE_BADVIEWIDUNKNOWN;
+
+    UA_Int32 arraySize;
+    UA_StatusCode retval = checkBrowseRequest(server, mc, request->nodesToBrowseSize,
+                                              responseHeader, &arraySize);
+    for(UA_Int32 i = 0; i < arraySize && retval == UA_STATUSCODE_GOOD; i++)
+        retval = Operation_BrowseEncode(server, session, mc,
+                                        request->requestedMaxReferencesPerNode,
+                                        &request->nodesToBrowse[i]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* Don't return any DiagnosticInfo */
+    arraySize = -1;
+    return UA_MessageContext_encode(mc, &arraySize, &UA_TYPES[UA_TYPES_INT32]);
+}
+
+UA_StatusCode
+Service_BrowseNext(UA_Server *server, UA_Session *session, UA_MessageContext *mc,
+                   const UA_BrowseNextRequest *request, UA_ResponseHeader *responseHeader) {
+    UA_LOG_DEBUG_SESSION(server->config.logger, session,
+                         "Processing BrowseNextRequest");
+
+    UA_Int32 arraySize;
+    UA_StatusCode retval = checkBrowseRequest(server, mc, request->continuationPointsSize,
+                                              responseHeader, &arraySize);
+    for(UA_Int32 i = 0; i < arraySize && retval == UA_STATUSCODE_GOOD; i++)
+        retval = Operation_BrowseNextEncode(server, session, mc,
+                                            request->releaseContinuationPoints,
+                                            &request->continuationPoints[i]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* Don't return any DiagnosticInfo */
+    arraySize = -1;
+    return UA_MessageContext_encode(mc, &arraySize, &UA_TYPES[UA_TYPES_INT32]);
+}
+
 /***********************/
 /* TranslateBrowsePath */
 /***********************/
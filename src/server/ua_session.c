@@ -34,13 +34,17 @@ UA_Session adminSession = {
     {0, NULL},
     UA_MAXCONTINUATIONPOINTS, /* .availableContinuationPoints */
     {NULL}, /* .continuationPoints */
+    0, /* .asyncOperations */
 #ifdef UA_ENABLE_SUBSCRIPTIONS
     0, /* .lastSubscriptionId */
     0, /* .lastSeenSubscriptionId */
     {NULL}, /* .serverSubscriptions */
-    {NULL, NULL}, /* .responseQueue */
+    {NULL, &adminSession.responseQueue.sqh_first}, /* .responseQueue */
     0, /* numSubscriptions */
-    0  /* numPublishReq */
+    0, /* numPublishReq */
+    {NULL, &adminSession.retransmissions.tqh_first}, /* .retransmissions */
+    0, /* .retransmissionBytes */
+    {NULL} /* .publishGroups */
 #endif
 };
 
@@ -49,6 +53,8 @@ void UA_Session_init(UA_Session *session) {
     session->availableContinuationPoints = UA_MAXCONTINUATIONPOINTS;
 #ifdef UA_ENABLE_SUBSCRIPTIONS
     SIMPLEQ_INIT(&session->responseQueue);
+    TAILQ_INIT(&session->retransmissions);
+    LIST_INIT(&session->publishGroups);
 #endif
 }
 
@@ -135,6 +141,10 @@ UA_Session_deleteSubscription(UA_Server *server, UA_Session *session,
 
     UA_Subscription_deleteMembers(server, sub);
 
+    /* Remove from the session before the delayed free is scheduled. With
+     * multithreading, the memory can be released by a worker right away. */
+    LIST_REMOVE(sub, listEntry);
+
     /* Add a delayed callback to remove the subscription when the currently
      * scheduled jobs have completed */
     UA_StatusCode retval = UA_Server_delayedFree(server, sub);
@@ -142,11 +152,10 @@ UA_Session_deleteSubscription(UA_Server *server, UA_Session *session,
         UA_LOG_WARNING_SESSION(server->config.logger, session,
                        "Could not remove subscription with error code %s",
                        UA_StatusCode_name(retval));
+        LIST_INSERT_HEAD(&session->serverSubscriptions, sub, listEntry);
         return retval; /* Try again next time */
     }
 
-    /* Remove from the session */
-    LIST_REMOVE(sub, listEntry);
     UA_assert(session->numSubscriptions > 0);
     session->numSubscriptions--;
     return UA_STATUSCODE_GOOD;
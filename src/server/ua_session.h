@@ -31,7 +31,12 @@ typedef struct ContinuationPointEntry {
 struct UA_Subscription;
 typedef struct UA_Subscription UA_Subscription;
 
+struct UA_PublishGroup;
+typedef struct UA_PublishGroup UA_PublishGroup;
+
 #ifdef UA_ENABLE_SUBSCRIPTIONS
+struct UA_NotificationMessageEntry;
+
 typedef struct UA_PublishResponseEntry {
     SIMPLEQ_ENTRY(UA_PublishResponseEntry) listEntry;
     UA_UInt32 requestId;
@@ -53,6 +58,7 @@ typedef struct {
     UA_ByteString     serverNonce;
     UA_UInt16 availableContinuationPoints;
     LIST_HEAD(ContinuationPointList, ContinuationPointEntry) continuationPoints;
+    UA_UInt32 asyncOperations; /* Outstanding, see ua_server_async.c */
 #ifdef UA_ENABLE_SUBSCRIPTIONS
     UA_UInt32 lastSubscriptionId;
     UA_UInt32 lastSeenSubscriptionId;
@@ -60,6 +66,15 @@ typedef struct {
     SIMPLEQ_HEAD(UA_ListOfQueuedPublishResponses, UA_PublishResponseEntry) responseQueue;
     UA_UInt32        numSubscriptions;
     UA_UInt32        numPublishReq;
+
+    /* The retransmission entries of all subscriptions in the order of their
+     * last use. The least recently used entries are evicted first when the
+     * encoded messages exceed maxRetransmissionBytesPerSession. */
+    TAILQ_HEAD(UA_ListOfRetransmissions, UA_NotificationMessageEntry) retransmissions;
+    size_t           retransmissionBytes;
+
+    /* The subscriptions are published in groups with a shared callback */
+    LIST_HEAD(UA_ListOfPublishGroups, UA_PublishGroup) publishGroups;
 #endif
 } UA_Session;
 
@@ -12,11 +12,18 @@
 #include "ua_session_manager.h"
 #include "ua_server_internal.h"
 
+#define UA_SESSIONINDEX_MINSIZE 16
+
 UA_StatusCode
 UA_SessionManager_init(UA_SessionManager *sm, UA_Server *server) {
     LIST_INIT(&sm->sessions);
     sm->currentSessionCount = 0;
     sm->server = server;
+    sm->tokenIndex = NULL;
+    sm->idIndex = NULL;
+    sm->indexSize = 0;
+    sm->timeoutHeap = NULL;
+    sm->timeoutHeapSize = 0;
     return UA_STATUSCODE_GOOD;
 }
 
@@ -27,12 +34,177 @@ void UA_SessionManager_deleteMembers(UA_SessionManager *sm) {
         UA_Session_deleteMembersCleanup(&current->session, sm->server);
         UA_free(current);
     }
+    UA_free(sm->tokenIndex);
+    UA_free(sm->idIndex);
+    UA_free(sm->timeoutHeap);
+    sm->tokenIndex = NULL;
+    sm->idIndex = NULL;
+    sm->indexSize = 0;
+    sm->timeoutHeap = NULL;
+    sm->timeoutHeapSize = 0;
+}
+
+/*****************/
+/* Session Index */
+/*****************/
+
+/* The sessions are indexed by the authentication token and by the session id.
+ * Both indexes use linear probing over a power-of-two number of slots. Entries
+ * are removed with backward shifting. So no tombstones are needed. */
+
+static const UA_NodeId *
+indexKey(const session_list_entry *sentry, UA_Boolean byToken) {
+    if(byToken)
+        return &sentry->session.header.authenticationToken;
+    return &sentry->session.sessionId;
+}
+
+static size_t
+indexFind(const UA_SessionManager *sm, session_list_entry **index,
+          const UA_NodeId *key, UA_Boolean byToken) {
+    if(sm->indexSize == 0)
+        return SIZE_MAX;
+    size_t mask = sm->indexSize - 1;
+    for(size_t slot = UA_NodeId_hash(key) & mask; index[slot]; slot = (slot + 1) & mask) {
+        if(UA_NodeId_equal(indexKey(index[slot], byToken), key))
+            return slot;
+    }
+    return SIZE_MAX;
+}
+
+static void
+indexInsert(const UA_SessionManager *sm, session_list_entry **index,
+            session_list_entry *sentry, UA_Boolean byToken) {
+    size_t mask = sm->indexSize - 1;
+    size_t slot = UA_NodeId_hash(indexKey(sentry, byToken)) & mask;
+    while(index[slot])
+        slot = (slot + 1) & mask;
+    index[slot] = sentry;
+}
+
+static void
+indexRemove(const UA_SessionManager *sm, session_list_entry **index,
+            session_list_entry *sentry, UA_Boolean byToken) {
+    size_t slot = indexFind(sm, index, indexKey(sentry, byToken), byToken);
+    if(slot == SIZE_MAX)
+        return;
+    size_t mask = sm->indexSize - 1;
+    size_t next = slot;
+    while(true) {
+        next = (next + 1) & mask;
+        session_list_entry *e = index[next];
+        if(!e)
+            break;
+        /* Move into the hole unless the home slot lies (cyclically) between
+         * the hole and the current position */
+        size_t home = UA_NodeId_hash(indexKey(e, byToken)) & mask;
+        if(((next - home) & mask) >= ((next - slot) & mask)) {
+            index[slot] = e;
+            slot = next;
+        }
+    }
+    index[slot] = NULL;
+}
+
+/****************/
+/* Timeout Heap */
+/****************/
+
+/* The heap is ordered by timeoutCheck. Sessions are extended with every
+ * request without notifying the session manager. Since validTill only
+ * increases, the heap key is a lower bound. An extended session at the top of
+ * the heap gets its key updated and is moved down. */
+
+static void
+timeoutHeapSet(UA_SessionManager *sm, size_t index, session_list_entry *sentry) {
+    sm->timeoutHeap[index] = sentry;
+    sentry->timeoutIndex = index;
+}
+
+static void
+timeoutHeapSiftUp(UA_SessionManager *sm, size_t index) {
+    session_list_entry *sentry = sm->timeoutHeap[index];
+    while(index > 0) {
+        size_t parent = (index - 1) / 2;
+        if(sm->timeoutHeap[parent]->timeoutCheck <= sentry->timeoutCheck)
+            break;
+        timeoutHeapSet(sm, index, sm->timeoutHeap[parent]);
+        index = parent;
+    }
+    timeoutHeapSet(sm, index, sentry);
+}
+
+static void
+timeoutHeapSiftDown(UA_SessionManager *sm, size_t index) {
+    session_list_entry *sentry = sm->timeoutHeap[index];
+    while(true) {
+        size_t child = (2 * index) + 1;
+        if(child >= sm->timeoutHeapSize)
+            break;
+        if(child + 1 < sm->timeoutHeapSize &&
+           sm->timeoutHeap[child + 1]->timeoutCheck < sm->timeoutHeap[child]->timeoutCheck)
+            child++;
+        if(sentry->timeoutCheck <= sm->timeoutHeap[child]->timeoutCheck)
+            break;
+        timeoutHeapSet(sm, index, sm->timeoutHeap[child]);
+        index = child;
+    }
+    timeoutHeapSet(sm, index, sentry);
+}
+
+static void
+timeoutHeapRemove(UA_SessionManager *sm, session_list_entry *sentry) {
+    size_t index = sentry->timeoutIndex;
+    sm->timeoutHeapSize--;
+    if(index == sm->timeoutHeapSize)
+        return;
+    session_list_entry *last = sm->timeoutHeap[sm->timeoutHeapSize];
+    timeoutHeapSet(sm, index, last);
+    timeoutHeapSiftUp(sm, index);
+    timeoutHeapSiftDown(sm, last->timeoutIndex);
+}
+
+/* Make room for one more session. The load factor of the indexes stays below
+ * one half. */
+static UA_StatusCode
+reserveSession(UA_SessionManager *sm) {
+    if(sm->timeoutHeapSize < sm->indexSize / 2)
+        return UA_STATUSCODE_GOOD;
+
+    size_t indexSize = sm->indexSize * 2;
+    if(indexSize < UA_SESSIONINDEX_MINSIZE)
+        indexSize = UA_SESSIONINDEX_MINSIZE;
+    session_list_entry **tokenIndex = (session_list_entry**)
+        UA_calloc(indexSize, sizeof(session_list_entry*));
+    session_list_entry **idIndex = (session_list_entry**)
+        UA_calloc(indexSize, sizeof(session_list_entry*));
+    session_list_entry **heap = (session_list_entry**)
+        UA_realloc(sm->timeoutHeap, (indexSize / 2) * sizeof(session_list_entry*));
+    if(heap)
+        sm->timeoutHeap = heap;
+    if(!tokenIndex || !idIndex || !heap) {
+        UA_free(tokenIndex);
+        UA_free(idIndex);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    UA_free(sm->tokenIndex);
+    UA_free(sm->idIndex);
+    sm->tokenIndex = tokenIndex;
+    sm->idIndex = idIndex;
+    sm->indexSize = indexSize;
+    for(size_t i = 0; i < sm->timeoutHeapSize; i++) {
+        indexInsert(sm, tokenIndex, sm->timeoutHeap[i], true);
+        indexInsert(sm, idIndex, sm->timeoutHeap[i], false);
+    }
+    return UA_STATUSCODE_GOOD;
 }
 
 /* Delayed callback to free the session memory */
 static void
 removeSessionCallback(UA_Server *server, void *entry) {
     session_list_entry *sentry = (session_list_entry*)entry;
+    UA_Server_removeSessionCachedValues(server, &sentry->session.sessionId);
     UA_Session_deleteMembersCleanup(&sentry->session, server);
     UA_free(sentry);
 }
@@ -58,6 +230,9 @@ removeSession(UA_SessionManager *sm, session_list_entry *sentry) {
     /* Detach the session from the session manager and make the capacity
      * available */
     LIST_REMOVE(sentry, pointers);
+    indexRemove(sm, sm->tokenIndex, sentry, true);
+    indexRemove(sm, sm->idIndex, sentry, false);
+    timeoutHeapRemove(sm, sentry);
     UA_atomic_subUInt32(&sm->currentSessionCount, 1);
     return UA_STATUSCODE_GOOD;
 }
@@ -65,40 +240,55 @@ removeSession(UA_SessionManager *sm, session_list_entry *sentry) {
 void
 UA_SessionManager_cleanupTimedOut(UA_SessionManager *sm,
                                   UA_DateTime nowMonotonic) {
-    session_list_entry *sentry, *temp;
-    LIST_FOREACH_SAFE(sentry, &sm->sessions, pointers, temp) {
-        /* Session has timed out? */
-        if(sentry->session.validTill >= nowMonotonic)
+    while(sm->timeoutHeapSize > 0) {
+        session_list_entry *sentry = sm->timeoutHeap[0];
+        if(sentry->timeoutCheck >= nowMonotonic)
+            break;
+
+        /* The session was extended. Update the position in the heap. */
+        if(sentry->session.validTill >= nowMonotonic) {
+            sentry->timeoutCheck = sentry->session.validTill;
+            timeoutHeapSiftDown(sm, 0);
             continue;
+        }
+
+        /* Session has timed out */
         UA_LOG_INFO_SESSION(sm->server->config.logger, &sentry->session,
                             "Session has timed out");
         sm->server->config.accessControl.closeSession(sm->server,
                                                       &sm->server->config.accessControl,
                                                       &sentry->session.sessionId,
                                                       sentry->session.sessionHandle);
-        removeSession(sm, sentry);
+        if(removeSession(sm, sentry) != UA_STATUSCODE_GOOD)
+            break; /* Try again next time */
     }
 }
 
-UA_Session *
-UA_SessionManager_getSessionByToken(UA_SessionManager *sm, const UA_NodeId *token) {
-    session_list_entry *current = NULL;
-    LIST_FOREACH(current, &sm->sessions, pointers) {
-        /* Token does not match */
-        if(!UA_NodeId_equal(&current->session.header.authenticationToken, token))
-            continue;
+static UA_Session *
+getSession(UA_SessionManager *sm, const UA_NodeId *key, UA_Boolean byToken) {
+    session_list_entry **index = byToken ? sm->tokenIndex : sm->idIndex;
+    size_t slot = indexFind(sm, index, key, byToken);
+    if(slot == SIZE_MAX)
+        return NULL;
 
-        /* Session has timed out */
-        if(UA_DateTime_nowMonotonic() > current->session.validTill) {
-            UA_LOG_INFO_SESSION(sm->server->config.logger, &current->session,
-                                "Client tries to use a session that has timed out");
-            return NULL;
-        }
-
-        /* Ok, return */
-        return &current->session;
+    /* Session has timed out */
+    session_list_entry *current = index[slot];
+    if(UA_DateTime_nowMonotonic() > current->session.validTill) {
+        UA_LOG_INFO_SESSION(sm->server->config.logger, &current->session,
+                            "Client tries to use a session that has timed out");
+        return NULL;
     }
 
+    /* Ok, return */
+    return &current->session;
+}
+
+UA_Session *
+UA_SessionManager_getSessionByToken(UA_SessionManager *sm, const UA_NodeId *token) {
+    UA_Session *session = getSession(sm, token, true);
+    if(session)
+        return session;
+
     /* Session not found */
     UA_LOG_INFO(sm->server->config.logger, UA_LOGCATEGORY_SESSION,
                 "Try to use Session with token " UA_PRINTF_GUID_FORMAT " but is not found",
@@ -108,22 +298,9 @@ UA_SessionManager_getSessionByToken(UA_SessionManager *sm, const UA_NodeId *toke
 
 UA_Session *
 UA_SessionManager_getSessionById(UA_SessionManager *sm, const UA_NodeId *sessionId) {
-    session_list_entry *current = NULL;
-    LIST_FOREACH(current, &sm->sessions, pointers) {
-        /* Token does not match */
-        if(!UA_NodeId_equal(&current->session.sessionId, sessionId))
-            continue;
-
-        /* Session has timed out */
-        if(UA_DateTime_nowMonotonic() > current->session.validTill) {
-            UA_LOG_INFO_SESSION(sm->server->config.logger, &current->session,
-                                "Client tries to use a session that has timed out");
-            return NULL;
-        }
-
-        /* Ok, return */
-        return &current->session;
-    }
+    UA_Session *session = getSession(sm, sessionId, false);
+    if(session)
+        return session;
 
     /* Session not found */
     UA_LOG_INFO(sm->server->config.logger, UA_LOGCATEGORY_SESSION,
@@ -139,6 +316,9 @@ UA_SessionManager_createSession(UA_SessionManager *sm, UA_SecureChannel *channel
     if(sm->currentSessionCount >= sm->server->config.maxSessions)
         return UA_STATUSCODE_BADTOOMANYSESSIONS;
 
+    if(reserveSession(sm) != UA_STATUSCODE_GOOD)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
     session_list_entry *newentry = (session_list_entry *)UA_malloc(sizeof(session_list_entry));
     if(!newentry)
         return UA_STATUSCODE_BADOUTOFMEMORY;
@@ -156,18 +336,20 @@ UA_SessionManager_createSession(UA_SessionManager *sm, UA_SecureChannel *channel
 
     UA_Session_updateLifetime(&newentry->session);
     LIST_INSERT_HEAD(&sm->sessions, newentry, pointers);
+    indexInsert(sm, sm->tokenIndex, newentry, true);
+    indexInsert(sm, sm->idIndex, newentry, false);
+    newentry->timeoutCheck = newentry->session.validTill;
+    sm->timeoutHeap[sm->timeoutHeapSize] = newentry;
+    sm->timeoutHeapSize++;
+    timeoutHeapSiftUp(sm, sm->timeoutHeapSize - 1);
     *session = &newentry->session;
     return UA_STATUSCODE_GOOD;
 }
 
 UA_StatusCode
 UA_SessionManager_removeSession(UA_SessionManager *sm, const UA_NodeId *token) {
-    session_list_entry *current;
-    LIST_FOREACH(current, &sm->sessions, pointers) {
-        if(UA_NodeId_equal(&current->session.header.authenticationToken, token))
-            break;
-    }
-    if(!current)
+    size_t slot = indexFind(sm, sm->tokenIndex, token, true);
+    if(slot == SIZE_MAX)
         return UA_STATUSCODE_BADSESSIONIDINVALID;
-    return removeSession(sm, current);
+    return removeSession(sm, sm->tokenIndex[slot]);
 }
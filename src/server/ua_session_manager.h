@@ -23,6 +23,10 @@ extern "C" {
 
 typedef struct session_list_entry {
     LIST_ENTRY(session_list_entry) pointers;
+    size_t timeoutIndex;      /* Position in the timeout heap */
+    UA_DateTime timeoutCheck; /* The heap is ordered by this validTill
+                               * timestamp. The session may have been extended
+                               * since. */
     UA_Session session;
 } session_list_entry;
 
@@ -30,6 +34,17 @@ typedef struct UA_SessionManager {
     LIST_HEAD(session_list, session_list_entry) sessions; // doubly-linked list of sessions
     UA_UInt32 currentSessionCount;
     UA_Server *server;
+
+    /* Open-addressing hash maps on the authentication token and the session
+     * id. Both have indexSize slots. The timeout heap has room for half as
+     * many sessions. */
+    session_list_entry **tokenIndex;
+    session_list_entry **idIndex;
+    size_t indexSize;
+
+    /* Min-heap of the sessions ordered by timeoutCheck */
+    session_list_entry **timeoutHeap;
+    size_t timeoutHeapSize;
 } UA_SessionManager;
 
 UA_StatusCode
@@ -16,9 +16,16 @@
 
 #include "ua_subscription.h"
 #include "ua_server_internal.h"
+#include "ua_types_encoding_binary.h"
 
 #ifdef UA_ENABLE_SUBSCRIPTIONS /* conditional compilation */
 
+/* Number of blocks per slab in the memory pool */
+#define UA_SUBSCRIPTION_RETRANSMISSIONSLAB 8
+
+/* Initial capacity of the notification index */
+#define UA_SUBSCRIPTION_NOTIFICATIONINDEX 32
+
 UA_Subscription *
 UA_Subscription_new(UA_Session *session, UA_UInt32 subscriptionId) {
     /* Allocate the memory */
@@ -32,10 +39,22 @@ UA_Subscription_new(UA_Session *session, UA_UInt32 subscriptionId) {
     newSub->subscriptionId = subscriptionId;
     newSub->state = UA_SUBSCRIPTIONSTATE_NORMAL; /* The first publish response is sent immediately */
     TAILQ_INIT(&newSub->retransmissionQueue);
-    TAILQ_INIT(&newSub->notificationQueue);
+    UA_MemoryPool_init(&newSub->retransmissionPool, sizeof(UA_NotificationMessageEntry),
+                       UA_SUBSCRIPTION_RETRANSMISSIONSLAB);
     return newSub;
 }
 
+static void
+removeRetransmissionEntry(UA_Subscription *sub, UA_NotificationMessageEntry *entry) {
+    UA_Session *session = sub->session;
+    TAILQ_REMOVE(&sub->retransmissionQueue, entry, listEntry);
+    TAILQ_REMOVE(&session->retransmissions, entry, sessionListEntry);
+    --sub->retransmissionQueueSize;
+    session->retransmissionBytes -= entry->encoded.length;
+    UA_ByteString_deleteMembers(&entry->encoded);
+    UA_MemoryPool_free(&sub->retransmissionPool, entry);
+}
+
 void
 UA_Subscription_deleteMembers(UA_Server *server, UA_Subscription *sub) {
     UA_LOG_DEBUG_SESSION(server->config.logger, sub->session, "Subscription %u | "
@@ -43,7 +62,10 @@ UA_Subscription_deleteMembers(UA_Server *server, UA_Subscription *sub) {
 
     Subscription_unregisterPublishCallback(server, sub);
 
-    /* Delete monitored Items */
+    /* Delete monitored Items. Drop the notification index first. Then the
+     * MonitoredItems are not removed from it one by one. */
+    sub->notificationQueueSize = 0;
+    sub->readyNotifications = 0;
     UA_MonitoredItem *mon, *tmp_mon;
     LIST_FOREACH_SAFE(mon, &sub->monitoredItems, listEntry, tmp_mon) {
         MonitoredItem_delete(server, mon);
@@ -53,11 +75,16 @@ UA_Subscription_deleteMembers(UA_Server *server, UA_Subscription *sub) {
     /* Delete Retransmission Queue */
     UA_NotificationMessageEntry *nme, *nme_tmp;
     TAILQ_FOREACH_SAFE(nme, &sub->retransmissionQueue, listEntry, nme_tmp) {
-        TAILQ_REMOVE(&sub->retransmissionQueue, nme, listEntry);
-        UA_NotificationMessage_deleteMembers(&nme->message);
-        UA_free(nme);
+        removeRetransmissionEntry(sub, nme);
     }
-    sub->retransmissionQueueSize = 0;
+    UA_assert(sub->retransmissionQueueSize == 0);
+
+    /* Release the notification index and the pool */
+    UA_free(sub->notificationIndex);
+    sub->notificationIndex = NULL;
+    sub->notificationIndexCapacity = 0;
+    sub->notificationIndexHead = 0;
+    UA_MemoryPool_deleteMembers(&sub->retransmissionPool);
 }
 
 UA_MonitoredItem *
@@ -94,6 +121,84 @@ UA_Subscription_addMonitoredItem(UA_Subscription *sub, UA_MonitoredItem *newMon)
     LIST_INSERT_HEAD(&sub->monitoredItems, newMon, listEntry);
 }
 
+static UA_UInt32
+notificationIndexPos(const UA_Subscription *sub, UA_UInt32 i) {
+    UA_UInt32 pos = sub->notificationIndexHead + i;
+    if(pos >= sub->notificationIndexCapacity)
+        pos -= sub->notificationIndexCapacity;
+    return pos;
+}
+
+UA_StatusCode
+UA_Subscription_reserveNotification(UA_Subscription *sub) {
+    UA_UInt32 size = sub->notificationQueueSize;
+    UA_UInt32 oldCapacity = sub->notificationIndexCapacity;
+    if(size < oldCapacity)
+        return UA_STATUSCODE_GOOD;
+
+    /* Double the capacity */
+    UA_UInt32 capacity = oldCapacity * 2;
+    if(capacity == 0)
+        capacity = UA_SUBSCRIPTION_NOTIFICATIONINDEX;
+    if(capacity <= oldCapacity)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    UA_MonitoredItem **index = (UA_MonitoredItem**)
+        UA_malloc(sizeof(UA_MonitoredItem*) * capacity);
+    if(!index)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    /* Unwrap the ring buffer */
+    UA_UInt32 first = oldCapacity - sub->notificationIndexHead;
+    if(first > size)
+        first = size;
+    if(first > 0)
+        memcpy(index, &sub->notificationIndex[sub->notificationIndexHead],
+               sizeof(UA_MonitoredItem*) * first);
+    if(size > first)
+        memcpy(&index[first], sub->notificationIndex,
+               sizeof(UA_MonitoredItem*) * (size - first));
+    UA_free(sub->notificationIndex);
+    sub->notificationIndex = index;
+    sub->notificationIndexCapacity = capacity;
+    sub->notificationIndexHead = 0;
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+UA_Subscription_appendNotification(UA_Subscription *sub, UA_MonitoredItem *mon) {
+    UA_assert(sub->notificationQueueSize < sub->notificationIndexCapacity);
+    sub->notificationIndex[notificationIndexPos(sub, sub->notificationQueueSize)] = mon;
+    ++sub->notificationQueueSize;
+}
+
+void
+UA_Subscription_removeNotifications(UA_Subscription *sub, UA_MonitoredItem *mon,
+                                    UA_UInt32 count) {
+    /* Clear the last entries of the MonitoredItem */
+    UA_UInt32 size = sub->notificationQueueSize;
+    UA_UInt32 found = 0;
+    for(UA_UInt32 i = size; i > 0 && found < count; --i) {
+        UA_UInt32 pos = notificationIndexPos(sub, i - 1);
+        if(sub->notificationIndex[pos] != mon)
+            continue;
+        sub->notificationIndex[pos] = NULL;
+        ++found;
+    }
+    if(found == 0)
+        return;
+
+    /* Close the gaps */
+    UA_UInt32 kept = 0;
+    for(UA_UInt32 i = 0; i < size; ++i) {
+        UA_MonitoredItem *entry = sub->notificationIndex[notificationIndexPos(sub, i)];
+        if(!entry)
+            continue;
+        sub->notificationIndex[notificationIndexPos(sub, kept)] = entry;
+        ++kept;
+    }
+    sub->notificationQueueSize = kept;
+}
+
 static void
 UA_Subscription_addRetransmissionMessage(UA_Server *server, UA_Subscription *sub,
                                          UA_NotificationMessageEntry *entry) {
@@ -102,15 +207,49 @@ UA_Subscription_addRetransmissionMessage(UA_Server *server, UA_Subscription *sub
        sub->retransmissionQueueSize >= server->config.maxRetransmissionQueueSize) {
         UA_NotificationMessageEntry *lastentry =
             TAILQ_LAST(&sub->retransmissionQueue, ListOfNotificationMessages);
-        TAILQ_REMOVE(&sub->retransmissionQueue, lastentry, listEntry);
-        --sub->retransmissionQueueSize;
-        UA_NotificationMessage_deleteMembers(&lastentry->message);
-        UA_free(lastentry);
+        removeRetransmissionEntry(sub, lastentry);
+    }
+
+    /* Release the least recently used entries of the session until the new
+     * entry fits into the byte budget */
+    UA_Session *session = sub->session;
+    size_t maxBytes = server->config.maxRetransmissionBytesPerSession;
+    if(maxBytes > 0) {
+        while(session->retransmissionBytes + entry->encoded.length > maxBytes) {
+            UA_NotificationMessageEntry *lru = TAILQ_FIRST(&session->retransmissions);
+            if(!lru)
+                break;
+            UA_LOG_DEBUG_SESSION(server->config.logger, session, "Subscription %u | "
+                                 "Drop the retransmission message %u to stay within "
+                                 "the session limit", lru->sub->subscriptionId,
+                                 lru->sequenceNumber);
+            removeRetransmissionEntry(lru->sub, lru);
+        }
     }
 
     /* Add entry */
+    entry->sub = sub;
     TAILQ_INSERT_HEAD(&sub->retransmissionQueue, entry, listEntry);
+    TAILQ_INSERT_TAIL(&session->retransmissions, entry, sessionListEntry);
     ++sub->retransmissionQueueSize;
+    session->retransmissionBytes += entry->encoded.length;
+}
+
+UA_NotificationMessageEntry *
+UA_Subscription_getRetransmissionMessage(UA_Subscription *sub, UA_UInt32 sequenceNumber) {
+    UA_NotificationMessageEntry *entry;
+    TAILQ_FOREACH(entry, &sub->retransmissionQueue, listEntry) {
+        if(entry->sequenceNumber == sequenceNumber)
+            break;
+    }
+    if(!entry)
+        return NULL;
+
+    /* Mark as the most recently used */
+    UA_Session *session = sub->session;
+    TAILQ_REMOVE(&session->retransmissions, entry, sessionListEntry);
+    TAILQ_INSERT_TAIL(&session->retransmissions, entry, sessionListEntry);
+    return entry;
 }
 
 UA_StatusCode
@@ -118,88 +257,134 @@ UA_Subscription_removeRetransmissionMessage(UA_Subscription *sub, UA_UInt32 sequ
     /* Find the retransmission message */
     UA_NotificationMessageEntry *entry;
     TAILQ_FOREACH(entry, &sub->retransmissionQueue, listEntry) {
-        if(entry->message.sequenceNumber == sequenceNumber)
+        if(entry->sequenceNumber == sequenceNumber)
             break;
     }
     if(!entry)
         return UA_STATUSCODE_BADSEQUENCENUMBERUNKNOWN;
 
     /* Remove the retransmission message */
-    TAILQ_REMOVE(&sub->retransmissionQueue, entry, listEntry);
-    --sub->retransmissionQueueSize;
-    UA_NotificationMessage_deleteMembers(&entry->message);
-    UA_free(entry);
+    removeRetransmissionEntry(sub, entry);
     return UA_STATUSCODE_GOOD;
 }
 
-/* Iterate over the monitoreditems of the subscription, starting at mon, and
- * move notifications into the response. */
+/* The MonitoredItems of the first index entries start again with their oldest
+ * notification */
 static void
-moveNotificationsFromMonitoredItems(UA_Subscription *sub, UA_MonitoredItemNotification *mins,
-                                    size_t minsSize) {
-    size_t pos = 0;
-    UA_Notification *notification, *notification_tmp;
-    TAILQ_FOREACH_SAFE(notification, &sub->notificationQueue, globalEntry, notification_tmp) {
-        if(pos >= minsSize)
-            return;
-
-        UA_MonitoredItem *mon = notification->mon;
-
-        /* Remove the notification from the queues */
-        TAILQ_REMOVE(&sub->notificationQueue, notification, globalEntry);
-        TAILQ_REMOVE(&mon->queue, notification, listEntry);
-        --mon->queueSize;
-        --sub->notificationQueueSize;
+resetQueueCursors(UA_Subscription *sub, size_t notifications) {
+    for(UA_UInt32 i = 0; i < notifications; ++i)
+        sub->notificationIndex[notificationIndexPos(sub, i)]->queueCursor = 0;
+}
 
-        /* Move the content to the response */
-        UA_MonitoredItemNotification *min = &mins[pos];
-        min->clientHandle = mon->clientHandle;
-        if(mon->monitoredItemType == UA_MONITOREDITEMTYPE_CHANGENOTIFY) {
-            min->value = notification->data.value;
-        } else {
-            /* TODO implementation for events */
-        }
-        UA_free(notification);
-        ++pos;
-    }
+/* Returns the value of the next index entry for the encoding. Event
+ * notifications are not implemented. They are sent as empty data change
+ * notifications. */
+static const UA_DataValue *
+nextNotificationValue(UA_Subscription *sub, UA_UInt32 i, const UA_DataValue *emptyValue,
+                      UA_MonitoredItem **mon) {
+    *mon = sub->notificationIndex[notificationIndexPos(sub, i)];
+    UA_Notification *notification = MonitoredItem_getNotification(*mon, (*mon)->queueCursor);
+    ++(*mon)->queueCursor;
+    if((*mon)->monitoredItemType != UA_MONITOREDITEMTYPE_CHANGENOTIFY)
+        return emptyValue;
+    return &notification->data.value;
 }
 
+/* The NotificationMessage is encoded directly from the notification queues in
+ * the order of the index. There is no intermediate DataChangeNotification
+ * structure. The layout is:
+ *
+ * NotificationMessage: sequenceNumber, publishTime, notificationData[1]
+ *   ExtensionObject: typeId, encoding (ByteString), body length
+ *     DataChangeNotification: monitoredItems[n], diagnosticInfos[-1]
+ *       MonitoredItemNotification: clientHandle, value */
 static UA_StatusCode
-prepareNotificationMessage(UA_Subscription *sub, UA_NotificationMessage *message,
-                           size_t notifications) {
-    /* Array of ExtensionObject to hold different kinds of notifications
-     * (currently only DataChangeNotifications) */
-    message->notificationData = UA_ExtensionObject_new();
-    if(!message->notificationData)
-        return UA_STATUSCODE_BADOUTOFMEMORY;
-    message->notificationDataSize = 1;
+encodeNotificationMessage(UA_Subscription *sub, UA_UInt32 sequenceNumber,
+                          UA_DateTime publishTime, size_t notifications,
+                          UA_ByteString *encoded) {
+    UA_assert(notifications <= sub->notificationQueueSize);
+    UA_DataValue emptyValue;
+    UA_DataValue_init(&emptyValue);
+    UA_MonitoredItem *mon;
 
-    /* Allocate Notification */
-    UA_DataChangeNotification *dcn = UA_DataChangeNotification_new();
-    if(!dcn) {
-        UA_NotificationMessage_deleteMembers(message);
-        return UA_STATUSCODE_BADOUTOFMEMORY;
+    /* Compute the size of the DataChangeNotification. Starting with the array
+     * lengths of the monitoredItems and diagnosticInfos. */
+    size_t bodySize = 8;
+    resetQueueCursors(sub, notifications);
+    for(UA_UInt32 i = 0; i < notifications; ++i) {
+        const UA_DataValue *value = nextNotificationValue(sub, i, &emptyValue, &mon);
+        bodySize += 4 + UA_calcSizeBinary(value, &UA_TYPES[UA_TYPES_DATAVALUE]);
     }
-    UA_ExtensionObject *data = message->notificationData;
-    data->encoding = UA_EXTENSIONOBJECT_DECODED;
-    data->content.decoded.data = dcn;
-    data->content.decoded.type = &UA_TYPES[UA_TYPES_DATACHANGENOTIFICATION];
-
-    /* Allocate array of notifications */
-    dcn->monitoredItems = (UA_MonitoredItemNotification *)
-        UA_Array_new(notifications,
-                     &UA_TYPES[UA_TYPES_MONITOREDITEMNOTIFICATION]);
-    if(!dcn->monitoredItems) {
-        UA_NotificationMessage_deleteMembers(message);
-        return UA_STATUSCODE_BADOUTOFMEMORY;
+    if(bodySize > UA_INT32_MAX)
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+
+    /* Allocate the buffer for the NotificationMessage */
+    UA_NodeId typeId =
+        UA_NODEID_NUMERIC(0, UA_TYPES[UA_TYPES_DATACHANGENOTIFICATION].binaryEncodingId);
+    size_t size = 4 + 8 + 4 + UA_calcSizeBinary(&typeId, &UA_TYPES[UA_TYPES_NODEID]) +
+        1 + 4 + bodySize;
+    UA_StatusCode retval = UA_ByteString_allocBuffer(encoded, size);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    UA_Byte *bufPos = encoded->data;
+    const UA_Byte *bufEnd = &encoded->data[encoded->length];
+
+    /* Encode the header of the NotificationMessage and the ExtensionObject */
+    UA_Int32 arraySize = 1;
+    UA_Byte encoding = (UA_Byte)UA_EXTENSIONOBJECT_ENCODED_BYTESTRING;
+    UA_Int32 bodyLength = (UA_Int32)bodySize;
+    retval |= UA_encodeBinary(&sequenceNumber, &UA_TYPES[UA_TYPES_UINT32],
+                              &bufPos, &bufEnd, NULL, NULL);
+    retval |= UA_encodeBinary(&publishTime, &UA_TYPES[UA_TYPES_DATETIME],
+                              &bufPos, &bufEnd, NULL, NULL);
+    retval |= UA_encodeBinary(&arraySize, &UA_TYPES[UA_TYPES_INT32],
+                              &bufPos, &bufEnd, NULL, NULL);
+    retval |= UA_encodeBinary(&typeId, &UA_TYPES[UA_TYPES_NODEID],
+                              &bufPos, &bufEnd, NULL, NULL);
+    retval |= UA_encodeBinary(&encoding, &UA_TYPES[UA_TYPES_BYTE],
+                              &bufPos, &bufEnd, NULL, NULL);
+    retval |= UA_encodeBinary(&bodyLength, &UA_TYPES[UA_TYPES_INT32],
+                              &bufPos, &bufEnd, NULL, NULL);
+
+    /* Encode the MonitoredItemNotifications */
+    arraySize = (UA_Int32)notifications;
+    retval |= UA_encodeBinary(&arraySize, &UA_TYPES[UA_TYPES_INT32],
+                              &bufPos, &bufEnd, NULL, NULL);
+    resetQueueCursors(sub, notifications);
+    for(UA_UInt32 i = 0; i < notifications; ++i) {
+        const UA_DataValue *value = nextNotificationValue(sub, i, &emptyValue, &mon);
+        retval |= UA_encodeBinary(&mon->clientHandle, &UA_TYPES[UA_TYPES_UINT32],
+                                  &bufPos, &bufEnd, NULL, NULL);
+        retval |= UA_encodeBinary(value, &UA_TYPES[UA_TYPES_DATAVALUE],
+                                  &bufPos, &bufEnd, NULL, NULL);
     }
-    dcn->monitoredItemsSize = notifications;
 
-    /* Move notifications into the response .. the point of no return */
+    /* No DiagnosticInfos */
+    arraySize = -1;
+    retval |= UA_encodeBinary(&arraySize, &UA_TYPES[UA_TYPES_INT32],
+                              &bufPos, &bufEnd, NULL, NULL);
 
-    moveNotificationsFromMonitoredItems(sub, dcn->monitoredItems, notifications);
+    UA_assert(retval != UA_STATUSCODE_GOOD || bufPos == bufEnd);
+    if(retval != UA_STATUSCODE_GOOD)
+        UA_ByteString_deleteMembers(encoded);
+    return retval;
+}
 
-    return UA_STATUSCODE_GOOD;
+/* Remove the notifications that were encoded from the queues */
+static void
+removeSentNotifications(UA_Subscription *sub, size_t notifications) {
+    for(size_t i = 0; i < notifications; ++i) {
+        UA_MonitoredItem *mon = sub->notificationIndex[sub->notificationIndexHead];
+        sub->notificationIndexHead = notificationIndexPos(sub, 1);
+        --sub->notificationQueueSize;
+
+        UA_assert(mon->queueSize > 0);
+        if(mon->monitoredItemType == UA_MONITOREDITEMTYPE_CHANGENOTIFY)
+            UA_Notification_deleteMembers(MonitoredItem_getNotification(mon, 0));
+        if(++mon->queueHead == mon->maxQueueSize)
+            mon->queueHead = 0;
+        --mon->queueSize;
+    }
 }
 
 /* According to OPC Unified Architecture, Part 4 5.13.1.1 i) The value 0 is
@@ -212,14 +397,89 @@ UA_Subscription_nextSequenceNumber(UA_UInt32 sequenceNumber) {
     return nextSequenceNumber;
 }
 
-static void
-publishCallback(UA_Server *server, UA_Subscription *sub) {
-    sub->readyNotifications = sub->notificationQueueSize;
-    UA_Subscription_publish(server, sub);
+static UA_StatusCode
+encodePublishResponseArray(UA_MessageContext *mc, const void *array, size_t size,
+                           const UA_DataType *type) {
+    UA_Int32 arraySize = (UA_Int32)size;
+    if(size == 0 && !array)
+        arraySize = -1;
+    UA_StatusCode retval = UA_MessageContext_encode(mc, &arraySize, &UA_TYPES[UA_TYPES_INT32]);
+    uintptr_t ptr = (uintptr_t)array;
+    for(size_t i = 0; i < size && retval == UA_STATUSCODE_GOOD; ++i) {
+        retval = UA_MessageContext_encode(mc, (const void*)ptr, type);
+        ptr += type->memSize;
+    }
+    return retval;
 }
 
+/* The PublishResponse is encoded field by field. So the NotificationMessage
+ * that was encoded for the retransmission queue is streamed into the chunks
+ * without encoding it a second time. Keepalive messages are not retained and
+ * encoded from the response. With a cork, the chunks are collected for a
+ * single send with the other responses of the publish cycle. */
+static UA_StatusCode
+sendPublishResponse(UA_SecureChannel *channel, UA_SendCork *cork, UA_UInt32 requestId,
+                    UA_PublishResponse *response, const UA_ByteString *encodedMessage) {
+    if(channel->connection && channel->connection->state == UA_CONNECTION_CLOSED)
+        return UA_STATUSCODE_BADCONNECTIONCLOSED;
+
+    UA_MessageContext mc;
+    UA_StatusCode retval = UA_MessageContext_begin(&mc, channel, requestId, UA_MESSAGETYPE_MSG);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    mc.cork = cork;
+
+    UA_NodeId typeId =
+        UA_NODEID_NUMERIC(0, UA_TYPES[UA_TYPES_PUBLISHRESPONSE].binaryEncodingId);
+    retval = UA_MessageContext_encode(&mc, &typeId, &UA_TYPES[UA_TYPES_NODEID]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    retval = UA_MessageContext_encode(&mc, &response->responseHeader,
+                                      &UA_TYPES[UA_TYPES_RESPONSEHEADER]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    retval = UA_MessageContext_encode(&mc, &response->subscriptionId,
+                                      &UA_TYPES[UA_TYPES_UINT32]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    retval = encodePublishResponseArray(&mc, response->availableSequenceNumbers,
+                                        response->availableSequenceNumbersSize,
+                                        &UA_TYPES[UA_TYPES_UINT32]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    retval = UA_MessageContext_encode(&mc, &response->moreNotifications,
+                                      &UA_TYPES[UA_TYPES_BOOLEAN]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    if(encodedMessage)
+        retval = UA_MessageContext_encodeRaw(&mc, encodedMessage);
+    else
+        retval = UA_MessageContext_encode(&mc, &response->notificationMessage,
+                                          &UA_TYPES[UA_TYPES_NOTIFICATIONMESSAGE]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    retval = encodePublishResponseArray(&mc, response->results, response->resultsSize,
+                                        &UA_TYPES[UA_TYPES_STATUSCODE]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    retval = encodePublishResponseArray(&mc, response->diagnosticInfos,
+                                        response->diagnosticInfosSize,
+                                        &UA_TYPES[UA_TYPES_DIAGNOSTICINFO]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return UA_MessageContext_finish(&mc);
+}
+
+static void
+publishSubscription(UA_Server *server, UA_Subscription *sub, UA_SendCork *cork);
+
 void
 UA_Subscription_publish(UA_Server *server, UA_Subscription *sub) {
+    publishSubscription(server, sub, NULL);
+}
+
+static void
+publishSubscription(UA_Server *server, UA_Subscription *sub, UA_SendCork *cork) {
     UA_LOG_DEBUG_SESSION(server->config.logger, sub->session, "Subscription %u | "
                          "Publish Callback", sub->subscriptionId);
     /* Dequeue a response */
@@ -281,13 +541,21 @@ UA_Subscription_publish(UA_Server *server, UA_Subscription *sub) {
         return;
     }
 
-    /* Prepare the response */
+    /* Prepare the response. The sequence number will be reused if there are
+     * no notifications (and this is a keepalive message). */
     UA_PublishResponse *response = &pre->response;
     UA_NotificationMessage *message = &response->notificationMessage;
+    response->responseHeader.timestamp = UA_DateTime_now();
+    response->subscriptionId = sub->subscriptionId;
+    response->moreNotifications = moreNotifications;
+    message->publishTime = response->responseHeader.timestamp;
+    message->sequenceNumber = UA_Subscription_nextSequenceNumber(sub->sequenceNumber);
+
     UA_NotificationMessageEntry *retransmission = NULL;
     if(notifications > 0) {
         /* Allocate the retransmission entry */
-        retransmission = (UA_NotificationMessageEntry*)UA_malloc(sizeof(UA_NotificationMessageEntry));
+        retransmission = (UA_NotificationMessageEntry*)
+            UA_MemoryPool_alloc(&sub->retransmissionPool);
         if(!retransmission) {
             UA_LOG_WARNING_SESSION(server->config.logger, sub->session,
                                    "Subscription %u | Could not allocate memory for retransmission. "
@@ -297,13 +565,16 @@ UA_Subscription_publish(UA_Server *server, UA_Subscription *sub) {
             return;
         }
 
-        /* Prepare the response */
-        UA_StatusCode retval = prepareNotificationMessage(sub, message, notifications);
+        /* Encode the notification message for sending and retransmission */
+        retransmission->sequenceNumber = message->sequenceNumber;
+        UA_StatusCode retval =
+            encodeNotificationMessage(sub, message->sequenceNumber, message->publishTime,
+                                      notifications, &retransmission->encoded);
         if(retval != UA_STATUSCODE_GOOD) {
             UA_LOG_WARNING_SESSION(server->config.logger, sub->session,
                                    "Subscription %u | Could not prepare the notification message. "
                                    "The subscription is late.", sub->subscriptionId);
-            UA_free(retransmission);
+            UA_MemoryPool_free(&sub->retransmissionPool, retransmission);
             sub->state = UA_SUBSCRIPTIONSTATE_LATE;
             UA_Session_queuePublishReq(sub->session, pre, true); /* Re-enqueue */
             return;
@@ -312,28 +583,18 @@ UA_Subscription_publish(UA_Server *server, UA_Subscription *sub) {
 
     /* <-- The point of no return --> */
 
-    /* Adjust the number of ready notifications */
-    UA_assert(sub->readyNotifications >= notifications);
-    sub->readyNotifications -= notifications;
-
-    /* Set up the response */
-    response->responseHeader.timestamp = UA_DateTime_now();
-    response->subscriptionId = sub->subscriptionId;
-    response->moreNotifications = moreNotifications;
-    message->publishTime = response->responseHeader.timestamp;
-
-    /* Set the sequence number. The sequence number will be reused if there are
-     * no notifications (and this is a keepalive message). */
-    message->sequenceNumber = UA_Subscription_nextSequenceNumber(sub->sequenceNumber);
-
     if(notifications != 0) {
+        /* Remove the encoded notifications from the queues */
+        removeSentNotifications(sub, notifications);
+        UA_assert(sub->readyNotifications >= notifications);
+        sub->readyNotifications -= notifications;
+
         /* There are notifications. So we can't reuse the sequence number. */
         sub->sequenceNumber = message->sequenceNumber;
 
         /* Put the notification message into the retransmission queue. This
          * needs to be done here, so that the message itself is included in the
          * available sequence numbers for acknowledgement. */
-        retransmission->message = response->notificationMessage;
         UA_Subscription_addRetransmissionMessage(server, sub, retransmission);
     }
 
@@ -346,7 +607,7 @@ UA_Subscription_publish(UA_Server *server, UA_Subscription *sub) {
         size_t i = 0;
         UA_NotificationMessageEntry *nme;
         TAILQ_FOREACH(nme, &sub->retransmissionQueue, listEntry) {
-            response->availableSequenceNumbers[i] = nme->message.sequenceNumber;
+            response->availableSequenceNumbers[i] = nme->sequenceNumber;
             ++i;
         }
     }
@@ -356,21 +617,21 @@ UA_Subscription_publish(UA_Server *server, UA_Subscription *sub) {
                          "Subscription %u | Sending out a publish response "
                          "with %u notifications", sub->subscriptionId,
                          (UA_UInt32)notifications);
-    UA_SecureChannel_sendSymmetricMessage(sub->session->header.channel, pre->requestId,
-                                          UA_MESSAGETYPE_MSG, response,
-                                          &UA_TYPES[UA_TYPES_PUBLISHRESPONSE]);
+    sendPublishResponse(channel, cork, pre->requestId, response,
+                        retransmission ? &retransmission->encoded : NULL);
 
     /* Reset subscription state to normal */
     sub->state = UA_SUBSCRIPTIONSTATE_NORMAL;
     sub->currentKeepAliveCount = 0;
 
-    /* Free the response */
+    /* Free the response. The available sequence numbers are on the stack and
+     * the notification message is encoded in the retransmission entry. */
     UA_Array_delete(response->results, response->resultsSize, &UA_TYPES[UA_TYPES_UINT32]);
-    UA_free(pre); /* No need for UA_PublishResponse_deleteMembers */
+    UA_free(pre);
 
     /* Repeat sending responses if there are more notifications to send */
     if(moreNotifications)
-        UA_Subscription_publish(server, sub);
+        publishSubscription(server, sub, cork);
 }
 
 UA_Boolean
@@ -413,22 +674,108 @@ UA_Subscription_reachedPublishReqLimit(UA_Server *server,  UA_Session *session)
     return true;
 }
 
+static void
+removePublishGroup(UA_Server *server, UA_PublishGroup *pg) {
+    UA_Server_removeRepeatedCallback(server, pg->callbackId);
+    LIST_REMOVE(pg, listEntry);
+    UA_Server_delayedFree(server, pg);
+}
+
+/* Publish the due subscriptions of the group in one batch. The responses are
+ * collected and handed to the network layer in one send. */
+static void
+publishGroupCallback(UA_Server *server, UA_PublishGroup *pg) {
+    UA_SecureChannel *channel = pg->session->header.channel;
+    UA_SendCork cork;
+    UA_SendCork *corkp = NULL;
+    if(channel && channel->connection) {
+        UA_SendCork_init(&cork, channel);
+        corkp = &cork;
+    }
+
+    /* Subscriptions can be deleted during the publish (end of lifetime). The
+     * group is not removed before the loop has finished. */
+    pg->processing = true;
+    UA_Subscription *sub, *sub_tmp;
+    LIST_FOREACH_SAFE(sub, &pg->subscriptions, publishGroupEntry, sub_tmp) {
+        ++sub->currentPublishTick;
+        if(sub->currentPublishTick < sub->publishTicks)
+            continue;
+        sub->currentPublishTick = 0;
+        sub->readyNotifications = sub->notificationQueueSize;
+        publishSubscription(server, sub, corkp);
+    }
+    pg->processing = false;
+
+    if(corkp) {
+        UA_StatusCode retval = UA_SendCork_finish(corkp);
+        if(retval != UA_STATUSCODE_GOOD)
+            UA_LOG_DEBUG_SESSION(server->config.logger, pg->session,
+                                 "Sending the publish responses failed "
+                                 "with error code %s", UA_StatusCode_name(retval));
+    }
+
+    if(LIST_EMPTY(&pg->subscriptions))
+        removePublishGroup(server, pg);
+}
+
 UA_StatusCode
 Subscription_registerPublishCallback(UA_Server *server, UA_Subscription *sub) {
     UA_LOG_DEBUG_SESSION(server->config.logger, sub->session,
                          "Subscription %u | Register subscription "
                          "publishing callback", sub->subscriptionId);
 
-    if(sub->publishCallbackIsRegistered)
+    if(sub->publishGroup)
         return UA_STATUSCODE_GOOD;
 
-    UA_StatusCode retval =
-        UA_Server_addRepeatedCallback(server, (UA_ServerCallback)publishCallback,
-                                      sub, (UA_UInt32)sub->publishingInterval, &sub->publishCallbackId);
-    if(retval != UA_STATUSCODE_GOOD)
-        return retval;
+    UA_UInt32 interval = (UA_UInt32)sub->publishingInterval;
+    if(interval == 0)
+        return UA_STATUSCODE_BADINTERNALERROR;
+
+    /* Join the group with the largest base interval that divides the
+     * publishing interval */
+    UA_PublishGroup *pg = NULL, *pg_iter;
+    LIST_FOREACH(pg_iter, &sub->session->publishGroups, listEntry) {
+        if(interval % pg_iter->interval != 0)
+            continue;
+        if(!pg || pg_iter->interval > pg->interval)
+            pg = pg_iter;
+    }
 
-    sub->publishCallbackIsRegistered = true;
+    /* Create a new group */
+    if(!pg) {
+        pg = (UA_PublishGroup*)UA_calloc(1, sizeof(UA_PublishGroup));
+        if(!pg)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        pg->session = sub->session;
+        pg->interval = interval;
+        LIST_INIT(&pg->subscriptions);
+        UA_StatusCode retval =
+            UA_Server_addRepeatedCallback(server, (UA_ServerCallback)publishGroupCallback,
+                                          pg, interval, &pg->callbackId);
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_free(pg);
+            return retval;
+        }
+        LIST_INSERT_HEAD(&sub->session->publishGroups, pg, listEntry);
+    }
+
+    /* Insert in the order of the priority. Higher priorities are published
+     * first. */
+    UA_Subscription *prev = NULL, *sub_iter;
+    LIST_FOREACH(sub_iter, &pg->subscriptions, publishGroupEntry) {
+        if(sub_iter->priority < sub->priority)
+            break;
+        prev = sub_iter;
+    }
+    if(prev)
+        LIST_INSERT_AFTER(prev, sub, publishGroupEntry);
+    else
+        LIST_INSERT_HEAD(&pg->subscriptions, sub, publishGroupEntry);
+
+    sub->publishGroup = pg;
+    sub->publishTicks = interval / pg->interval;
+    sub->currentPublishTick = 0;
     return UA_STATUSCODE_GOOD;
 }
 
@@ -437,14 +784,16 @@ Subscription_unregisterPublishCallback(UA_Server *server, UA_Subscription *sub)
     UA_LOG_DEBUG_SESSION(server->config.logger, sub->session, "Subscription %u | "
                          "Unregister subscription publishing callback", sub->subscriptionId);
 
-    if(!sub->publishCallbackIsRegistered)
+    UA_PublishGroup *pg = sub->publishGroup;
+    if(!pg)
         return UA_STATUSCODE_GOOD;
 
-    UA_StatusCode retval = UA_Server_removeRepeatedCallback(server, sub->publishCallbackId);
-    if(retval != UA_STATUSCODE_GOOD)
-        return retval;
+    LIST_REMOVE(sub, publishGroupEntry);
+    sub->publishGroup = NULL;
 
-    sub->publishCallbackIsRegistered = false;
+    /* Remove the empty group. Unless it is currently publishing. */
+    if(LIST_EMPTY(&pg->subscriptions) && !pg->processing)
+        removePublishGroup(server, pg);
     return UA_STATUSCODE_GOOD;
 }
 
@@ -18,6 +18,7 @@
 #include "ua_types.h"
 #include "ua_types_generated.h"
 #include "ua_session.h"
+#include "ua_mempool.h"
 
 /**
  * MonitoredItems create Notifications. Subscriptions collect Notifications from
@@ -49,11 +50,22 @@ typedef struct UA_Event {
 struct UA_MonitoredItem;
 typedef struct UA_MonitoredItem UA_MonitoredItem;
 
-typedef struct UA_Notification {
-    TAILQ_ENTRY(UA_Notification) listEntry;
-    TAILQ_ENTRY(UA_Notification) globalEntry;
+/* A sampled variant that is shared between the notifications and the last
+ * values of the MonitoredItems in a sample group. The variant is freed with
+ * the last reference. */
+typedef struct {
+    UA_Variant value;
+    UA_UInt32 refCount;
+} UA_SharedValue;
+
+/* Takes over the content of the variant. The reference count is one. */
+UA_SharedValue * UA_SharedValue_new(UA_Variant *value);
+void UA_SharedValue_release(UA_SharedValue *sv);
 
-    UA_MonitoredItem *mon;
+/* Notifications are stored inline in the queue of the MonitoredItem */
+typedef struct UA_Notification {
+    /* If set, the variant of the value points into the shared value */
+    UA_SharedValue *shared;
 
     /* See the monitoredItemType of the MonitoredItem */
     union {
@@ -62,7 +74,50 @@ typedef struct UA_Notification {
     } data;
 } UA_Notification;
 
-typedef TAILQ_HEAD(NotificationQueue, UA_Notification) NotificationQueue;
+/* Free the content of the notification and release the shared value */
+void UA_Notification_deleteMembers(UA_Notification *notification);
+
+/* Bucket in the server-wide index of MonitoredItems sampled on write */
+LIST_HEAD(UA_MonitoredItemBucket, UA_MonitoredItem);
+
+/* MonitoredItems of a session on nodes with the same bulk data source and with
+ * the same sampling interval share a repeated callback. The values are then
+ * read from the source in one batch. */
+typedef struct UA_BulkSampleGroup {
+    LIST_ENTRY(UA_BulkSampleGroup) listEntry;
+    UA_BulkDataSource *bulkDataSource;
+    UA_Session *session;
+    UA_UInt32 samplingInterval;
+    UA_UInt64 sampleCallbackId;
+    LIST_HEAD(, UA_MonitoredItem) monitoredItems;
+    size_t monitoredItemsSize;
+} UA_BulkSampleGroup;
+
+/* MonitoredItems on the Value attribute of the same node, with the same index
+ * range and sampling interval, share a sample group. The value is read and
+ * compared with the last sample once per interval. The MonitoredItems are
+ * only evaluated when it changed. The sampled variant is then shared between
+ * their notifications. */
+typedef struct UA_SampleGroup {
+    LIST_ENTRY(UA_SampleGroup) listEntry; /* In the bucket of the hash table */
+    UA_UInt32 hash;
+    UA_NodeId nodeId;
+    UA_String indexRange;
+    UA_UInt32 samplingInterval;
+    UA_UInt64 sampleCallbackId;
+    LIST_HEAD(, UA_MonitoredItem) monitoredItems;
+    size_t monitoredItemsSize;
+
+    /* Added MonitoredItems were not yet evaluated against the last sample */
+    UA_Boolean newMonitoredItems;
+
+    /* The last sample. The variant points into the shared value. */
+    UA_DataValue lastValue;
+    UA_SharedValue *lastShared;
+} UA_SampleGroup;
+
+/* Bucket in the server-wide hash table of sample groups */
+LIST_HEAD(UA_SampleGroupBucket, UA_SampleGroup);
 
 struct UA_MonitoredItem {
     LIST_ENTRY(UA_MonitoredItem) listEntry;
@@ -82,34 +137,80 @@ struct UA_MonitoredItem {
     UA_Boolean discardOldest;
     // TODO: dataEncoding is hardcoded to UA binary
     UA_DataChangeTrigger trigger;
+    UA_Double deadband; /* Absolute deadband for numeric values. A percent
+                         * deadband is converted with the EURange of the
+                         * variable when the filter is set. */
 
-    /* Sample Callback */
+    /* Sample Callback. Either a repeated callback, an entry in the index of
+     * MonitoredItems that are sampled when the node is written or a member of
+     * a bulk sample group or of a shared sample group. */
     UA_UInt64 sampleCallbackId;
-    UA_ByteString lastSampledValue;
     UA_Boolean sampleCallbackIsRegistered;
-
-    /* Notification Queue */
-    NotificationQueue queue;
+    UA_Boolean sampleOnWrite;
+    LIST_ENTRY(UA_MonitoredItem) monitoredNodeEntry;
+    UA_UInt32 monitoredNodeHash;
+    UA_BulkSampleGroup *bulkSampleGroup;
+    LIST_ENTRY(UA_MonitoredItem) bulkSampleEntry;
+    UA_SampleGroup *sampleGroup;
+    LIST_ENTRY(UA_MonitoredItem) sampleGroupEntry;
+
+    /* The last reported value, reduced to the fields that are relevant for the
+     * trigger. New samples are compared against it. The variant points into
+     * the shared value if that is set. */
+    UA_DataValue lastValue;
+    UA_Boolean lastValueSet;
+    UA_SharedValue *lastValueShared;
+
+    /* Notification queue. A ring buffer with maxQueueSize entries that is
+     * allocated when the queue size is set. The oldest notification is at
+     * queueHead. */
+    UA_Notification *queue;
+    UA_UInt32 queueHead;
     UA_UInt32 queueSize;
+    UA_UInt32 queueCursor; /* Scratch position while publishing */
 };
 
+/* Returns the i-th oldest notification in the queue */
+static UA_INLINE UA_Notification *
+MonitoredItem_getNotification(UA_MonitoredItem *mon, UA_UInt32 i) {
+    UA_UInt32 pos = mon->queueHead + i;
+    if(pos >= mon->maxQueueSize)
+        pos -= mon->maxQueueSize;
+    return &mon->queue[pos];
+}
+
 UA_MonitoredItem * UA_MonitoredItem_new(UA_MonitoredItemType);
 void MonitoredItem_delete(UA_Server *server, UA_MonitoredItem *monitoredItem);
 void UA_MonitoredItem_SampleCallback(UA_Server *server, UA_MonitoredItem *monitoredItem);
 UA_StatusCode MonitoredItem_registerSampleCallback(UA_Server *server, UA_MonitoredItem *mon);
 UA_StatusCode MonitoredItem_unregisterSampleCallback(UA_Server *server, UA_MonitoredItem *mon);
 
-/* Remove entries until mon->maxQueueSize is reached. Sets infobits for lost
- * data if required. */
-void MonitoredItem_ensureQueueSpace(UA_MonitoredItem *mon);
+/* Reallocate the queue for the new size. If the queue shrinks, notifications
+ * are removed according to discardOldest. Then the infobits for lost data are
+ * set if required. */
+UA_StatusCode
+MonitoredItem_setQueueSize(UA_MonitoredItem *mon, UA_UInt32 maxQueueSize,
+                           UA_Boolean discardOldest);
+
+/* Remove all queued notifications */
+void MonitoredItem_clearQueue(UA_MonitoredItem *mon);
+
+/* Forget the last reported value. The next sample creates a notification. */
+void MonitoredItem_resetLastValue(UA_MonitoredItem *mon);
 
 /****************/
 /* Subscription */
 /****************/
 
+/* Sent NotificationMessages are retained in binary encoding until they are
+ * acknowledged. Republish streams the bytes without re-encoding. */
 typedef struct UA_NotificationMessageEntry {
     TAILQ_ENTRY(UA_NotificationMessageEntry) listEntry;
-    UA_NotificationMessage message;
+    TAILQ_ENTRY(UA_NotificationMessageEntry) sessionListEntry; /* In the order of
+                                                                * the last use */
+    UA_Subscription *sub;
+    UA_UInt32 sequenceNumber;
+    UA_ByteString encoded; /* Encoded NotificationMessage */
 } UA_NotificationMessageEntry;
 
 /* We use only a subset of the states defined in the standard */
@@ -121,6 +222,19 @@ typedef enum {
     UA_SUBSCRIPTIONSTATE_KEEPALIVE
 } UA_SubscriptionState;
 
+/* The subscriptions of a session with equal or harmonic publishing intervals
+ * share a repeated callback at the base interval. In every cycle, the due
+ * subscriptions are published in one batch (in the order of their priority)
+ * and the responses are handed to the network layer in one send. */
+struct UA_PublishGroup {
+    LIST_ENTRY(UA_PublishGroup) listEntry;
+    UA_Session *session;
+    UA_UInt32 interval; /* The base interval in ms */
+    UA_UInt64 callbackId;
+    UA_Boolean processing; /* Removal is deferred while publishing */
+    LIST_HEAD(, UA_Subscription) subscriptions;
+};
+
 typedef TAILQ_HEAD(ListOfNotificationMessages, UA_NotificationMessageEntry) ListOfNotificationMessages;
 
 struct UA_Subscription {
@@ -142,23 +256,33 @@ struct UA_Subscription {
     UA_UInt32 currentKeepAliveCount;
     UA_UInt32 currentLifetimeCount;
 
-    /* Publish Callback */
-    UA_UInt64 publishCallbackId;
-    UA_Boolean publishCallbackIsRegistered;
+    /* Publish Callback. The subscription is published every publishTicks-th
+     * cycle of the PublishGroup. */
+    UA_PublishGroup *publishGroup;
+    LIST_ENTRY(UA_Subscription) publishGroupEntry;
+    UA_UInt32 publishTicks;
+    UA_UInt32 currentPublishTick;
 
     /* MonitoredItems */
     UA_UInt32 lastMonitoredItemId; /* increase the identifiers */
     LIST_HEAD(UA_ListOfUAMonitoredItems, UA_MonitoredItem) monitoredItems;
     UA_UInt32 monitoredItemsSize;
 
-    /* Global list of notifications from the MonitoredItems */
-    NotificationQueue notificationQueue;
-    UA_UInt32 notificationQueueSize;
+    /* Global order of the notifications in the queues of the MonitoredItems.
+     * Every entry stands for the oldest notification of the MonitoredItem that
+     * is not taken by an earlier entry. A ring buffer that grows on demand. */
+    UA_MonitoredItem **notificationIndex;
+    UA_UInt32 notificationIndexCapacity;
+    UA_UInt32 notificationIndexHead;
+    UA_UInt32 notificationQueueSize; /* Entries in the index */
     UA_UInt32 readyNotifications; /* Notifications to be sent out now (already late) */
 
     /* Retransmission Queue */
     ListOfNotificationMessages retransmissionQueue;
     UA_UInt32 retransmissionQueueSize;
+
+    /* The retransmission entries are taken from a pool of the subscription */
+    UA_MemoryPool retransmissionPool;
 };
 
 UA_Subscription * UA_Subscription_new(UA_Session *session, UA_UInt32 subscriptionId);
@@ -168,12 +292,26 @@ UA_StatusCode Subscription_unregisterPublishCallback(UA_Server *server, UA_Subsc
 void UA_Subscription_addMonitoredItem(UA_Subscription *sub, UA_MonitoredItem *newMon);
 UA_MonitoredItem * UA_Subscription_getMonitoredItem(UA_Subscription *sub, UA_UInt32 monitoredItemId);
 
+/* Make room for one more entry in the notification index. Then appending
+ * cannot fail. */
+UA_StatusCode UA_Subscription_reserveNotification(UA_Subscription *sub);
+void UA_Subscription_appendNotification(UA_Subscription *sub, UA_MonitoredItem *mon);
+
+/* Remove the last count entries of the MonitoredItem from the index */
+void UA_Subscription_removeNotifications(UA_Subscription *sub, UA_MonitoredItem *mon,
+                                         UA_UInt32 count);
+
 UA_StatusCode
 UA_Subscription_deleteMonitoredItem(UA_Server *server, UA_Subscription *sub,
                                     UA_UInt32 monitoredItemId);
 
 void UA_Subscription_publish(UA_Server *server, UA_Subscription *sub);
 UA_StatusCode UA_Subscription_removeRetransmissionMessage(UA_Subscription *sub, UA_UInt32 sequenceNumber);
+
+/* Returns NULL if the message is not (or no longer) available. Otherwise the
+ * entry is marked as the most recently used in the session. */
+UA_NotificationMessageEntry *
+UA_Subscription_getRetransmissionMessage(UA_Subscription *sub, UA_UInt32 sequenceNumber);
 void UA_Subscription_answerPublishRequestsNoSubscription(UA_Server *server, UA_Session *session);
 UA_Boolean UA_Subscription_reachedPublishReqLimit(UA_Server *server,  UA_Session *session);
 
@@ -13,8 +13,48 @@
 
 #ifdef UA_ENABLE_SUBSCRIPTIONS /* conditional compilation */
 
+/* Stack space for the encoding of small structures when they are compared */
 #define UA_VALUENCODING_MAXSTACK 512
 
+UA_SharedValue *
+UA_SharedValue_new(UA_Variant *value) {
+    UA_SharedValue *sv = (UA_SharedValue*)UA_malloc(sizeof(UA_SharedValue));
+    if(!sv)
+        return NULL;
+    sv->value = *value;
+    sv->refCount = 1;
+    UA_Variant_init(value);
+    return sv;
+}
+
+void
+UA_SharedValue_release(UA_SharedValue *sv) {
+    if(UA_atomic_subUInt32(&sv->refCount, 1) > 0)
+        return;
+    UA_Variant_deleteMembers(&sv->value);
+    UA_free(sv);
+}
+
+/* Returns a shallow copy of the DataValue that points into the shared value */
+static void
+shareDataValue(UA_SharedValue *sv, const UA_DataValue *src, UA_DataValue *dst) {
+    *dst = *src;
+    if(!dst->hasValue)
+        return;
+    dst->value = sv->value;
+    dst->value.storageType = UA_VARIANT_DATA_NODELETE;
+    UA_atomic_addUInt32(&sv->refCount, 1);
+}
+
+void
+UA_Notification_deleteMembers(UA_Notification *notification) {
+    UA_DataValue_deleteMembers(&notification->data.value);
+    if(notification->shared) {
+        UA_SharedValue_release(notification->shared);
+        notification->shared = NULL;
+    }
+}
+
 UA_MonitoredItem *
 UA_MonitoredItem_new(UA_MonitoredItemType monType) {
     /* Allocate the memory */
@@ -26,7 +66,6 @@ UA_MonitoredItem_new(UA_MonitoredItemType monType) {
     /* Remaining members are covered by calloc zeroing out the memory */
     newItem->monitoredItemType = monType; /* currently hardcoded */
     newItem->timestampsToReturn = UA_TIMESTAMPSTORETURN_SOURCE;
-    TAILQ_INIT(&newItem->queue);
     return newItem;
 }
 
@@ -43,17 +82,7 @@ MonitoredItem_delete(UA_Server *server, UA_MonitoredItem *monitoredItem) {
         MonitoredItem_unregisterSampleCallback(server, monitoredItem);
 
         /* Clear the queued notifications */
-        UA_Notification *notification, *notification_tmp;
-        TAILQ_FOREACH_SAFE(notification, &monitoredItem->queue, listEntry, notification_tmp) {
-            /* Remove the item from the queues */
-            TAILQ_REMOVE(&monitoredItem->queue, notification, listEntry);
-            TAILQ_REMOVE(&sub->notificationQueue, notification, globalEntry);
-            --sub->notificationQueueSize;
-
-            UA_DataValue_deleteMembers(&notification->data.value);
-            UA_free(notification);
-        }
-        monitoredItem->queueSize = 0;
+        MonitoredItem_clearQueue(monitoredItem);
     } else {
         /* TODO: Access val data.event */
         UA_LOG_ERROR(server->config.logger, UA_LOGCATEGORY_SERVER,
@@ -63,204 +92,388 @@ MonitoredItem_delete(UA_Server *server, UA_MonitoredItem *monitoredItem) {
     /* Remove the monitored item */
     LIST_REMOVE(monitoredItem, listEntry);
     UA_String_deleteMembers(&monitoredItem->indexRange);
-    UA_ByteString_deleteMembers(&monitoredItem->lastSampledValue);
+    MonitoredItem_resetLastValue(monitoredItem);
     UA_NodeId_deleteMembers(&monitoredItem->monitoredNodeId);
+    UA_free(monitoredItem->queue);
+    monitoredItem->queue = NULL;
     UA_Server_delayedFree(server, monitoredItem);
 }
 
-void MonitoredItem_ensureQueueSpace(UA_MonitoredItem *mon) {
-    if(mon->queueSize <= mon->maxQueueSize)
+/* Set the infobits for lost data on the oldest or newest notification,
+ * depending on which end the notifications were removed. If the queue size is
+ * one, the infobits are removed. */
+static void
+setOverflowInfobits(UA_MonitoredItem *mon) {
+    if(mon->monitoredItemType != UA_MONITOREDITEMTYPE_CHANGENOTIFY) {
+        /* TODO: Infobits for Events? */
         return;
+    }
 
-    /* Remove notifications until the queue size is reached */
-    UA_Subscription *sub = mon->subscription;
-    while(mon->queueSize > mon->maxQueueSize) {
-        UA_assert(mon->queueSize >= 2); /* At least two Notifications in the queue */
-
-        /* Make sure that the MonitoredItem does not lose its place in the
-         * global queue when notifications are removed. Otherwise the
-         * MonitoredItem can "starve" itself by putting new notifications always
-         * at the end of the global queue and removing the old ones.
-         *
-         * - If the oldest notification is removed, put the second oldest
-         *   notification right behind it.
-         * - If the newest notification is removed, put the new notification
-         *   right behind it. */
-
-        UA_Notification *del; /* The notification that will be deleted */
-        UA_Notification *after_del; /* The notification to keep and move after del */
-        if(mon->discardOldest) {
-            /* Remove the oldest */
-            del = TAILQ_FIRST(&mon->queue);
-            after_del = TAILQ_NEXT(del, listEntry);
-        } else {
-            /* Remove the second newest (to keep the up-to-date notification) */
-            after_del = TAILQ_LAST(&mon->queue, NotificationQueue);
-            del = TAILQ_PREV(after_del, NotificationQueue, listEntry);
-        }
+    UA_Notification *notification;
+    if(mon->discardOldest)
+        notification = MonitoredItem_getNotification(mon, 0);
+    else
+        notification = MonitoredItem_getNotification(mon, mon->queueSize - 1);
 
-        /* Move after_del right after del in the global queue */
-        TAILQ_REMOVE(&sub->notificationQueue, after_del, globalEntry);
-        TAILQ_INSERT_AFTER(&sub->notificationQueue, del, after_del, globalEntry);
-
-        /* Remove the notification from the queues */
-        TAILQ_REMOVE(&mon->queue, del, listEntry);
-        TAILQ_REMOVE(&sub->notificationQueue, del, globalEntry);
-        --mon->queueSize;
-        --sub->notificationQueueSize;
-
-        /* Free the notification */
-        if(mon->monitoredItemType == UA_MONITOREDITEMTYPE_CHANGENOTIFY) {
-            UA_DataValue_deleteMembers(&del->data.value);
-        } else {
-            /* TODO: event implemantation */
-        }
+    if(mon->maxQueueSize > 1) {
+        notification->data.value.hasStatus = true;
+        notification->data.value.status |= (UA_STATUSCODE_INFOTYPE_DATAVALUE |
+                                            UA_STATUSCODE_INFOBITS_OVERFLOW);
+    } else {
+        notification->data.value.status &= ~(UA_StatusCode)(UA_STATUSCODE_INFOTYPE_DATAVALUE |
+                                                            UA_STATUSCODE_INFOBITS_OVERFLOW);
+    }
+}
+
+static void
+deleteNotification(UA_MonitoredItem *mon, UA_Notification *notification) {
+    if(mon->monitoredItemType == UA_MONITOREDITEMTYPE_CHANGENOTIFY)
+        UA_Notification_deleteMembers(notification);
+    /* TODO: event implementation */
+}
 
-        /* Work around a false positive in clang analyzer */
-#ifndef __clang_analyzer__
-        UA_free(del);
-#endif
+UA_StatusCode
+MonitoredItem_setQueueSize(UA_MonitoredItem *mon, UA_UInt32 maxQueueSize,
+                           UA_Boolean discardOldest) {
+    if(maxQueueSize == 0)
+        maxQueueSize = 1;
+    if(mon->queue && maxQueueSize == mon->maxQueueSize) {
+        mon->discardOldest = discardOldest;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    UA_Notification *queue = (UA_Notification*)
+        UA_malloc(sizeof(UA_Notification) * maxQueueSize);
+    if(!queue)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    /* Remove notifications if the queue shrinks. Either the oldest, or the
+     * ones before the newest (to keep the up-to-date notification). The
+     * MonitoredItem keeps its place in the global order of the subscription.
+     * So the last entries are removed from the index. */
+    UA_UInt32 removed = 0;
+    if(mon->queueSize > maxQueueSize) {
+        removed = mon->queueSize - maxQueueSize;
+        UA_Subscription_removeNotifications(mon->subscription, mon, removed);
     }
+    UA_UInt32 firstRemoved = discardOldest ? 0 : maxQueueSize - 1;
 
-    if(mon->monitoredItemType == UA_MONITOREDITEMTYPE_CHANGENOTIFY) {
-        /* Get the element that carries the infobits */
-        UA_Notification *notification = NULL;
-        if(mon->discardOldest)
-            notification = TAILQ_FIRST(&mon->queue);
+    /* Move the notifications into the new queue */
+    UA_UInt32 pos = 0;
+    for(UA_UInt32 i = 0; i < mon->queueSize; ++i) {
+        UA_Notification *notification = MonitoredItem_getNotification(mon, i);
+        if(i >= firstRemoved && i < firstRemoved + removed)
+            deleteNotification(mon, notification);
         else
-            notification = TAILQ_LAST(&mon->queue, NotificationQueue);
-        UA_assert(notification);
-
-        if(mon->maxQueueSize > 1) {
-            /* Add the infobits either to the newest or the new last entry */
-            notification->data.value.hasStatus = true;
-            notification->data.value.status |= (UA_STATUSCODE_INFOTYPE_DATAVALUE |
-                                                UA_STATUSCODE_INFOBITS_OVERFLOW);
-        } else {
-            /* If the queue size is reduced to one, remove the infobits */
-            notification->data.value.status &= ~(UA_StatusCode)(UA_STATUSCODE_INFOTYPE_DATAVALUE |
-                                                                UA_STATUSCODE_INFOBITS_OVERFLOW);
-        }
+            queue[pos++] = *notification;
+    }
+
+    UA_free(mon->queue);
+    mon->queue = queue;
+    mon->queueHead = 0;
+    mon->queueSize = pos;
+    mon->maxQueueSize = maxQueueSize;
+    mon->discardOldest = discardOldest;
+    if(removed > 0)
+        setOverflowInfobits(mon);
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+MonitoredItem_clearQueue(UA_MonitoredItem *mon) {
+    if(mon->queueSize == 0)
+        return;
+    UA_Subscription_removeNotifications(mon->subscription, mon, mon->queueSize);
+    for(UA_UInt32 i = 0; i < mon->queueSize; ++i)
+        deleteNotification(mon, MonitoredItem_getNotification(mon, i));
+    mon->queueHead = 0;
+    mon->queueSize = 0;
+}
+
+/* Add the notification to the queue. If the queue is full, a notification is
+ * overwritten in place. Then the MonitoredItem keeps its place in the global
+ * order. Otherwise it could "starve" itself by putting new notifications
+ * always at the end of the global queue and removing the old ones.
+ *
+ * - If the oldest notification is removed, the second oldest takes its place.
+ * - If the newest notification is removed, the new notification takes its
+ *   place. */
+static void
+enqueueNotification(UA_Subscription *sub, UA_MonitoredItem *mon,
+                    const UA_Notification *notification) {
+    if(mon->queueSize < mon->maxQueueSize) {
+        *MonitoredItem_getNotification(mon, mon->queueSize) = *notification;
+        ++mon->queueSize;
+        UA_Subscription_appendNotification(sub, mon);
+        return;
     }
 
-    /* TODO: Infobits for Events? */
+    if(mon->discardOldest) {
+        /* The slot of the oldest becomes the newest */
+        UA_Notification *oldest = MonitoredItem_getNotification(mon, 0);
+        deleteNotification(mon, oldest);
+        *oldest = *notification;
+        if(++mon->queueHead == mon->maxQueueSize)
+            mon->queueHead = 0;
+    } else {
+        UA_Notification *newest = MonitoredItem_getNotification(mon, mon->queueSize - 1);
+        deleteNotification(mon, newest);
+        *newest = *notification;
+    }
+    setOverflowInfobits(mon);
+}
+
+void
+MonitoredItem_resetLastValue(UA_MonitoredItem *mon) {
+    UA_DataValue_deleteMembers(&mon->lastValue);
+    mon->lastValueSet = false;
+    if(mon->lastValueShared) {
+        UA_SharedValue_release(mon->lastValueShared);
+        mon->lastValueShared = NULL;
+    }
 }
 
-/* Errors are returned as no change detected */
+/* Numeric builtin types are compared with the deadband */
 static UA_Boolean
-detectValueChangeWithFilter(UA_MonitoredItem *mon, UA_DataValue *value,
-                            UA_ByteString *encoding) {
-    /* Encode the data for comparison */
-    size_t binsize = UA_calcSizeBinary(value, &UA_TYPES[UA_TYPES_DATAVALUE]);
-    if(binsize == 0)
+isNumericType(const UA_DataType *type) {
+    return (type->typeIndex >= UA_TYPES_SBYTE && type->typeIndex <= UA_TYPES_DOUBLE &&
+            type == &UA_TYPES[type->typeIndex]);
+}
+
+static UA_Double
+numericValue(const void *data, size_t index, const UA_DataType *type) {
+    switch(type->typeIndex) {
+    case UA_TYPES_SBYTE: return (UA_Double)((const UA_SByte*)data)[index];
+    case UA_TYPES_BYTE: return (UA_Double)((const UA_Byte*)data)[index];
+    case UA_TYPES_INT16: return (UA_Double)((const UA_Int16*)data)[index];
+    case UA_TYPES_UINT16: return (UA_Double)((const UA_UInt16*)data)[index];
+    case UA_TYPES_INT32: return (UA_Double)((const UA_Int32*)data)[index];
+    case UA_TYPES_UINT32: return (UA_Double)((const UA_UInt32*)data)[index];
+    case UA_TYPES_INT64: return (UA_Double)((const UA_Int64*)data)[index];
+    case UA_TYPES_UINT64: return (UA_Double)((const UA_UInt64*)data)[index];
+    case UA_TYPES_FLOAT: return (UA_Double)((const UA_Float*)data)[index];
+    default: return ((const UA_Double*)data)[index];
+    }
+}
+
+static UA_Boolean
+outOfDeadband(const void *data1, const void *data2, size_t length,
+              const UA_DataType *type, UA_Double deadband) {
+    for(size_t i = 0; i < length; ++i) {
+        UA_Double v1 = numericValue(data1, i, type);
+        UA_Double v2 = numericValue(data2, i, type);
+        if(v1 != v1 || v2 != v2) { /* Check for nan */
+            if((v1 != v1) != (v2 != v2))
+                return true;
+            continue;
+        }
+        UA_Double diff = v1 - v2;
+        if(diff < 0)
+            diff = -diff;
+        if(diff > deadband)
+            return true;
+    }
+    return false;
+}
+
+/* Fallback for structured types. Compare the binary encoding. Errors are
+ * returned as no change detected. */
+static UA_Boolean
+encodingChanged(const UA_Variant *v1, const UA_Variant *v2) {
+    const UA_DataType *vt = &UA_TYPES[UA_TYPES_VARIANT];
+    size_t size = UA_calcSizeBinary(v1, vt);
+    if(size == 0)
         return false;
+    if(size != UA_calcSizeBinary(v2, vt))
+        return true;
 
-    /* Allocate buffer on the heap if necessary */
-    if(binsize > UA_VALUENCODING_MAXSTACK &&
-       UA_ByteString_allocBuffer(encoding, binsize) != UA_STATUSCODE_GOOD)
+    /* Stack-allocate the buffers for small values */
+    UA_Byte *buf1, *buf2;
+    UA_STACKARRAY(UA_Byte, stackBuf, 2 * UA_VALUENCODING_MAXSTACK);
+    if(size <= UA_VALUENCODING_MAXSTACK) {
+        buf1 = stackBuf;
+    } else {
+        buf1 = (UA_Byte*)UA_malloc(2 * size);
+        if(!buf1)
+            return false;
+    }
+    buf2 = &buf1[size];
+
+    UA_Boolean changed = false;
+    UA_Byte *pos1 = buf1, *pos2 = buf2;
+    const UA_Byte *end1 = &buf1[size], *end2 = &buf2[size];
+    if(UA_encodeBinary(v1, vt, &pos1, &end1, NULL, NULL) == UA_STATUSCODE_GOOD &&
+       UA_encodeBinary(v2, vt, &pos2, &end2, NULL, NULL) == UA_STATUSCODE_GOOD)
+        changed = (memcmp(buf1, buf2, size) != 0);
+
+    if(buf1 != stackBuf)
+        UA_free(buf1);
+    return changed;
+}
+
+static UA_Boolean
+variantChanged(const UA_Variant *v1, const UA_Variant *v2, UA_Double deadband) {
+    /* Compare the type and the array layout */
+    const UA_DataType *type = v1->type;
+    if(type != v2->type)
+        return true;
+    if(!type)
         return false;
+    UA_Boolean scalar = UA_Variant_isScalar(v1);
+    if(scalar != UA_Variant_isScalar(v2) || v1->arrayLength != v2->arrayLength)
+        return true;
+    if(v1->arrayDimensionsSize != v2->arrayDimensionsSize ||
+       (v1->arrayDimensionsSize > 0 &&
+        memcmp(v1->arrayDimensions, v2->arrayDimensions,
+               sizeof(UA_UInt32) * v1->arrayDimensionsSize) != 0))
+        return true;
 
-    /* Encode the value */
-    UA_Byte *bufPos = encoding->data;
-    const UA_Byte *bufEnd = &encoding->data[encoding->length];
-    UA_StatusCode retval = UA_encodeBinary(value, &UA_TYPES[UA_TYPES_DATAVALUE],
-                                           &bufPos, &bufEnd, NULL, NULL);
-    if(retval != UA_STATUSCODE_GOOD)
+    /* Compare the content */
+    size_t length = scalar ? 1 : v1->arrayLength;
+    if(length == 0)
+        return false;
+    if(deadband > 0.0 && isNumericType(type))
+        return outOfDeadband(v1->data, v2->data, length, type, deadband);
+    if(type->overlayable)
+        return (memcmp(v1->data, v2->data, type->memSize * length) != 0);
+    if(type == &UA_TYPES[UA_TYPES_STRING] || type == &UA_TYPES[UA_TYPES_BYTESTRING] ||
+       type == &UA_TYPES[UA_TYPES_XMLELEMENT]) {
+        const UA_String *s1 = (const UA_String*)v1->data;
+        const UA_String *s2 = (const UA_String*)v2->data;
+        for(size_t i = 0; i < length; ++i) {
+            if(!UA_String_equal(&s1[i], &s2[i]))
+                return true;
+        }
         return false;
+    }
+    return encodingChanged(v1, v2);
+}
 
-    /* The value has changed */
-    encoding->length = (uintptr_t)bufPos - (uintptr_t)encoding->data;
-    return !mon->lastSampledValue.data || !UA_String_equal(encoding, &mon->lastSampledValue);
+/* Reduce the DataValue to the fields that are considered by the trigger. The
+ * result is a shallow copy. */
+static void
+filterDataValue(UA_DataChangeTrigger trigger, const UA_DataValue *value,
+                UA_DataValue *filtered) {
+    *filtered = *value;
+    filtered->hasServerTimestamp = false;
+    filtered->hasServerPicoseconds = false;
+    if(trigger < UA_DATACHANGETRIGGER_STATUSVALUETIMESTAMP) {
+        filtered->hasSourceTimestamp = false;
+        filtered->hasSourcePicoseconds = false;
+    }
+    if(trigger == UA_DATACHANGETRIGGER_STATUS)
+        filtered->hasValue = false;
+    if(!filtered->hasValue)
+        UA_Variant_init(&filtered->value);
 }
 
-/* Has this sample changed from the last one? The method may allocate additional
- * space for the encoding buffer. Detect the change in encoding->data. */
+/* Compares the typed members of the filtered DataValue. No encoding is
+ * required for builtin types. */
 static UA_Boolean
-detectValueChange(UA_MonitoredItem *mon, UA_DataValue *value, UA_ByteString *encoding) {
-    /* Apply Filter */
-    UA_Boolean hasValue = value->hasValue;
-    if(mon->trigger == UA_DATACHANGETRIGGER_STATUS)
-        value->hasValue = false;
-
-    UA_Boolean hasServerTimestamp = value->hasServerTimestamp;
-    UA_Boolean hasServerPicoseconds = value->hasServerPicoseconds;
-    value->hasServerTimestamp = false;
-    value->hasServerPicoseconds = false;
-
-    UA_Boolean hasSourceTimestamp = value->hasSourceTimestamp;
-    UA_Boolean hasSourcePicoseconds = value->hasSourcePicoseconds;
-    if(mon->trigger < UA_DATACHANGETRIGGER_STATUSVALUETIMESTAMP) {
-        value->hasSourceTimestamp = false;
-        value->hasSourcePicoseconds = false;
-    }
+dataValueChanged(const UA_DataValue *filtered, const UA_DataValue *last,
+                 UA_Double deadband) {
+    /* A missing status is good */
+    UA_StatusCode valueStatus = filtered->hasStatus ? filtered->status : UA_STATUSCODE_GOOD;
+    UA_StatusCode lastStatus = last->hasStatus ? last->status : UA_STATUSCODE_GOOD;
+    if(valueStatus != lastStatus)
+        return true;
 
-    /* Detect the Value Change */
-    UA_Boolean res = detectValueChangeWithFilter(mon, value, encoding);
+    if(filtered->hasSourceTimestamp != last->hasSourceTimestamp ||
+       (filtered->hasSourceTimestamp && filtered->sourceTimestamp != last->sourceTimestamp))
+        return true;
+    if(filtered->hasSourcePicoseconds != last->hasSourcePicoseconds ||
+       (filtered->hasSourcePicoseconds &&
+        filtered->sourcePicoseconds != last->sourcePicoseconds))
+        return true;
 
-    /* Reset the filter */
-    value->hasValue = hasValue;
-    value->hasServerTimestamp = hasServerTimestamp;
-    value->hasServerPicoseconds = hasServerPicoseconds;
-    value->hasSourceTimestamp = hasSourceTimestamp;
-    value->hasSourcePicoseconds = hasSourcePicoseconds;
-    return res;
+    if(filtered->hasValue != last->hasValue)
+        return true;
+    return variantChanged(&filtered->value, &last->value, deadband);
 }
 
-/* Returns whether a new sample was created */
+/* Has this sample changed from the last reported one? */
 static UA_Boolean
-sampleCallbackWithValue(UA_Server *server, UA_Subscription *sub,
-                        UA_MonitoredItem *monitoredItem,
-                        UA_DataValue *value,
-                        UA_ByteString *valueEncoding) {
-    UA_assert(monitoredItem->monitoredItemType == UA_MONITOREDITEMTYPE_CHANGENOTIFY);
-    /* Store the pointer to the stack-allocated bytestring to see if a heap-allocation
-     * was necessary */
-    UA_Byte *stackValueEncoding = valueEncoding->data;
-
-    /* Has the value changed? */
-    UA_Boolean changed = detectValueChange(monitoredItem, value, valueEncoding);
-    if(!changed)
-        return false;
+detectValueChange(const UA_MonitoredItem *mon, const UA_DataValue *value) {
+    if(!mon->lastValueSet)
+        return true;
+    UA_DataValue filtered;
+    filterDataValue(mon->trigger, value, &filtered);
+    return dataValueChanged(&filtered, &mon->lastValue, mon->deadband);
+}
 
-    /* Allocate the entry for the publish queue */
-    UA_Notification *newNotification =
-        (UA_Notification *)UA_malloc(sizeof(UA_Notification));
-    if(!newNotification) {
+/* Copy the filtered value for the next comparison. The notification takes
+ * over the value unless it points into the node. */
+static UA_Boolean
+copySampledValue(UA_Server *server, UA_Subscription *sub, UA_MonitoredItem *monitoredItem,
+                 UA_DataValue *value, const UA_DataValue *filtered,
+                 UA_DataValue *lastValue, UA_DataValue *notificationValue) {
+    UA_StatusCode retval = UA_DataValue_copy(filtered, lastValue);
+    if(retval != UA_STATUSCODE_GOOD) {
         UA_LOG_WARNING_SESSION(server->config.logger, sub->session,
                                "Subscription %u | MonitoredItem %i | "
-                               "Item for the publishing queue could not be allocated",
+                               "Value to compare with could not be created",
                                sub->subscriptionId, monitoredItem->monitoredItemId);
         return false;
     }
 
-    /* Copy valueEncoding on the heap for the next comparison (if not already done) */
-    if(valueEncoding->data == stackValueEncoding) {
-        UA_ByteString cbs;
-        if(UA_ByteString_copy(valueEncoding, &cbs) != UA_STATUSCODE_GOOD) {
-            UA_LOG_WARNING_SESSION(server->config.logger, sub->session,
-                                   "Subscription %u | MonitoredItem %i | "
-                                   "ByteString to compare values could not be created",
-                                   sub->subscriptionId, monitoredItem->monitoredItemId);
-            UA_free(newNotification);
-            return false;
-        }
-        *valueEncoding = cbs;
-    }
-
     /* Prepare the newQueueItem */
     if(value->hasValue && value->value.storageType == UA_VARIANT_DATA_NODELETE) {
         /* Make a deep copy of the value */
-        UA_StatusCode retval = UA_DataValue_copy(value, &newNotification->data.value);
+        retval = UA_DataValue_copy(value, notificationValue);
         if(retval != UA_STATUSCODE_GOOD) {
             UA_LOG_WARNING_SESSION(server->config.logger, sub->session,
                                    "Subscription %u | MonitoredItem %i | "
                                    "Item for the publishing queue could not be prepared",
                                    sub->subscriptionId, monitoredItem->monitoredItemId);
-            UA_free(newNotification);
+            UA_DataValue_deleteMembers(lastValue);
             return false;
         }
     } else {
-        newNotification->data.value = *value; /* Just copy the value and do not release it */
+        *notificationValue = *value; /* Just copy the value and do not release it */
+    }
+    return true;
+}
+
+/* Returns whether a new sample was created. Then the notification has taken
+ * over the value. If the value points into a shared value, then a reference
+ * is taken instead. */
+static UA_Boolean
+sampleCallbackWithValue(UA_Server *server, UA_Subscription *sub,
+                        UA_MonitoredItem *monitoredItem,
+                        UA_DataValue *value, UA_SharedValue *shared) {
+    UA_assert(monitoredItem->monitoredItemType == UA_MONITOREDITEMTYPE_CHANGENOTIFY);
+
+    /* Has the value changed? */
+    UA_Boolean changed = detectValueChange(monitoredItem, value);
+    if(!changed)
+        return false;
+
+    /* Make room for the entry in the global order of the subscription. A full
+     * queue overwrites a notification and keeps the entry. */
+    if(monitoredItem->queueSize < monitoredItem->maxQueueSize &&
+       UA_Subscription_reserveNotification(sub) != UA_STATUSCODE_GOOD) {
+        UA_LOG_WARNING_SESSION(server->config.logger, sub->session,
+                               "Subscription %u | MonitoredItem %i | "
+                               "Item for the publishing queue could not be allocated",
+                               sub->subscriptionId, monitoredItem->monitoredItemId);
+        return false;
+    }
+
+    UA_DataValue filtered;
+    filterDataValue(monitoredItem->trigger, value, &filtered);
+    UA_DataValue lastValue;
+    UA_Notification newNotification;
+    newNotification.shared = NULL;
+    if(shared) {
+        /* Reference the shared value for the notification and for the next
+         * comparison */
+        shareDataValue(shared, &filtered, &lastValue);
+        shareDataValue(shared, value, &newNotification.data.value);
+        if(value->hasValue)
+            newNotification.shared = shared;
+    } else if(!copySampledValue(server, sub, monitoredItem, value, &filtered,
+                                &lastValue, &newNotification.data.value)) {
+        return false;
     }
 
     /* <-- Point of no return --> */
@@ -269,20 +482,16 @@ sampleCallbackWithValue(UA_Server *server, UA_Subscription *sub,
                          "Subscription %u | MonitoredItem %u | Sampled a new value",
                          sub->subscriptionId, monitoredItem->monitoredItemId);
 
-    newNotification->mon = monitoredItem;
-
-    /* Replace the encoding for comparison */
-    UA_ByteString_deleteMembers(&monitoredItem->lastSampledValue);
-    monitoredItem->lastSampledValue = *valueEncoding;
+    /* Replace the value for comparison. The shared value was referenced twice
+     * if the sample has a value. For the notification and the last value. */
+    MonitoredItem_resetLastValue(monitoredItem);
+    monitoredItem->lastValue = lastValue;
+    monitoredItem->lastValueSet = true;
+    if(shared && lastValue.hasValue)
+        monitoredItem->lastValueShared = shared;
 
-    /* Add the notification to the end of local and global queue */
-    TAILQ_INSERT_TAIL(&monitoredItem->queue, newNotification, listEntry);
-    TAILQ_INSERT_TAIL(&sub->notificationQueue, newNotification, globalEntry);
-    ++monitoredItem->queueSize;
-    ++sub->notificationQueueSize;
-
-    /* Remove some notifications if the queue is beyond maximum capacity */
-    MonitoredItem_ensureQueueSpace(monitoredItem);
+    /* Add the notification to the queue */
+    enqueueNotification(sub, monitoredItem, &newNotification);
 
     return true;
 }
@@ -299,40 +508,534 @@ UA_MonitoredItem_SampleCallback(UA_Server *server,
         return;
     }
 
-    /* Read the value */
-    UA_ReadValueId rvid;
-    UA_ReadValueId_init(&rvid);
-    rvid.nodeId = monitoredItem->monitoredNodeId;
-    rvid.attributeId = monitoredItem->attributeId;
-    rvid.indexRange = monitoredItem->indexRange;
+    /* Read the value. Values from data sources that were read within half
+     * the sampling interval are taken from the cache. So MonitoredItems with
+     * the same sampling interval share the read. */
+    UA_ReadOperation op;
+    memset(&op, 0, sizeof(UA_ReadOperation));
+    op.id.nodeId = monitoredItem->monitoredNodeId;
+    op.id.attributeId = monitoredItem->attributeId;
+    op.id.indexRange = monitoredItem->indexRange;
+    op.maxAge = monitoredItem->samplingInterval / 2.0;
+    op.node = UA_Nodestore_get(server, &op.id.nodeId);
     UA_DataValue value =
-        UA_Server_readWithSession(server, sub->session,
-                                  &rvid, monitoredItem->timestampsToReturn);
-
-    /* Stack-allocate some memory for the value encoding. We might heap-allocate
-     * more memory if needed. This is just enough for scalars and small
-     * structures. */
-    UA_STACKARRAY(UA_Byte, stackValueEncoding, UA_VALUENCODING_MAXSTACK);
-    UA_ByteString valueEncoding;
-    valueEncoding.data = stackValueEncoding;
-    valueEncoding.length = UA_VALUENCODING_MAXSTACK;
+        Read_performCopy(server, sub->session, monitoredItem->timestampsToReturn, &op);
 
     /* Create a sample and compare with the last value */
-    UA_Boolean newNotification = sampleCallbackWithValue(server, sub, monitoredItem,
-                                                         &value, &valueEncoding);
+    UA_Boolean newNotification =
+        sampleCallbackWithValue(server, sub, monitoredItem, &value, NULL);
 
     /* Clean up */
-    if(!newNotification) {
-        if(valueEncoding.data != stackValueEncoding)
-            UA_ByteString_deleteMembers(&valueEncoding);
+    if(!newNotification)
         UA_DataValue_deleteMembers(&value);
+}
+
+/***********************************/
+/* MonitoredItems Sampled on Write */
+/***********************************/
+
+#define UA_MONITOREDNODES_MINSIZE 64
+
+static void
+monitoredNodesRehash(UA_Server *server, size_t newSize) {
+    struct UA_MonitoredItemBucket *buckets = (struct UA_MonitoredItemBucket*)
+        UA_malloc(sizeof(struct UA_MonitoredItemBucket) * newSize);
+    if(!buckets)
+        return; /* Continue with longer chains */
+    for(size_t i = 0; i < newSize; ++i)
+        LIST_INIT(&buckets[i]);
+
+    UA_MonitoredItem *mon, *mon_tmp;
+    for(size_t i = 0; i < server->monitoredNodesSize; ++i) {
+        LIST_FOREACH_SAFE(mon, &server->monitoredNodes[i], monitoredNodeEntry, mon_tmp) {
+            LIST_REMOVE(mon, monitoredNodeEntry);
+            LIST_INSERT_HEAD(&buckets[mon->monitoredNodeHash & (newSize - 1)],
+                             mon, monitoredNodeEntry);
+        }
+    }
+    UA_free(server->monitoredNodes);
+    server->monitoredNodes = buckets;
+    server->monitoredNodesSize = newSize;
+}
+
+static UA_StatusCode
+monitoredNodesInsert(UA_Server *server, UA_MonitoredItem *mon) {
+    if(server->monitoredNodesItems >= server->monitoredNodesSize) {
+        size_t newSize = server->monitoredNodesSize * 2;
+        if(newSize < UA_MONITOREDNODES_MINSIZE)
+            newSize = UA_MONITOREDNODES_MINSIZE;
+        monitoredNodesRehash(server, newSize);
+        if(!server->monitoredNodes)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
     }
+    mon->monitoredNodeHash = UA_NodeId_hash(&mon->monitoredNodeId);
+    LIST_INSERT_HEAD(&server->monitoredNodes[mon->monitoredNodeHash &
+                                             (server->monitoredNodesSize - 1)],
+                     mon, monitoredNodeEntry);
+    ++server->monitoredNodesItems;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+monitoredNodesRemove(UA_Server *server, UA_MonitoredItem *mon) {
+    LIST_REMOVE(mon, monitoredNodeEntry);
+    --server->monitoredNodesItems;
+    if(server->monitoredNodesItems > 0)
+        return;
+    UA_free(server->monitoredNodes);
+    server->monitoredNodes = NULL;
+    server->monitoredNodesSize = 0;
+}
+
+/* The value is stored in the node and there is no onRead callback. Then the
+ * value can only change with a write, and reading it does not depend on the
+ * session. */
+static UA_Boolean
+hasStoredValue(UA_Server *server, const UA_NodeId *nodeId) {
+    const UA_VariableNode *vn = (const UA_VariableNode*)
+        UA_Nodestore_get(server, nodeId);
+    if(!vn)
+        return false;
+    UA_Boolean res = (vn->nodeClass == UA_NODECLASS_VARIABLE &&
+                      vn->valueSource == UA_VALUESOURCE_DATA &&
+                      !vn->value.data.callback.onRead);
+    UA_Nodestore_release(server, (const UA_Node*)vn);
+    return res;
+}
+
+static UA_Boolean
+canSampleOnWrite(UA_Server *server, const UA_MonitoredItem *mon) {
+    return (server->config.sampleMonitoredItemsOnWrite &&
+            mon->attributeId == UA_ATTRIBUTEID_VALUE &&
+            hasStoredValue(server, &mon->monitoredNodeId));
+}
+
+void
+UA_Server_sampleWrittenNode(UA_Server *server, const UA_NodeId *nodeId) {
+    if(server->monitoredNodesItems == 0)
+        return;
+    UA_UInt32 hash = UA_NodeId_hash(nodeId);
+    UA_MonitoredItem *mon, *mon_tmp;
+    LIST_FOREACH_SAFE(mon, &server->monitoredNodes[hash & (server->monitoredNodesSize - 1)],
+                      monitoredNodeEntry, mon_tmp) {
+        if(mon->monitoredNodeHash == hash && UA_NodeId_equal(&mon->monitoredNodeId, nodeId))
+            UA_MonitoredItem_SampleCallback(server, mon);
+    }
+}
+
+/* Collects the MonitoredItems on the node that are sampled on write or in a
+ * sample group. Their registration depends on the value source. Only counts
+ * them if mons is NULL. */
+static size_t
+valueSourceItems(UA_Server *server, const UA_NodeId *nodeId, UA_MonitoredItem **mons) {
+    size_t count = 0;
+    UA_MonitoredItem *mon;
+    if(server->monitoredNodesItems > 0) {
+        UA_UInt32 hash = UA_NodeId_hash(nodeId);
+        LIST_FOREACH(mon, &server->monitoredNodes[hash & (server->monitoredNodesSize - 1)],
+                     monitoredNodeEntry) {
+            if(mon->monitoredNodeHash != hash ||
+               !UA_NodeId_equal(&mon->monitoredNodeId, nodeId))
+                continue;
+            if(mons)
+                mons[count] = mon;
+            ++count;
+        }
+    }
+
+    /* The sample groups are also hashed over the sampling interval */
+    UA_SampleGroup *group;
+    for(size_t i = 0; i < server->sampleGroupsSize; ++i) {
+        LIST_FOREACH(group, &server->sampleGroups[i], listEntry) {
+            if(!UA_NodeId_equal(&group->nodeId, nodeId))
+                continue;
+            LIST_FOREACH(mon, &group->monitoredItems, sampleGroupEntry) {
+                if(mons)
+                    mons[count] = mon;
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+void
+UA_Server_valueSourceChanged(UA_Server *server, const UA_NodeId *nodeId) {
+    /* Collect the MonitoredItems first. The re-registration changes the index
+     * and the sample groups (and may free them). */
+    size_t count = valueSourceItems(server, nodeId, NULL);
+    if(count == 0)
+        return;
+    UA_STACKARRAY(UA_MonitoredItem*, mons, count);
+    valueSourceItems(server, nodeId, mons);
+
+    for(size_t i = 0; i < count; ++i) {
+        MonitoredItem_unregisterSampleCallback(server, mons[i]);
+        UA_StatusCode retval = MonitoredItem_registerSampleCallback(server, mons[i]);
+        if(retval != UA_STATUSCODE_GOOD)
+            UA_LOG_WARNING_SESSION(server->config.logger, mons[i]->subscription->session,
+                                   "Subscription %u | MonitoredItem %i | Could not register "
+                                   "the sampling after the value source changed with error %s",
+                                   mons[i]->subscription->subscriptionId,
+                                   mons[i]->monitoredItemId, UA_StatusCode_name(retval));
+    }
+}
+
+/*************************************/
+/* MonitoredItems Sampled in Batches */
+/*************************************/
+
+static void
+bulkSampleGroupCallback(UA_Server *server, UA_BulkSampleGroup *group) {
+    UA_ReadOperation *ops = (UA_ReadOperation*)
+        UA_malloc(sizeof(UA_ReadOperation) * group->monitoredItemsSize);
+    UA_MonitoredItem *mon;
+    if(!ops) {
+        /* Sample individually */
+        LIST_FOREACH(mon, &group->monitoredItems, bulkSampleEntry)
+            UA_MonitoredItem_SampleCallback(server, mon);
+        return;
+    }
+
+    /* Read the values from the source in one batch. The source timestamp is
+     * removed again for the MonitoredItems that don't return it. */
+    size_t i = 0;
+    LIST_FOREACH(mon, &group->monitoredItems, bulkSampleEntry) {
+        UA_ReadValueId_init(&ops[i].id);
+        ops[i].id.nodeId = mon->monitoredNodeId;
+        ops[i].id.attributeId = mon->attributeId;
+        ops[i].id.indexRange = mon->indexRange;
+        ops[i].maxAge = group->samplingInterval / 2.0;
+        i++;
+    }
+    Read_prepare(server, group->session, true, ops, group->monitoredItemsSize);
+
+    /* Create the samples */
+    i = 0;
+    LIST_FOREACH(mon, &group->monitoredItems, bulkSampleEntry) {
+        UA_DataValue value = Read_performCopy(server, group->session,
+                                              mon->timestampsToReturn, &ops[i]);
+        if(!sampleCallbackWithValue(server, mon->subscription, mon, &value, NULL))
+            UA_DataValue_deleteMembers(&value);
+        i++;
+    }
+    UA_free(ops);
+}
+
+/* Returns the bulk data source if the MonitoredItem samples from one */
+static UA_BulkDataSource *
+getBulkDataSource(UA_Server *server, const UA_MonitoredItem *mon) {
+    if(mon->monitoredItemType != UA_MONITOREDITEMTYPE_CHANGENOTIFY ||
+       mon->attributeId != UA_ATTRIBUTEID_VALUE)
+        return NULL;
+    const UA_VariableNode *vn = (const UA_VariableNode*)
+        UA_Nodestore_get(server, &mon->monitoredNodeId);
+    if(!vn)
+        return NULL;
+    UA_BulkDataSource *source = NULL;
+    if(vn->nodeClass == UA_NODECLASS_VARIABLE &&
+       vn->valueSource == UA_VALUESOURCE_DATASOURCE)
+        source = vn->bulkDataSource;
+    UA_Nodestore_release(server, (const UA_Node*)vn);
+    return source;
+}
+
+static UA_StatusCode
+bulkSampleGroupAdd(UA_Server *server, UA_MonitoredItem *mon,
+                   UA_BulkDataSource *source) {
+    UA_Session *session = mon->subscription->session;
+    UA_UInt32 samplingInterval = (UA_UInt32)mon->samplingInterval;
+
+    /* Find the group */
+    UA_BulkSampleGroup *group;
+    LIST_FOREACH(group, &server->bulkSampleGroups, listEntry) {
+        if(group->bulkDataSource == source && group->session == session &&
+           group->samplingInterval == samplingInterval)
+            break;
+    }
+
+    /* Create a new group */
+    if(!group) {
+        group = (UA_BulkSampleGroup*)UA_calloc(1, sizeof(UA_BulkSampleGroup));
+        if(!group)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        UA_StatusCode retval =
+            UA_Server_addRepeatedCallback(server, (UA_ServerCallback)bulkSampleGroupCallback,
+                                          group, samplingInterval, &group->sampleCallbackId);
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_free(group);
+            return retval;
+        }
+        group->bulkDataSource = source;
+        group->session = session;
+        group->samplingInterval = samplingInterval;
+        LIST_INIT(&group->monitoredItems);
+        LIST_INSERT_HEAD(&server->bulkSampleGroups, group, listEntry);
+    }
+
+    /* Add to the group */
+    LIST_INSERT_HEAD(&group->monitoredItems, mon, bulkSampleEntry);
+    group->monitoredItemsSize++;
+    mon->bulkSampleGroup = group;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+bulkSampleGroupRemove(UA_Server *server, UA_MonitoredItem *mon) {
+    UA_BulkSampleGroup *group = mon->bulkSampleGroup;
+    LIST_REMOVE(mon, bulkSampleEntry);
+    mon->bulkSampleGroup = NULL;
+    group->monitoredItemsSize--;
+    if(group->monitoredItemsSize > 0)
+        return;
+    UA_Server_removeRepeatedCallback(server, group->sampleCallbackId);
+    LIST_REMOVE(group, listEntry);
+    UA_Server_delayedFree(server, group);
+}
+
+/***********************************/
+/* MonitoredItems in Sample Groups */
+/***********************************/
+
+#define UA_SAMPLEGROUPS_MINSIZE 64
+
+static UA_UInt32
+sampleGroupHash(const UA_NodeId *nodeId, UA_UInt32 samplingInterval) {
+    return UA_NodeId_hash(nodeId) ^ (samplingInterval * 2654435761u);
+}
+
+static void
+sampleGroupsRehash(UA_Server *server, size_t newSize) {
+    struct UA_SampleGroupBucket *buckets = (struct UA_SampleGroupBucket*)
+        UA_malloc(sizeof(struct UA_SampleGroupBucket) * newSize);
+    if(!buckets)
+        return; /* Continue with longer chains */
+    for(size_t i = 0; i < newSize; ++i)
+        LIST_INIT(&buckets[i]);
+
+    UA_SampleGroup *group, *group_tmp;
+    for(size_t i = 0; i < server->sampleGroupsSize; ++i) {
+        LIST_FOREACH_SAFE(group, &server->sampleGroups[i], listEntry, group_tmp) {
+            LIST_REMOVE(group, listEntry);
+            LIST_INSERT_HEAD(&buckets[group->hash & (newSize - 1)], group, listEntry);
+        }
+    }
+    UA_free(server->sampleGroups);
+    server->sampleGroups = buckets;
+    server->sampleGroupsSize = newSize;
+}
+
+static UA_SampleGroup *
+sampleGroupsFind(UA_Server *server, const UA_MonitoredItem *mon,
+                 UA_UInt32 hash, UA_UInt32 samplingInterval) {
+    if(server->sampleGroupsSize == 0)
+        return NULL;
+    UA_SampleGroup *group;
+    LIST_FOREACH(group, &server->sampleGroups[hash & (server->sampleGroupsSize - 1)],
+                 listEntry) {
+        if(group->hash == hash && group->samplingInterval == samplingInterval &&
+           UA_NodeId_equal(&group->nodeId, &mon->monitoredNodeId) &&
+           UA_String_equal(&group->indexRange, &mon->indexRange))
+            return group;
+    }
+    return NULL;
+}
+
+static void
+sampleGroupDelete(UA_Server *server, UA_SampleGroup *group) {
+    UA_Server_removeRepeatedCallback(server, group->sampleCallbackId);
+    LIST_REMOVE(group, listEntry);
+    UA_NodeId_deleteMembers(&group->nodeId);
+    UA_String_deleteMembers(&group->indexRange);
+    if(group->lastShared)
+        UA_SharedValue_release(group->lastShared);
+    UA_Server_delayedFree(server, group);
+
+    --server->sampleGroupsCount;
+    if(server->sampleGroupsCount > 0)
+        return;
+    UA_free(server->sampleGroups);
+    server->sampleGroups = NULL;
+    server->sampleGroupsSize = 0;
+}
+
+/* Remove the timestamps that the MonitoredItem does not return */
+static void
+removeTimestamps(UA_DataValue *value, UA_TimestampsToReturn timestampsToReturn) {
+    if(timestampsToReturn == UA_TIMESTAMPSTORETURN_SERVER ||
+       timestampsToReturn == UA_TIMESTAMPSTORETURN_NEITHER) {
+        value->hasSourceTimestamp = false;
+        value->hasSourcePicoseconds = false;
+    }
+    if(timestampsToReturn == UA_TIMESTAMPSTORETURN_SOURCE ||
+       timestampsToReturn == UA_TIMESTAMPSTORETURN_NEITHER) {
+        value->hasServerTimestamp = false;
+        value->hasServerPicoseconds = false;
+    }
+}
+
+static void
+sampleGroupCallback(UA_Server *server, UA_SampleGroup *group) {
+    /* Read the value with all timestamps. The value is stored in the node, so
+     * the read does not depend on the session. The access rights of the
+     * sessions are checked for the individual MonitoredItems. */
+    UA_ReadOperation op;
+    memset(&op, 0, sizeof(UA_ReadOperation));
+    op.id.nodeId = group->nodeId;
+    op.id.attributeId = UA_ATTRIBUTEID_VALUE;
+    op.id.indexRange = group->indexRange;
+    op.maxAge = group->samplingInterval / 2.0;
+    op.node = UA_Nodestore_get(server, &op.id.nodeId);
+    UA_DataValue value =
+        Read_performCopy(server, &adminSession, UA_TIMESTAMPSTORETURN_BOTH, &op);
+
+    /* If the sample is unchanged, then every MonitoredItem has already been
+     * evaluated for it */
+    if(group->lastShared && !group->newMonitoredItems) {
+        UA_DataValue filtered;
+        filterDataValue(UA_DATACHANGETRIGGER_STATUSVALUETIMESTAMP, &value, &filtered);
+        if(!dataValueChanged(&filtered, &group->lastValue, 0.0)) {
+            UA_DataValue_deleteMembers(&value);
+            return;
+        }
+    }
+
+    /* Share the new sample */
+    UA_SharedValue *shared = UA_SharedValue_new(&value.value);
+    if(!shared) {
+        UA_DataValue_deleteMembers(&value);
+        return;
+    }
+    if(group->lastShared)
+        UA_SharedValue_release(group->lastShared);
+    group->lastShared = shared;
+    group->lastValue = value;
+    group->lastValue.value = shared->value;
+    group->lastValue.value.storageType = UA_VARIANT_DATA_NODELETE;
+    group->newMonitoredItems = false;
+
+    /* Evaluate the MonitoredItems */
+    const UA_Node *node = UA_Nodestore_get(server, &group->nodeId);
+    UA_MonitoredItem *mon;
+    LIST_FOREACH(mon, &group->monitoredItems, sampleGroupEntry) {
+        UA_Subscription *sub = mon->subscription;
+        UA_StatusCode access = UA_STATUSCODE_GOOD;
+        if(node)
+            access = checkValueReadable(server, sub->session, node);
+        if(access != UA_STATUSCODE_GOOD) {
+            UA_DataValue denied;
+            UA_DataValue_init(&denied);
+            denied.hasStatus = true;
+            denied.status = access;
+            sampleCallbackWithValue(server, sub, mon, &denied, NULL);
+            continue;
+        }
+        UA_DataValue sample = group->lastValue;
+        removeTimestamps(&sample, mon->timestampsToReturn);
+        sampleCallbackWithValue(server, sub, mon, &sample, shared);
+    }
+    if(node)
+        UA_Nodestore_release(server, node);
+}
+
+/* Polled MonitoredItems on the Value attribute can share the sample. Only if
+ * the value is stored in the node. DataSources and onRead callbacks get the
+ * session of the reader and are sampled for every MonitoredItem. */
+static UA_Boolean
+canShareSamples(UA_Server *server, const UA_MonitoredItem *mon) {
+    return (server->config.shareMonitoredItemSamples &&
+            mon->monitoredItemType == UA_MONITOREDITEMTYPE_CHANGENOTIFY &&
+            mon->attributeId == UA_ATTRIBUTEID_VALUE &&
+            hasStoredValue(server, &mon->monitoredNodeId));
+}
+
+static UA_StatusCode
+sampleGroupAdd(UA_Server *server, UA_MonitoredItem *mon) {
+    UA_UInt32 samplingInterval = (UA_UInt32)mon->samplingInterval;
+    UA_UInt32 hash = sampleGroupHash(&mon->monitoredNodeId, samplingInterval);
+
+    /* Create a new group */
+    UA_SampleGroup *group = sampleGroupsFind(server, mon, hash, samplingInterval);
+    if(!group) {
+        if(server->sampleGroupsCount >= server->sampleGroupsSize) {
+            size_t newSize = server->sampleGroupsSize * 2;
+            if(newSize < UA_SAMPLEGROUPS_MINSIZE)
+                newSize = UA_SAMPLEGROUPS_MINSIZE;
+            sampleGroupsRehash(server, newSize);
+            if(!server->sampleGroups)
+                return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+        group = (UA_SampleGroup*)UA_calloc(1, sizeof(UA_SampleGroup));
+        if(!group)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        UA_StatusCode retval = UA_NodeId_copy(&mon->monitoredNodeId, &group->nodeId);
+        retval |= UA_String_copy(&mon->indexRange, &group->indexRange);
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = UA_Server_addRepeatedCallback(server, (UA_ServerCallback)sampleGroupCallback,
+                                                   group, samplingInterval,
+                                                   &group->sampleCallbackId);
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_NodeId_deleteMembers(&group->nodeId);
+            UA_String_deleteMembers(&group->indexRange);
+            UA_free(group);
+            return retval;
+        }
+        group->hash = hash;
+        group->samplingInterval = samplingInterval;
+        LIST_INIT(&group->monitoredItems);
+        LIST_INSERT_HEAD(&server->sampleGroups[hash & (server->sampleGroupsSize - 1)],
+                         group, listEntry);
+        ++server->sampleGroupsCount;
+    }
+
+    /* Add to the group */
+    LIST_INSERT_HEAD(&group->monitoredItems, mon, sampleGroupEntry);
+    group->monitoredItemsSize++;
+    group->newMonitoredItems = true;
+    mon->sampleGroup = group;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+sampleGroupRemove(UA_Server *server, UA_MonitoredItem *mon) {
+    UA_SampleGroup *group = mon->sampleGroup;
+    LIST_REMOVE(mon, sampleGroupEntry);
+    mon->sampleGroup = NULL;
+    group->monitoredItemsSize--;
+    if(group->monitoredItemsSize == 0)
+        sampleGroupDelete(server, group);
 }
 
 UA_StatusCode
 MonitoredItem_registerSampleCallback(UA_Server *server, UA_MonitoredItem *mon) {
     if(mon->sampleCallbackIsRegistered)
         return UA_STATUSCODE_GOOD;
+
+    /* Sample when the node is written. Fall back to polling if the index
+     * cannot be allocated. */
+    if(canSampleOnWrite(server, mon) &&
+       monitoredNodesInsert(server, mon) == UA_STATUSCODE_GOOD) {
+        mon->sampleOnWrite = true;
+        mon->sampleCallbackIsRegistered = true;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    /* Sample together with the other MonitoredItems on the bulk data source.
+     * Fall back to an individual callback if the group cannot be created. */
+    UA_BulkDataSource *source = getBulkDataSource(server, mon);
+    if(source && bulkSampleGroupAdd(server, mon, source) == UA_STATUSCODE_GOOD) {
+        mon->sampleCallbackIsRegistered = true;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    /* Share the sample with the MonitoredItems of all sessions on the same
+     * node and with the same sampling interval */
+    if(canShareSamples(server, mon) &&
+       sampleGroupAdd(server, mon) == UA_STATUSCODE_GOOD) {
+        mon->sampleCallbackIsRegistered = true;
+        return UA_STATUSCODE_GOOD;
+    }
+
     UA_StatusCode retval =
         UA_Server_addRepeatedCallback(server, (UA_ServerCallback)UA_MonitoredItem_SampleCallback,
                                       mon, (UA_UInt32)mon->samplingInterval, &mon->sampleCallbackId);
@@ -346,6 +1049,19 @@ MonitoredItem_unregisterSampleCallback(UA_Server *server, UA_MonitoredItem *mon)
     if(!mon->sampleCallbackIsRegistered)
         return UA_STATUSCODE_GOOD;
     mon->sampleCallbackIsRegistered = false;
+    if(mon->sampleOnWrite) {
+        mon->sampleOnWrite = false;
+        monitoredNodesRemove(server, mon);
+        return UA_STATUSCODE_GOOD;
+    }
+    if(mon->bulkSampleGroup) {
+        bulkSampleGroupRemove(server, mon);
+        return UA_STATUSCODE_GOOD;
+    }
+    if(mon->sampleGroup) {
+        sampleGroupRemove(server, mon);
+        return UA_STATUSCODE_GOOD;
+    }
     return UA_Server_removeRepeatedCallback(server, mon->sampleCallbackId);
 }
 
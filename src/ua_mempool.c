@@ -0,0 +1,164 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <string.h>
+#include "ua_mempool.h"
+
+/* Alignment of the blocks. Enough for all builtin types. */
+#define UA_MEMORYPOOL_ALIGN 16
+#define UA_MEMORYPOOL_ROUNDUP(SIZE) \
+    (((SIZE) + UA_MEMORYPOOL_ALIGN - 1) & ~(size_t)(UA_MEMORYPOOL_ALIGN - 1))
+
+#define UA_MEMORYPOOL_SLABHEADER UA_MEMORYPOOL_ROUNDUP(sizeof(UA_MemoryPoolSlab))
+
+void
+UA_MemoryPool_init(UA_MemoryPool *pool, size_t blockSize, size_t slabBlocks) {
+    if(blockSize < sizeof(UA_MemoryPoolBlock))
+        blockSize = sizeof(UA_MemoryPoolBlock);
+    pool->blockSize = UA_MEMORYPOOL_ROUNDUP(blockSize);
+    pool->slabBlocks = (slabBlocks > 0) ? slabBlocks : 1;
+    pool->usedBlocks = 0;
+    SLIST_INIT(&pool->slabs);
+    SLIST_INIT(&pool->freeBlocks);
+}
+
+void
+UA_MemoryPool_deleteMembers(UA_MemoryPool *pool) {
+    UA_MemoryPoolSlab *slab;
+    while((slab = SLIST_FIRST(&pool->slabs))) {
+        SLIST_REMOVE_HEAD(&pool->slabs, next);
+        UA_free(slab);
+    }
+    SLIST_INIT(&pool->freeBlocks);
+    pool->usedBlocks = 0;
+}
+
+/* Put all blocks of the slab into the free list */
+static void
+carveSlab(UA_MemoryPool *pool, UA_MemoryPoolSlab *slab) {
+    UA_Byte *blocks = (UA_Byte*)slab + UA_MEMORYPOOL_SLABHEADER;
+    for(size_t i = pool->slabBlocks; i > 0; --i) {
+        UA_MemoryPoolBlock *block = (UA_MemoryPoolBlock*)
+            (uintptr_t)&blocks[(i - 1) * pool->blockSize];
+        SLIST_INSERT_HEAD(&pool->freeBlocks, block, next);
+    }
+}
+
+void *
+UA_MemoryPool_alloc(UA_MemoryPool *pool) {
+    UA_MemoryPoolBlock *block = SLIST_FIRST(&pool->freeBlocks);
+    if(!block) {
+        UA_MemoryPoolSlab *slab = (UA_MemoryPoolSlab*)
+            UA_malloc(UA_MEMORYPOOL_SLABHEADER + (pool->blockSize * pool->slabBlocks));
+        if(!slab)
+            return NULL;
+        SLIST_INSERT_HEAD(&pool->slabs, slab, next);
+        carveSlab(pool, slab);
+        block = SLIST_FIRST(&pool->freeBlocks);
+    }
+    SLIST_REMOVE_HEAD(&pool->freeBlocks, next);
+    ++pool->usedBlocks;
+    return block;
+}
+
+void
+UA_MemoryPool_free(UA_MemoryPool *pool, void *p) {
+    if(!p)
+        return;
+    UA_assert(pool->usedBlocks > 0);
+    UA_MemoryPoolBlock *block = (UA_MemoryPoolBlock*)p;
+    SLIST_INSERT_HEAD(&pool->freeBlocks, block, next);
+    --pool->usedBlocks;
+    if(pool->usedBlocks > 0)
+        return;
+
+    /* All blocks are free. Release the slabs in bulk, but keep the first slab
+     * for the next allocations and a second one as a spare. Otherwise a
+     * workload that oscillates across the boundary of the first slab mallocs
+     * and frees a slab in every cycle. */
+    UA_MemoryPoolSlab *keep = SLIST_FIRST(&pool->slabs);
+    UA_MemoryPoolSlab *spare = SLIST_NEXT(keep, next);
+    if(!spare || !SLIST_NEXT(spare, next))
+        return;
+    SLIST_REMOVE_HEAD(&pool->slabs, next);
+    SLIST_REMOVE_HEAD(&pool->slabs, next);
+    UA_MemoryPool_deleteMembers(pool);
+    SLIST_INSERT_HEAD(&pool->slabs, spare, next);
+    SLIST_INSERT_HEAD(&pool->slabs, keep, next);
+    carveSlab(pool, spare);
+    carveSlab(pool, keep);
+}
+
+/*********/
+/* Arena */
+/*********/
+
+#define UA_ARENA_BLOCKHEADER UA_MEMORYPOOL_ROUNDUP(sizeof(UA_ArenaBlock))
+
+void
+UA_Arena_init(UA_Arena *arena, size_t blockSize) {
+    arena->blockSize = blockSize;
+    SLIST_INIT(&arena->blocks);
+}
+
+void
+UA_Arena_deleteMembers(UA_Arena *arena) {
+    UA_ArenaBlock *block;
+    while((block = SLIST_FIRST(&arena->blocks))) {
+        SLIST_REMOVE_HEAD(&arena->blocks, next);
+        UA_free(block);
+    }
+}
+
+void *
+UA_Arena_alloc(UA_Arena *arena, size_t size) {
+    if(size > SIZE_MAX - UA_ARENA_BLOCKHEADER - UA_MEMORYPOOL_ALIGN)
+        return NULL;
+    size = UA_MEMORYPOOL_ROUNDUP(size);
+
+    /* Take from the current block */
+    UA_ArenaBlock *block = SLIST_FIRST(&arena->blocks);
+    if(!block || block->size - block->used < size) {
+        size_t blockSize = arena->blockSize;
+        if(blockSize == 0)
+            blockSize = UA_ARENA_DEFAULTBLOCKSIZE;
+        if(blockSize < size)
+            blockSize = size;
+        block = (UA_ArenaBlock*)UA_malloc(UA_ARENA_BLOCKHEADER + blockSize);
+        if(!block)
+            return NULL;
+        block->size = blockSize;
+        block->used = 0;
+        SLIST_INSERT_HEAD(&arena->blocks, block, next);
+    }
+
+    UA_Byte *p = (UA_Byte*)block + UA_ARENA_BLOCKHEADER + block->used;
+    block->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+void
+UA_Arena_reset(UA_Arena *arena) {
+    /* Keep the largest block. Unless it is much larger than the default, so
+     * that a single large allocation is not retained indefinitely. */
+    size_t maxKeep = arena->blockSize;
+    if(maxKeep == 0)
+        maxKeep = UA_ARENA_DEFAULTBLOCKSIZE;
+    maxKeep *= 16;
+    UA_ArenaBlock *keep = NULL, *block;
+    while((block = SLIST_FIRST(&arena->blocks))) {
+        SLIST_REMOVE_HEAD(&arena->blocks, next);
+        if(block->size <= maxKeep && (!keep || block->size > keep->size)) {
+            UA_free(keep);
+            keep = block;
+        } else {
+            UA_free(block);
+        }
+    }
+    if(!keep)
+        return;
+    keep->used = 0;
+    SLIST_INSERT_HEAD(&arena->blocks, keep, next);
+}
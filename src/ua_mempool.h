@@ -0,0 +1,89 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef UA_MEMPOOL_H_
+#define UA_MEMPOOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ua_util.h"
+
+/* A memory pool hands out blocks of a fixed size. The blocks are carved from
+ * larger slabs and recycled over a free list. This avoids the fragmentation of
+ * many short-lived small allocations. When all blocks are returned, the pool
+ * releases all slabs except for one and a spare. The pool is not
+ * thread-safe. */
+
+typedef struct UA_MemoryPoolSlab {
+    SLIST_ENTRY(UA_MemoryPoolSlab) next;
+    /* The blocks follow after the (aligned) header */
+} UA_MemoryPoolSlab;
+
+/* Unused blocks are linked in the free list */
+typedef struct UA_MemoryPoolBlock {
+    SLIST_ENTRY(UA_MemoryPoolBlock) next;
+} UA_MemoryPoolBlock;
+
+typedef struct {
+    size_t blockSize;  /* Rounded up for alignment */
+    size_t slabBlocks; /* Number of blocks per slab */
+    size_t usedBlocks;
+    SLIST_HEAD(UA_MemoryPoolSlabList, UA_MemoryPoolSlab) slabs;
+    SLIST_HEAD(UA_MemoryPoolFreeList, UA_MemoryPoolBlock) freeBlocks;
+} UA_MemoryPool;
+
+void
+UA_MemoryPool_init(UA_MemoryPool *pool, size_t blockSize, size_t slabBlocks);
+
+/* Frees all slabs. Blocks that are still in use become invalid. */
+void
+UA_MemoryPool_deleteMembers(UA_MemoryPool *pool);
+
+/* Returns NULL if no slab can be allocated */
+void *
+UA_MemoryPool_alloc(UA_MemoryPool *pool);
+
+void
+UA_MemoryPool_free(UA_MemoryPool *pool, void *block);
+
+/* An arena is a bump allocator. Allocations are not freed individually. All
+ * memory is released at once when the arena is reset. Large allocations get a
+ * block of their own. After a reset, one block is kept for reuse. A zeroed
+ * arena is initialized with the default block size. The arena is not
+ * thread-safe. */
+
+#define UA_ARENA_DEFAULTBLOCKSIZE 4096
+
+typedef struct UA_ArenaBlock {
+    SLIST_ENTRY(UA_ArenaBlock) next;
+    size_t size; /* Usable bytes after the (aligned) header */
+    size_t used;
+} UA_ArenaBlock;
+
+typedef struct {
+    size_t blockSize;
+    SLIST_HEAD(UA_ArenaBlockList, UA_ArenaBlock) blocks; /* Current block first */
+} UA_Arena;
+
+void
+UA_Arena_init(UA_Arena *arena, size_t blockSize);
+
+void
+UA_Arena_deleteMembers(UA_Arena *arena);
+
+/* Returns zeroed memory or NULL if no block can be allocated */
+void *
+UA_Arena_alloc(UA_Arena *arena, size_t size);
+
+/* Invalidates all memory taken from the arena */
+void
+UA_Arena_reset(UA_Arena *arena);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* UA_MEMPOOL_H_ */
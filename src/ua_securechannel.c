@@ -75,8 +75,21 @@ UA_SecureChannel_init(UA_SecureChannel *channel,
     retval = securityPolicy->asymmetricModule.
         makeCertificateThumbprint(securityPolicy, &channel->remoteCertificate,
                                   &remoteCertificateThumbprint);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
 
-    return retval;
+    UA_SECURECHANNEL_SENDLOCK_INIT(channel);
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+deleteChunkEntry(struct ChunkEntry *ch) {
+    struct ChunkPayload *p;
+    while((p = SIMPLEQ_FIRST(&ch->payloads))) {
+        SIMPLEQ_REMOVE_HEAD(&ch->payloads, pointers);
+        UA_free(p);
+    }
+    UA_free(ch);
 }
 
 void
@@ -110,10 +123,11 @@ UA_SecureChannel_deleteMembersCleanup(UA_SecureChannel *channel) {
     /* Remove the buffered chunks */
     struct ChunkEntry *ch, *temp_ch;
     LIST_FOREACH_SAFE(ch, &channel->chunks, pointers, temp_ch) {
-        UA_ByteString_deleteMembers(&ch->bytes);
         LIST_REMOVE(ch, pointers);
-        UA_free(ch);
+        deleteChunkEntry(ch);
     }
+
+    UA_Arena_deleteMembers(&channel->decodeArena);
 }
 
 UA_StatusCode
@@ -395,6 +409,8 @@ UA_SecureChannel_sendAsymmetricOPNMessage(UA_SecureChannel *channel, UA_UInt32 r
     retval |= UA_encodeBinary(&asymHeader, &UA_TRANSPORT[UA_TRANSPORT_ASYMMETRICALGORITHMSECURITYHEADER],
                               &header_pos, &buf_end, NULL, NULL);
 
+    /* Sequence numbers go out in order (see sendSymmetricChunk) */
+    UA_SECURECHANNEL_SENDLOCK(channel);
     UA_SequenceHeader seqHeader;
     seqHeader.requestId = requestId;
     seqHeader.sequenceNumber = UA_atomic_addUInt32(&channel->sendSequenceNumber, 1);
@@ -404,6 +420,7 @@ UA_SecureChannel_sendAsymmetricOPNMessage(UA_SecureChannel *channel, UA_UInt32 r
     /* Did encoding the header succeed? */
     if(retval != UA_STATUSCODE_GOOD) {
         connection->releaseSendBuffer(connection, &buf);
+        UA_SECURECHANNEL_SENDUNLOCK(channel);
         return retval;
     }
 
@@ -418,6 +435,7 @@ UA_SecureChannel_sendAsymmetricOPNMessage(UA_SecureChannel *channel, UA_UInt32 r
             sign(securityPolicy, channel->channelContext, &dataToSign, &signature);
         if(retval != UA_STATUSCODE_GOOD) {
             connection->releaseSendBuffer(connection, &buf);
+            UA_SECURECHANNEL_SENDUNLOCK(channel);
             return retval;
         }
 
@@ -432,6 +450,7 @@ UA_SecureChannel_sendAsymmetricOPNMessage(UA_SecureChannel *channel, UA_UInt32 r
             encrypt(securityPolicy, channel->channelContext, &dataToEncrypt);
         if(retval != UA_STATUSCODE_GOOD) {
             connection->releaseSendBuffer(connection, &buf);
+            UA_SECURECHANNEL_SENDUNLOCK(channel);
             return retval;
         }
     }
@@ -439,6 +458,7 @@ UA_SecureChannel_sendAsymmetricOPNMessage(UA_SecureChannel *channel, UA_UInt32 r
     /* Send the message, the buffer is freed in the network layer */
     buf.length = respHeader.messageHeader.messageSize;
     retval = connection->send(connection, &buf);
+    UA_SECURECHANNEL_SENDUNLOCK(channel);
 #ifdef UA_ENABLE_UNIT_TEST_FAILURE_HOOKS
     retval |= sendAsym_sendFailure
 #endif
@@ -484,6 +504,55 @@ setBufPos(UA_MessageContext *mc) {
         mc->buf_end -= 2;
 }
 
+void
+UA_SendCork_init(UA_SendCork *cork, UA_SecureChannel *channel) {
+    UA_SECURECHANNEL_SENDLOCK(channel);
+    cork->channel = channel;
+    cork->buffer = UA_BYTESTRING_NULL;
+    cork->capacity = 0;
+}
+
+static UA_StatusCode
+flushCork(UA_SendCork *cork) {
+    if(cork->buffer.length == 0)
+        return UA_STATUSCODE_GOOD;
+    /* The buffer is freed in the network layer */
+    UA_Connection *connection = cork->channel->connection;
+    UA_StatusCode retval = connection->send(connection, &cork->buffer);
+    cork->buffer = UA_BYTESTRING_NULL;
+    cork->capacity = 0;
+    return retval;
+}
+
+UA_StatusCode
+UA_SendCork_finish(UA_SendCork *cork) {
+    UA_StatusCode retval = flushCork(cork);
+    UA_SECURECHANNEL_SENDUNLOCK(cork->channel);
+    return retval;
+}
+
+/* Copy the chunk behind the collected chunks. If it does not fit, the collected
+ * chunks are sent out and the chunk buffer (allocated with the send buffer
+ * size) is taken over for the next chunks. The chunk is consumed in any
+ * case. */
+static UA_StatusCode
+corkChunk(UA_SendCork *cork, UA_ByteString *chunk) {
+    UA_Connection *connection = cork->channel->connection;
+    if(cork->buffer.length > 0 &&
+       cork->buffer.length + chunk->length <= cork->capacity) {
+        memcpy(&cork->buffer.data[cork->buffer.length], chunk->data, chunk->length);
+        cork->buffer.length += chunk->length;
+        connection->releaseSendBuffer(connection, chunk);
+        return UA_STATUSCODE_GOOD;
+    }
+
+    UA_StatusCode retval = flushCork(cork);
+    cork->buffer = *chunk;
+    cork->capacity = connection->localConf.sendBufferSize;
+    *chunk = UA_BYTESTRING_NULL;
+    return retval;
+}
+
 static UA_StatusCode
 sendSymmetricChunk(UA_MessageContext *mc) {
     UA_StatusCode res = UA_STATUSCODE_GOOD;
@@ -560,6 +629,12 @@ sendSymmetricChunk(UA_MessageContext *mc) {
                            &UA_TRANSPORT[UA_TRANSPORT_SYMMETRICALGORITHMSECURITYHEADER],
                            &header_pos, &mc->buf_end, NULL, NULL);
 
+    /* From here until the chunk is handed to the network layer, no other chunk
+     * can be sent on the channel. An open cork already holds the lock. */
+    if(!mc->cork) {
+        UA_SECURECHANNEL_SENDLOCK(channel);
+    }
+
     UA_SequenceHeader seqHeader;
     seqHeader.requestId = mc->requestId;
     seqHeader.sequenceNumber = UA_atomic_addUInt32(&channel->sendSequenceNumber, 1);
@@ -588,13 +663,22 @@ sendSymmetricChunk(UA_MessageContext *mc) {
             encrypt(securityPolicy, channel->channelContext, &dataToEncrypt);
     }
 
-    if(res != UA_STATUSCODE_GOOD) {
-        connection->releaseSendBuffer(channel->connection, &mc->messageBuffer);
-        return res;
+    /* Collect the chunk for a later send */
+    if(mc->cork) {
+        if(res != UA_STATUSCODE_GOOD) {
+            connection->releaseSendBuffer(channel->connection, &mc->messageBuffer);
+            return res;
+        }
+        return corkChunk(mc->cork, &mc->messageBuffer);
     }
 
     /* Send the chunk, the buffer is freed in the network layer */
-    return connection->send(channel->connection, &mc->messageBuffer);
+    if(res == UA_STATUSCODE_GOOD)
+        res = connection->send(channel->connection, &mc->messageBuffer);
+    else
+        connection->releaseSendBuffer(channel->connection, &mc->messageBuffer);
+    UA_SECURECHANNEL_SENDUNLOCK(channel);
+    return res;
 }
 
 /* Callback from the encoding layer. Send the chunk and replace the buffer. */
@@ -639,6 +723,7 @@ UA_MessageContext_begin(UA_MessageContext *mc, UA_SecureChannel *channel,
     mc->final = false;
     mc->messageBuffer = UA_BYTESTRING_NULL;
     mc->messageType = messageType;
+    mc->cork = NULL;
 
     /* Minimum required size */
     if(connection->localConf.sendBufferSize <= UA_SECURE_MESSAGE_HEADER_LENGTH)
@@ -671,6 +756,35 @@ UA_MessageContext_encode(UA_MessageContext *mc, const void *content,
     return retval;
 }
 
+UA_StatusCode
+UA_MessageContext_encodeRaw(UA_MessageContext *mc, const UA_ByteString *encoded) {
+    const UA_Byte *pos = encoded->data;
+    size_t remaining = encoded->length;
+    while(remaining > 0) {
+        /* Send out the chunk if it is full */
+        if(mc->buf_pos >= mc->buf_end) {
+            UA_StatusCode retval =
+                sendSymmetricEncodingCallback(mc, &mc->buf_pos, &mc->buf_end);
+            if(retval != UA_STATUSCODE_GOOD) {
+                if(mc->messageBuffer.length > 0) {
+                    UA_Connection *connection = mc->channel->connection;
+                    connection->releaseSendBuffer(connection, &mc->messageBuffer);
+                }
+                return retval;
+            }
+        }
+
+        /* Copy as much as fits into the current chunk */
+        size_t space = (uintptr_t)mc->buf_end - (uintptr_t)mc->buf_pos;
+        size_t len = remaining < space ? remaining : space;
+        memcpy(mc->buf_pos, pos, len);
+        mc->buf_pos += len;
+        pos += len;
+        remaining -= len;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
 UA_StatusCode
 UA_MessageContext_finish(UA_MessageContext *mc) {
     mc->final = true;
@@ -717,41 +831,51 @@ UA_SecureChannel_sendSymmetricMessage(UA_SecureChannel *channel, UA_UInt32 reque
 /* Assemble Complete Message */
 /*****************************/
 
-static void
-UA_SecureChannel_removeChunks(UA_SecureChannel *channel, UA_UInt32 requestId) {
+/* Only a few chunked messages are assembled at the same time. The list is
+ * searched linearly. The found entry is moved to the front since the next chunk
+ * usually belongs to the same message. */
+static struct ChunkEntry *
+findChunkEntry(UA_SecureChannel *channel, UA_UInt32 requestId) {
     struct ChunkEntry *ch;
     LIST_FOREACH(ch, &channel->chunks, pointers) {
-        if(ch->requestId == requestId) {
-            UA_ByteString_deleteMembers(&ch->bytes);
-            LIST_REMOVE(ch, pointers);
-            UA_free(ch);
-            return;
-        }
+        if(ch->requestId == requestId)
+            break;
     }
+    if(ch && ch != LIST_FIRST(&channel->chunks)) {
+        LIST_REMOVE(ch, pointers);
+        LIST_INSERT_HEAD(&channel->chunks, ch, pointers);
+    }
+    return ch;
 }
 
+static void
+UA_SecureChannel_removeChunks(UA_SecureChannel *channel, UA_UInt32 requestId) {
+    struct ChunkEntry *ch = findChunkEntry(channel, requestId);
+    if(!ch)
+        return;
+    LIST_REMOVE(ch, pointers);
+    deleteChunkEntry(ch);
+}
+
+/* Copy the chunk body once. The network buffer is released after the chunk
+ * was processed. */
 static UA_StatusCode
 appendChunk(struct ChunkEntry *chunkEntry, const UA_ByteString *chunkBody) {
-    UA_Byte *new_bytes = (UA_Byte *)
-        UA_realloc(chunkEntry->bytes.data, chunkEntry->bytes.length + chunkBody->length);
-    if(!new_bytes) {
-        UA_ByteString_deleteMembers(&chunkEntry->bytes);
+    struct ChunkPayload *p = (struct ChunkPayload*)
+        UA_malloc(sizeof(struct ChunkPayload) + chunkBody->length);
+    if(!p)
         return UA_STATUSCODE_BADOUTOFMEMORY;
-    }
-    chunkEntry->bytes.data = new_bytes;
-    memcpy(&chunkEntry->bytes.data[chunkEntry->bytes.length], chunkBody->data, chunkBody->length);
-    chunkEntry->bytes.length += chunkBody->length;
+    p->length = chunkBody->length;
+    memcpy(p->data, chunkBody->data, chunkBody->length);
+    SIMPLEQ_INSERT_TAIL(&chunkEntry->payloads, p, pointers);
+    chunkEntry->totalLength += chunkBody->length;
     return UA_STATUSCODE_GOOD;
 }
 
 static UA_StatusCode
 UA_SecureChannel_appendChunk(UA_SecureChannel *channel, UA_UInt32 requestId,
                              const UA_ByteString *chunkBody) {
-    struct ChunkEntry *ch;
-    LIST_FOREACH(ch, &channel->chunks, pointers) {
-        if(ch->requestId == requestId)
-            break;
-    }
+    struct ChunkEntry *ch = findChunkEntry(channel, requestId);
 
     /* No chunkentry on the channel, create one */
     if(!ch) {
@@ -759,33 +883,52 @@ UA_SecureChannel_appendChunk(UA_SecureChannel *channel, UA_UInt32 requestId,
         if(!ch)
             return UA_STATUSCODE_BADOUTOFMEMORY;
         ch->requestId = requestId;
-        UA_ByteString_init(&ch->bytes);
+        ch->totalLength = 0;
+        SIMPLEQ_INIT(&ch->payloads);
         LIST_INSERT_HEAD(&channel->chunks, ch, pointers);
     }
 
     return appendChunk(ch, chunkBody);
 }
 
+/* Gather the buffered chunk bodies and the final chunk body into a single
+ * buffer of the exact size. The intermediate bodies are copied a second time
+ * here (after being buffered in appendChunk). The final body is copied only
+ * once. */
+static UA_StatusCode
+assembleChunks(struct ChunkEntry *chunkEntry, const UA_ByteString *chunkBody,
+               UA_ByteString *bytes) {
+    UA_StatusCode retval =
+        UA_ByteString_allocBuffer(bytes, chunkEntry->totalLength + chunkBody->length);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    size_t pos = 0;
+    struct ChunkPayload *p;
+    SIMPLEQ_FOREACH(p, &chunkEntry->payloads, pointers) {
+        memcpy(&bytes->data[pos], p->data, p->length);
+        pos += p->length;
+    }
+    if(chunkBody->length > 0)
+        memcpy(&bytes->data[pos], chunkBody->data, chunkBody->length);
+    return UA_STATUSCODE_GOOD;
+}
+
 static UA_StatusCode
 UA_SecureChannel_finalizeChunk(UA_SecureChannel *channel, UA_UInt32 requestId,
                                const UA_ByteString *chunkBody, UA_MessageType messageType,
                                UA_ProcessMessageCallback callback, void *application) {
-    struct ChunkEntry *chunkEntry;
-    LIST_FOREACH(chunkEntry, &channel->chunks, pointers) {
-        if(chunkEntry->requestId == requestId)
-            break;
-    }
+    struct ChunkEntry *chunkEntry = findChunkEntry(channel, requestId);
 
     UA_ByteString bytes;
     if(!chunkEntry) {
         bytes = *chunkBody;
     } else {
-        UA_StatusCode retval = appendChunk(chunkEntry, chunkBody);
+        LIST_REMOVE(chunkEntry, pointers);
+        UA_StatusCode retval = assembleChunks(chunkEntry, chunkBody, &bytes);
+        deleteChunkEntry(chunkEntry);
         if(retval != UA_STATUSCODE_GOOD)
             return retval;
-        bytes = chunkEntry->bytes;
-        LIST_REMOVE(chunkEntry, pointers);
-        UA_free(chunkEntry);
     }
 
     UA_StatusCode retval = callback(application, channel, messageType, requestId, &bytes);
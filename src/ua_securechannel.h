@@ -21,6 +21,11 @@ extern "C" {
 #include "ua_connection_internal.h"
 #include "ua_plugin_securitypolicy.h"
 #include "ua_plugin_log.h"
+#include "ua_mempool.h"
+
+#ifdef UA_ENABLE_MULTITHREADING
+#include <pthread.h>
+#endif
 
 #define UA_SECURE_CONVERSATION_MESSAGE_HEADER_LENGTH 12
 #define UA_SECURE_MESSAGE_HEADER_LENGTH 24
@@ -43,11 +48,21 @@ typedef struct UA_SessionHeader {
     UA_SecureChannel *channel; /* The pointer back to the SecureChannel in the session. */
 } UA_SessionHeader;
 
-/* For chunked requests */
+/* The body of a received intermediate chunk. The data is allocated together
+ * with the structure. */
+struct ChunkPayload {
+    SIMPLEQ_ENTRY(ChunkPayload) pointers;
+    size_t length;
+    UA_Byte data[];
+};
+
+/* For chunked requests. The chunk bodies are collected in a list and copied
+ * into one buffer of the exact size once the final chunk arrives. */
 struct ChunkEntry {
     LIST_ENTRY(ChunkEntry) pointers;
     UA_UInt32 requestId;
-    UA_ByteString bytes;
+    size_t totalLength;
+    SIMPLEQ_HEAD(chunkpayload_list, ChunkPayload) payloads;
 };
 
 typedef enum {
@@ -77,11 +92,34 @@ struct UA_SecureChannel {
 
     UA_UInt32 receiveSequenceNumber;
     UA_UInt32 sendSequenceNumber;
+#ifdef UA_ENABLE_MULTITHREADING
+    /* Held from assigning the sequence number of a chunk until the chunk is
+     * handed to the network layer. An open UA_SendCork holds it for all its
+     * chunks. Initialized and destroyed by the owner of the channel, as the
+     * channel can be cleaned up and reused (client). */
+    pthread_mutex_t sendMutex;
+#endif
 
     LIST_HEAD(session_pointerlist, UA_SessionHeader) sessions;
     LIST_HEAD(chunk_pointerlist, ChunkEntry) chunks;
+
+    /* Holds the decoded request while it is processed. Reset after the
+     * response is sent. */
+    UA_Arena decodeArena;
 };
 
+#ifdef UA_ENABLE_MULTITHREADING
+# define UA_SECURECHANNEL_SENDLOCK_INIT(CHANNEL) pthread_mutex_init(&(CHANNEL)->sendMutex, NULL)
+# define UA_SECURECHANNEL_SENDLOCK_DESTROY(CHANNEL) pthread_mutex_destroy(&(CHANNEL)->sendMutex)
+# define UA_SECURECHANNEL_SENDLOCK(CHANNEL) pthread_mutex_lock(&(CHANNEL)->sendMutex)
+# define UA_SECURECHANNEL_SENDUNLOCK(CHANNEL) pthread_mutex_unlock(&(CHANNEL)->sendMutex)
+#else
+# define UA_SECURECHANNEL_SENDLOCK_INIT(CHANNEL)
+# define UA_SECURECHANNEL_SENDLOCK_DESTROY(CHANNEL)
+# define UA_SECURECHANNEL_SENDLOCK(CHANNEL)
+# define UA_SECURECHANNEL_SENDUNLOCK(CHANNEL)
+#endif
+
 UA_StatusCode
 UA_SecureChannel_init(UA_SecureChannel *channel,
                       const UA_SecurityPolicy *securityPolicy,
@@ -118,6 +156,26 @@ UA_SecureChannel_sendSymmetricMessage(UA_SecureChannel *channel, UA_UInt32 reque
                                       UA_MessageType messageType, void *payload,
                                       const UA_DataType *payloadType);
 
+/* Chunks of several messages can be collected and handed to the network layer
+ * in one send (corked send). The chunks are written back-to-back into a buffer
+ * of the connection's send buffer size. When the next chunk does not fit, the
+ * collected chunks are sent out first.
+ *
+ * The cork holds the send lock of the channel from _init to _finish. So the
+ * chunks go out in the order of their sequence numbers. All messages on the
+ * channel have to be sent through the cork in between. */
+typedef struct {
+    UA_SecureChannel *channel;
+    UA_ByteString buffer; /* The length is the number of collected bytes */
+    size_t capacity;
+} UA_SendCork;
+
+/* The channel must have a connection */
+void UA_SendCork_init(UA_SendCork *cork, UA_SecureChannel *channel);
+
+/* Sends out the remaining chunks and releases the send lock */
+UA_StatusCode UA_SendCork_finish(UA_SendCork *cork);
+
 /* The MessageContext is forwarded into the encoding layer so that we can send
  * chunks before continuing to encode. This lets us reuse a fixed chunk-sized
  * messages buffer. */
@@ -134,9 +192,11 @@ typedef struct {
     const UA_Byte *buf_end;
 
     UA_Boolean final;
+    UA_SendCork *cork; /* If set, the chunks are collected instead of sent */
 } UA_MessageContext;
 
-/* Start the context of a new symmetric message. */
+/* Start the context of a new symmetric message. The cork can be set on the
+ * context after this. */
 UA_StatusCode
 UA_MessageContext_begin(UA_MessageContext *mc, UA_SecureChannel *channel,
                         UA_UInt32 requestId, UA_MessageType messageType);
@@ -148,6 +208,12 @@ UA_StatusCode
 UA_MessageContext_encode(UA_MessageContext *mc, const void *content,
                          const UA_DataType *contentType);
 
+/* Append content that is already binary encoded. The bytes are copied as-is
+ * (without a length prefix) and full chunks are sent out. Cleans up the
+ * context internally in case of errors, as _encode does. */
+UA_StatusCode
+UA_MessageContext_encodeRaw(UA_MessageContext *mc, const UA_ByteString *encoded);
+
 /* Sends a symmetric message already encoded in the context. The context is
  * cleaned up, also in case of errors. */
 UA_StatusCode
@@ -15,23 +15,27 @@
  * by Dmitry Vyukov.
  * http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
  *
- * The RepeatedCallback structure is used both in the sorted list of callbacks
- * and in the MPSC changes queue. For the changes queue, we differentiate
+ * The RepeatedCallback structure is used both in the heap of callbacks and in
+ * the MPSC changes queue. For the changes queue, we differentiate
  * between three cases encoded in the callback pointer.
  *
- * callback > 0x01: add the new repeated callback to the sorted list
+ * callback > 0x01: add the new repeated callback to the heap
  * callback == 0x00: remove the callback with the same id
  * callback == 0x01: change the interval of the existing callback */
 
 #define REMOVE_SENTINEL 0x00
 #define CHANGE_SENTINEL 0x01
 
+#define UA_TIMER_MINCAPACITY 16
+
 struct UA_TimerCallbackEntry {
-    SLIST_ENTRY(UA_TimerCallbackEntry) next; /* Next element in the list */
+    SLIST_ENTRY(UA_TimerCallbackEntry) next; /* Next element in the MPSC queue
+                                              * (must be the first field) */
     UA_DateTime nextTime;                    /* The next time when the callbacks
                                               * are to be executed */
     UA_UInt64 interval;                      /* Interval in 100ns resolution */
     UA_UInt64 id;                            /* Id of the repeated callback */
+    size_t heapIndex;                        /* Current position in the heap */
 
     UA_TimerCallback callback;
     void *data;
@@ -39,7 +43,11 @@ struct UA_TimerCallbackEntry {
 
 void
 UA_Timer_init(UA_Timer *t) {
-    SLIST_INIT(&t->repeatedCallbacks);
+    t->heap = NULL;
+    t->idMap = NULL;
+    t->heapSize = 0;
+    t->heapCapacity = 0;
+    SLIST_INIT(&t->pendingCallbacks);
     t->changes_head = (UA_TimerCallbackEntry*)&t->changes_stub;
     t->changes_tail = (UA_TimerCallbackEntry*)&t->changes_stub;
     t->changes_stub = NULL;
@@ -121,30 +129,211 @@ UA_Timer_addRepeatedCallback(UA_Timer *t, UA_TimerCallback callback,
     return UA_STATUSCODE_GOOD;
 }
 
+/*********************/
+/* Heap and Id Index */
+/*********************/
+
+/* Only the main thread operates on the heap and the id index. The heap is
+ * ordered by the execution timestamp. Entries with the same timestamp are
+ * ordered by their id to keep the dispatch order deterministic. Every entry
+ * knows its position in the heap. So the entry can be removed or repositioned
+ * in O(log n) once it was found with the id index. */
+
+static UA_Boolean
+entryBefore(const UA_TimerCallbackEntry *a, const UA_TimerCallbackEntry *b) {
+    if(a->nextTime != b->nextTime)
+        return a->nextTime < b->nextTime;
+    return a->id < b->id;
+}
+
 static void
-addTimerCallbackEntry(UA_Timer *t, UA_TimerCallbackEntry * UA_RESTRICT tc) {
-    /* Find the last entry before this callback */
-    UA_TimerCallbackEntry *tmpTc, *afterTc = NULL;
-    SLIST_FOREACH(tmpTc, &t->repeatedCallbacks, next) {
-        if(tmpTc->nextTime >= tc->nextTime)
+heapSet(UA_Timer *t, size_t index, UA_TimerCallbackEntry *tc) {
+    t->heap[index] = tc;
+    tc->heapIndex = index;
+}
+
+static void
+heapSiftUp(UA_Timer *t, size_t index) {
+    UA_TimerCallbackEntry *tc = t->heap[index];
+    while(index > 0) {
+        size_t parent = (index - 1) / 2;
+        if(!entryBefore(tc, t->heap[parent]))
+            break;
+        heapSet(t, index, t->heap[parent]);
+        index = parent;
+    }
+    heapSet(t, index, tc);
+}
+
+static void
+heapSiftDown(UA_Timer *t, size_t index) {
+    UA_TimerCallbackEntry *tc = t->heap[index];
+    while(true) {
+        size_t child = (2 * index) + 1;
+        if(child >= t->heapSize)
+            break;
+        if(child + 1 < t->heapSize && entryBefore(t->heap[child + 1], t->heap[child]))
+            child++;
+        if(!entryBefore(t->heap[child], tc))
+            break;
+        heapSet(t, index, t->heap[child]);
+        index = child;
+    }
+    heapSet(t, index, tc);
+}
+
+/* Restore the heap property after the timestamp of the entry has changed */
+static void
+heapFix(UA_Timer *t, size_t index) {
+    if(index > 0 && entryBefore(t->heap[index], t->heap[(index - 1) / 2]))
+        heapSiftUp(t, index);
+    else
+        heapSiftDown(t, index);
+}
+
+/* Fibonacci hashing spreads the sequential ids over the map */
+static size_t
+idMapSlot(const UA_Timer *t, UA_UInt64 id) {
+    return (size_t)((id * 11400714819323198485ULL) >> 32) & ((t->heapCapacity * 2) - 1);
+}
+
+static size_t
+idMapFind(const UA_Timer *t, UA_UInt64 id) {
+    if(t->heapCapacity == 0)
+        return SIZE_MAX;
+    size_t mask = (t->heapCapacity * 2) - 1;
+    for(size_t slot = idMapSlot(t, id); t->idMap[slot]; slot = (slot + 1) & mask) {
+        if(t->idMap[slot]->id == id)
+            return slot;
+    }
+    return SIZE_MAX;
+}
+
+static void
+idMapInsert(UA_Timer *t, UA_TimerCallbackEntry *tc) {
+    size_t mask = (t->heapCapacity * 2) - 1;
+    size_t slot = idMapSlot(t, tc->id);
+    while(t->idMap[slot])
+        slot = (slot + 1) & mask;
+    t->idMap[slot] = tc;
+}
+
+/* Remove with backward shifting. So no tombstones are needed for the linear
+ * probing. */
+static void
+idMapRemove(UA_Timer *t, size_t slot) {
+    size_t mask = (t->heapCapacity * 2) - 1;
+    size_t next = slot;
+    while(true) {
+        next = (next + 1) & mask;
+        UA_TimerCallbackEntry *tc = t->idMap[next];
+        if(!tc)
             break;
-        afterTc = tmpTc;
-
-        /* The goal is to have many repeated callbacks with the same repetition
-         * interval in a "block" in order to reduce linear search for re-entry
-         * to the sorted list after processing. Allow the first execution to lie
-         * between "nextTime - 1s" and "nextTime" if this adjustment groups
-         * callbacks with the same repetition interval. */
-        if(tmpTc->interval == tc->interval &&
-           tmpTc->nextTime > (tc->nextTime - UA_DATETIME_SEC))
-            tc->nextTime = tmpTc->nextTime;
+        /* Can the entry be moved into the hole? Only if its home slot is not
+         * (cyclically) between the hole and the current position. */
+        size_t home = idMapSlot(t, tc->id);
+        if(((next - home) & mask) >= ((next - slot) & mask)) {
+            t->idMap[slot] = tc;
+            slot = next;
+        }
+    }
+    t->idMap[slot] = NULL;
+}
+
+/* Grow or shrink the heap and rebuild the id index */
+static UA_StatusCode
+resizeTimer(UA_Timer *t, size_t capacity) {
+    UA_TimerCallbackEntry **idMap = (UA_TimerCallbackEntry**)
+        UA_calloc(capacity * 2, sizeof(UA_TimerCallbackEntry*));
+    if(!idMap)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    UA_TimerCallbackEntry **heap = (UA_TimerCallbackEntry**)
+        UA_realloc(t->heap, capacity * sizeof(UA_TimerCallbackEntry*));
+    if(!heap) {
+        UA_free(idMap);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    UA_free(t->idMap);
+    t->heap = heap;
+    t->idMap = idMap;
+    t->heapCapacity = capacity;
+    for(size_t i = 0; i < t->heapSize; i++)
+        idMapInsert(t, heap[i]);
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_TimerCallbackEntry *
+findTimerCallbackEntry(UA_Timer *t, UA_UInt64 callbackId) {
+    size_t slot = idMapFind(t, callbackId);
+    if(slot == SIZE_MAX)
+        return NULL;
+    return t->idMap[slot];
+}
+
+static UA_StatusCode
+addTimerCallbackEntry(UA_Timer *t, UA_TimerCallbackEntry * UA_RESTRICT tc) {
+    if(t->heapSize == t->heapCapacity) {
+        size_t capacity = t->heapCapacity * 2;
+        if(capacity < UA_TIMER_MINCAPACITY)
+            capacity = UA_TIMER_MINCAPACITY;
+        UA_StatusCode retval = resizeTimer(t, capacity);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+    }
+    idMapInsert(t, tc);
+    t->heap[t->heapSize] = tc;
+    t->heapSize++;
+    heapSiftUp(t, t->heapSize - 1);
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+removeTimerCallbackEntry(UA_Timer *t, UA_TimerCallbackEntry *tc) {
+    idMapRemove(t, idMapFind(t, tc->id));
+    size_t index = tc->heapIndex;
+    t->heapSize--;
+    if(index < t->heapSize) {
+        heapSet(t, index, t->heap[t->heapSize]);
+        heapFix(t, index);
+    }
+
+    /* Shrink if the heap is mostly empty. Failing to shrink is not an error. */
+    if(t->heapCapacity > UA_TIMER_MINCAPACITY && t->heapSize < t->heapCapacity / 8)
+        resizeTimer(t, t->heapCapacity / 2);
+}
+
+/* Added callbacks whose insertion failed (out of memory) remain in the pending
+ * list. So their id stays valid and insertion is retried in the next
+ * iteration. */
+static void
+findPendingCallback(UA_Timer *t, UA_UInt64 callbackId,
+                    UA_TimerCallbackEntry **prev, UA_TimerCallbackEntry **tc) {
+    *prev = NULL;
+    SLIST_FOREACH(*tc, &t->pendingCallbacks, next) {
+        if((*tc)->id == callbackId)
+            return;
+        *prev = *tc;
     }
+}
 
-    /* Add the repeated callback */
-    if(afterTc)
-        SLIST_INSERT_AFTER(afterTc, tc, next);
+static void
+unlinkPendingCallback(UA_Timer *t, UA_TimerCallbackEntry *prev) {
+    if(prev)
+        SLIST_REMOVE_AFTER(prev, next);
     else
-        SLIST_INSERT_HEAD(&t->repeatedCallbacks, tc, next);
+        SLIST_REMOVE_HEAD(&t->pendingCallbacks, next);
+}
+
+static void
+addPendingCallbacks(UA_Timer *t) {
+    UA_TimerCallbackEntry *tc;
+    while((tc = SLIST_FIRST(&t->pendingCallbacks))) {
+        SLIST_REMOVE_HEAD(&t->pendingCallbacks, next);
+        if(addTimerCallbackEntry(t, tc) != UA_STATUSCODE_GOOD) {
+            SLIST_INSERT_HEAD(&t->pendingCallbacks, tc, next);
+            return;
+        }
+    }
 }
 
 UA_StatusCode
@@ -174,32 +363,25 @@ UA_Timer_changeRepeatedCallbackInterval(UA_Timer *t, UA_UInt64 callbackId,
 static void
 changeTimerCallbackEntryInterval(UA_Timer *t, UA_UInt64 callbackId,
                                  UA_UInt64 interval, UA_DateTime nextTime) {
-    /* Remove from the sorted list */
-    UA_TimerCallbackEntry *tc, *prev = NULL;
-    SLIST_FOREACH(tc, &t->repeatedCallbacks, next) {
-        if(callbackId == tc->id) {
-            if(prev)
-                SLIST_REMOVE_AFTER(prev, next);
-            else
-                SLIST_REMOVE_HEAD(&t->repeatedCallbacks, next);
-            break;
-        }
-        prev = tc;
-    }
-    if(!tc)
+    UA_TimerCallbackEntry *tc = findTimerCallbackEntry(t, callbackId);
+    if(!tc) {
+        UA_TimerCallbackEntry *prev;
+        findPendingCallback(t, callbackId, &prev, &tc);
+        if(!tc)
+            return;
+        tc->interval = interval;
+        tc->nextTime = nextTime;
         return;
+    }
 
-    /* Adjust settings */
+    /* Adjust settings and move to the new position */
     tc->interval = interval;
     tc->nextTime = nextTime;
-
-    /* Reinsert at the new position */
-    addTimerCallbackEntry(t, tc);
+    heapFix(t, tc->heapIndex);
 }
 
-/* Removing a repeated callback: Add an entry with the "nextTime" timestamp set
- * to UA_INT64_MAX. The next iteration picks this up and removes the repated
- * callback from the linked list. */
+/* Removing a repeated callback: Add an entry with the remove sentinel. The next
+ * iteration picks this up and removes the repated callback from the heap. */
 UA_StatusCode
 UA_Timer_removeRepeatedCallback(UA_Timer *t, UA_UInt64 callbackId) {
     /* Allocate the repeated callback structure */
@@ -219,23 +401,26 @@ UA_Timer_removeRepeatedCallback(UA_Timer *t, UA_UInt64 callbackId) {
 
 static void
 removeRepeatedCallback(UA_Timer *t, UA_UInt64 callbackId) {
-    UA_TimerCallbackEntry *tc, *prev = NULL;
-    SLIST_FOREACH(tc, &t->repeatedCallbacks, next) {
-        if(callbackId == tc->id) {
-            if(prev)
-                SLIST_REMOVE_AFTER(prev, next);
-            else
-                SLIST_REMOVE_HEAD(&t->repeatedCallbacks, next);
-            UA_free(tc);
-            break;
-        }
-        prev = tc;
+    UA_TimerCallbackEntry *tc = findTimerCallbackEntry(t, callbackId);
+    if(tc) {
+        removeTimerCallbackEntry(t, tc);
+        UA_free(tc);
+        return;
     }
+
+    UA_TimerCallbackEntry *prev;
+    findPendingCallback(t, callbackId, &prev, &tc);
+    if(!tc)
+        return;
+    unlinkPendingCallback(t, prev);
+    UA_free(tc);
 }
 
 /* Process the changes that were added to the MPSC queue (by other threads) */
 static void
 processChanges(UA_Timer *t) {
+    addPendingCallbacks(t);
+
     UA_TimerCallbackEntry *change;
     while((change = dequeueChange(t))) {
         switch((uintptr_t)change->callback) {
@@ -249,7 +434,8 @@ processChanges(UA_Timer *t) {
             UA_free(change);
             break;
         default:
-            addTimerCallbackEntry(t, change);
+            if(addTimerCallbackEntry(t, change) != UA_STATUSCODE_GOOD)
+                SLIST_INSERT_HEAD(&t->pendingCallbacks, change, next);
         }
     }
 }
@@ -261,37 +447,12 @@ UA_Timer_process(UA_Timer *t, UA_DateTime nowMonotonic,
     /* Insert and remove callbacks */
     processChanges(t);
 
-    /* Find the last callback to be executed now */
-    UA_TimerCallbackEntry *firstAfter, *lastNow = NULL;
-    SLIST_FOREACH(firstAfter, &t->repeatedCallbacks, next) {
-        if(firstAfter->nextTime > nowMonotonic)
+    /* Dispatch the callbacks that are due. The rescheduled callbacks lie in the
+     * future. So every callback is executed at most once per iteration. */
+    while(t->heapSize > 0) {
+        UA_TimerCallbackEntry *tc = t->heap[0];
+        if(tc->nextTime > nowMonotonic)
             break;
-        lastNow = firstAfter;
-    }
-
-    /* Nothing to do */
-    if(!lastNow) {
-        if(firstAfter)
-            return firstAfter->nextTime;
-        return UA_INT64_MAX;
-    }
-
-    /* Put the callbacks that are executed now in a separate list */
-    UA_TimerCallbackList executedNowList;
-    executedNowList.slh_first = SLIST_FIRST(&t->repeatedCallbacks);
-    lastNow->next.sle_next = NULL;
-
-    /* Fake entry to represent the first element in the newly-sorted list */
-    UA_TimerCallbackEntry tmp_first;
-    tmp_first.nextTime = nowMonotonic - 1; /* never matches for last_dispatched */
-    tmp_first.next.sle_next = firstAfter;
-    UA_TimerCallbackEntry *last_dispatched = &tmp_first;
-
-    /* Iterate over the list of callbacks to process now */
-    UA_TimerCallbackEntry *tc;
-    while((tc = SLIST_FIRST(&executedNowList))) {
-        /* Remove from the list */
-        SLIST_REMOVE_HEAD(&executedNowList, next);
 
         /* Dispatch/process callback */
         dispatchCallback(application, tc->callback, tc->data);
@@ -302,49 +463,18 @@ UA_Timer_process(UA_Timer *t, UA_DateTime nowMonotonic,
         if(tc->nextTime < nowMonotonic)
             tc->nextTime = nowMonotonic + 1;
 
-        /* Find the new position for tc to keep the list sorted */
-        UA_TimerCallbackEntry *prev_tc;
-        if(last_dispatched->nextTime == tc->nextTime) {
-            /* We try to "batch" repeatedCallbacks with the same interval. This
-             * saves a linear search when the last dispatched entry has the same
-             * nextTime timestamp as this entry. */
-            UA_assert(last_dispatched != &tmp_first);
-            prev_tc = last_dispatched;
-        } else {
-            /* Find the position for the next execution by a linear search
-             * starting at last_dispatched or the first element */
-            if(last_dispatched->nextTime < tc->nextTime)
-                prev_tc = last_dispatched;
-            else
-                prev_tc = &tmp_first;
-
-            while(true) {
-                UA_TimerCallbackEntry *n = SLIST_NEXT(prev_tc, next);
-                if(!n || n->nextTime >= tc->nextTime)
-                    break;
-                prev_tc = n;
-            }
-
-            /* Update last_dispatched */
-            last_dispatched = tc;
-        }
-
-        /* Add entry to the new position in the sorted list */
-        SLIST_INSERT_AFTER(prev_tc, tc, next);
+        /* Move to the new position in the heap */
+        heapSiftDown(t, 0);
     }
 
-    /* Set the entry-point for the newly sorted list */
-    t->repeatedCallbacks.slh_first = tmp_first.next.sle_next;
-
     /* Re-repeat processAddRemoved since one of the callbacks might have removed
      * or added a callback. So we return a correct timeout. */
     processChanges(t);
 
     /* Return timestamp of next repetition */
-    tc = SLIST_FIRST(&t->repeatedCallbacks);
-    if(!tc)
+    if(t->heapSize == 0)
         return UA_INT64_MAX; /* Main-loop has a max timeout / will continue earlier */
-    return tc->nextTime;
+    return t->heap[0]->nextTime;
 }
 
 void
@@ -353,9 +483,18 @@ UA_Timer_deleteMembers(UA_Timer *t) {
     processChanges(t);
 
     /* Remove repeated callbacks */
+    for(size_t i = 0; i < t->heapSize; i++)
+        UA_free(t->heap[i]);
+    UA_free(t->heap);
+    UA_free(t->idMap);
+    t->heap = NULL;
+    t->idMap = NULL;
+    t->heapSize = 0;
+    t->heapCapacity = 0;
+
     UA_TimerCallbackEntry *current;
-    while((current = SLIST_FIRST(&t->repeatedCallbacks))) {
-        SLIST_REMOVE_HEAD(&t->repeatedCallbacks, next);
+    while((current = SLIST_FIRST(&t->pendingCallbacks))) {
+        SLIST_REMOVE_HEAD(&t->pendingCallbacks, next);
         UA_free(current);
     }
 }
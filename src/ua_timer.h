@@ -28,8 +28,17 @@ typedef struct UA_TimerCallbackEntry UA_TimerCallbackEntry;
 typedef SLIST_HEAD(UA_TimerCallbackList, UA_TimerCallbackEntry) UA_TimerCallbackList;
 
 typedef struct {
-    /* The linked list of callbacks is sorted according to the execution timestamp. */
-    UA_TimerCallbackList repeatedCallbacks;
+    /* The callbacks are kept in a binary min-heap ordered by the execution
+     * timestamp. An open-addressing hash map indexes the heap entries by their
+     * id. The map has twice the capacity of the heap. */
+    UA_TimerCallbackEntry **heap;
+    UA_TimerCallbackEntry **idMap;
+    size_t heapSize;
+    size_t heapCapacity;
+
+    /* Added callbacks that could not be inserted into the heap (out of memory).
+     * Insertion is retried during the next _process call. */
+    UA_TimerCallbackList pendingCallbacks;
 
     /* Changes to the repeated callbacks in a multi-producer single-consumer queue */
     UA_TimerCallbackEntry * volatile changes_head;
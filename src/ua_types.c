@@ -37,8 +37,7 @@ const UA_Guid UA_GUID_NULL = {0, 0, 0, {0,0,0,0,0,0,0,0}};
 const UA_NodeId UA_NODEID_NULL = {0, UA_NODEIDTYPE_NUMERIC, {0}};
 const UA_ExpandedNodeId UA_EXPANDEDNODEID_NULL = {{0, UA_NODEIDTYPE_NUMERIC, {0}}, {0, NULL}, 0};
 
-/* TODO: The standard-defined types are ordered. See if binary search is
- * more efficient. */
+/* Binary search in UA_TYPES_TYPEIDINDEX for the first type with the typeId */
 const UA_DataType *
 UA_findDataType(const UA_NodeId *typeId) {
     if(typeId->identifierType != UA_NODEIDTYPE_NUMERIC)
@@ -46,10 +45,22 @@ UA_findDataType(const UA_NodeId *typeId) {
 
     /* Always look in built-in types first
      * (may contain data types from all namespaces) */
-    for(size_t i = 0; i < UA_TYPES_COUNT; ++i) {
-        if(UA_TYPES[i].typeId.identifier.numeric == typeId->identifier.numeric
-           && UA_TYPES[i].typeId.namespaceIndex == typeId->namespaceIndex)
-            return &UA_TYPES[i];
+    UA_UInt16 ns = typeId->namespaceIndex;
+    UA_UInt32 id = typeId->identifier.numeric;
+    size_t lo = 0, hi = UA_TYPES_COUNT;
+    while(lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+        const UA_DataType *type = &UA_TYPES[UA_TYPES_TYPEIDINDEX[mid]];
+        if(type->typeId.namespaceIndex < ns ||
+           (type->typeId.namespaceIndex == ns && type->typeId.identifier.numeric < id))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(lo < UA_TYPES_COUNT) {
+        const UA_DataType *type = &UA_TYPES[UA_TYPES_TYPEIDINDEX[lo]];
+        if(type->typeId.namespaceIndex == ns && type->typeId.identifier.numeric == id)
+            return type;
     }
 
     /* TODO When other namespace look in custom types, too, requires access to custom types array here! */
@@ -45,6 +45,16 @@ typedef struct {
 
     size_t customTypesArraySize;
     const UA_DataType *customTypesArray;
+    /* Sorted by the binaryEncodingId. Created on demand during decoding if
+     * there are many custom types. */
+    const UA_DataType **customTypesIndex;
+
+    /* If set, all memory for the decoded value is taken from the arena */
+    UA_Arena *arena;
+    /* Overlayable arrays (also String and ByteString content) point into the
+     * source buffer instead of being copied. Only used together with an
+     * arena. */
+    UA_Boolean borrow;
 
     UA_exchangeEncodeBuffer exchangeBufferCallback;
     void *exchangeBufferCallbackHandle;
@@ -72,9 +82,33 @@ typedef size_t (*calcSizeBinarySignature)(const void *UA_RESTRICT p, const UA_Da
 extern const encodeBinarySignature encodeBinaryJumpTable[UA_BUILTIN_TYPES_COUNT + 1];
 extern const decodeBinarySignature decodeBinaryJumpTable[UA_BUILTIN_TYPES_COUNT + 1];
 extern const calcSizeBinarySignature calcSizeBinaryJumpTable[UA_BUILTIN_TYPES_COUNT + 1];
+
+/* Flattened routines for the hot types in UA_TYPES, generated by
+ * generate_datatypes.py with --specialized-types. Return NULL if the type has
+ * no specialized routine. Then the member descriptions are interpreted. */
+static encodeBinarySignature getEncodeBinarySpecialized(const UA_DataType *type);
+static decodeBinarySignature getDecodeBinarySpecialized(const UA_DataType *type);
+static calcSizeBinarySignature getCalcSizeBinarySpecialized(const UA_DataType *type);
 static status encodeBinaryInternal(const void *src, const UA_DataType *type, Ctx *ctx);
 static status decodeBinaryInternal(void *dst, const UA_DataType *type, Ctx *ctx);
 
+/* Memory management during decoding. Memory from the arena is not freed
+ * individually. */
+static void *
+decodeCalloc(Ctx *ctx, size_t nmemb, size_t size) {
+    if(!ctx->arena)
+        return UA_calloc(nmemb, size);
+    if(size > 0 && nmemb > SIZE_MAX / size)
+        return NULL;
+    return UA_Arena_alloc(ctx->arena, nmemb * size);
+}
+
+static void
+decodeDeleteMembers(Ctx *ctx, void *p, const UA_DataType *type) {
+    if(!ctx->arena)
+        UA_deleteMembers(p, type);
+}
+
 /**
  * Chunking
  * ^^^^^^^^
@@ -122,6 +156,27 @@ encodeWithExchangeBuffer(const void *ptr, encodeBinarySignature encodeFunc, Ctx
     return UA_STATUSCODE_GOOD;
 }
 
+/* Encode a (non-array) member of a structure. If the buffer is full, exchange
+ * the buffer and encode the member again. */
+static UA_INLINE status
+encodeMember(const void *ptr, const UA_DataType *type,
+             encodeBinarySignature encodeFunc, Ctx *ctx) {
+    while(true) {
+        u8 *oldpos = ctx->pos;
+        status ret = encodeFunc(ptr, type, ctx);
+        if(ret != UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED)
+            return ret;
+        ctx->pos = oldpos; /* exchange/send the buffer */
+        ret = exchangeBuffer(ctx);
+        if(ret == UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED || ctx->pos + type->memSize > ctx->end) {
+            /* the send buffer is too small to encode the member, even after exchangeBuffer */
+            return UA_STATUSCODE_BADRESPONSETOOLARGE;
+        }
+        if(ret != UA_STATUSCODE_GOOD)
+            return ret;
+    }
+}
+
 #define ENCODE_WITHEXCHANGE(VAR, TYPE) \
     encodeWithExchangeBuffer((const void*)VAR, (encodeBinarySignature)TYPE##_encodeBinary, ctx)
 
@@ -510,21 +565,29 @@ Array_decodeBinary(void *UA_RESTRICT *UA_RESTRICT dst, size_t *out_length,
     if(ctx->pos + ((type->memSize * length) / 32) > ctx->end)
         return UA_STATUSCODE_BADDECODINGERROR;
 
-    /* Allocate memory */
-    *dst = UA_calloc(length, type->memSize);
-    if(!*dst)
-        return UA_STATUSCODE_BADOUTOFMEMORY;
-
     if(type->overlayable) {
-        /* memcpy overlayable array */
-        if(ctx->end < ctx->pos + (type->memSize * length)) {
-            UA_free(*dst);
-            *dst = NULL;
+        if(ctx->end < ctx->pos + (type->memSize * length))
             return UA_STATUSCODE_BADDECODINGERROR;
+
+        /* Point into the source buffer if the position is aligned for the
+         * type. The alignment of a type divides its size and is at most 8. */
+        size_t align = type->memSize < 8 ? type->memSize : 8;
+        if(ctx->borrow && (uintptr_t)ctx->pos % align == 0) {
+            *dst = ctx->pos;
+        } else {
+            /* memcpy overlayable array */
+            *dst = decodeCalloc(ctx, length, type->memSize);
+            if(!*dst)
+                return UA_STATUSCODE_BADOUTOFMEMORY;
+            memcpy(*dst, ctx->pos, type->memSize * length);
         }
-        memcpy(*dst, ctx->pos, type->memSize * length);
         ctx->pos += type->memSize * length;
     } else {
+        /* Allocate memory */
+        *dst = decodeCalloc(ctx, length, type->memSize);
+        if(!*dst)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+
         /* Decode array members */
         uintptr_t ptr = (uintptr_t)*dst;
         size_t decode_index = type->builtin ? type->typeIndex : UA_BUILTIN_TYPES_COUNT;
@@ -532,7 +595,8 @@ Array_decodeBinary(void *UA_RESTRICT *UA_RESTRICT dst, size_t *out_length,
             ret = decodeBinaryJumpTable[decode_index]((void*)ptr, type, ctx);
             if(ret != UA_STATUSCODE_GOOD) {
                 /* +1 because last element is also already initialized */
-                UA_Array_delete(*dst, i+1, type);
+                if(!ctx->arena)
+                    UA_Array_delete(*dst, i+1, type);
                 *dst = NULL;
                 return ret;
             }
@@ -792,6 +856,82 @@ DECODE_BINARY(LocalizedText) {
     return ret;
 }
 
+/* Below this size, the custom types are searched linearly */
+#define UA_CUSTOMTYPES_MAXLINEARSEARCH 16
+
+/* Order by the namespace index and the binary encoding id. The position in the
+ * array decides for duplicate identifiers, so that the first type wins as in a
+ * linear search. */
+static int
+compareCustomTypes(const void *a, const void *b) {
+    const UA_DataType *ta = *(const UA_DataType * const *)a;
+    const UA_DataType *tb = *(const UA_DataType * const *)b;
+    if(ta->typeId.namespaceIndex != tb->typeId.namespaceIndex)
+        return (ta->typeId.namespaceIndex < tb->typeId.namespaceIndex) ? -1 : 1;
+    if(ta->binaryEncodingId != tb->binaryEncodingId)
+        return (ta->binaryEncodingId < tb->binaryEncodingId) ? -1 : 1;
+    if(ta != tb)
+        return (ta < tb) ? -1 : 1;
+    return 0;
+}
+
+/* Returns the position of the first entry that is not smaller than the
+ * (namespaceIndex, binaryEncodingId) key */
+#define UA_LOWERBOUND_BINARYENCODING(SIZE, GETTYPE, NS, ID, POS) do {  \
+        size_t lo = 0, hi = SIZE;                                     \
+        while(lo < hi) {                                              \
+            size_t mid = lo + ((hi - lo) / 2);                        \
+            const UA_DataType *t = GETTYPE(mid);                      \
+            if(t->typeId.namespaceIndex < NS ||                       \
+               (t->typeId.namespaceIndex == NS &&                     \
+                t->binaryEncodingId < ID))                            \
+                lo = mid + 1;                                         \
+            else                                                      \
+                hi = mid;                                             \
+        }                                                             \
+        POS = lo;                                                     \
+    } while(0)
+
+#define UA_TYPES_BYBINARY(I) (&UA_TYPES[UA_TYPES_BINARYENCODINGINDEX[I]])
+#define UA_CUSTOMTYPES_BYBINARY(I) (ctx->customTypesIndex[I])
+
+static const UA_DataType *
+findCustomTypeByBinary(u16 ns, u32 id, Ctx *ctx) {
+    /* Create the index */
+    if(!ctx->customTypesIndex &&
+       ctx->customTypesArraySize > UA_CUSTOMTYPES_MAXLINEARSEARCH) {
+        ctx->customTypesIndex = (const UA_DataType**)
+            UA_malloc(sizeof(UA_DataType*) * ctx->customTypesArraySize);
+        if(ctx->customTypesIndex) {
+            for(size_t i = 0; i < ctx->customTypesArraySize; ++i)
+                ctx->customTypesIndex[i] = &ctx->customTypesArray[i];
+            qsort((void*)ctx->customTypesIndex, ctx->customTypesArraySize,
+                  sizeof(UA_DataType*), compareCustomTypes);
+        }
+    }
+
+    /* Linear search */
+    if(!ctx->customTypesIndex) {
+        for(size_t i = 0; i < ctx->customTypesArraySize; ++i) {
+            if(ctx->customTypesArray[i].binaryEncodingId == id &&
+               ctx->customTypesArray[i].typeId.namespaceIndex == ns)
+                return &ctx->customTypesArray[i];
+        }
+        return NULL;
+    }
+
+    /* Binary search */
+    size_t pos;
+    UA_LOWERBOUND_BINARYENCODING(ctx->customTypesArraySize, UA_CUSTOMTYPES_BYBINARY,
+                                 ns, id, pos);
+    if(pos < ctx->customTypesArraySize) {
+        const UA_DataType *type = ctx->customTypesIndex[pos];
+        if(type->binaryEncodingId == id && type->typeId.namespaceIndex == ns)
+            return type;
+    }
+    return NULL;
+}
+
 /* The binary encoding has a different nodeid from the data type. So it is not
  * possible to reuse UA_findDataType */
 static const UA_DataType *
@@ -802,20 +942,19 @@ UA_findDataTypeByBinaryInternal(const UA_NodeId *typeId, Ctx *ctx) {
 
     /* Always look in built-in types first
      * (may contain data types from all namespaces) */
-    for(size_t i = 0; i < UA_TYPES_COUNT; ++i) {
-        if(UA_TYPES[i].binaryEncodingId == typeId->identifier.numeric &&
-           UA_TYPES[i].typeId.namespaceIndex == typeId->namespaceIndex)
-            return &UA_TYPES[i];
+    u16 ns = typeId->namespaceIndex;
+    u32 id = typeId->identifier.numeric;
+    size_t pos;
+    UA_LOWERBOUND_BINARYENCODING(UA_TYPES_COUNT, UA_TYPES_BYBINARY, ns, id, pos);
+    if(pos < UA_TYPES_COUNT) {
+        const UA_DataType *type = UA_TYPES_BYBINARY(pos);
+        if(type->binaryEncodingId == id && type->typeId.namespaceIndex == ns)
+            return type;
     }
 
     /* When other namespace look in custom types, too */
-    if(typeId->namespaceIndex != 0) {
-        for(size_t i = 0; i < ctx->customTypesArraySize; ++i) {
-            if(ctx->customTypesArray[i].binaryEncodingId == typeId->identifier.numeric &&
-               ctx->customTypesArray[i].typeId.namespaceIndex == typeId->namespaceIndex)
-                return &ctx->customTypesArray[i];
-        }
-    }
+    if(ns != 0)
+        return findCustomTypeByBinary(ns, id, ctx);
 
     return NULL;
 }
@@ -825,6 +964,9 @@ UA_findDataTypeByBinary(const UA_NodeId *typeId) {
     Ctx ctx;
     ctx.customTypesArraySize = 0;
     ctx.customTypesArray = NULL;
+    ctx.customTypesIndex = NULL;
+    ctx.arena = NULL;
+    ctx.borrow = false;
     return UA_findDataTypeByBinaryInternal(typeId, &ctx);
 }
 
@@ -893,15 +1035,19 @@ ExtensionObject_decodeBinaryContent(UA_ExtensionObject *dst, const UA_NodeId *ty
     /* Lookup the datatype */
     const UA_DataType *type = UA_findDataTypeByBinaryInternal(typeId, ctx);
 
-    /* Unknown type, just take the binary content */
+    /* Unknown type, just take the binary content. With an arena, the typeId
+     * was also decoded into the arena and can be shared. */
     if(!type) {
         dst->encoding = UA_EXTENSIONOBJECT_ENCODED_BYTESTRING;
-        UA_NodeId_copy(typeId, &dst->content.encoded.typeId);
+        if(ctx->arena)
+            dst->content.encoded.typeId = *typeId;
+        else
+            UA_NodeId_copy(typeId, &dst->content.encoded.typeId);
         return DECODE_DIRECT(&dst->content.encoded.body, String); /* ByteString */
     }
 
     /* Allocate memory */
-    dst->content.decoded.data = UA_new(type);
+    dst->content.decoded.data = decodeCalloc(ctx, 1, type->memSize);
     if(!dst->content.decoded.data)
         return UA_STATUSCODE_BADOUTOFMEMORY;
 
@@ -927,13 +1073,13 @@ DECODE_BINARY(ExtensionObject) {
     ret |= DECODE_DIRECT(&binTypeId, NodeId);
     ret |= DECODE_DIRECT(&encoding, Byte);
     if(ret != UA_STATUSCODE_GOOD) {
-        UA_NodeId_deleteMembers(&binTypeId);
+        decodeDeleteMembers(ctx, &binTypeId, &UA_TYPES[UA_TYPES_NODEID]);
         return ret;
     }
 
     if(encoding == UA_EXTENSIONOBJECT_ENCODED_BYTESTRING) {
         ret = ExtensionObject_decodeBinaryContent(dst, &binTypeId, ctx);
-        UA_NodeId_deleteMembers(&binTypeId);
+        decodeDeleteMembers(ctx, &binTypeId, &UA_TYPES[UA_TYPES_NODEID]);
     } else if(encoding == UA_EXTENSIONOBJECT_ENCODED_NOBODY) {
         dst->encoding = (UA_ExtensionObjectEncoding)encoding;
         dst->content.encoded.typeId = binTypeId; /* move to dst */
@@ -943,9 +1089,9 @@ DECODE_BINARY(ExtensionObject) {
         dst->content.encoded.typeId = binTypeId; /* move to dst */
         ret = DECODE_DIRECT(&dst->content.encoded.body, String); /* ByteString */
         if(ret != UA_STATUSCODE_GOOD)
-            UA_NodeId_deleteMembers(&dst->content.encoded.typeId);
+            decodeDeleteMembers(ctx, &dst->content.encoded.typeId, &UA_TYPES[UA_TYPES_NODEID]);
     } else {
-        UA_NodeId_deleteMembers(&binTypeId);
+        decodeDeleteMembers(ctx, &binTypeId, &UA_TYPES[UA_TYPES_NODEID]);
         ret = UA_STATUSCODE_BADDECODINGERROR;
     }
 
@@ -1060,7 +1206,7 @@ Variant_decodeBinaryUnwrapExtensionObject(UA_Variant *dst, Ctx *ctx) {
     u8 encoding;
     ret = DECODE_DIRECT(&encoding, Byte);
     if(ret != UA_STATUSCODE_GOOD) {
-        UA_NodeId_deleteMembers(&typeId);
+        decodeDeleteMembers(ctx, &typeId, &UA_TYPES[UA_TYPES_NODEID]);
         return ret;
     }
 
@@ -1073,11 +1219,11 @@ Variant_decodeBinaryUnwrapExtensionObject(UA_Variant *dst, Ctx *ctx) {
         /* Reset and decode as ExtensionObject */
         dst->type = &UA_TYPES[UA_TYPES_EXTENSIONOBJECT];
         ctx->pos = old_pos;
-        UA_NodeId_deleteMembers(&typeId);
+        decodeDeleteMembers(ctx, &typeId, &UA_TYPES[UA_TYPES_NODEID]);
     }
 
     /* Allocate memory */
-    dst->data = UA_new(dst->type);
+    dst->data = decodeCalloc(ctx, 1, dst->type->memSize);
     if(!dst->data)
         return UA_STATUSCODE_BADOUTOFMEMORY;
 
@@ -1122,7 +1268,7 @@ DECODE_BINARY(Variant) {
     if(isArray) {
         ret = Array_decodeBinary(&dst->data, &dst->arrayLength, dst->type, ctx);
     } else if(typeIndex != UA_TYPES_EXTENSIONOBJECT) {
-        dst->data = UA_new(dst->type);
+        dst->data = decodeCalloc(ctx, 1, dst->type->memSize);
         if(!dst->data)
             return UA_STATUSCODE_BADOUTOFMEMORY;
         ret = decodeBinaryJumpTable[typeIndex](dst->data, dst->type, ctx);
@@ -1310,7 +1456,7 @@ DECODE_BINARY(DiagnosticInfo) {
     if(encodingMask & 0x40) {
         /* innerDiagnosticInfo is allocated on the heap */
         dst->innerDiagnosticInfo = (UA_DiagnosticInfo*)
-            UA_calloc(1, sizeof(UA_DiagnosticInfo));
+            decodeCalloc(ctx, 1, sizeof(UA_DiagnosticInfo));
         if(!dst->innerDiagnosticInfo)
             return UA_STATUSCODE_BADOUTOFMEMORY;
         dst->hasInnerDiagnosticInfo = true;
@@ -1361,6 +1507,10 @@ const encodeBinarySignature encodeBinaryJumpTable[UA_BUILTIN_TYPES_COUNT + 1] =
 
 static status
 encodeBinaryInternal(const void *src, const UA_DataType *type, Ctx *ctx) {
+    encodeBinarySignature specialized = getEncodeBinarySpecialized(type);
+    if(specialized)
+        return specialized(src, type, ctx);
+
     /* Check the recursion limit */
     if(ctx->depth > UA_ENCODING_MAX_RECURSION)
         return UA_STATUSCODE_BADENCODINGERROR;
@@ -1376,21 +1526,8 @@ encodeBinaryInternal(const void *src, const UA_DataType *type, Ctx *ctx) {
         if(!member->isArray) {
             ptr += member->padding;
             size_t encode_index = membertype->builtin ? membertype->typeIndex : UA_BUILTIN_TYPES_COUNT;
-            size_t memSize = membertype->memSize;
-            u8 *oldpos = ctx->pos;
-            ret = encodeBinaryJumpTable[encode_index]((const void*)ptr, membertype, ctx);
-            ptr += memSize;
-            if(ret == UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED) {
-                ctx->pos = oldpos; /* exchange/send the buffer */
-                ret = exchangeBuffer(ctx);
-                ptr -= member->padding + memSize; /* encode the same member in the next iteration */
-                if(ret == UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED || ctx->pos + memSize > ctx->end) {
-                    /* the send buffer is too small to encode the member, even after exchangeBuffer */
-                    ret = UA_STATUSCODE_BADRESPONSETOOLARGE;
-                    break;
-                }
-                --i;
-            }
+            ret = encodeMember((const void*)ptr, membertype, encodeBinaryJumpTable[encode_index], ctx);
+            ptr += membertype->memSize;
         } else {
             ptr += member->padding;
             const size_t length = *((const size_t*)ptr);
@@ -1458,6 +1595,10 @@ const decodeBinarySignature decodeBinaryJumpTable[UA_BUILTIN_TYPES_COUNT + 1] =
 
 static status
 decodeBinaryInternal(void *dst, const UA_DataType *type, Ctx *ctx) {
+    decodeBinarySignature specialized = getDecodeBinarySpecialized(type);
+    if(specialized)
+        return specialized(dst, type, ctx);
+
     /* Check the recursion limit */
     if(ctx->depth > UA_ENCODING_MAX_RECURSION)
         return UA_STATUSCODE_BADENCODINGERROR;
@@ -1489,10 +1630,11 @@ decodeBinaryInternal(void *dst, const UA_DataType *type, Ctx *ctx) {
     return ret;
 }
 
-status
-UA_decodeBinary(const UA_ByteString *src, size_t *offset, void *dst,
-                const UA_DataType *type, size_t customTypesSize,
-                const UA_DataType *customTypes) {
+static status
+decodeBinaryWithArena(const UA_ByteString *src, size_t *offset, void *dst,
+                      const UA_DataType *type, size_t customTypesSize,
+                      const UA_DataType *customTypes, UA_Arena *arena,
+                      UA_Boolean borrow) {
     /* Set up the context */
     Ctx ctx;
     ctx.pos = &src->data[*offset];
@@ -1500,22 +1642,50 @@ UA_decodeBinary(const UA_ByteString *src, size_t *offset, void *dst,
     ctx.depth = 0;
     ctx.customTypesArraySize = customTypesSize;
     ctx.customTypesArray = customTypes;
+    ctx.customTypesIndex = NULL;
+    ctx.arena = arena;
+    ctx.borrow = borrow;
 
     /* Decode */
     memset(dst, 0, type->memSize); /* Initialize the value */
     status ret = decodeBinaryInternal(dst, type, &ctx);
+    UA_free((void*)ctx.customTypesIndex);
 
     if(ret == UA_STATUSCODE_GOOD) {
         /* Set the new offset */
         *offset = (size_t)(ctx.pos - src->data) / sizeof(u8);
     } else {
         /* Clean up */
-        UA_deleteMembers(dst, type);
+        decodeDeleteMembers(&ctx, dst, type);
         memset(dst, 0, type->memSize);
     }
     return ret;
 }
 
+status
+UA_decodeBinary(const UA_ByteString *src, size_t *offset, void *dst,
+                const UA_DataType *type, size_t customTypesSize,
+                const UA_DataType *customTypes) {
+    return decodeBinaryWithArena(src, offset, dst, type, customTypesSize,
+                                 customTypes, NULL, false);
+}
+
+status
+UA_decodeBinaryArena(const UA_ByteString *src, size_t *offset, void *dst,
+                     const UA_DataType *type, size_t customTypesSize,
+                     const UA_DataType *customTypes, UA_Arena *arena) {
+    return decodeBinaryWithArena(src, offset, dst, type, customTypesSize,
+                                 customTypes, arena, false);
+}
+
+status
+UA_decodeBinaryBorrowed(const UA_ByteString *src, size_t *offset, void *dst,
+                        const UA_DataType *type, size_t customTypesSize,
+                        const UA_DataType *customTypes, UA_Arena *arena) {
+    return decodeBinaryWithArena(src, offset, dst, type, customTypesSize,
+                                 customTypes, arena, true);
+}
+
 /**
  * Compute the Message Size
  * ------------------------
@@ -1726,6 +1896,10 @@ const calcSizeBinarySignature calcSizeBinaryJumpTable[UA_BUILTIN_TYPES_COUNT + 1
 
 size_t
 UA_calcSizeBinary(const void *p, const UA_DataType *type) {
+    calcSizeBinarySignature specialized = getCalcSizeBinarySpecialized(type);
+    if(specialized)
+        return specialized(p, type);
+
     size_t s = 0;
     uintptr_t ptr = (uintptr_t)p;
     u8 membersSize = type->membersSize;
@@ -1748,3 +1922,11 @@ UA_calcSizeBinary(const void *p, const UA_DataType *type) {
     }
     return s;
 }
+
+/**
+ * Specialized Routines
+ * --------------------
+ * Generated routines for selected types. They call the routines of the members
+ * directly instead of interpreting the member descriptions. */
+
+#include "ua_types_generated_encoding_binary_specialized.h"
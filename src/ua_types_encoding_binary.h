@@ -17,6 +17,7 @@ extern "C" {
 #endif
 
 #include "ua_types.h"
+#include "ua_mempool.h"
 
 typedef UA_StatusCode (*UA_exchangeEncodeBuffer)(void *handle, UA_Byte **bufPos,
                                                  const UA_Byte **bufEnd);
@@ -67,6 +68,27 @@ UA_decodeBinary(const UA_ByteString *src, size_t *offset, void *dst,
                 const UA_DataType *type, size_t customTypesSize,
                 const UA_DataType *customTypes) UA_FUNC_ATTR_WARN_UNUSED_RESULT;
 
+/* Decodes like UA_decodeBinary. But all memory of the decoded value is taken
+ * from the arena. The value must not be deleted with UA_deleteMembers. It
+ * remains valid until the arena is reset. If decoding fails, the value is
+ * reset (zeroed). */
+UA_StatusCode
+UA_decodeBinaryArena(const UA_ByteString *src, size_t *offset, void *dst,
+                     const UA_DataType *type, size_t customTypesSize,
+                     const UA_DataType *customTypes,
+                     UA_Arena *arena) UA_FUNC_ATTR_WARN_UNUSED_RESULT;
+
+/* Decodes into the arena like UA_decodeBinaryArena. Additionally, the content
+ * of Strings, ByteStrings and other arrays of overlayable types is not copied
+ * but points into src. So the value is valid only as long as both the arena
+ * and src are unchanged. Values that are retained beyond that need to be
+ * copied. */
+UA_StatusCode
+UA_decodeBinaryBorrowed(const UA_ByteString *src, size_t *offset, void *dst,
+                        const UA_DataType *type, size_t customTypesSize,
+                        const UA_DataType *customTypes,
+                        UA_Arena *arena) UA_FUNC_ATTR_WARN_UNUSED_RESULT;
+
 /* Returns the number of bytes the value p takes in binary encoding. Returns
  * zero if an error occurs. UA_calcSizeBinary is thread-safe and reentrant since
  * it does not access global (thread-local) variables. */
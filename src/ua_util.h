@@ -106,6 +106,29 @@ UA_atomic_cmpxchg(void * volatile * addr, void *expected, void *newptr) {
 #endif
 }
 
+static UA_INLINE size_t
+UA_atomic_cmpxchgSize(volatile size_t *addr, size_t expected, size_t newval) {
+#ifndef UA_ENABLE_MULTITHREADING
+    size_t old = *addr;
+    if(old == expected) {
+        *addr = newval;
+    }
+    return old;
+#else
+# ifdef _MSC_VER /* Visual Studio */
+#  ifdef _WIN64
+    return (size_t)_InterlockedCompareExchange64((volatile __int64*)addr,
+                                                 (__int64)newval, (__int64)expected);
+#  else
+    return (size_t)_InterlockedCompareExchange((volatile long*)addr,
+                                               (long)newval, (long)expected);
+#  endif
+# else /* GCC/Clang */
+    return __sync_val_compare_and_swap(addr, expected, newval);
+# endif
+#endif
+}
+
 static UA_INLINE uint32_t
 UA_atomic_addUInt32(volatile uint32_t *addr, uint32_t increase) {
 #ifndef UA_ENABLE_MULTITHREADING
@@ -0,0 +1,146 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ua_types.h"
+#include "ua_mempool.h"
+#include "check.h"
+
+#define POOL_BLOCKS 100
+
+static UA_MemoryPool pool;
+
+static void setup(void) {
+    UA_MemoryPool_init(&pool, sizeof(UA_DataValue), 8);
+}
+
+static void teardown(void) {
+    UA_MemoryPool_deleteMembers(&pool);
+}
+
+static size_t
+countSlabs(void) {
+    size_t count = 0;
+    UA_MemoryPoolSlab *slab;
+    SLIST_FOREACH(slab, &pool.slabs, next)
+        ++count;
+    return count;
+}
+
+START_TEST(MemoryPool_allocFree) {
+    void *blocks[POOL_BLOCKS];
+    for(size_t i = 0; i < POOL_BLOCKS; ++i) {
+        blocks[i] = UA_MemoryPool_alloc(&pool);
+        ck_assert_ptr_ne(blocks[i], NULL);
+        ck_assert_uint_eq((uintptr_t)blocks[i] % sizeof(UA_Double), 0);
+        memset(blocks[i], (int)i, sizeof(UA_DataValue));
+    }
+    ck_assert_uint_eq(pool.usedBlocks, POOL_BLOCKS);
+    ck_assert_uint_eq(countSlabs(), (POOL_BLOCKS + 7) / 8);
+
+    /* The blocks do not overlap */
+    for(size_t i = 0; i < POOL_BLOCKS; ++i) {
+        UA_Byte *b = (UA_Byte*)blocks[i];
+        for(size_t j = 0; j < sizeof(UA_DataValue); ++j)
+            ck_assert_uint_eq(b[j], (UA_Byte)i);
+    }
+
+    /* Freed blocks are reused */
+    UA_MemoryPool_free(&pool, blocks[10]);
+    void *reused = UA_MemoryPool_alloc(&pool);
+    ck_assert_ptr_eq(reused, blocks[10]);
+
+    /* Releasing all blocks keeps one slab and a spare */
+    for(size_t i = 0; i < POOL_BLOCKS; ++i)
+        UA_MemoryPool_free(&pool, blocks[i]);
+    ck_assert_uint_eq(pool.usedBlocks, 0);
+    ck_assert_uint_eq(countSlabs(), 2);
+
+    /* The remaining slabs are reused. Crossing the boundary of the first slab
+     * does not allocate a new slab. */
+    UA_MemoryPoolSlab *first = SLIST_FIRST(&pool.slabs);
+    for(size_t round = 0; round < 3; ++round) {
+        for(size_t i = 0; i < 9; ++i)
+            blocks[i] = UA_MemoryPool_alloc(&pool);
+        ck_assert_uint_eq(countSlabs(), 2);
+        for(size_t i = 0; i < 9; ++i)
+            UA_MemoryPool_free(&pool, blocks[i]);
+        ck_assert_uint_eq(countSlabs(), 2);
+        ck_assert_ptr_eq(SLIST_FIRST(&pool.slabs), first);
+    }
+}
+END_TEST
+
+static size_t
+countArenaBlocks(UA_Arena *arena) {
+    size_t count = 0;
+    UA_ArenaBlock *block;
+    SLIST_FOREACH(block, &arena->blocks, next)
+        ++count;
+    return count;
+}
+
+START_TEST(Arena_allocReset) {
+    UA_Arena arena;
+    UA_Arena_init(&arena, 1024);
+
+    /* Allocations are aligned, zeroed and do not overlap */
+    UA_Byte *allocs[POOL_BLOCKS];
+    for(size_t i = 0; i < POOL_BLOCKS; ++i) {
+        allocs[i] = (UA_Byte*)UA_Arena_alloc(&arena, 1 + (i % 40));
+        ck_assert_ptr_ne(allocs[i], NULL);
+        ck_assert_uint_eq((uintptr_t)allocs[i] % sizeof(UA_Double), 0);
+        for(size_t j = 0; j < 1 + (i % 40); ++j)
+            ck_assert_uint_eq(allocs[i][j], 0);
+        memset(allocs[i], (int)i, 1 + (i % 40));
+    }
+    for(size_t i = 0; i < POOL_BLOCKS; ++i) {
+        for(size_t j = 0; j < 1 + (i % 40); ++j)
+            ck_assert_uint_eq(allocs[i][j], (UA_Byte)i);
+    }
+    ck_assert_uint_gt(countArenaBlocks(&arena), 1);
+
+    /* A large allocation gets a block of its own */
+    UA_Byte *large = (UA_Byte*)UA_Arena_alloc(&arena, 5000);
+    ck_assert_ptr_ne(large, NULL);
+    memset(large, 0xff, 5000);
+
+    /* Reset keeps one block that is reused */
+    UA_Arena_reset(&arena);
+    ck_assert_uint_eq(countArenaBlocks(&arena), 1);
+    UA_Byte *first = (UA_Byte*)UA_Arena_alloc(&arena, 16);
+    ck_assert_ptr_eq(first, large);
+    ck_assert_uint_eq(first[0], 0);
+    ck_assert_uint_eq(countArenaBlocks(&arena), 1);
+
+    /* Overflowing sizes are rejected */
+    ck_assert_ptr_eq(UA_Arena_alloc(&arena, SIZE_MAX - 8), NULL);
+
+    UA_Arena_deleteMembers(&arena);
+}
+END_TEST
+
+static Suite* testSuite_MemoryPool(void) {
+    Suite *s = suite_create("MemoryPool");
+    TCase *tc_pool = tcase_create("MemoryPool");
+    tcase_add_checked_fixture(tc_pool, setup, teardown);
+    tcase_add_test(tc_pool, MemoryPool_allocFree);
+    suite_add_tcase(s, tc_pool);
+    TCase *tc_arena = tcase_create("Arena");
+    tcase_add_test(tc_arena, Arena_allocReset);
+    suite_add_tcase(s, tc_arena);
+    return s;
+}
+
+int main(void) {
+    Suite *s = testSuite_MemoryPool();
+    SRunner *sr = srunner_create(s);
+    srunner_set_fork_status(sr, CK_NOFORK);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,177 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "ua_types.h"
+#include "ua_timer.h"
+#include "check.h"
+
+#define BENCHMARK_CALLBACKS 100000
+
+static UA_Timer timer;
+static size_t dispatched;
+static UA_UInt32 *lastData;
+
+static void
+timerCallback(void *application, void *data) {
+    lastData = (UA_UInt32*)data;
+    dispatched++;
+}
+
+static void
+dispatchCallback(void *application, UA_TimerCallback callback, void *data) {
+    callback(application, data);
+}
+
+static void setup(void) {
+    UA_Timer_init(&timer);
+    dispatched = 0;
+    lastData = NULL;
+}
+
+static void teardown(void) {
+    UA_Timer_deleteMembers(&timer);
+}
+
+START_TEST(Timer_dispatchInOrder) {
+    UA_UInt32 data[3] = {0, 1, 2};
+    UA_UInt64 id;
+    UA_Timer_addRepeatedCallback(&timer, timerCallback, &data[0], 30, &id);
+    UA_Timer_addRepeatedCallback(&timer, timerCallback, &data[1], 12, &id);
+    UA_Timer_addRepeatedCallback(&timer, timerCallback, &data[2], 20, &id);
+
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    UA_DateTime next = UA_Timer_process(&timer, now, dispatchCallback, NULL);
+    ck_assert_uint_eq(dispatched, 0);
+
+    /* The shortest interval comes first */
+    next = UA_Timer_process(&timer, next, dispatchCallback, NULL);
+    ck_assert_uint_eq(dispatched, 1);
+    ck_assert_ptr_eq(lastData, &data[1]);
+
+    next = UA_Timer_process(&timer, next, dispatchCallback, NULL);
+    ck_assert_uint_eq(dispatched, 2);
+    ck_assert_ptr_eq(lastData, &data[2]);
+
+    /* The 12ms callback is repeated before the 30ms callback */
+    next = UA_Timer_process(&timer, next, dispatchCallback, NULL);
+    ck_assert_uint_eq(dispatched, 3);
+    ck_assert_ptr_eq(lastData, &data[1]);
+}
+END_TEST
+
+START_TEST(Timer_changeInterval) {
+    UA_UInt32 data[2] = {0, 1};
+    UA_UInt64 fastId, slowId;
+    UA_Timer_addRepeatedCallback(&timer, timerCallback, &data[0], 10, &fastId);
+    UA_Timer_addRepeatedCallback(&timer, timerCallback, &data[1], 1000, &slowId);
+    UA_Timer_process(&timer, UA_DateTime_nowMonotonic(), dispatchCallback, NULL);
+
+    /* Swap the intervals */
+    UA_Timer_changeRepeatedCallbackInterval(&timer, fastId, 1000);
+    UA_Timer_changeRepeatedCallbackInterval(&timer, slowId, 10);
+    UA_DateTime next = UA_Timer_process(&timer, UA_DateTime_nowMonotonic(),
+                                        dispatchCallback, NULL);
+    UA_Timer_process(&timer, next, dispatchCallback, NULL);
+    ck_assert_uint_eq(dispatched, 1);
+    ck_assert_ptr_eq(lastData, &data[1]);
+}
+END_TEST
+
+START_TEST(Timer_remove) {
+    UA_UInt32 data[64];
+    UA_UInt64 ids[64];
+    for(UA_UInt32 i = 0; i < 64; i++) {
+        data[i] = i;
+        UA_Timer_addRepeatedCallback(&timer, timerCallback, &data[i], 10 + i, &ids[i]);
+    }
+    UA_Timer_process(&timer, UA_DateTime_nowMonotonic(), dispatchCallback, NULL);
+
+    /* Remove every callback except the last one */
+    for(size_t i = 0; i < 63; i++)
+        UA_Timer_removeRepeatedCallback(&timer, ids[i]);
+
+    UA_DateTime end = UA_DateTime_nowMonotonic() + (80 * UA_DATETIME_MSEC);
+    UA_Timer_process(&timer, end, dispatchCallback, NULL);
+    ck_assert_uint_eq(dispatched, 1);
+    ck_assert_ptr_eq(lastData, &data[63]);
+
+    /* Removing an unknown id has no effect */
+    UA_Timer_removeRepeatedCallback(&timer, ids[0]);
+    UA_Timer_process(&timer, end, dispatchCallback, NULL);
+    ck_assert_uint_eq(dispatched, 1);
+}
+END_TEST
+
+/* Schedule many callbacks with different intervals. Then dispatch, change and
+ * remove them. */
+START_TEST(Timer_benchmark) {
+    UA_UInt64 *ids = (UA_UInt64*)UA_malloc(BENCHMARK_CALLBACKS * sizeof(UA_UInt64));
+    ck_assert_ptr_ne(ids, NULL);
+
+    clock_t begin = clock();
+    for(size_t i = 0; i < BENCHMARK_CALLBACKS; i++) {
+        UA_StatusCode retval =
+            UA_Timer_addRepeatedCallback(&timer, timerCallback, NULL,
+                                         (UA_UInt32)(5 + (i % 1000)), &ids[i]);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    }
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    UA_Timer_process(&timer, now, dispatchCallback, NULL);
+    clock_t added = clock();
+
+    /* Every callback is due after one second */
+    UA_Timer_process(&timer, now + (1005 * UA_DATETIME_MSEC), dispatchCallback, NULL);
+    ck_assert_uint_ge(dispatched, BENCHMARK_CALLBACKS);
+    clock_t processed = clock();
+
+    for(size_t i = 0; i < BENCHMARK_CALLBACKS; i++)
+        UA_Timer_changeRepeatedCallbackInterval(&timer, ids[i],
+                                                (UA_UInt32)(5 + ((i * 7) % 1000)));
+    UA_Timer_process(&timer, now, dispatchCallback, NULL);
+    clock_t changed = clock();
+
+    for(size_t i = 0; i < BENCHMARK_CALLBACKS; i++)
+        UA_Timer_removeRepeatedCallback(&timer, ids[i]);
+    UA_Timer_process(&timer, now, dispatchCallback, NULL);
+    clock_t removed = clock();
+
+    dispatched = 0;
+    UA_Timer_process(&timer, now + (10 * UA_DATETIME_SEC), dispatchCallback, NULL);
+    ck_assert_uint_eq(dispatched, 0);
+
+    printf("%u callbacks: add %f s, process %f s, change %f s, remove %f s\n",
+           BENCHMARK_CALLBACKS,
+           (double)(added - begin) / CLOCKS_PER_SEC,
+           (double)(processed - added) / CLOCKS_PER_SEC,
+           (double)(changed - processed) / CLOCKS_PER_SEC,
+           (double)(removed - changed) / CLOCKS_PER_SEC);
+    UA_free(ids);
+}
+END_TEST
+
+static Suite* testSuite_Timer(void) {
+    Suite *s = suite_create("Timer");
+    TCase *tc_timer = tcase_create("Timer");
+    tcase_add_checked_fixture(tc_timer, setup, teardown);
+    tcase_add_test(tc_timer, Timer_dispatchInOrder);
+    tcase_add_test(tc_timer, Timer_changeInterval);
+    tcase_add_test(tc_timer, Timer_remove);
+    tcase_add_test(tc_timer, Timer_benchmark);
+    suite_add_tcase(s, tc_timer);
+    return s;
+}
+
+int main(void) {
+    Suite *s = testSuite_Timer();
+    SRunner *sr = srunner_create(s);
+    srunner_set_fork_status(sr, CK_NOFORK);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
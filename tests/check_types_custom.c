@@ -193,11 +193,88 @@ START_TEST(parseCustomArray) {
     UA_ByteString_deleteMembers(&buf);
 } END_TEST
 
+/* Many custom types are looked up with a sorted index */
+#define MANY_CUSTOM_TYPES 40
+
+START_TEST(parseManyCustomTypes) {
+    UA_DataType types[MANY_CUSTOM_TYPES];
+    for(size_t i = 0; i < MANY_CUSTOM_TYPES; ++i) {
+        types[i] = PointType;
+        types[i].typeIndex = (UA_UInt16)i;
+        types[i].typeId.identifier.numeric = (UA_UInt32)(1000 - i);
+        types[i].binaryEncodingId = (UA_UInt16)(2000 - (i * 3));
+    }
+
+    Point ps[MANY_CUSTOM_TYPES];
+    UA_ExtensionObject eos[MANY_CUSTOM_TYPES];
+    for(size_t i = 0; i < MANY_CUSTOM_TYPES; ++i) {
+        ps[i].x = (UA_Float)i;
+        ps[i].y = 0.0;
+        ps[i].z = 0.0;
+        UA_ExtensionObject_init(&eos[i]);
+        eos[i].encoding = UA_EXTENSIONOBJECT_DECODED_NODELETE;
+        eos[i].content.decoded.data = &ps[i];
+        eos[i].content.decoded.type = &types[(i * 7) % MANY_CUSTOM_TYPES];
+    }
+
+    UA_Variant var;
+    UA_Variant_setArray(&var, eos, MANY_CUSTOM_TYPES, &UA_TYPES[UA_TYPES_EXTENSIONOBJECT]);
+    size_t buflen = UA_calcSizeBinary(&var, &UA_TYPES[UA_TYPES_VARIANT]);
+    UA_ByteString buf;
+    UA_StatusCode retval = UA_ByteString_allocBuffer(&buf, buflen);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Byte *pos = buf.data;
+    const UA_Byte *end = &buf.data[buf.length];
+    retval = UA_encodeBinary(&var, &UA_TYPES[UA_TYPES_VARIANT], &pos, &end, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_Variant var2;
+    size_t offset = 0;
+    retval = UA_decodeBinary(&buf, &offset, &var2, &UA_TYPES[UA_TYPES_VARIANT],
+                             MANY_CUSTOM_TYPES, types);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_int_eq(var2.arrayLength, MANY_CUSTOM_TYPES);
+    for(size_t i = 0; i < MANY_CUSTOM_TYPES; i++) {
+        UA_ExtensionObject *eo = &((UA_ExtensionObject*)var2.data)[i];
+        ck_assert_int_eq(eo->encoding, UA_EXTENSIONOBJECT_DECODED);
+        ck_assert_ptr_eq(eo->content.decoded.type, &types[(i * 7) % MANY_CUSTOM_TYPES]);
+        ck_assert((int)((Point*)eo->content.decoded.data)->x == (int)i);
+    }
+
+    UA_Variant_deleteMembers(&var2);
+    UA_ByteString_deleteMembers(&buf);
+} END_TEST
+
+START_TEST(findStandardTypes) {
+    for(size_t i = 0; i < UA_TYPES_COUNT; ++i) {
+        const UA_DataType *type = &UA_TYPES[i];
+        if(type->typeId.identifier.numeric != 0) {
+            const UA_DataType *found = UA_findDataType(&type->typeId);
+            ck_assert_ptr_ne(found, NULL);
+            ck_assert(UA_NodeId_equal(&found->typeId, &type->typeId));
+        }
+        if(type->binaryEncodingId != 0) {
+            UA_NodeId encodingId = UA_NODEID_NUMERIC(type->typeId.namespaceIndex,
+                                                     type->binaryEncodingId);
+            ck_assert_ptr_eq(UA_findDataTypeByBinary(&encodingId), type);
+        }
+    }
+
+    /* Unknown identifiers */
+    UA_NodeId unknown = UA_NODEID_NUMERIC(0, 0xffffffff);
+    ck_assert_ptr_eq(UA_findDataType(&unknown), NULL);
+    ck_assert_ptr_eq(UA_findDataTypeByBinary(&unknown), NULL);
+    unknown = UA_NODEID_NUMERIC(5, UA_TYPES[UA_TYPES_INT32].typeId.identifier.numeric);
+    ck_assert_ptr_eq(UA_findDataType(&unknown), NULL);
+} END_TEST
+
 int main(void) {
     Suite *s  = suite_create("Test Custom DataType Encoding");
     TCase *tc = tcase_create("test cases");
     tcase_add_test(tc, parseCustomScalar);
     tcase_add_test(tc, parseCustomScalarExtensionObject);
+    tcase_add_test(tc, parseManyCustomTypes);
+    tcase_add_test(tc, findStandardTypes);
     tcase_add_test(tc, parseCustomArray);
     suite_add_tcase(s, tc);
 
@@ -274,6 +274,251 @@ START_TEST(decodeComplexTypeFromRandomBufferShallSurvive) {
 }
 END_TEST
 
+START_TEST(decodeComplexTypeFromRandomBufferWithArenaShallSurvive) {
+    UA_ByteString msg1;
+    UA_StatusCode retval = UA_ByteString_allocBuffer(&msg1, 256);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+#ifdef _WIN32
+    srand(42);
+#else
+    srandom(42);
+#endif
+    UA_Arena arena;
+    UA_Arena_init(&arena, 0);
+    void *obj1 = UA_new(&UA_TYPES[_i]);
+    for(int n = 0; n < RANDOM_TESTS; n++) {
+        for(size_t i = 0; i < msg1.length; i++) {
+#ifdef _WIN32
+            msg1.data[i] = (UA_Byte)rand();
+#else
+            msg1.data[i] = (UA_Byte)random();
+#endif
+        }
+        size_t pos = 0;
+        retval = UA_decodeBinaryArena(&msg1, &pos, obj1, &UA_TYPES[_i], 0, NULL, &arena);
+        UA_Arena_reset(&arena);
+    }
+    UA_free(obj1); /* The members were in the arena */
+    UA_Arena_deleteMembers(&arena);
+    UA_ByteString_deleteMembers(&msg1);
+}
+END_TEST
+
+/* Decoding into an arena yields the same value as the normal decoding */
+START_TEST(decodeWithArenaShallYieldDecode) {
+    UA_String strings[3] = {UA_STRING_STATIC("a"), UA_STRING_STATIC("bc"),
+                            UA_STRING_STATIC("def")};
+    UA_WriteValue wv[2];
+    UA_WriteValue_init(&wv[0]);
+    UA_WriteValue_init(&wv[1]);
+    wv[0].nodeId = UA_NODEID_STRING(1, "the.answer");
+    wv[0].attributeId = UA_ATTRIBUTEID_VALUE;
+    wv[0].value.hasValue = true;
+    UA_Variant_setArray(&wv[0].value.value, strings, 3, &UA_TYPES[UA_TYPES_STRING]);
+    wv[1].nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER);
+    wv[1].attributeId = UA_ATTRIBUTEID_DISPLAYNAME;
+    wv[1].indexRange = UA_STRING("1:2");
+    UA_WriteRequest request;
+    UA_WriteRequest_init(&request);
+    request.nodesToWrite = wv;
+    request.nodesToWriteSize = 2;
+
+    UA_ByteString msg1, msg2;
+    UA_StatusCode retval = UA_ByteString_allocBuffer(&msg1, 1000);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    retval = UA_ByteString_allocBuffer(&msg2, 1000);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Byte *pos = msg1.data;
+    const UA_Byte *end = &msg1.data[msg1.length];
+    retval = UA_encodeBinary(&request, &UA_TYPES[UA_TYPES_WRITEREQUEST], &pos, &end, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    msg1.length = (size_t)(pos - msg1.data);
+
+    UA_Arena arena;
+    UA_Arena_init(&arena, 64);
+    UA_WriteRequest decoded;
+    size_t offset = 0;
+    retval = UA_decodeBinaryArena(&msg1, &offset, &decoded, &UA_TYPES[UA_TYPES_WRITEREQUEST],
+                                  0, NULL, &arena);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(offset, msg1.length);
+    ck_assert_uint_eq(decoded.nodesToWriteSize, 2);
+    ck_assert(UA_NodeId_equal(&decoded.nodesToWrite[0].nodeId, &wv[0].nodeId));
+    ck_assert_uint_eq(decoded.nodesToWrite[0].value.value.arrayLength, 3);
+
+    pos = msg2.data;
+    end = &msg2.data[msg2.length];
+    retval = UA_encodeBinary(&decoded, &UA_TYPES[UA_TYPES_WRITEREQUEST], &pos, &end, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    msg2.length = (size_t)(pos - msg2.data);
+    ck_assert(UA_ByteString_equal(&msg1, &msg2));
+
+    /* No UA_deleteMembers. The memory is released with the arena. */
+    UA_Arena_deleteMembers(&arena);
+    UA_ByteString_deleteMembers(&msg1);
+    UA_ByteString_deleteMembers(&msg2);
+}
+END_TEST
+
+/* Borrowed decoding points into the message buffer */
+START_TEST(decodeBorrowedShallPointIntoBuffer) {
+    UA_Byte payload[300];
+    for(size_t i = 0; i < sizeof(payload); i++)
+        payload[i] = (UA_Byte)i;
+    UA_ByteString bs = {sizeof(payload), payload};
+    UA_WriteValue wv;
+    UA_WriteValue_init(&wv);
+    wv.nodeId = UA_NODEID_STRING(1, "the.answer");
+    wv.attributeId = UA_ATTRIBUTEID_VALUE;
+    wv.value.hasValue = true;
+    UA_Variant_setScalar(&wv.value.value, &bs, &UA_TYPES[UA_TYPES_BYTESTRING]);
+
+    UA_ByteString msg1, msg2;
+    UA_StatusCode retval = UA_ByteString_allocBuffer(&msg1, 1000);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    retval = UA_ByteString_allocBuffer(&msg2, 1000);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Byte *pos = msg1.data;
+    const UA_Byte *end = &msg1.data[msg1.length];
+    retval = UA_encodeBinary(&wv, &UA_TYPES[UA_TYPES_WRITEVALUE], &pos, &end, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    msg1.length = (size_t)(pos - msg1.data);
+
+    UA_Arena arena;
+    UA_Arena_init(&arena, 0);
+    UA_WriteValue decoded;
+    size_t offset = 0;
+    retval = UA_decodeBinaryBorrowed(&msg1, &offset, &decoded, &UA_TYPES[UA_TYPES_WRITEVALUE],
+                                     0, NULL, &arena);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(offset, msg1.length);
+
+    /* The string content is not copied */
+    UA_String *id = &decoded.nodeId.identifier.string;
+    ck_assert(UA_String_equal(id, &wv.nodeId.identifier.string));
+    ck_assert(id->data > msg1.data && id->data < &msg1.data[msg1.length]);
+    UA_ByteString *value = (UA_ByteString*)decoded.value.value.data;
+    ck_assert(UA_ByteString_equal(value, &bs));
+    ck_assert(value->data > msg1.data && value->data < &msg1.data[msg1.length]);
+
+    /* A deep copy is independent of the buffer */
+    UA_Variant copy;
+    retval = UA_Variant_copy(&decoded.value.value, &copy);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    pos = msg2.data;
+    end = &msg2.data[msg2.length];
+    retval = UA_encodeBinary(&decoded, &UA_TYPES[UA_TYPES_WRITEVALUE], &pos, &end, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    msg2.length = (size_t)(pos - msg2.data);
+    ck_assert(UA_ByteString_equal(&msg1, &msg2));
+
+    UA_Arena_deleteMembers(&arena);
+    memset(msg1.data, 0, msg1.length);
+    ck_assert(UA_ByteString_equal((UA_ByteString*)copy.data, &bs));
+    UA_Variant_deleteMembers(&copy);
+    UA_ByteString_deleteMembers(&msg1);
+    UA_ByteString_deleteMembers(&msg2);
+}
+END_TEST
+
+/* A copy of the type description is not in UA_TYPES. Then the generic
+ * routines are used instead of the specialized routines. */
+static void
+assertSpecializedEqualsGeneric(const void *p, const UA_DataType *type) {
+    UA_DataType generic = *type;
+    size_t size = UA_calcSizeBinary(p, type);
+    ck_assert_uint_eq(size, UA_calcSizeBinary(p, &generic));
+
+    UA_ByteString msg1, msg2;
+    UA_StatusCode retval = UA_ByteString_allocBuffer(&msg1, size);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    retval = UA_ByteString_allocBuffer(&msg2, size);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Byte *pos = msg1.data;
+    const UA_Byte *end = &msg1.data[msg1.length];
+    retval = UA_encodeBinary(p, type, &pos, &end, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_ptr_eq(pos, end);
+    pos = msg2.data;
+    end = &msg2.data[msg2.length];
+    retval = UA_encodeBinary(p, &generic, &pos, &end, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert(UA_ByteString_equal(&msg1, &msg2));
+
+    /* Decode with the generic routines and encode with the specialized
+     * routines */
+    void *decoded = UA_new(type);
+    size_t offset = 0;
+    retval = UA_decodeBinary(&msg1, &offset, decoded, &generic, 0, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(offset, size);
+    pos = msg2.data;
+    end = &msg2.data[msg2.length];
+    retval = UA_encodeBinary(decoded, type, &pos, &end, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert(UA_ByteString_equal(&msg1, &msg2));
+    UA_delete(decoded, type);
+
+    UA_ByteString_deleteMembers(&msg1);
+    UA_ByteString_deleteMembers(&msg2);
+}
+
+START_TEST(encodeSpecializedShallEqualGeneric) {
+    UA_ReadValueId rvi[2];
+    UA_ReadValueId_init(&rvi[0]);
+    UA_ReadValueId_init(&rvi[1]);
+    rvi[0].nodeId = UA_NODEID_STRING(1, "the.answer");
+    rvi[0].attributeId = UA_ATTRIBUTEID_VALUE;
+    rvi[1].nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER);
+    rvi[1].attributeId = UA_ATTRIBUTEID_BROWSENAME;
+    rvi[1].dataEncoding = UA_QUALIFIEDNAME(0, "Default Binary");
+    UA_ReadRequest rr;
+    UA_ReadRequest_init(&rr);
+    rr.requestHeader.authenticationToken = UA_NODEID_NUMERIC(0, 4711);
+    rr.requestHeader.timestamp = 131536291000000000;
+    rr.requestHeader.requestHandle = 42;
+    rr.maxAge = 1.5;
+    rr.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+    rr.nodesToRead = rvi;
+    rr.nodesToReadSize = 2;
+    assertSpecializedEqualsGeneric(&rr, &UA_TYPES[UA_TYPES_READREQUEST]);
+
+    UA_Double d = 3.14;
+    UA_MonitoredItemNotification min[2];
+    UA_MonitoredItemNotification_init(&min[0]);
+    UA_MonitoredItemNotification_init(&min[1]);
+    min[0].clientHandle = 1;
+    min[0].value.hasValue = true;
+    UA_Variant_setScalar(&min[0].value.value, &d, &UA_TYPES[UA_TYPES_DOUBLE]);
+    min[1].clientHandle = 2;
+    min[1].value.hasStatus = true;
+    min[1].value.status = UA_STATUSCODE_BADNODEIDUNKNOWN;
+    UA_DataChangeNotification dcn;
+    UA_DataChangeNotification_init(&dcn);
+    dcn.monitoredItems = min;
+    dcn.monitoredItemsSize = 2;
+    UA_ExtensionObject eo;
+    eo.encoding = UA_EXTENSIONOBJECT_DECODED_NODELETE;
+    eo.content.decoded.type = &UA_TYPES[UA_TYPES_DATACHANGENOTIFICATION];
+    eo.content.decoded.data = &dcn;
+    UA_UInt32 available[3] = {7, 8, 9};
+    UA_PublishResponse pr;
+    UA_PublishResponse_init(&pr);
+    pr.responseHeader.requestHandle = 42;
+    pr.responseHeader.serviceResult = UA_STATUSCODE_GOOD;
+    pr.subscriptionId = 5;
+    pr.availableSequenceNumbers = available;
+    pr.availableSequenceNumbersSize = 3;
+    pr.moreNotifications = true;
+    pr.notificationMessage.sequenceNumber = 9;
+    pr.notificationMessage.publishTime = 131536291000000000;
+    pr.notificationMessage.notificationData = &eo;
+    pr.notificationMessage.notificationDataSize = 1;
+    assertSpecializedEqualsGeneric(&pr, &UA_TYPES[UA_TYPES_PUBLISHRESPONSE]);
+}
+END_TEST
+
 START_TEST(calcSizeBinaryShallBeCorrect) {
     /* Empty variants (with no type defined) cannot be encoded. This is
      * intentional. Discovery configuration is just a base class and void * */
@@ -326,6 +571,9 @@ int main(void) {
     tcase_add_loop_test(tc, newAndEmptyObjectShallBeDeleted, UA_TYPES_BOOLEAN, UA_TYPES_COUNT - 1);
     tcase_add_test(tc, arrayCopyShallMakeADeepCopy);
     tcase_add_loop_test(tc, encodeShallYieldDecode, UA_TYPES_BOOLEAN, UA_TYPES_COUNT - 1);
+    tcase_add_test(tc, decodeWithArenaShallYieldDecode);
+    tcase_add_test(tc, decodeBorrowedShallPointIntoBuffer);
+    tcase_add_test(tc, encodeSpecializedShallEqualGeneric);
     suite_add_tcase(s, tc);
     tc = tcase_create("Truncated Buffers");
     tcase_add_loop_test(tc, decodeShallFailWithTruncatedBufferButSurvive,
@@ -335,6 +583,8 @@ int main(void) {
     tc = tcase_create("Fuzzing with Random Buffers");
     tcase_add_loop_test(tc, decodeScalarBasicTypeFromRandomBufferShallSucceed,
                         UA_TYPES_BOOLEAN, UA_TYPES_DOUBLE);
+    tcase_add_loop_test(tc, decodeComplexTypeFromRandomBufferWithArenaShallSurvive,
+                        UA_TYPES_NODEID, UA_TYPES_COUNT - 1);
     tcase_add_loop_test(tc, decodeComplexTypeFromRandomBufferShallSurvive,
                         UA_TYPES_NODEID, UA_TYPES_COUNT - 1);
     suite_add_tcase(s, tc);
@@ -36,6 +36,7 @@ addVariable(size_t size) {
     attr.description = UA_LOCALIZEDTEXT("en-US", name);
     attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
     attr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
 
     /* Add the variable node to the information model */
     UA_NodeId myIntegerNodeId = UA_NODEID_STRING(1, name);
@@ -56,16 +57,32 @@ THREAD_CALLBACK(serverloop) {
     return 0;
 }
 
-static void setup(void) {
-    running = UA_Boolean_new();
-    *running = true;
-    config = UA_ServerConfig_new_default();
+static void startServer(void) {
     server = UA_Server_new(config);
     UA_Server_run_startup(server);
     addVariable(16366);
     THREAD_CREATE(server_thread, serverloop);
 }
 
+static void setup(void) {
+    running = UA_Boolean_new();
+    *running = true;
+    config = UA_ServerConfig_new_default();
+    startServer();
+}
+
+#if defined(__linux__)
+static void setup_epoll(void) {
+    running = UA_Boolean_new();
+    *running = true;
+    config = UA_ServerConfig_new_default();
+    config->networkLayers[0].deleteMembers(&config->networkLayers[0]);
+    config->networkLayers[0] =
+        UA_ServerNetworkLayerTCP_epoll(UA_ConnectionConfig_default, 4840, config->logger);
+    startServer();
+}
+#endif
+
 static void teardown(void) {
     *running = false;
     THREAD_JOIN(server_thread);
@@ -163,6 +180,37 @@ START_TEST(Client_read) {
 }
 END_TEST
 
+/* The request and the response are split into many chunks */
+START_TEST(Client_writeReadChunked) {
+    UA_Client *client = UA_Client_new(UA_ClientConfig_default);
+    UA_StatusCode retval = UA_Client_connect(client, "opc.tcp://localhost:4840");
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    size_t size = 100000;
+    UA_Int32 *array = (UA_Int32*)UA_Array_new(size, &UA_TYPES[UA_TYPES_INT32]);
+    for(size_t i = 0; i < size; i++)
+        array[i] = (UA_Int32)i;
+    UA_Variant val;
+    UA_Variant_setArray(&val, array, size, &UA_TYPES[UA_TYPES_INT32]);
+
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "my.variable");
+    retval = UA_Client_writeValueAttribute(client, nodeId, &val);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_Variant readVal;
+    retval = UA_Client_readValueAttribute(client, nodeId, &readVal);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(readVal.arrayLength, size);
+    ck_assert_int_eq(memcmp(readVal.data, array, size * sizeof(UA_Int32)), 0);
+
+    UA_Variant_deleteMembers(&readVal);
+    UA_Variant_deleteMembers(&val);
+
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+}
+END_TEST
+
 START_TEST(Client_renewSecureChannel) {
     UA_Client *client = UA_Client_new(UA_ClientConfig_default);
     UA_StatusCode retval = UA_Client_connect(client, "opc.tcp://localhost:4840");
@@ -318,7 +366,18 @@ static Suite* testSuite_Client(void) {
     tcase_add_test(tc_client, Client_endpoints);
     tcase_add_test(tc_client, Client_endpoints_empty);
     tcase_add_test(tc_client, Client_read);
+    tcase_add_test(tc_client, Client_writeReadChunked);
     suite_add_tcase(s,tc_client);
+#if defined(__linux__)
+    TCase *tc_client_epoll = tcase_create("Client Basic epoll");
+    tcase_add_checked_fixture(tc_client_epoll, setup_epoll, teardown);
+    tcase_add_test(tc_client_epoll, Client_connect);
+    tcase_add_test(tc_client_epoll, Client_endpoints);
+    tcase_add_test(tc_client_epoll, Client_read);
+    tcase_add_test(tc_client_epoll, Client_writeReadChunked);
+    tcase_add_test(tc_client_epoll, Client_reconnect);
+    suite_add_tcase(s,tc_client_epoll);
+#endif
     TCase *tc_client_reconnect = tcase_create("Client Reconnect");
     tcase_add_checked_fixture(tc_client_reconnect, setup, teardown);
     tcase_add_test(tc_client_reconnect, Client_renewSecureChannel);
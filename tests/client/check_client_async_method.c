@@ -0,0 +1,229 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ua_server.h"
+#include "ua_client.h"
+#include "ua_client_highlevel.h"
+#include "ua_config_default.h"
+#include "check.h"
+#include "testing_clock.h"
+#include "thread_wrapper.h"
+
+UA_Server *server;
+UA_ServerConfig *config;
+UA_Boolean running;
+THREAD_HANDLE server_thread;
+
+UA_Client *client;
+
+/* The application answers the queued operations from the server loop */
+volatile UA_Boolean answerOperations;
+volatile size_t answeredOperations;
+
+#define ASYNC_METHOD 62541
+#define SYNC_METHOD 62542
+
+static UA_StatusCode
+doubleMethod(UA_Server *server_, const UA_NodeId *sessionId, void *sessionContext,
+             const UA_NodeId *methodId, void *methodContext,
+             const UA_NodeId *objectId, void *objectContext,
+             size_t inputSize, const UA_Variant *input,
+             size_t outputSize, UA_Variant *output) {
+    UA_Int32 out = *(UA_Int32*)input->data * 2;
+    return UA_Variant_setScalarCopy(output, &out, &UA_TYPES[UA_TYPES_INT32]);
+}
+
+static void
+answerAsyncOperations(void) {
+    UA_AsyncOperationType type;
+    const UA_AsyncOperationRequest *request;
+    void *context;
+    while(UA_Server_getAsyncOperation(server, &type, &request, &context)) {
+        ck_assert_int_eq(type, UA_ASYNCOPERATIONTYPE_CALL);
+        UA_AsyncOperationResponse response;
+        response.callMethodResult = UA_Server_call(server, &request->callMethodRequest);
+        UA_Server_setAsyncOperationResult(server, &response, context);
+        UA_CallMethodResult_deleteMembers(&response.callMethodResult);
+        answeredOperations++;
+    }
+}
+
+THREAD_CALLBACK(serverloop) {
+    while(running) {
+        UA_Server_run_iterate(server, true);
+        if(answerOperations)
+            answerAsyncOperations();
+        else
+            UA_fakeSleep(50); /* Advance towards the timeout */
+    }
+    return 0;
+}
+
+static void
+addMethod(UA_UInt32 id, UA_Boolean async) {
+    UA_Argument inputArgument;
+    UA_Argument_init(&inputArgument);
+    inputArgument.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
+    inputArgument.valueRank = -1;
+    UA_Argument outputArgument;
+    UA_Argument_init(&outputArgument);
+    outputArgument.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
+    outputArgument.valueRank = -1;
+
+    UA_MethodAttributes attr = UA_MethodAttributes_default;
+    attr.executable = true;
+    attr.userExecutable = true;
+    UA_StatusCode retval =
+        UA_Server_addMethodNode(server, UA_NODEID_NUMERIC(1, id),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                UA_QUALIFIEDNAME(1, async ? "async" : "sync"), attr,
+                                doubleMethod, 1, &inputArgument, 1, &outputArgument,
+                                NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    retval = UA_Server_setMethodNode_async(server, UA_NODEID_NUMERIC(1, id), async);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+}
+
+static void setup(void) {
+    running = true;
+    answerOperations = true;
+    answeredOperations = 0;
+    config = UA_ServerConfig_new_default();
+    config->maxAsyncOperationsPerSession = 2;
+    config->asyncOperationTimeout = 1000.0;
+    server = UA_Server_new(config);
+    addMethod(ASYNC_METHOD, true);
+    addMethod(SYNC_METHOD, false);
+    UA_Server_run_startup(server);
+    THREAD_CREATE(server_thread, serverloop);
+
+    client = UA_Client_new(UA_ClientConfig_default);
+    UA_StatusCode retval = UA_Client_connect(client, "opc.tcp://localhost:4840");
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+}
+
+static void teardown(void) {
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+    running = false;
+    THREAD_JOIN(server_thread);
+    UA_Server_run_shutdown(server);
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+
+static void
+setCallMethodRequest(UA_CallMethodRequest *item, UA_UInt32 methodId, UA_Int32 *input) {
+    UA_CallMethodRequest_init(item);
+    item->objectId = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+    item->methodId = UA_NODEID_NUMERIC(1, methodId);
+    item->inputArgumentsSize = 1;
+    item->inputArguments = UA_Variant_new();
+    UA_Variant_setScalar(item->inputArguments, input, &UA_TYPES[UA_TYPES_INT32]);
+}
+
+static void
+checkResult(const UA_CallMethodResult *result, UA_Int32 expected) {
+    ck_assert_uint_eq(result->statusCode, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(result->outputArgumentsSize, 1);
+    ck_assert(result->outputArguments[0].type == &UA_TYPES[UA_TYPES_INT32]);
+    ck_assert_int_eq(*(UA_Int32*)result->outputArguments[0].data, expected);
+}
+
+START_TEST(AsyncMethod_call) {
+    UA_Int32 input = 21;
+    UA_Variant inputVariant;
+    UA_Variant_setScalar(&inputVariant, &input, &UA_TYPES[UA_TYPES_INT32]);
+    size_t outputSize = 0;
+    UA_Variant *output = NULL;
+    UA_StatusCode retval =
+        UA_Client_call(client, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                       UA_NODEID_NUMERIC(1, ASYNC_METHOD), 1, &inputVariant,
+                       &outputSize, &output);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(outputSize, 1);
+    ck_assert_int_eq(*(UA_Int32*)output[0].data, 42);
+    UA_Array_delete(output, outputSize, &UA_TYPES[UA_TYPES_VARIANT]);
+
+    /* The call was executed by the application */
+    ck_assert_uint_eq(answeredOperations, 1);
+} END_TEST
+
+/* Synchronous and asynchronous operations in one request. The third
+ * asynchronous operation exceeds the limit per session. */
+START_TEST(AsyncMethod_mixed) {
+    UA_Int32 inputs[4] = {1, 2, 3, 4};
+    UA_UInt32 methods[4] = {ASYNC_METHOD, SYNC_METHOD, ASYNC_METHOD, ASYNC_METHOD};
+    UA_CallMethodRequest items[4];
+    for(size_t i = 0; i < 4; i++)
+        setCallMethodRequest(&items[i], methods[i], &inputs[i]);
+
+    UA_CallRequest request;
+    UA_CallRequest_init(&request);
+    request.methodsToCallSize = 4;
+    request.methodsToCall = items;
+
+    UA_CallResponse response = UA_Client_Service_call(client, request);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 4);
+    checkResult(&response.results[0], 2);
+    checkResult(&response.results[1], 4);
+    checkResult(&response.results[2], 6);
+    ck_assert_uint_eq(response.results[3].statusCode, UA_STATUSCODE_BADTOOMANYOPERATIONS);
+    ck_assert_uint_eq(answeredOperations, 2);
+    UA_CallResponse_deleteMembers(&response);
+
+    for(size_t i = 0; i < 4; i++)
+        UA_free(items[i].inputArguments);
+} END_TEST
+
+START_TEST(AsyncMethod_timeout) {
+    answerOperations = false;
+
+    UA_Int32 input = 21;
+    UA_CallMethodRequest item;
+    setCallMethodRequest(&item, ASYNC_METHOD, &input);
+    UA_CallRequest request;
+    UA_CallRequest_init(&request);
+    request.methodsToCallSize = 1;
+    request.methodsToCall = &item;
+
+    UA_CallResponse response = UA_Client_Service_call(client, request);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 1);
+    ck_assert_uint_eq(response.results[0].statusCode, UA_STATUSCODE_BADTIMEOUT);
+    UA_CallResponse_deleteMembers(&response);
+
+    /* The timed out operation no longer counts against the limit */
+    answerOperations = true;
+    response = UA_Client_Service_call(client, request);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 1);
+    checkResult(&response.results[0], 42);
+    UA_CallResponse_deleteMembers(&response);
+
+    UA_free(item.inputArguments);
+} END_TEST
+
+static Suite* testSuite_AsyncMethod(void) {
+    Suite *s = suite_create("Async Method");
+    TCase *tc = tcase_create("Async Method Calls");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, AsyncMethod_call);
+    tcase_add_test(tc, AsyncMethod_mixed);
+    tcase_add_test(tc, AsyncMethod_timeout);
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+int main(void) {
+    Suite *s = testSuite_AsyncMethod();
+    SRunner *sr = srunner_create(s);
+    srunner_set_fork_status(sr, CK_NOFORK);
+    srunner_run_all(sr,CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
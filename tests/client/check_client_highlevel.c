@@ -315,6 +315,103 @@ START_TEST(Node_Browse) {
 }
 END_TEST
 
+/* The references of a large folder span several chunks */
+#define BROWSE_LARGE_CHILDREN 2000
+
+START_TEST(Node_BrowseLarge) {
+    UA_AddNodesItem items[BROWSE_LARGE_CHILDREN + 1];
+    UA_ObjectAttributes attr[BROWSE_LARGE_CHILDREN + 1];
+    char names[BROWSE_LARGE_CHILDREN + 1][16];
+    for(size_t i = 0; i <= BROWSE_LARGE_CHILDREN; i++) {
+        attr[i] = UA_ObjectAttributes_default;
+        snprintf(names[i], 16, "child%u", (unsigned)i);
+        attr[i].displayName = UA_LOCALIZEDTEXT("en-US", names[i]);
+        UA_AddNodesItem_init(&items[i]);
+        items[i].requestedNewNodeId.nodeId = UA_NODEID_NUMERIC(1, (UA_UInt32)(70000 + i));
+        items[i].parentNodeId.nodeId = UA_NODEID_NUMERIC(1, 70000);
+        items[i].referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT);
+        items[i].browseName = UA_QUALIFIEDNAME(1, names[i]);
+        items[i].nodeClass = UA_NODECLASS_OBJECT;
+        items[i].typeDefinition.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE);
+        items[i].nodeAttributes.encoding = UA_EXTENSIONOBJECT_DECODED_NODELETE;
+        items[i].nodeAttributes.content.decoded.type = &UA_TYPES[UA_TYPES_OBJECTATTRIBUTES];
+        items[i].nodeAttributes.content.decoded.data = &attr[i];
+    }
+
+    /* The first item is the folder */
+    items[0].parentNodeId.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+    items[0].referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES);
+    items[0].typeDefinition.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE);
+
+    UA_AddNodesRequest addReq;
+    UA_AddNodesRequest_init(&addReq);
+    addReq.nodesToAdd = items;
+    addReq.nodesToAddSize = BROWSE_LARGE_CHILDREN + 1;
+    UA_AddNodesResponse addResp = UA_Client_Service_addNodes(client, addReq);
+    ck_assert_uint_eq(addResp.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(addResp.resultsSize, BROWSE_LARGE_CHILDREN + 1);
+    for(size_t i = 0; i <= BROWSE_LARGE_CHILDREN; i++)
+        ck_assert_uint_eq(addResp.results[i].statusCode, UA_STATUSCODE_GOOD);
+    UA_AddNodesResponse_deleteMembers(&addResp);
+
+    /* Browse in portions of 700 references */
+    UA_BrowseDescription bd;
+    UA_BrowseDescription_init(&bd);
+    bd.nodeId = UA_NODEID_NUMERIC(1, 70000);
+    bd.referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT);
+    bd.browseDirection = UA_BROWSEDIRECTION_FORWARD;
+    bd.resultMask = UA_BROWSERESULTMASK_ALL;
+    UA_BrowseRequest bReq;
+    UA_BrowseRequest_init(&bReq);
+    bReq.requestedMaxReferencesPerNode = 700;
+    bReq.nodesToBrowse = &bd;
+    bReq.nodesToBrowseSize = 1;
+    UA_BrowseResponse bResp = UA_Client_Service_browse(client, bReq);
+    ck_assert_uint_eq(bResp.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(bResp.resultsSize, 1);
+
+    UA_Boolean seen[BROWSE_LARGE_CHILDREN + 1];
+    memset(seen, 0, sizeof(seen));
+    size_t total = 0;
+    UA_BrowseResult *br = &bResp.results[0];
+    UA_BrowseNextResponse bNextResp;
+    UA_BrowseNextResponse_init(&bNextResp);
+    while(true) {
+        ck_assert_uint_eq(br->statusCode, UA_STATUSCODE_GOOD);
+        ck_assert(br->referencesSize <= 700);
+        for(size_t i = 0; i < br->referencesSize; i++) {
+            UA_ReferenceDescription *rd = &br->references[i];
+            UA_UInt32 index = rd->nodeId.nodeId.identifier.numeric - 70000;
+            ck_assert(index >= 1 && index <= BROWSE_LARGE_CHILDREN);
+            ck_assert(!seen[index]);
+            seen[index] = true;
+            ck_assert(UA_String_equal(&rd->displayName.text,
+                                      &attr[index].displayName.text));
+            ck_assert_uint_eq(rd->nodeClass, UA_NODECLASS_OBJECT);
+            ck_assert_uint_eq(rd->typeDefinition.nodeId.identifier.numeric,
+                              UA_NS0ID_BASEOBJECTTYPE);
+        }
+        total += br->referencesSize;
+        if(br->continuationPoint.length == 0)
+            break;
+
+        UA_BrowseNextRequest bNextReq;
+        UA_BrowseNextRequest_init(&bNextReq);
+        bNextReq.continuationPoints = &br->continuationPoint;
+        bNextReq.continuationPointsSize = 1;
+        UA_BrowseNextResponse next = UA_Client_Service_browseNext(client, bNextReq);
+        UA_BrowseNextResponse_deleteMembers(&bNextResp);
+        bNextResp = next;
+        ck_assert_uint_eq(bNextResp.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+        ck_assert_uint_eq(bNextResp.resultsSize, 1);
+        br = &bNextResp.results[0];
+    }
+    ck_assert_uint_eq(total, BROWSE_LARGE_CHILDREN);
+    UA_BrowseNextResponse_deleteMembers(&bNextResp);
+    UA_BrowseResponse_deleteMembers(&bResp);
+}
+END_TEST
+
 START_TEST(Node_Register) {
     UA_RegisterNodesRequest req;
     UA_RegisterNodesRequest_init(&req);
@@ -1030,6 +1127,7 @@ static Suite *testSuite_Client(void) {
     tcase_add_test(tc_nodes, Node_Add);
 #endif
     tcase_add_test(tc_nodes, Node_Browse);
+    tcase_add_test(tc_nodes, Node_BrowseLarge);
     tcase_add_test(tc_nodes, Node_Register);
     suite_add_tcase(s, tc_nodes);
 
@@ -24,8 +24,12 @@
  * released */
 typedef struct UA_NodeMapEntry {
     struct UA_NodeMapEntry *orig; /* the version this is a copy from (or NULL) */
-    UA_UInt16 refCount; /* How many consumers have a reference to the node? */
+    UA_UInt32 refCount; /* How many consumers have a reference to the node? */
     UA_Boolean deleted; /* Node was marked as deleted and can be deleted when refCount == 0 */
+#ifdef UA_ENABLE_MULTITHREADING
+    struct UA_NodeMapEntry *retiredNext;
+    UA_UInt32 retiredEpoch;
+#endif
     UA_Node node;
 } UA_NodeMapEntry;
 
@@ -91,6 +95,27 @@ START_TEST(replaceOldNode) {
 }
 END_TEST
 
+START_TEST(replacedNodeRemainsValidUntilRelease) {
+    UA_Node* n1 = createNode(0,2253);
+    ns.insertNode(ns.context, n1, NULL);
+    UA_NodeId in1 = UA_NODEID_NUMERIC(0,2253);
+    const UA_Node *held = ns.getNode(ns.context, &in1);
+    ck_assert_ptr_eq(held, n1);
+
+    UA_Node* n2;
+    ns.getNodeCopy(ns.context, &in1, &n2);
+    UA_StatusCode retval = ns.replaceNode(ns.context, n2);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* The old version is still accessible by the holder */
+    ck_assert_uint_eq(held->nodeId.identifier.numeric, 2253);
+    const UA_Node *current = ns.getNode(ns.context, &in1);
+    ck_assert_ptr_eq(current, n2);
+    ns.releaseNode(ns.context, current);
+    ns.releaseNode(ns.context, held);
+}
+END_TEST
+
 START_TEST(findNodeInUA_NodeStoreWithSingleEntry) {
     UA_Node* n1 = createNode(0,2253);
     ns.insertNode(ns.context, n1, NULL);
@@ -229,6 +254,72 @@ static void *profileGetThread(void *arg) {
 
 #define N 1000 /* make bigger to test */
 
+#ifdef UA_ENABLE_MULTITHREADING
+#define THREADS 4
+
+static volatile UA_Boolean readersRunning;
+
+static void *concurrentGetThread(void *arg) {
+    UA_NodeId id = UA_NODEID_NUMERIC(0, 0);
+    size_t *misses = (size_t*)arg;
+    while(readersRunning) {
+        for(UA_UInt32 i = 0; i < N; i++) {
+            id.identifier.numeric = i+1;
+            const UA_Node *n = ns.getNode(ns.context, &id);
+            if(!n || n->nodeId.identifier.numeric != i+1)
+                (*misses)++;
+            ns.releaseNode(ns.context, n);
+        }
+    }
+    return NULL;
+}
+
+/* Readers must always find a valid version while the nodes are replaced and
+ * the table is resized by a concurrent writer */
+START_TEST(concurrentGetReplace) {
+    for(UA_UInt32 i = 0; i < N; i++) {
+        UA_Node *n = createNode(0,i+1);
+        ns.insertNode(ns.context, n, NULL);
+    }
+
+    readersRunning = true;
+    pthread_t t[THREADS];
+    size_t misses[THREADS];
+    for(int i = 0; i < THREADS; i++) {
+        misses[i] = 0;
+        pthread_create(&t[i], NULL, concurrentGetThread, &misses[i]);
+    }
+
+    UA_NodeId id = UA_NODEID_NUMERIC(0, 0);
+    for(UA_UInt32 round = 0; round < 20; round++) {
+        for(UA_UInt32 i = 0; i < N; i++) {
+            id.identifier.numeric = i+1;
+            UA_Node *copy;
+            UA_StatusCode retval = ns.getNodeCopy(ns.context, &id, &copy);
+            ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+            retval = ns.replaceNode(ns.context, copy);
+            ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        }
+        /* Grow and shrink the table with additional nodes */
+        for(UA_UInt32 i = 0; i < N; i++) {
+            UA_Node *n = createNode(1,i+1);
+            ns.insertNode(ns.context, n, NULL);
+        }
+        for(UA_UInt32 i = 0; i < N; i++) {
+            UA_NodeId extra = UA_NODEID_NUMERIC(1, i+1);
+            ns.removeNode(ns.context, &extra);
+        }
+    }
+
+    readersRunning = false;
+    for(int i = 0; i < THREADS; i++) {
+        pthread_join(t[i], NULL);
+        ck_assert_uint_eq(misses[i], 0);
+    }
+}
+END_TEST
+#endif
+
 START_TEST(profileGetDelete) {
     clock_t begin, end;
     begin = clock();
@@ -239,7 +330,6 @@ START_TEST(profileGetDelete) {
     }
 
 #ifdef UA_ENABLE_MULTITHREADING
-#define THREADS 4
     pthread_t t[THREADS];
     struct UA_NodeStoreProfileTest p[THREADS];
     for (int i = 0; i < THREADS; i++) {
@@ -280,6 +370,7 @@ static Suite * namespace_suite (void) {
     tcase_add_checked_fixture(tc_replace, setup, teardown);
     tcase_add_test (tc_replace, replaceExistingNode);
     tcase_add_test (tc_replace, replaceOldNode);
+    tcase_add_test (tc_replace, replacedNodeRemainsValidUntilRelease);
     suite_add_tcase (s, tc_replace);
 
     TCase* tc_iterate = tcase_create ("Iterate");
@@ -293,6 +384,13 @@ static Suite * namespace_suite (void) {
     tcase_add_test (tc_profile, profileGetDelete);
     suite_add_tcase (s, tc_profile);
 
+#ifdef UA_ENABLE_MULTITHREADING
+    TCase* tc_concurrent = tcase_create ("Concurrent");
+    tcase_add_checked_fixture(tc_concurrent, setup, teardown);
+    tcase_add_test (tc_concurrent, concurrentGetReplace);
+    suite_add_tcase (s, tc_concurrent);
+#endif
+
     return s;
 }
 
@@ -14,6 +14,9 @@ UA_ServerConfig *config = NULL;
 
 static void setup(void) {
     config = UA_ServerConfig_new_default();
+#ifdef UA_ENABLE_MULTITHREADING
+    config->nThreads = 4;
+#endif
     server = UA_Server_new(config);
     UA_Server_run_startup(server);
 }
@@ -69,12 +72,66 @@ START_TEST(Server_repeatedCallbackRemoveItself) {
 }
 END_TEST
 
+#define DISPATCHED_CALLBACKS 10000
+
+static volatile UA_UInt32 dispatchedCount;
+static volatile UA_UInt32 countAtDelayed;
+
+static void
+countCallback(UA_Server *serverPtr, void *data) {
+    UA_atomic_addUInt32(&dispatchedCount, 1);
+}
+
+static void
+delayedCheckCallback(UA_Server *serverPtr, void *data) {
+    countAtDelayed = dispatchedCount;
+}
+
+/* The delayed callback runs only after all callbacks dispatched before have
+ * finished */
+START_TEST(Server_delayedCallbackAfterDispatched) {
+    dispatchedCount = 0;
+    countAtDelayed = 0;
+    for(size_t i = 0; i < DISPATCHED_CALLBACKS; i++)
+        UA_Server_workerCallback(server, countCallback, NULL);
+    UA_Server_delayedCallback(server, delayedCheckCallback, NULL);
+
+    /* Without workers, the delayed callbacks are processed in the main loop */
+    UA_Server_run_iterate(server, false);
+    for(size_t i = 0; i < 100 && countAtDelayed == 0; i++)
+        UA_realSleep(10);
+    ck_assert_uint_eq(countAtDelayed, DISPATCHED_CALLBACKS);
+}
+END_TEST
+
+#define PARALLEL_INDICES 10000
+
+UA_UInt32 parallelVisits[PARALLEL_INDICES];
+
+static void
+visitRange(UA_Server *serverPtr, void *context, size_t start, size_t end) {
+    for(size_t i = start; i < end; i++)
+        UA_atomic_addUInt32(&parallelVisits[i], 1);
+}
+
+/* Every index is processed exactly once, also when the ranges are spread over
+ * the workers */
+START_TEST(Server_parallelFor) {
+    memset(parallelVisits, 0, sizeof(parallelVisits));
+    UA_Server_parallelFor(server, PARALLEL_INDICES, visitRange, NULL);
+    for(size_t i = 0; i < PARALLEL_INDICES; i++)
+        ck_assert_uint_eq(parallelVisits[i], 1);
+}
+END_TEST
+
 static Suite* testSuite_Client(void) {
     Suite *s = suite_create("Server Callbacks");
     TCase *tc_server = tcase_create("Server Repeated Callbacks");
     tcase_add_checked_fixture(tc_server, setup, teardown);
     tcase_add_test(tc_server, Server_addRemoveRepeatedCallback);
     tcase_add_test(tc_server, Server_repeatedCallbackRemoveItself);
+    tcase_add_test(tc_server, Server_delayedCallbackAfterDispatched);
+    tcase_add_test(tc_server, Server_parallelFor);
     suite_add_tcase(s, tc_server);
     return s;
 }
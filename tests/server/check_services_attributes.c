@@ -12,6 +12,8 @@
 #include "ua_types.h"
 #include "ua_config_default.h"
 #include "server/ua_server_internal.h"
+#include "server/ua_subscription.h"
+#include "testing_clock.h"
 
 #ifdef __clang__
 //required for ck_assert_ptr_eq and const casting
@@ -576,6 +578,335 @@ START_TEST (ReadSingleDataSourceAttributeArrayDimensionsWithoutTimestamp) {
     UA_DataValue_deleteMembers(&resp);
 } END_TEST
 
+static size_t bulkReadCount;
+static size_t bulkReadValuesSize;
+
+static UA_StatusCode
+readBulkTemperature(UA_Server *server_, UA_BulkDataSource *source,
+                    const UA_NodeId *sessionId, void *sessionContext,
+                    UA_Boolean includeSourceTimeStamp,
+                    size_t valuesSize, UA_BulkReadValue *values) {
+    bulkReadCount++;
+    bulkReadValuesSize = valuesSize;
+    for(size_t i = 0; i < valuesSize; i++) {
+        UA_Float temp = 20.0f + (UA_Float)(uintptr_t)values[i].nodeContext;
+        UA_Variant_setScalarCopy(&values[i].value.value, &temp, &UA_TYPES[UA_TYPES_FLOAT]);
+        values[i].value.hasValue = true;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+START_TEST(ReadBulkDataSourceAttributeValue) {
+    UA_BulkDataSource source;
+    memset(&source, 0, sizeof(UA_BulkDataSource));
+    source.read = readBulkTemperature;
+
+    /* Three sensors with the index in the node context */
+    UA_ReadOperation ops[5];
+    memset(ops, 0, sizeof(ops));
+    for(size_t i = 0; i < 3; i++) {
+        UA_VariableAttributes vattr = UA_VariableAttributes_default;
+        UA_StatusCode retval =
+            UA_Server_addVariableNode(server, UA_NODEID_NUMERIC(1, (UA_UInt32)(1000 + i)),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                      UA_QUALIFIEDNAME(1, "sensor"),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                      vattr, (void*)(uintptr_t)i, NULL);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        retval = UA_Server_setVariableNode_bulkDataSource(server,
+                                                          UA_NODEID_NUMERIC(1, (UA_UInt32)(1000 + i)),
+                                                          &source);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        ops[i].id.nodeId = UA_NODEID_NUMERIC(1, (UA_UInt32)(1000 + i));
+        ops[i].id.attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+
+    /* A node without bulk data source and an attribute other than the value */
+    ops[3].id.nodeId = UA_NODEID_STRING(1, "the.answer");
+    ops[3].id.attributeId = UA_ATTRIBUTEID_VALUE;
+    ops[4].id.nodeId = UA_NODEID_NUMERIC(1, 1000);
+    ops[4].id.attributeId = UA_ATTRIBUTEID_BROWSENAME;
+
+    /* The values of the sensors are read in one batch */
+    bulkReadCount = 0;
+    Read_prepare(server, &adminSession, false, ops, 5);
+    ck_assert_uint_eq(bulkReadCount, 1);
+    ck_assert_uint_eq(bulkReadValuesSize, 3);
+
+    for(size_t i = 0; i < 5; i++) {
+        UA_DataValue dv = Read_performCopy(server, &adminSession,
+                                           UA_TIMESTAMPSTORETURN_NEITHER, &ops[i]);
+        ck_assert_uint_eq(dv.hasStatus, false);
+        ck_assert_uint_eq(dv.hasValue, true);
+        if(i < 3) {
+            ck_assert_ptr_eq(dv.value.type, &UA_TYPES[UA_TYPES_FLOAT]);
+            ck_assert(*(UA_Float*)dv.value.data == 20.0f + (UA_Float)i);
+        }
+        UA_DataValue_deleteMembers(&dv);
+    }
+    ck_assert_uint_eq(bulkReadCount, 1);
+
+    /* Single reads go to the bulk data source as well */
+    UA_Variant value;
+    UA_StatusCode retval = UA_Server_readValue(server, UA_NODEID_NUMERIC(1, 1002), &value);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(bulkReadCount, 2);
+    ck_assert_uint_eq(bulkReadValuesSize, 1);
+    ck_assert(*(UA_Float*)value.data == 22.0f);
+    UA_Variant_deleteMembers(&value);
+} END_TEST
+
+/* Fills in the values and fails afterwards */
+static UA_StatusCode
+readBulkFailing(UA_Server *server_, UA_BulkDataSource *source,
+                const UA_NodeId *sessionId, void *sessionContext,
+                UA_Boolean includeSourceTimeStamp,
+                size_t valuesSize, UA_BulkReadValue *values) {
+    readBulkTemperature(server_, source, sessionId, sessionContext,
+                        includeSourceTimeStamp, valuesSize, values);
+    return UA_STATUSCODE_BADINTERNALERROR;
+}
+
+START_TEST(ReadBulkDataSourceFailure) {
+    UA_BulkDataSource source;
+    memset(&source, 0, sizeof(UA_BulkDataSource));
+    source.read = readBulkFailing;
+
+    UA_ReadOperation ops[2];
+    memset(ops, 0, sizeof(ops));
+    for(size_t i = 0; i < 2; i++) {
+        UA_VariableAttributes vattr = UA_VariableAttributes_default;
+        UA_StatusCode retval =
+            UA_Server_addVariableNode(server, UA_NODEID_NUMERIC(1, (UA_UInt32)(1100 + i)),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                      UA_QUALIFIEDNAME(1, "failing sensor"),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                      vattr, NULL, NULL);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        retval = UA_Server_setVariableNode_bulkDataSource(server,
+                                                          UA_NODEID_NUMERIC(1, (UA_UInt32)(1100 + i)),
+                                                          &source);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        ops[i].id.nodeId = UA_NODEID_NUMERIC(1, (UA_UInt32)(1100 + i));
+        ops[i].id.attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+
+    /* The values filled in before the failure are released (checked with the
+     * leak sanitizer) and the error is returned for every operation */
+    Read_prepare(server, &adminSession, false, ops, 2);
+    for(size_t i = 0; i < 2; i++) {
+        UA_DataValue dv = Read_performCopy(server, &adminSession,
+                                           UA_TIMESTAMPSTORETURN_NEITHER, &ops[i]);
+        ck_assert_uint_eq(dv.hasValue, false);
+        ck_assert_uint_eq(dv.hasStatus, true);
+        ck_assert_uint_eq(dv.status, UA_STATUSCODE_BADINTERNALERROR);
+        UA_DataValue_deleteMembers(&dv);
+    }
+} END_TEST
+
+static size_t dataSourceReadCount;
+static UA_NodeId dataSourceReadSession;
+
+static UA_StatusCode
+readCountedTemperature(UA_Server *server_,
+                       const UA_NodeId *sessionId, void *sessionContext,
+                       const UA_NodeId *nodeId, void *nodeContext,
+                       UA_Boolean sourceTimeStamp, const UA_NumericRange *range,
+                       UA_DataValue *dataValue) {
+    dataSourceReadCount++;
+    dataSourceReadSession = *sessionId;
+    if(sourceTimeStamp) {
+        dataValue->sourceTimestamp = UA_DateTime_now();
+        dataValue->hasSourceTimestamp = true;
+    }
+    return readCPUTemperature(server_, sessionId, sessionContext, nodeId,
+                              nodeContext, sourceTimeStamp, range, dataValue);
+}
+
+static UA_DataValue
+readSessionWithMaxAge(UA_Session *session, UA_Double maxAge,
+                      UA_TimestampsToReturn timestamps) {
+    UA_ReadOperation op;
+    memset(&op, 0, sizeof(UA_ReadOperation));
+    op.id.nodeId = UA_NODEID_STRING(1, "cpu.temperature");
+    op.id.attributeId = UA_ATTRIBUTEID_VALUE;
+    op.maxAge = maxAge;
+    op.node = UA_Nodestore_get(server, &op.id.nodeId);
+    return Read_performCopy(server, session, timestamps, &op);
+}
+
+static UA_DataValue
+readWithMaxAge(UA_Double maxAge) {
+    return readSessionWithMaxAge(&adminSession, maxAge, UA_TIMESTAMPSTORETURN_SOURCE);
+}
+
+START_TEST(ReadDataSourceAttributeValueMaxAge) {
+    UA_DataSource dataSource;
+    dataSource.read = readCountedTemperature;
+    dataSource.write = NULL;
+    dataSource.sessionDependent = false;
+    UA_StatusCode retval =
+        UA_Server_setVariableNode_dataSource(server, UA_NODEID_STRING(1, "cpu.temperature"),
+                                             dataSource);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    dataSourceReadCount = 0;
+
+    /* Reads with maxAge zero always go to the data source */
+    UA_DataValue dv = readWithMaxAge(0.0);
+    UA_DataValue_deleteMembers(&dv);
+    dv = readWithMaxAge(0.0);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 2);
+
+    /* The first read with a maxAge fills the cache */
+    dv = readWithMaxAge(500.0);
+    ck_assert_uint_eq(dataSourceReadCount, 3);
+    ck_assert(dv.hasSourceTimestamp);
+    UA_DateTime sourceTimestamp = dv.sourceTimestamp;
+    UA_DataValue_deleteMembers(&dv);
+
+    /* Served from the cache within the maxAge */
+    UA_fakeSleep(200);
+    dv = readWithMaxAge(500.0);
+    ck_assert_uint_eq(dataSourceReadCount, 3);
+    ck_assert_uint_eq(dv.hasValue, true);
+    ck_assert(*(UA_Float*)dv.value.data == 20.5f);
+    ck_assert(dv.sourceTimestamp == sourceTimestamp);
+    UA_DataValue_deleteMembers(&dv);
+
+    /* A smaller maxAge reads the source again */
+    dv = readWithMaxAge(100.0);
+    ck_assert_uint_eq(dataSourceReadCount, 4);
+    UA_DataValue_deleteMembers(&dv);
+
+    /* The cached value expires */
+    UA_fakeSleep(600);
+    dv = readWithMaxAge(500.0);
+    ck_assert_uint_eq(dataSourceReadCount, 5);
+    UA_DataValue_deleteMembers(&dv);
+
+    /* A new data source drops the cached value */
+    retval = UA_Server_setVariableNode_dataSource(server, UA_NODEID_STRING(1, "cpu.temperature"),
+                                                  dataSource);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    dv = readWithMaxAge(500.0);
+    ck_assert_uint_eq(dataSourceReadCount, 6);
+    UA_DataValue_deleteMembers(&dv);
+} END_TEST
+
+START_TEST(ReadDataSourceAttributeValueMaxAgeSession) {
+    UA_DataSource dataSource;
+    dataSource.read = readCountedTemperature;
+    dataSource.write = NULL;
+    dataSource.sessionDependent = false;
+    UA_StatusCode retval =
+        UA_Server_setVariableNode_dataSource(server, UA_NODEID_STRING(1, "cpu.temperature"),
+                                             dataSource);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    dataSourceReadCount = 0;
+
+    UA_Session session1, session2;
+    UA_Session_init(&session1);
+    UA_Session_init(&session2);
+    session1.sessionId = UA_NODEID_NUMERIC(1, 1001);
+    session2.sessionId = UA_NODEID_NUMERIC(1, 1002);
+
+    /* The cached value is shared by the sessions */
+    UA_DataValue dv = readSessionWithMaxAge(&session1, 500.0, UA_TIMESTAMPSTORETURN_SOURCE);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 1);
+    dv = readSessionWithMaxAge(&session2, 500.0, UA_TIMESTAMPSTORETURN_SOURCE);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 1);
+
+    /* A session dependent data source is read by every session itself */
+    dataSource.sessionDependent = true;
+    retval = UA_Server_setVariableNode_dataSource(server, UA_NODEID_STRING(1, "cpu.temperature"),
+                                                  dataSource);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    dataSourceReadCount = 0;
+    dv = readSessionWithMaxAge(&session1, 500.0, UA_TIMESTAMPSTORETURN_SOURCE);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 1);
+    ck_assert(UA_NodeId_equal(&dataSourceReadSession, &session1.sessionId));
+    dv = readSessionWithMaxAge(&session2, 500.0, UA_TIMESTAMPSTORETURN_SOURCE);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 2);
+    ck_assert(UA_NodeId_equal(&dataSourceReadSession, &session2.sessionId));
+    dv = readSessionWithMaxAge(&session1, 500.0, UA_TIMESTAMPSTORETURN_SOURCE);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 2);
+
+    /* The values of a removed session are dropped */
+    UA_Server_removeSessionCachedValues(server, &session1.sessionId);
+    dv = readSessionWithMaxAge(&session1, 500.0, UA_TIMESTAMPSTORETURN_SOURCE);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 3);
+    dv = readSessionWithMaxAge(&session2, 500.0, UA_TIMESTAMPSTORETURN_SOURCE);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 3);
+
+    /* A value cached without a source timestamp does not serve reads that
+     * need one */
+    UA_fakeSleep(600);
+    dv = readSessionWithMaxAge(&session1, 500.0, UA_TIMESTAMPSTORETURN_NEITHER);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 4);
+    dv = readSessionWithMaxAge(&session1, 500.0, UA_TIMESTAMPSTORETURN_NEITHER);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 4);
+    dv = readSessionWithMaxAge(&session1, 500.0, UA_TIMESTAMPSTORETURN_BOTH);
+    ck_assert_uint_eq(dataSourceReadCount, 5);
+    ck_assert(dv.hasSourceTimestamp);
+    UA_DateTime sourceTimestamp = dv.sourceTimestamp;
+    UA_DataValue_deleteMembers(&dv);
+    UA_fakeSleep(100);
+    dv = readSessionWithMaxAge(&session1, 500.0, UA_TIMESTAMPSTORETURN_SOURCE);
+    ck_assert_uint_eq(dataSourceReadCount, 5);
+    ck_assert(dv.sourceTimestamp == sourceTimestamp);
+    UA_DataValue_deleteMembers(&dv);
+
+    UA_Server_removeSessionCachedValues(server, &session1.sessionId);
+    UA_Server_removeSessionCachedValues(server, &session2.sessionId);
+} END_TEST
+
+START_TEST(ReadDataSourceAttributeValueMaxAgeCleanup) {
+    UA_DataSource dataSource;
+    dataSource.read = readCountedTemperature;
+    dataSource.write = NULL;
+    dataSource.sessionDependent = false;
+    UA_StatusCode retval =
+        UA_Server_setVariableNode_dataSource(server, UA_NODEID_STRING(1, "cpu.temperature"),
+                                             dataSource);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    dataSourceReadCount = 0;
+
+    UA_DataValue dv = readWithMaxAge(100.0);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(server->valueCache.entries, 1);
+
+    /* The entry is kept for the largest maxAge it is read with */
+    dv = readWithMaxAge(1000.0);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(dataSourceReadCount, 1);
+    UA_fakeSleep(500);
+    UA_ValueCache_cleanup(&server->valueCache, UA_DateTime_nowMonotonic());
+    ck_assert_uint_eq(server->valueCache.entries, 1);
+
+    /* Expired entries are dropped */
+    UA_fakeSleep(600);
+    UA_ValueCache_cleanup(&server->valueCache, UA_DateTime_nowMonotonic());
+    ck_assert_uint_eq(server->valueCache.entries, 0);
+
+    /* Reads without a maxAge don't create entries */
+    dv = readWithMaxAge(0.0);
+    UA_DataValue_deleteMembers(&dv);
+    ck_assert_uint_eq(server->valueCache.entries, 0);
+    ck_assert_uint_eq(dataSourceReadCount, 2);
+} END_TEST
+
 /* Tests for writeValue method */
 
 START_TEST(WriteSingleAttributeNodeId) {
@@ -777,6 +1108,49 @@ START_TEST(WriteSingleAttributeDataType) {
     ck_assert_int_eq(retval, UA_STATUSCODE_BADTYPEMISMATCH);
 } END_TEST
 
+/* The DataType hierarchy is cached for the type checks. Moving a DataType
+ * below Int32 allows Int32 values to be written. */
+START_TEST(WriteSingleAttributeValueDataTypeHierarchy) {
+    UA_NodeId myInt = UA_NODEID_STRING(1, "my.int");
+    UA_DataTypeAttributes dattr = UA_DataTypeAttributes_default;
+    dattr.displayName = UA_LOCALIZEDTEXT("en-US", "MyInt");
+    UA_StatusCode retval =
+        UA_Server_addDataTypeNode(server, myInt,
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATATYPE),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE),
+                                  UA_QUALIFIEDNAME(1, "MyInt"), dattr, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_VariableAttributes vattr = UA_VariableAttributes_default;
+    vattr.dataType = myInt;
+    vattr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+    UA_NodeId varId = UA_NODEID_STRING(1, "my.int.variable");
+    retval = UA_Server_addVariableNode(server, varId, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                       UA_QUALIFIEDNAME(1, "MyIntVariable"),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                       vattr, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_Int32 value = 1;
+    UA_Variant v;
+    UA_Variant_setScalar(&v, &value, &UA_TYPES[UA_TYPES_INT32]);
+    retval = UA_Server_writeValue(server, varId, v);
+    ck_assert_int_eq(retval, UA_STATUSCODE_BADTYPEMISMATCH);
+
+    retval = UA_Server_deleteReference(server, UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATATYPE),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE), true,
+                                       UA_EXPANDEDNODEID_STRING(1, "my.int"), true);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    retval = UA_Server_addReference(server, UA_NODEID_NUMERIC(0, UA_NS0ID_INT32),
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE),
+                                    UA_EXPANDEDNODEID_STRING(1, "my.int"), true);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    retval = UA_Server_writeValue(server, varId, v);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+} END_TEST
+
 START_TEST(WriteSingleAttributeValueRank) {
     UA_WriteValue wValue;
     UA_WriteValue_init(&wValue);
@@ -851,6 +1225,144 @@ START_TEST(WriteSingleAttributeExecutable) {
     ck_assert_int_eq(retval, UA_STATUSCODE_BADNODECLASSINVALID);
 } END_TEST
 
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+/* MonitoredItems on the nodes 2000 to 2099 that are sampled on write */
+static UA_Subscription *
+monitorParallelNodes(UA_Server *pserver) {
+    UA_CreateSubscriptionRequest subRequest;
+    UA_CreateSubscriptionRequest_init(&subRequest);
+    subRequest.publishingEnabled = true;
+    UA_CreateSubscriptionResponse subResponse;
+    UA_CreateSubscriptionResponse_init(&subResponse);
+    Service_CreateSubscription(pserver, &adminSession, &subRequest, &subResponse);
+    ck_assert_uint_eq(subResponse.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    UA_UInt32 localSubscriptionId = subResponse.subscriptionId;
+    UA_CreateSubscriptionResponse_deleteMembers(&subResponse);
+
+    UA_MonitoredItemCreateRequest items[100];
+    for(size_t i = 0; i < 100; i++) {
+        UA_MonitoredItemCreateRequest_init(&items[i]);
+        items[i].itemToMonitor.nodeId = UA_NODEID_NUMERIC(1, (UA_UInt32)(2000 + i));
+        items[i].itemToMonitor.attributeId = UA_ATTRIBUTEID_VALUE;
+        items[i].monitoringMode = UA_MONITORINGMODE_REPORTING;
+        items[i].requestedParameters.samplingInterval = 1000.0;
+        items[i].requestedParameters.queueSize = 10;
+    }
+    UA_CreateMonitoredItemsRequest request;
+    UA_CreateMonitoredItemsRequest_init(&request);
+    request.subscriptionId = localSubscriptionId;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    request.itemsToCreateSize = 100;
+    request.itemsToCreate = items;
+    UA_CreateMonitoredItemsResponse response;
+    UA_CreateMonitoredItemsResponse_init(&response);
+    Service_CreateMonitoredItems(pserver, &adminSession, &request, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 100);
+    for(size_t i = 0; i < 100; i++)
+        ck_assert_uint_eq(response.results[i].statusCode, UA_STATUSCODE_GOOD);
+    UA_CreateMonitoredItemsResponse_deleteMembers(&response);
+    ck_assert_uint_eq(pserver->monitoredNodesItems, 100);
+
+    UA_Subscription *sub = UA_Session_getSubscriptionById(&adminSession, localSubscriptionId);
+    ck_assert_ptr_ne(sub, NULL);
+    return sub;
+}
+#endif
+
+/* Large requests may be processed by several workers. The results are in the
+ * order of the request. With sampling on write, the written nodes are sampled
+ * once the operations are done. */
+static void
+writeParallel(UA_Boolean sampleOnWrite) {
+    UA_ServerConfig *pconfig = UA_ServerConfig_new_default();
+    pconfig->parallelOperationsThreshold = 10;
+    pconfig->sampleMonitoredItemsOnWrite = sampleOnWrite;
+#ifdef UA_ENABLE_MULTITHREADING
+    pconfig->nThreads = 4;
+#endif
+    UA_Server *pserver = UA_Server_new(pconfig);
+    UA_Server_run_startup(pserver);
+
+    UA_Int32 values[100];
+    UA_WriteValue items[100];
+    for(size_t i = 0; i < 100; i++) {
+        UA_VariableAttributes vattr = UA_VariableAttributes_default;
+        UA_StatusCode retval =
+            UA_Server_addVariableNode(pserver, UA_NODEID_NUMERIC(1, (UA_UInt32)(2000 + i)),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                      UA_QUALIFIEDNAME(1, "parallel"),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                      vattr, NULL, NULL);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        values[i] = (UA_Int32)i;
+        UA_WriteValue_init(&items[i]);
+        items[i].nodeId = UA_NODEID_NUMERIC(1, (UA_UInt32)(2000 + i));
+        items[i].attributeId = UA_ATTRIBUTEID_VALUE;
+        items[i].value.hasValue = true;
+        UA_Variant_setScalar(&items[i].value.value, &values[i], &UA_TYPES[UA_TYPES_INT32]);
+    }
+    /* Every fifth operation fails */
+    for(size_t i = 0; i < 100; i += 5)
+        items[i].nodeId = UA_NODEID_NUMERIC(1, 99999);
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    UA_Subscription *sub = NULL;
+    if(sampleOnWrite)
+        sub = monitorParallelNodes(pserver);
+#endif
+
+    UA_WriteRequest request;
+    UA_WriteRequest_init(&request);
+    request.nodesToWriteSize = 100;
+    request.nodesToWrite = items;
+    UA_WriteResponse response;
+    UA_WriteResponse_init(&response);
+    Service_Write(pserver, &adminSession, &request, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 100);
+    for(size_t i = 0; i < 100; i++) {
+        if(i % 5 == 0) {
+            ck_assert_uint_eq(response.results[i], UA_STATUSCODE_BADNODEIDUNKNOWN);
+            continue;
+        }
+        ck_assert_uint_eq(response.results[i], UA_STATUSCODE_GOOD);
+        UA_Variant value;
+        UA_StatusCode retval = UA_Server_readValue(pserver, items[i].nodeId, &value);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        ck_assert_int_eq(*(UA_Int32*)value.data, (UA_Int32)i);
+        UA_Variant_deleteMembers(&value);
+    }
+    UA_WriteResponse_deleteMembers(&response);
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    /* The first sample of every item and one sample for each written node */
+    if(sub) {
+        ck_assert_uint_eq(sub->monitoredItemsSize, 100);
+        ck_assert_uint_eq(sub->notificationQueueSize, 180);
+        UA_MonitoredItem *mon;
+        LIST_FOREACH(mon, &sub->monitoredItems, listEntry) {
+            UA_UInt32 i = mon->monitoredNodeId.identifier.numeric - 2000;
+            ck_assert_uint_eq(mon->queueSize, (i % 5 == 0) ? 1 : 2);
+        }
+        UA_Session_deleteSubscription(pserver, &adminSession, sub->subscriptionId);
+    }
+#endif
+
+    UA_Server_run_shutdown(pserver);
+    UA_Server_delete(pserver);
+    UA_ServerConfig_delete(pconfig);
+}
+
+START_TEST(WriteParallel) {
+    writeParallel(false);
+} END_TEST
+
+START_TEST(WriteParallelSampleOnWrite) {
+    writeParallel(true);
+} END_TEST
+
 START_TEST(WriteSingleDataSourceAttributeValue) {
     UA_WriteValue wValue;
     UA_WriteValue_init(&wValue);
@@ -895,6 +1407,11 @@ static Suite * testSuite_services_attributes(void) {
     tcase_add_test(tc_readSingleAttributes, ReadSingleDataSourceAttributeValueEmptyWithoutTimestamp);
     tcase_add_test(tc_readSingleAttributes, ReadSingleDataSourceAttributeDataTypeWithoutTimestamp);
     tcase_add_test(tc_readSingleAttributes, ReadSingleDataSourceAttributeArrayDimensionsWithoutTimestamp);
+    tcase_add_test(tc_readSingleAttributes, ReadBulkDataSourceAttributeValue);
+    tcase_add_test(tc_readSingleAttributes, ReadBulkDataSourceFailure);
+    tcase_add_test(tc_readSingleAttributes, ReadDataSourceAttributeValueMaxAge);
+    tcase_add_test(tc_readSingleAttributes, ReadDataSourceAttributeValueMaxAgeSession);
+    tcase_add_test(tc_readSingleAttributes, ReadDataSourceAttributeValueMaxAgeCleanup);
 
     suite_add_tcase(s, tc_readSingleAttributes);
 
@@ -913,6 +1430,7 @@ static Suite * testSuite_services_attributes(void) {
     tcase_add_test(tc_writeSingleAttributes, WriteSingleAttributeEventNotifier);
     tcase_add_test(tc_writeSingleAttributes, WriteSingleAttributeValue);
     tcase_add_test(tc_writeSingleAttributes, WriteSingleAttributeDataType);
+    tcase_add_test(tc_writeSingleAttributes, WriteSingleAttributeValueDataTypeHierarchy);
     tcase_add_test(tc_writeSingleAttributes, WriteSingleAttributeValueRangeFromScalar);
     tcase_add_test(tc_writeSingleAttributes, WriteSingleAttributeValueRangeFromArray);
     tcase_add_test(tc_writeSingleAttributes, WriteSingleAttributeValueRank);
@@ -922,6 +1440,8 @@ static Suite * testSuite_services_attributes(void) {
     tcase_add_test(tc_writeSingleAttributes, WriteSingleAttributeHistorizing);
     tcase_add_test(tc_writeSingleAttributes, WriteSingleAttributeExecutable);
     tcase_add_test(tc_writeSingleAttributes, WriteSingleDataSourceAttributeValue);
+    tcase_add_test(tc_writeSingleAttributes, WriteParallel);
+    tcase_add_test(tc_writeSingleAttributes, WriteParallelSampleOnWrite);
 
     suite_add_tcase(s, tc_writeSingleAttributes);
 
@@ -9,20 +9,42 @@
 #include "server/ua_server_internal.h"
 #include "server/ua_subscription.h"
 #include "ua_config_default.h"
+#include "ua_types_encoding_binary.h"
 
 #include "check.h"
 #include "testing_clock.h"
+#include "testing_networklayers.h"
+#include "testing_policy.h"
 
 static UA_Server *server = NULL;
 static UA_ServerConfig *config = NULL;
 
+/* Responses that are not returned from the service call are sent over this
+ * channel. The last sent chunk is copied to sentData. */
+static UA_SecureChannel testChannel;
+static UA_SecurityPolicy dummyPolicy;
+static UA_Connection testingConnection;
+static UA_ByteString sentData;
+static funcs_called funcsCalled;
+static key_sizes keySizes;
+
 static void setup(void) {
     config = UA_ServerConfig_new_default();
     server = UA_Server_new(config);
     UA_Server_run_startup(server);
+
+    TestingPolicy(&dummyPolicy, UA_BYTESTRING_NULL, &funcsCalled, &keySizes);
+    UA_SecureChannel_init(&testChannel, &dummyPolicy, &UA_BYTESTRING_NULL);
+    testingConnection = createDummyConnection(65535, &sentData);
+    UA_Connection_attachSecureChannel(&testingConnection, &testChannel);
+    testChannel.connection = &testingConnection;
 }
 
 static void teardown(void) {
+    UA_SecureChannel_deleteMembersCleanup(&testChannel);
+    dummyPolicy.deleteMembers(&dummyPolicy);
+    testingConnection.close(&testingConnection);
+
     UA_Server_run_shutdown(server);
     UA_Server_delete(server);
     UA_ServerConfig_delete(config);
@@ -90,16 +112,38 @@ START_TEST(Server_setPublishingMode) {
 }
 END_TEST
 
-START_TEST(Server_republish) {
+/* Republish streams the response into the message context. Decode it from the
+ * sent chunk. */
+static void
+republish(UA_UInt32 localSubscriptionId, UA_UInt32 sequenceNumber,
+          UA_RepublishResponse *response) {
     UA_RepublishRequest request;
     UA_RepublishRequest_init(&request);
-    request.subscriptionId = subscriptionId;
-    request.retransmitSequenceNumber = 0;
+    request.subscriptionId = localSubscriptionId;
+    request.retransmitSequenceNumber = sequenceNumber;
+
+    UA_ResponseHeader rh;
+    UA_ResponseHeader_init(&rh);
+
+    UA_MessageContext mc;
+    UA_StatusCode retval = UA_MessageContext_begin(&mc, &testChannel, 0, UA_MESSAGETYPE_MSG);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    retval = Service_Republish(server, &adminSession, &mc, &request, &rh);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    retval = UA_MessageContext_finish(&mc);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    size_t offset = UA_SECURE_MESSAGE_HEADER_LENGTH;
+    UA_RepublishResponse_init(response);
+    retval = UA_decodeBinary(&sentData, &offset, response,
+                             &UA_TYPES[UA_TYPES_REPUBLISHRESPONSE], 0, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(offset, sentData.length);
+}
 
+START_TEST(Server_republish) {
     UA_RepublishResponse response;
-    UA_RepublishResponse_init(&response);
-
-    Service_Republish(server, &adminSession, &request, &response);
+    republish(subscriptionId, 0, &response);
     ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_BADMESSAGENOTAVAILABLE);
 
     UA_RepublishResponse_deleteMembers(&response);
@@ -108,15 +152,8 @@ END_TEST
 
 
 START_TEST(Server_republish_invalid) {
-    UA_RepublishRequest request;
-    UA_RepublishRequest_init(&request);
-    request.subscriptionId = subscriptionId;
-    request.retransmitSequenceNumber = 0;
-
     UA_RepublishResponse response;
-    UA_RepublishResponse_init(&response);
-
-    Service_Republish(server, &adminSession, &request, &response);
+    republish(subscriptionId, 0, &response);
     ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_BADSUBSCRIPTIONIDINVALID);
 
     UA_RepublishResponse_deleteMembers(&response);
@@ -330,28 +367,28 @@ START_TEST(Server_overflow) {
     ck_assert_uint_eq(mon->queueSize, 1); 
     ck_assert_uint_eq(mon->maxQueueSize, 3); 
     UA_Notification *notification;
-    notification = TAILQ_LAST(&mon->queue, NotificationQueue);
+    notification = MonitoredItem_getNotification(mon, mon->queueSize - 1);
     ck_assert_uint_eq(notification->data.value.hasStatus, false);
 
-    UA_ByteString_deleteMembers(&mon->lastSampledValue);
+    MonitoredItem_resetLastValue(mon);
     UA_MonitoredItem_SampleCallback(server, mon);
     ck_assert_uint_eq(mon->queueSize, 2); 
     ck_assert_uint_eq(mon->maxQueueSize, 3); 
-    notification = TAILQ_LAST(&mon->queue, NotificationQueue);
+    notification = MonitoredItem_getNotification(mon, mon->queueSize - 1);
     ck_assert_uint_eq(notification->data.value.hasStatus, false);
 
-    UA_ByteString_deleteMembers(&mon->lastSampledValue);
+    MonitoredItem_resetLastValue(mon);
     UA_MonitoredItem_SampleCallback(server, mon);
     ck_assert_uint_eq(mon->queueSize, 3); 
     ck_assert_uint_eq(mon->maxQueueSize, 3); 
-    notification = TAILQ_LAST(&mon->queue, NotificationQueue);
+    notification = MonitoredItem_getNotification(mon, mon->queueSize - 1);
     ck_assert_uint_eq(notification->data.value.hasStatus, false);
 
-    UA_ByteString_deleteMembers(&mon->lastSampledValue);
+    MonitoredItem_resetLastValue(mon);
     UA_MonitoredItem_SampleCallback(server, mon);
     ck_assert_uint_eq(mon->queueSize, 3); 
     ck_assert_uint_eq(mon->maxQueueSize, 3); 
-    notification = TAILQ_FIRST(&mon->queue);
+    notification = MonitoredItem_getNotification(mon, 0);
     ck_assert_uint_eq(notification->data.value.hasStatus, true);
     ck_assert_uint_eq(notification->data.value.status,
                       UA_STATUSCODE_INFOTYPE_DATAVALUE | UA_STATUSCODE_INFOBITS_OVERFLOW);
@@ -389,7 +426,7 @@ START_TEST(Server_overflow) {
 
     ck_assert_uint_eq(mon->queueSize, 2); 
     ck_assert_uint_eq(mon->maxQueueSize, 2); 
-    notification = TAILQ_FIRST(&mon->queue);
+    notification = MonitoredItem_getNotification(mon, 0);
     ck_assert_uint_eq(notification->data.value.hasStatus, true);
     ck_assert_uint_eq(notification->data.value.status,
                       UA_STATUSCODE_INFOTYPE_DATAVALUE | UA_STATUSCODE_INFOBITS_OVERFLOW);
@@ -419,7 +456,7 @@ START_TEST(Server_overflow) {
 
     ck_assert_uint_eq(mon->queueSize, 1); 
     ck_assert_uint_eq(mon->maxQueueSize, 1); 
-    notification = TAILQ_LAST(&mon->queue, NotificationQueue);
+    notification = MonitoredItem_getNotification(mon, mon->queueSize - 1);
     ck_assert_uint_eq(notification->data.value.hasStatus, false);
 
     /* Modify the MonitoredItem */
@@ -449,7 +486,7 @@ START_TEST(Server_overflow) {
     UA_MonitoredItem_SampleCallback(server, mon);
     ck_assert_uint_eq(mon->queueSize, 1); 
     ck_assert_uint_eq(mon->maxQueueSize, 1); 
-    notification = TAILQ_FIRST(&mon->queue);
+    notification = MonitoredItem_getNotification(mon, 0);
     ck_assert_uint_eq(notification->data.value.hasStatus, false); /* the infobit is only set if the queue is larger than one */
 
     /* Remove the subscriptions */
@@ -663,6 +700,917 @@ START_TEST(Server_lifeTimeCount) {
 }
 END_TEST
 
+static UA_NodeId deadbandNodeId;
+
+static void
+addDeadbandVariable(UA_Boolean withEURange) {
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_Double d = 0.0;
+    UA_Variant_setScalar(&attr.value, &d, &UA_TYPES[UA_TYPES_DOUBLE]);
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+    UA_StatusCode retval =
+        UA_Server_addVariableNode(server, UA_NODEID_NULL,
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                  UA_QUALIFIEDNAME(1, "Deadband"),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                  attr, NULL, &deadbandNodeId);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    if(!withEURange)
+        return;
+
+    UA_VariableAttributes rangeAttr = UA_VariableAttributes_default;
+    UA_Range range;
+    range.low = 0.0;
+    range.high = 200.0;
+    UA_Variant_setScalar(&rangeAttr.value, &range, &UA_TYPES[UA_TYPES_RANGE]);
+    retval = UA_Server_addVariableNode(server, UA_NODEID_NULL, deadbandNodeId,
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_HASPROPERTY),
+                                       UA_QUALIFIEDNAME(0, "EURange"),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_PROPERTYTYPE),
+                                       rangeAttr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+}
+
+static UA_StatusCode
+createDeadbandItem(UA_UInt32 localSubscriptionId, UA_DeadbandType deadbandType,
+                   UA_Double deadbandValue, UA_MonitoredItem **mon) {
+    UA_DataChangeFilter filter;
+    UA_DataChangeFilter_init(&filter);
+    filter.trigger = UA_DATACHANGETRIGGER_STATUSVALUE;
+    filter.deadbandType = deadbandType;
+    filter.deadbandValue = deadbandValue;
+
+    UA_MonitoredItemCreateRequest item;
+    UA_MonitoredItemCreateRequest_init(&item);
+    item.itemToMonitor.nodeId = deadbandNodeId;
+    item.itemToMonitor.attributeId = UA_ATTRIBUTEID_VALUE;
+    item.monitoringMode = UA_MONITORINGMODE_REPORTING;
+    item.requestedParameters.queueSize = 10;
+    item.requestedParameters.discardOldest = true;
+    item.requestedParameters.filter.encoding = UA_EXTENSIONOBJECT_DECODED;
+    item.requestedParameters.filter.content.decoded.type = &UA_TYPES[UA_TYPES_DATACHANGEFILTER];
+    item.requestedParameters.filter.content.decoded.data = &filter;
+
+    UA_CreateMonitoredItemsRequest request;
+    UA_CreateMonitoredItemsRequest_init(&request);
+    request.subscriptionId = localSubscriptionId;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    request.itemsToCreateSize = 1;
+    request.itemsToCreate = &item;
+
+    UA_CreateMonitoredItemsResponse response;
+    UA_CreateMonitoredItemsResponse_init(&response);
+    Service_CreateMonitoredItems(server, &adminSession, &request, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 1);
+    UA_StatusCode retval = response.results[0].statusCode;
+    *mon = NULL;
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_Subscription *sub = UA_Session_getSubscriptionById(&adminSession, localSubscriptionId);
+        ck_assert_ptr_ne(sub, NULL);
+        *mon = UA_Subscription_getMonitoredItem(sub, response.results[0].monitoredItemId);
+    }
+    UA_CreateMonitoredItemsResponse_deleteMembers(&response);
+    return retval;
+}
+
+static void
+writeDeadbandValue(UA_Double d) {
+    UA_Variant v;
+    UA_Variant_setScalar(&v, &d, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_StatusCode retval = UA_Server_writeValue(server, deadbandNodeId, v);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+}
+
+static UA_UInt32
+createSessionSubscription(UA_Session *session) {
+    UA_CreateSubscriptionRequest request;
+    UA_CreateSubscriptionRequest_init(&request);
+    request.publishingEnabled = true;
+    UA_CreateSubscriptionResponse response;
+    UA_CreateSubscriptionResponse_init(&response);
+    Service_CreateSubscription(server, session, &request, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    UA_UInt32 localSubscriptionId = response.subscriptionId;
+    UA_CreateSubscriptionResponse_deleteMembers(&response);
+    return localSubscriptionId;
+}
+
+static UA_UInt32
+createDeadbandSubscription(void) {
+    return createSessionSubscription(&adminSession);
+}
+
+START_TEST(Server_deadbandAbsolute) {
+    addDeadbandVariable(false);
+    UA_UInt32 localSubscriptionId = createDeadbandSubscription();
+
+    UA_MonitoredItem *mon;
+    UA_StatusCode retval =
+        createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_ABSOLUTE, 1.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_ptr_ne(mon, NULL);
+    UA_assert(mon);
+    ck_assert_uint_eq(mon->queueSize, 1); /* The first sample */
+
+    /* Changes within the deadband are not reported */
+    writeDeadbandValue(0.5);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    ck_assert_uint_eq(mon->queueSize, 1);
+    writeDeadbandValue(1.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    ck_assert_uint_eq(mon->queueSize, 1);
+
+    /* The deadband is relative to the last reported value */
+    writeDeadbandValue(1.5);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    ck_assert_uint_eq(mon->queueSize, 2);
+    writeDeadbandValue(2.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    ck_assert_uint_eq(mon->queueSize, 2);
+    writeDeadbandValue(0.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    ck_assert_uint_eq(mon->queueSize, 3);
+
+    /* Invalid deadband settings */
+    retval = createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_ABSOLUTE, -1.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_BADDEADBANDFILTERINVALID);
+    retval = createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_PERCENT, 10.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_BADMONITOREDITEMFILTERUNSUPPORTED);
+
+    UA_Subscription *sub = UA_Session_getSubscriptionById(&adminSession, localSubscriptionId);
+    ck_assert_ptr_ne(sub, NULL);
+    UA_assert(sub);
+    ck_assert_uint_eq(sub->monitoredItemsSize, 1);
+    UA_Session_deleteSubscription(server, &adminSession, localSubscriptionId);
+}
+END_TEST
+
+START_TEST(Server_deadbandPercent) {
+    addDeadbandVariable(true);
+    UA_UInt32 localSubscriptionId = createDeadbandSubscription();
+
+    /* 10 percent of the EURange 0..200 */
+    UA_MonitoredItem *mon;
+    UA_StatusCode retval =
+        createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_PERCENT, 10.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_ptr_ne(mon, NULL);
+    UA_assert(mon);
+    ck_assert(mon->deadband == 20.0);
+    ck_assert_uint_eq(mon->queueSize, 1);
+
+    writeDeadbandValue(15.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    ck_assert_uint_eq(mon->queueSize, 1);
+    writeDeadbandValue(25.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    ck_assert_uint_eq(mon->queueSize, 2);
+
+    retval = createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_PERCENT, 101.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_BADDEADBANDFILTERINVALID);
+    UA_Session_deleteSubscription(server, &adminSession, localSubscriptionId);
+}
+END_TEST
+
+START_TEST(Server_deadbandNotNumeric) {
+    UA_UInt32 localSubscriptionId = createDeadbandSubscription();
+
+    /* A variable with the String DataType */
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_String str = UA_STRING("text");
+    UA_Variant_setScalar(&attr.value, &str, &UA_TYPES[UA_TYPES_STRING]);
+    attr.dataType = UA_TYPES[UA_TYPES_STRING].typeId;
+    UA_StatusCode retval =
+        UA_Server_addVariableNode(server, UA_NODEID_NULL,
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                  UA_QUALIFIEDNAME(1, "StringVariable"),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                  attr, NULL, &deadbandNodeId);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_MonitoredItem *mon;
+    retval = createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_ABSOLUTE, 1.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_BADFILTERNOTALLOWED);
+    retval = createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_PERCENT, 10.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_BADFILTERNOTALLOWED);
+    retval = createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_NONE, 0.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* For the BaseDataType, the type of the current value decides */
+    attr.dataType = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATATYPE);
+    retval = UA_Server_addVariableNode(server, UA_NODEID_NULL,
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                       UA_QUALIFIEDNAME(1, "AnyVariable"),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                       attr, NULL, &deadbandNodeId);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    retval = createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_ABSOLUTE, 1.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_BADFILTERNOTALLOWED);
+
+    UA_Session_deleteSubscription(server, &adminSession, localSubscriptionId);
+}
+END_TEST
+
+static void
+onReadDeadband(UA_Server *s, const UA_NodeId *sessionId, void *sessionContext,
+               const UA_NodeId *nodeId, void *nodeContext,
+               const UA_NumericRange *range, const UA_DataValue *value) {
+}
+
+START_TEST(Server_sampleOnWrite) {
+    server->config.sampleMonitoredItemsOnWrite = true;
+    addDeadbandVariable(false);
+    UA_UInt32 localSubscriptionId = createDeadbandSubscription();
+
+    UA_MonitoredItem *mon;
+    UA_StatusCode retval =
+        createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_NONE, 0.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_ptr_ne(mon, NULL);
+    UA_assert(mon);
+    ck_assert(mon->sampleOnWrite);
+    ck_assert_uint_eq(server->monitoredNodesItems, 1);
+    ck_assert_uint_eq(mon->queueSize, 1);
+
+    /* The write samples the value without waiting for the sampling interval */
+    writeDeadbandValue(1.0);
+    ck_assert_uint_eq(mon->queueSize, 2);
+    writeDeadbandValue(1.0);
+    ck_assert_uint_eq(mon->queueSize, 2);
+    writeDeadbandValue(2.0);
+    ck_assert_uint_eq(mon->queueSize, 3);
+
+    /* With an onRead callback, the value can change without a write. The
+     * MonitoredItem falls back to polling. */
+    UA_ValueCallback callback;
+    callback.onRead = onReadDeadband;
+    callback.onWrite = NULL;
+    UA_StatusCode res =
+        UA_Server_setVariableNode_valueCallback(server, deadbandNodeId, callback);
+    ck_assert_uint_eq(res, UA_STATUSCODE_GOOD);
+    ck_assert(!mon->sampleOnWrite);
+    ck_assert(mon->sampleCallbackIsRegistered);
+    ck_assert_uint_eq(server->monitoredNodesItems, 0);
+
+    UA_Session_deleteSubscription(server, &adminSession, localSubscriptionId);
+    ck_assert_uint_eq(server->monitoredNodesItems, 0);
+}
+END_TEST
+
+static void
+publishNotifications(UA_Subscription *sub) {
+    UA_PublishRequest request;
+    UA_PublishRequest_init(&request);
+    Service_Publish(server, &adminSession, &request, 0);
+    sub->readyNotifications = sub->notificationQueueSize;
+    UA_Subscription_publish(server, sub);
+}
+
+static UA_Double
+republishedValue(UA_UInt32 localSubscriptionId, UA_UInt32 sequenceNumber) {
+    UA_RepublishResponse response;
+    republish(localSubscriptionId, sequenceNumber, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.notificationMessage.sequenceNumber, sequenceNumber);
+    ck_assert_uint_eq(response.notificationMessage.notificationDataSize, 1);
+    UA_ExtensionObject *data = response.notificationMessage.notificationData;
+    ck_assert_uint_eq(data->encoding, UA_EXTENSIONOBJECT_DECODED);
+    ck_assert_ptr_eq(data->content.decoded.type, &UA_TYPES[UA_TYPES_DATACHANGENOTIFICATION]);
+    UA_DataChangeNotification *dcn = (UA_DataChangeNotification*)data->content.decoded.data;
+    ck_assert_uint_eq(dcn->monitoredItemsSize, 1);
+    ck_assert(UA_Variant_hasScalarType(&dcn->monitoredItems[0].value.value,
+                                       &UA_TYPES[UA_TYPES_DOUBLE]));
+    UA_Double d = *(UA_Double*)dcn->monitoredItems[0].value.value.data;
+    UA_RepublishResponse_deleteMembers(&response);
+    return d;
+}
+
+START_TEST(Server_retransmissionQueue) {
+    UA_Session_attachToSecureChannel(&adminSession, &testChannel);
+    addDeadbandVariable(false);
+    UA_UInt32 localSubscriptionId = createDeadbandSubscription();
+    UA_MonitoredItem *mon;
+    UA_StatusCode retval =
+        createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_NONE, 0.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Subscription *sub = UA_Session_getSubscriptionById(&adminSession, localSubscriptionId);
+    ck_assert_ptr_ne(sub, NULL);
+    UA_assert(sub);
+
+    /* Send three messages that are not acknowledged. The first contains the
+     * initial sample. */
+    publishNotifications(sub);
+    writeDeadbandValue(1.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    publishNotifications(sub);
+    writeDeadbandValue(2.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    publishNotifications(sub);
+    ck_assert_uint_eq(sub->retransmissionQueueSize, 3);
+
+    /* The messages have the same encoded size */
+    UA_NotificationMessageEntry *entry = TAILQ_FIRST(&adminSession.retransmissions);
+    ck_assert_ptr_ne(entry, NULL);
+    UA_assert(entry);
+    size_t messageSize = entry->encoded.length;
+    ck_assert_uint_eq(adminSession.retransmissionBytes, 3 * messageSize);
+
+    /* Republish streams the retained encoding. Message 1 becomes the most
+     * recently used. */
+    ck_assert(republishedValue(localSubscriptionId, 1) == 0.0);
+    ck_assert(republishedValue(localSubscriptionId, 3) == 2.0);
+    ck_assert(republishedValue(localSubscriptionId, 1) == 0.0);
+
+    /* The least recently used message 2 is dropped to stay within the
+     * limit */
+    server->config.maxRetransmissionBytesPerSession = (UA_UInt32)(3 * messageSize);
+    writeDeadbandValue(3.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    publishNotifications(sub);
+    ck_assert_uint_eq(sub->retransmissionQueueSize, 3);
+    ck_assert_uint_eq(adminSession.retransmissionBytes, 3 * messageSize);
+    UA_RepublishResponse response;
+    republish(localSubscriptionId, 2, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult,
+                      UA_STATUSCODE_BADMESSAGENOTAVAILABLE);
+    UA_RepublishResponse_deleteMembers(&response);
+    ck_assert(republishedValue(localSubscriptionId, 4) == 3.0);
+
+    /* Acknowledged messages are released */
+    retval = UA_Subscription_removeRetransmissionMessage(sub, 1);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(adminSession.retransmissionBytes, 2 * messageSize);
+
+    UA_Session_deleteSubscription(server, &adminSession, localSubscriptionId);
+    ck_assert_uint_eq(adminSession.retransmissionBytes, 0);
+    ck_assert(TAILQ_EMPTY(&adminSession.retransmissions));
+    UA_Session_detachFromSecureChannel(&adminSession);
+}
+END_TEST
+
+START_TEST(Server_publishEncoding) {
+    UA_Session_attachToSecureChannel(&adminSession, &testChannel);
+    addDeadbandVariable(false);
+    UA_UInt32 localSubscriptionId = createDeadbandSubscription();
+    UA_MonitoredItem *mon;
+    UA_StatusCode retval =
+        createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_NONE, 0.0, &mon);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Subscription *sub = UA_Session_getSubscriptionById(&adminSession, localSubscriptionId);
+    ck_assert_ptr_ne(sub, NULL);
+    UA_assert(sub);
+
+    /* Three notifications in one message */
+    writeDeadbandValue(1.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    writeDeadbandValue(2.0);
+    UA_MonitoredItem_SampleCallback(server, mon);
+    ck_assert_uint_eq(sub->notificationQueueSize, 3);
+    publishNotifications(sub);
+    ck_assert_uint_eq(sub->notificationQueueSize, 0);
+    ck_assert_uint_eq(mon->queueSize, 0);
+
+    /* Decode the sent response */
+    size_t offset = UA_SECURE_MESSAGE_HEADER_LENGTH;
+    UA_NodeId typeId;
+    retval = UA_decodeBinary(&sentData, &offset, &typeId, &UA_TYPES[UA_TYPES_NODEID], 0, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(typeId.identifier.numeric,
+                      UA_TYPES[UA_TYPES_PUBLISHRESPONSE].binaryEncodingId);
+    UA_PublishResponse response;
+    retval = UA_decodeBinary(&sentData, &offset, &response,
+                             &UA_TYPES[UA_TYPES_PUBLISHRESPONSE], 0, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(offset, sentData.length);
+    ck_assert_uint_eq(response.subscriptionId, localSubscriptionId);
+    ck_assert_uint_eq(response.availableSequenceNumbersSize, 1);
+    ck_assert_uint_eq(response.availableSequenceNumbers[0], 1);
+    ck_assert_uint_eq(response.notificationMessage.sequenceNumber, 1);
+    ck_assert_uint_eq(response.notificationMessage.notificationDataSize, 1);
+    UA_ExtensionObject *data = response.notificationMessage.notificationData;
+    ck_assert_ptr_eq(data->content.decoded.type, &UA_TYPES[UA_TYPES_DATACHANGENOTIFICATION]);
+    UA_DataChangeNotification *dcn = (UA_DataChangeNotification*)data->content.decoded.data;
+    ck_assert_uint_eq(dcn->monitoredItemsSize, 3);
+    ck_assert_uint_eq(dcn->diagnosticInfosSize, 0);
+    for(size_t i = 0; i < 3; i++) {
+        ck_assert_uint_eq(dcn->monitoredItems[i].clientHandle, mon->clientHandle);
+        ck_assert(*(UA_Double*)dcn->monitoredItems[i].value.value.data == (UA_Double)i);
+    }
+    UA_PublishResponse_deleteMembers(&response);
+
+    UA_Session_deleteSubscription(server, &adminSession, localSubscriptionId);
+    UA_Session_detachFromSecureChannel(&adminSession);
+}
+END_TEST
+
+/* Count the sends on the testing connection */
+static size_t sendCount;
+static UA_StatusCode (*testingSend)(UA_Connection *connection, UA_ByteString *buf);
+
+static UA_StatusCode
+countingSend(UA_Connection *connection, UA_ByteString *buf) {
+    ++sendCount;
+    return testingSend(connection, buf);
+}
+
+static UA_UInt32
+createGroupedSubscription(UA_Double publishingInterval, UA_Byte priority) {
+    UA_CreateSubscriptionRequest request;
+    UA_CreateSubscriptionRequest_init(&request);
+    request.publishingEnabled = true;
+    request.requestedPublishingInterval = publishingInterval;
+    request.requestedMaxKeepAliveCount = 100;
+    request.priority = priority;
+    UA_CreateSubscriptionResponse response;
+    UA_CreateSubscriptionResponse_init(&response);
+    Service_CreateSubscription(server, &adminSession, &request, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert(response.revisedPublishingInterval == publishingInterval);
+    UA_UInt32 localSubscriptionId = response.subscriptionId;
+    UA_CreateSubscriptionResponse_deleteMembers(&response);
+    return localSubscriptionId;
+}
+
+/* Decode the PublishResponses that were sent back-to-back in one buffer */
+static size_t
+decodeSentPublishResponses(UA_UInt32 *subscriptionIds, size_t max) {
+    size_t count = 0;
+    size_t pos = 0;
+    while(pos < sentData.length) {
+        ck_assert_uint_lt(count, max);
+        size_t offset = pos + 4; /* Skip the message type */
+        UA_UInt32 messageSize;
+        UA_StatusCode retval =
+            UA_decodeBinary(&sentData, &offset, &messageSize, &UA_TYPES[UA_TYPES_UINT32], 0, NULL);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+        offset = pos + UA_SECURE_MESSAGE_HEADER_LENGTH;
+        UA_NodeId typeId;
+        retval = UA_decodeBinary(&sentData, &offset, &typeId, &UA_TYPES[UA_TYPES_NODEID], 0, NULL);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+        ck_assert_uint_eq(typeId.identifier.numeric,
+                          UA_TYPES[UA_TYPES_PUBLISHRESPONSE].binaryEncodingId);
+        UA_PublishResponse response;
+        retval = UA_decodeBinary(&sentData, &offset, &response,
+                                 &UA_TYPES[UA_TYPES_PUBLISHRESPONSE], 0, NULL);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+        ck_assert_uint_eq(offset, pos + messageSize);
+        subscriptionIds[count] = response.subscriptionId;
+        UA_PublishResponse_deleteMembers(&response);
+        pos += messageSize;
+        ++count;
+    }
+    return count;
+}
+
+START_TEST(Server_publishGroup) {
+    UA_Session_attachToSecureChannel(&adminSession, &testChannel);
+    testingSend = testingConnection.send;
+    testingConnection.send = countingSend;
+    sendCount = 0;
+
+    /* Equal and harmonic publishing intervals share one group */
+    UA_UInt32 sub1Id = createGroupedSubscription(100.0, 0);
+    UA_UInt32 sub2Id = createGroupedSubscription(100.0, 10);
+    UA_UInt32 sub3Id = createGroupedSubscription(200.0, 0);
+    UA_UInt32 sub4Id = createGroupedSubscription(150.0, 0);
+    UA_Subscription *sub1 = UA_Session_getSubscriptionById(&adminSession, sub1Id);
+    UA_Subscription *sub3 = UA_Session_getSubscriptionById(&adminSession, sub3Id);
+    UA_Subscription *sub4 = UA_Session_getSubscriptionById(&adminSession, sub4Id);
+    ck_assert_ptr_ne(sub1, NULL);
+    ck_assert_ptr_ne(sub3, NULL);
+    ck_assert_ptr_ne(sub4, NULL);
+    UA_assert(sub1 && sub3 && sub4);
+    ck_assert_ptr_eq(sub1->publishGroup, sub3->publishGroup);
+    ck_assert_uint_eq(sub1->publishGroup->interval, 100);
+    ck_assert_uint_eq(sub3->publishTicks, 2);
+    ck_assert_ptr_ne(sub4->publishGroup, sub1->publishGroup);
+
+    /* A non-harmonic interval has a group of its own. The group is removed
+     * with the subscription. */
+    UA_Session_deleteSubscription(server, &adminSession, sub4Id);
+    UA_PublishGroup *pg;
+    size_t groups = 0;
+    LIST_FOREACH(pg, &adminSession.publishGroups, listEntry)
+        ++groups;
+    ck_assert_uint_eq(groups, 1);
+
+    UA_PublishRequest request;
+    UA_PublishRequest_init(&request);
+    for(size_t i = 0; i < 3; i++)
+        Service_Publish(server, &adminSession, &request, 0);
+
+    /* The first keepalives of the two subscriptions with the base interval go
+     * out in one send. The higher priority is published first. */
+    UA_fakeSleep(100 + 1);
+    UA_Server_run_iterate(server, false);
+    UA_realSleep(100);
+    ck_assert_uint_eq(sendCount, 1);
+    UA_UInt32 ids[3];
+    ck_assert_uint_eq(decodeSentPublishResponses(ids, 3), 2);
+    ck_assert_uint_eq(ids[0], sub2Id);
+    ck_assert_uint_eq(ids[1], sub1Id);
+
+    /* The subscription with the double interval is published every second
+     * cycle */
+    UA_fakeSleep(100 + 1);
+    UA_Server_run_iterate(server, false);
+    UA_realSleep(100);
+    ck_assert_uint_eq(sendCount, 2);
+    ck_assert_uint_eq(decodeSentPublishResponses(ids, 3), 1);
+    ck_assert_uint_eq(ids[0], sub3Id);
+
+    /* The group is removed with the last subscription */
+    UA_Session_deleteSubscription(server, &adminSession, sub1Id);
+    UA_Session_deleteSubscription(server, &adminSession, sub2Id);
+    ck_assert(!LIST_EMPTY(&adminSession.publishGroups));
+    UA_Session_deleteSubscription(server, &adminSession, sub3Id);
+    ck_assert(LIST_EMPTY(&adminSession.publishGroups));
+
+    testingConnection.send = testingSend;
+    UA_Session_detachFromSecureChannel(&adminSession);
+}
+END_TEST
+
+START_TEST(Server_notificationOrder) {
+    UA_Session_attachToSecureChannel(&adminSession, &testChannel);
+    addDeadbandVariable(false);
+    UA_UInt32 localSubscriptionId = createDeadbandSubscription();
+    UA_MonitoredItem *monA, *monB;
+    UA_StatusCode retval =
+        createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_NONE, 0.0, &monA);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    retval = createDeadbandItem(localSubscriptionId, UA_DEADBANDTYPE_NONE, 0.0, &monB);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_assert(monA && monB);
+    monA->clientHandle = 1;
+    monB->clientHandle = 2;
+    retval = MonitoredItem_setQueueSize(monA, 2, true);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Subscription *sub = UA_Session_getSubscriptionById(&adminSession, localSubscriptionId);
+    ck_assert_ptr_ne(sub, NULL);
+    UA_assert(sub);
+
+    /* Interleaved samples. The third sample of A discards the oldest. The
+     * second oldest takes its place in the global order: A1 B0 A2 B1 */
+    writeDeadbandValue(1.0);
+    UA_MonitoredItem_SampleCallback(server, monA);
+    UA_MonitoredItem_SampleCallback(server, monB);
+    writeDeadbandValue(2.0);
+    UA_MonitoredItem_SampleCallback(server, monA);
+    ck_assert_uint_eq(monA->queueSize, 2);
+    ck_assert_uint_eq(monB->queueSize, 2);
+    ck_assert_uint_eq(sub->notificationQueueSize, 4);
+    UA_Notification *notification = MonitoredItem_getNotification(monA, 0);
+    ck_assert(notification->data.value.status & UA_STATUSCODE_INFOBITS_OVERFLOW);
+
+    /* Shrink the queue of B and keep the newest. It takes the place of the
+     * removed notification: A1 B1 A2 */
+    retval = MonitoredItem_setQueueSize(monB, 1, false);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(monB->queueSize, 1);
+    ck_assert_uint_eq(sub->notificationQueueSize, 3);
+
+    publishNotifications(sub);
+    ck_assert_uint_eq(sub->notificationQueueSize, 0);
+    ck_assert_uint_eq(monA->queueSize, 0);
+    ck_assert_uint_eq(monB->queueSize, 0);
+
+    size_t offset = UA_SECURE_MESSAGE_HEADER_LENGTH;
+    UA_NodeId typeId;
+    retval = UA_decodeBinary(&sentData, &offset, &typeId, &UA_TYPES[UA_TYPES_NODEID], 0, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_PublishResponse response;
+    retval = UA_decodeBinary(&sentData, &offset, &response,
+                             &UA_TYPES[UA_TYPES_PUBLISHRESPONSE], 0, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.notificationMessage.notificationDataSize, 1);
+    UA_DataChangeNotification *dcn = (UA_DataChangeNotification*)
+        response.notificationMessage.notificationData->content.decoded.data;
+    ck_assert_uint_eq(dcn->monitoredItemsSize, 3);
+    UA_UInt32 handles[3] = {1, 2, 1};
+    UA_Double values[3] = {1.0, 1.0, 2.0};
+    for(size_t i = 0; i < 3; i++) {
+        ck_assert_uint_eq(dcn->monitoredItems[i].clientHandle, handles[i]);
+        ck_assert(*(UA_Double*)dcn->monitoredItems[i].value.value.data == values[i]);
+    }
+    UA_PublishResponse_deleteMembers(&response);
+
+    UA_Session_deleteSubscription(server, &adminSession, localSubscriptionId);
+    UA_Session_detachFromSecureChannel(&adminSession);
+}
+END_TEST
+
+static size_t bulkReadCount;
+static UA_Double bulkValue;
+
+static UA_StatusCode
+bulkRead(UA_Server *server_, UA_BulkDataSource *source,
+         const UA_NodeId *sessionId, void *sessionContext,
+         UA_Boolean includeSourceTimeStamp,
+         size_t valuesSize, UA_BulkReadValue *values) {
+    bulkReadCount++;
+    for(size_t i = 0; i < valuesSize; i++) {
+        UA_Variant_setScalarCopy(&values[i].value.value, &bulkValue,
+                                 &UA_TYPES[UA_TYPES_DOUBLE]);
+        values[i].value.hasValue = true;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+START_TEST(Server_bulkSampling) {
+    UA_BulkDataSource source;
+    memset(&source, 0, sizeof(UA_BulkDataSource));
+    source.read = bulkRead;
+    bulkValue = 0.0;
+
+    /* Three variables on the same bulk data source */
+    UA_MonitoredItemCreateRequest items[3];
+    for(size_t i = 0; i < 3; i++) {
+        UA_NodeId nodeId;
+        UA_VariableAttributes attr = UA_VariableAttributes_default;
+        UA_StatusCode retval =
+            UA_Server_addVariableNode(server, UA_NODEID_NULL,
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                      UA_QUALIFIEDNAME(1, "Bulk"),
+                                      UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                      attr, NULL, &nodeId);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+        retval = UA_Server_setVariableNode_bulkDataSource(server, nodeId, &source);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+        UA_MonitoredItemCreateRequest_init(&items[i]);
+        items[i].itemToMonitor.nodeId = nodeId;
+        items[i].itemToMonitor.attributeId = UA_ATTRIBUTEID_VALUE;
+        items[i].monitoringMode = UA_MONITORINGMODE_REPORTING;
+        items[i].requestedParameters.samplingInterval = 100.0;
+        items[i].requestedParameters.queueSize = 10;
+    }
+
+    UA_UInt32 localSubscriptionId = createDeadbandSubscription();
+    UA_CreateMonitoredItemsRequest request;
+    UA_CreateMonitoredItemsRequest_init(&request);
+    request.subscriptionId = localSubscriptionId;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    request.itemsToCreateSize = 3;
+    request.itemsToCreate = items;
+
+    UA_CreateMonitoredItemsResponse response;
+    UA_CreateMonitoredItemsResponse_init(&response);
+    Service_CreateMonitoredItems(server, &adminSession, &request, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 3);
+
+    /* The MonitoredItems are sampled together */
+    UA_Subscription *sub = UA_Session_getSubscriptionById(&adminSession, localSubscriptionId);
+    ck_assert_ptr_ne(sub, NULL);
+    UA_assert(sub);
+    UA_MonitoredItem *mons[3];
+    for(size_t i = 0; i < 3; i++) {
+        ck_assert_uint_eq(response.results[i].statusCode, UA_STATUSCODE_GOOD);
+        mons[i] = UA_Subscription_getMonitoredItem(sub, response.results[i].monitoredItemId);
+        ck_assert_ptr_ne(mons[i], NULL);
+        UA_assert(mons[i]);
+        ck_assert_ptr_ne(mons[i]->bulkSampleGroup, NULL);
+        ck_assert_ptr_eq(mons[i]->bulkSampleGroup, mons[0]->bulkSampleGroup);
+        ck_assert_uint_eq(mons[i]->queueSize, 1); /* The first sample */
+    }
+    ck_assert_uint_eq(mons[0]->bulkSampleGroup->monitoredItemsSize, 3);
+    UA_CreateMonitoredItemsResponse_deleteMembers(&response);
+
+    /* One call to the data source samples all MonitoredItems */
+    bulkReadCount = 0;
+    bulkValue = 1.0;
+    UA_fakeSleep(101);
+    UA_Server_run_iterate(server, false);
+    UA_realSleep(100);
+    ck_assert_uint_eq(bulkReadCount, 1);
+    for(size_t i = 0; i < 3; i++)
+        ck_assert_uint_eq(mons[i]->queueSize, 2);
+
+    /* The group is removed with the last MonitoredItem */
+    UA_Session_deleteSubscription(server, &adminSession, localSubscriptionId);
+    ck_assert(LIST_EMPTY(&server->bulkSampleGroups));
+}
+END_TEST
+
+/* Bit set of the sessions the data source has seen. Bit 0 for the admin
+ * session, bit n for the session with the numeric id 1000 + n. */
+static UA_UInt32 sharedReadSessions;
+
+static UA_StatusCode
+sharedRead(UA_Server *server_, const UA_NodeId *sessionId, void *sessionContext,
+           const UA_NodeId *nodeId, void *nodeContext, UA_Boolean includeSourceTimeStamp,
+           const UA_NumericRange *range, UA_DataValue *value) {
+    if(sessionId->namespaceIndex == 1 && sessionId->identifierType == UA_NODEIDTYPE_NUMERIC)
+        sharedReadSessions |= 1u << (sessionId->identifier.numeric - 1000);
+    else
+        sharedReadSessions |= 1u;
+    UA_Double v = 1.0;
+    value->hasValue = true;
+    return UA_Variant_setScalarCopy(&value->value, &v, &UA_TYPES[UA_TYPES_DOUBLE]);
+}
+
+static UA_MonitoredItem *
+createSharedItem(UA_Session *session, UA_NodeId nodeId,
+                 UA_TimestampsToReturn timestampsToReturn) {
+    UA_UInt32 localSubscriptionId = createSessionSubscription(session);
+    UA_MonitoredItemCreateRequest item;
+    UA_MonitoredItemCreateRequest_init(&item);
+    item.itemToMonitor.nodeId = nodeId;
+    item.itemToMonitor.attributeId = UA_ATTRIBUTEID_VALUE;
+    item.monitoringMode = UA_MONITORINGMODE_REPORTING;
+    item.requestedParameters.samplingInterval = 100.0;
+    item.requestedParameters.queueSize = 10;
+
+    UA_CreateMonitoredItemsRequest request;
+    UA_CreateMonitoredItemsRequest_init(&request);
+    request.subscriptionId = localSubscriptionId;
+    request.timestampsToReturn = timestampsToReturn;
+    request.itemsToCreateSize = 1;
+    request.itemsToCreate = &item;
+
+    UA_CreateMonitoredItemsResponse response;
+    UA_CreateMonitoredItemsResponse_init(&response);
+    Service_CreateMonitoredItems(server, session, &request, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 1);
+    ck_assert_uint_eq(response.results[0].statusCode, UA_STATUSCODE_GOOD);
+    UA_Subscription *sub = UA_Session_getSubscriptionById(session, localSubscriptionId);
+    ck_assert_ptr_ne(sub, NULL);
+    UA_assert(sub);
+    UA_MonitoredItem *mon =
+        UA_Subscription_getMonitoredItem(sub, response.results[0].monitoredItemId);
+    UA_CreateMonitoredItemsResponse_deleteMembers(&response);
+    ck_assert_ptr_ne(mon, NULL);
+    return mon;
+}
+
+static UA_NodeId
+addSharedVariable(UA_Double value) {
+    UA_NodeId nodeId;
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_Variant_setScalar(&attr.value, &value, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_StatusCode retval =
+        UA_Server_addVariableNode(server, UA_NODEID_NULL,
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                  UA_QUALIFIEDNAME(1, "Shared"),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                  attr, NULL, &nodeId);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    return nodeId;
+}
+
+static void
+writeSharedVariable(UA_NodeId nodeId, UA_Double value) {
+    UA_Variant var;
+    UA_Variant_setScalar(&var, &value, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_StatusCode retval = UA_Server_writeValue(server, nodeId, var);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+}
+
+static void
+sampleSharedItems(void) {
+    UA_fakeSleep(101);
+    UA_Server_run_iterate(server, false);
+    UA_realSleep(100);
+}
+
+START_TEST(Server_sharedSampling) {
+    UA_NodeId nodeId = addSharedVariable(0.0);
+
+    /* Two subscriptions monitor the node with different timestamps */
+    UA_MonitoredItem *mon1 = createSharedItem(&adminSession, nodeId, UA_TIMESTAMPSTORETURN_SOURCE);
+    UA_MonitoredItem *mon2 = createSharedItem(&adminSession, nodeId, UA_TIMESTAMPSTORETURN_SERVER);
+    UA_assert(mon1 && mon2);
+    ck_assert_ptr_ne(mon1->sampleGroup, NULL);
+    ck_assert_ptr_eq(mon1->sampleGroup, mon2->sampleGroup);
+    ck_assert_uint_eq(mon1->sampleGroup->monitoredItemsSize, 2);
+    ck_assert_uint_eq(server->sampleGroupsCount, 1);
+    ck_assert_uint_eq(mon1->queueSize, 1); /* The first sample */
+    ck_assert_uint_eq(mon2->queueSize, 1);
+
+    /* One read samples both MonitoredItems. The notifications share the value
+     * and keep their own timestamps. */
+    writeSharedVariable(nodeId, 1.0);
+    sampleSharedItems();
+    ck_assert_uint_eq(mon1->queueSize, 2);
+    ck_assert_uint_eq(mon2->queueSize, 2);
+    UA_Notification *n1 = MonitoredItem_getNotification(mon1, mon1->queueSize - 1);
+    UA_Notification *n2 = MonitoredItem_getNotification(mon2, mon2->queueSize - 1);
+    ck_assert_ptr_ne(n1->shared, NULL);
+    ck_assert_ptr_eq(n1->shared, n2->shared);
+    ck_assert_ptr_eq(n1->data.value.value.data, n2->data.value.value.data);
+    ck_assert(*(UA_Double*)n1->data.value.value.data == 1.0);
+    ck_assert(!n1->data.value.hasServerTimestamp);
+    ck_assert(n2->data.value.hasServerTimestamp);
+    /* The group, the notifications and the last values of the items */
+    ck_assert_uint_eq(n1->shared->refCount, 5);
+
+    /* An unchanged value is compared once for the group */
+    sampleSharedItems();
+    ck_assert_uint_eq(mon1->queueSize, 2);
+    ck_assert_uint_eq(mon2->queueSize, 2);
+
+    /* The group is removed with the last MonitoredItem */
+    UA_Session_deleteSubscription(server, &adminSession, mon1->subscription->subscriptionId);
+    UA_Session_deleteSubscription(server, &adminSession, mon2->subscription->subscriptionId);
+    ck_assert_uint_eq(server->sampleGroupsCount, 0);
+}
+END_TEST
+
+/* The second test session may not read the value of this node */
+static UA_NodeId deniedNodeId;
+
+static UA_Byte
+denySecondSession(UA_Server *server_, UA_AccessControl *ac,
+                  const UA_NodeId *sessionId, void *sessionContext,
+                  const UA_NodeId *nodeId, void *nodeContext) {
+    if(UA_NodeId_equal(nodeId, &deniedNodeId) && sessionId->namespaceIndex == 1 &&
+       sessionId->identifierType == UA_NODEIDTYPE_NUMERIC &&
+       sessionId->identifier.numeric == 1002)
+        return 0;
+    return 0xFF;
+}
+
+START_TEST(Server_sharedSamplingSessions) {
+    UA_Session session1, session2;
+    UA_Session_init(&session1);
+    UA_Session_init(&session2);
+    session1.sessionId = UA_NODEID_NUMERIC(1, 1001);
+    session2.sessionId = UA_NODEID_NUMERIC(1, 1002);
+    server->config.accessControl.getUserAccessLevel = denySecondSession;
+
+    /* A session dependent DataSource sees the session of every MonitoredItem */
+    UA_DataSource source;
+    source.read = sharedRead;
+    source.write = NULL;
+    source.sessionDependent = true;
+    UA_NodeId sourceId;
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_StatusCode retval =
+        UA_Server_addDataSourceVariableNode(server, UA_NODEID_NULL,
+                                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                            UA_QUALIFIEDNAME(1, "Source"),
+                                            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                            attr, source, NULL, &sourceId);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_MonitoredItem *mon1 = createSharedItem(&session1, sourceId, UA_TIMESTAMPSTORETURN_BOTH);
+    UA_MonitoredItem *mon2 = createSharedItem(&session2, sourceId, UA_TIMESTAMPSTORETURN_BOTH);
+    UA_assert(mon1 && mon2);
+    ck_assert_ptr_eq(mon1->sampleGroup, NULL);
+    ck_assert_ptr_eq(mon2->sampleGroup, NULL);
+    ck_assert_uint_eq(server->sampleGroupsCount, 0);
+    sharedReadSessions = 0;
+    sampleSharedItems();
+    ck_assert_uint_eq(sharedReadSessions, (1u << 1) | (1u << 2));
+    UA_Session_deleteSubscription(server, &session1, mon1->subscription->subscriptionId);
+    UA_Session_deleteSubscription(server, &session2, mon2->subscription->subscriptionId);
+
+    /* Stored values are shared. The access rights are checked per session. */
+    UA_NodeId nodeId = addSharedVariable(0.0);
+    deniedNodeId = nodeId;
+    UA_MonitoredItem *mon3 = createSharedItem(&session1, nodeId, UA_TIMESTAMPSTORETURN_BOTH);
+    UA_MonitoredItem *mon4 = createSharedItem(&session2, nodeId, UA_TIMESTAMPSTORETURN_BOTH);
+    UA_assert(mon3 && mon4);
+    ck_assert_ptr_ne(mon3->sampleGroup, NULL);
+    ck_assert_ptr_eq(mon3->sampleGroup, mon4->sampleGroup);
+    writeSharedVariable(nodeId, 1.0);
+    sampleSharedItems();
+    UA_Notification *n3 = MonitoredItem_getNotification(mon3, mon3->queueSize - 1);
+    UA_Notification *n4 = MonitoredItem_getNotification(mon4, mon4->queueSize - 1);
+    ck_assert(n3->data.value.hasValue);
+    ck_assert(*(UA_Double*)n3->data.value.value.data == 1.0);
+    ck_assert(!n4->data.value.hasValue);
+    ck_assert(n4->data.value.hasStatus);
+    ck_assert_uint_eq(n4->data.value.status, UA_STATUSCODE_BADUSERACCESSDENIED);
+
+    /* The MonitoredItems leave the group when the node gets a DataSource. The
+     * DataSource is not read for the session without access. */
+    retval = UA_Server_setVariableNode_dataSource(server, nodeId, source);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_ptr_eq(mon3->sampleGroup, NULL);
+    ck_assert_ptr_eq(mon4->sampleGroup, NULL);
+    ck_assert(mon3->sampleCallbackIsRegistered);
+    ck_assert(mon4->sampleCallbackIsRegistered);
+    ck_assert_uint_eq(server->sampleGroupsCount, 0);
+    sharedReadSessions = 0;
+    sampleSharedItems();
+    ck_assert_uint_eq(sharedReadSessions, 1u << 1);
+    n4 = MonitoredItem_getNotification(mon4, mon4->queueSize - 1);
+    ck_assert_uint_eq(n4->data.value.status, UA_STATUSCODE_BADUSERACCESSDENIED);
+
+    UA_Session_deleteMembersCleanup(&session1, server);
+    UA_Session_deleteMembersCleanup(&session2, server);
+}
+END_TEST
+
 #endif /* UA_ENABLE_SUBSCRIPTIONS */
 
 static Suite* testSuite_Client(void) {
@@ -682,6 +1630,17 @@ static Suite* testSuite_Client(void) {
     tcase_add_test(tc_server, Server_deleteSubscription);
     tcase_add_test(tc_server, Server_republish_invalid);
     tcase_add_test(tc_server, Server_publishCallback);
+    tcase_add_test(tc_server, Server_deadbandAbsolute);
+    tcase_add_test(tc_server, Server_deadbandPercent);
+    tcase_add_test(tc_server, Server_deadbandNotNumeric);
+    tcase_add_test(tc_server, Server_sampleOnWrite);
+    tcase_add_test(tc_server, Server_retransmissionQueue);
+    tcase_add_test(tc_server, Server_publishEncoding);
+    tcase_add_test(tc_server, Server_notificationOrder);
+    tcase_add_test(tc_server, Server_publishGroup);
+    tcase_add_test(tc_server, Server_bulkSampling);
+    tcase_add_test(tc_server, Server_sharedSampling);
+    tcase_add_test(tc_server, Server_sharedSamplingSessions);
     tcase_add_test(tc_server, Server_lifeTimeCount);
 #endif /* UA_ENABLE_SUBSCRIPTIONS */
     suite_add_tcase(s, tc_server);
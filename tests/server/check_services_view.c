@@ -10,7 +10,10 @@
 #include "ua_server.h"
 #include "ua_config_default.h"
 #include "ua_network_tcp.h"
+#include "ua_services.h"
 #include "thread_wrapper.h"
+#include "testing_networklayers.h"
+#include "testing_policy.h"
 
 UA_Server *server_translate_browse;
 UA_ServerConfig *server_translate_config;
@@ -102,6 +105,125 @@ START_TEST(Service_Browse_WithMaxResults) {
 }
 END_TEST
 
+/* The references of the folder do not fit into a message of this size */
+#define BROWSE_ENCODE_CHILDREN 3000
+#define BROWSE_ENCODE_MAXREFS 1400
+
+static UA_StatusCode
+browseEncode(UA_Server *server, UA_Session *session, UA_SecureChannel *channel,
+             const UA_BrowseDescription *bd, const UA_ByteString *cp) {
+    UA_MessageContext mc;
+    UA_StatusCode retval = UA_MessageContext_begin(&mc, channel, 0, UA_MESSAGETYPE_MSG);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_ResponseHeader rh;
+    UA_ResponseHeader_init(&rh);
+    if(bd) {
+        UA_BrowseRequest request;
+        UA_BrowseRequest_init(&request);
+        request.requestedMaxReferencesPerNode = BROWSE_ENCODE_MAXREFS;
+        request.nodesToBrowse = (UA_BrowseDescription*)(uintptr_t)bd;
+        request.nodesToBrowseSize = 1;
+        retval = Service_Browse(server, session, &mc, &request, &rh);
+    } else {
+        UA_BrowseNextRequest request;
+        UA_BrowseNextRequest_init(&request);
+        request.continuationPoints = (UA_ByteString*)(uintptr_t)cp;
+        request.continuationPointsSize = 1;
+        retval = Service_BrowseNext(server, session, &mc, &request, &rh);
+    }
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_MessageContext_abort(&mc);
+        return retval;
+    }
+    return UA_MessageContext_finish(&mc);
+}
+
+START_TEST(Service_Browse_EncodeFailure) {
+    UA_ServerConfig *config = UA_ServerConfig_new_default();
+    UA_Server *server = UA_Server_new(config);
+
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    UA_StatusCode retval =
+        UA_Server_addObjectNode(server, UA_NODEID_NUMERIC(1, 80000),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                UA_QUALIFIEDNAME(1, "folder"),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                                attr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    for(UA_UInt32 i = 1; i <= BROWSE_ENCODE_CHILDREN; i++) {
+        retval = UA_Server_addObjectNode(server, UA_NODEID_NUMERIC(1, 80000 + i),
+                                         UA_NODEID_NUMERIC(1, 80000),
+                                         UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                         UA_QUALIFIEDNAME(1, "child"),
+                                         UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                         attr, NULL, NULL);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    }
+
+    UA_SecureChannel channel;
+    UA_SecurityPolicy dummyPolicy;
+    funcs_called funcsCalled;
+    key_sizes keySizes;
+    TestingPolicy(&dummyPolicy, UA_BYTESTRING_NULL, &funcsCalled, &keySizes);
+    UA_SecureChannel_init(&channel, &dummyPolicy, &UA_BYTESTRING_NULL);
+    UA_Connection connection = createDummyConnection(65535, NULL);
+    connection.localConf.sendBufferSize = 8192; /* Several chunks per response */
+    UA_Connection_attachSecureChannel(&connection, &channel);
+    channel.connection = &connection;
+
+    UA_Session session;
+    UA_Session_init(&session);
+
+    UA_BrowseDescription bd;
+    UA_BrowseDescription_init(&bd);
+    bd.nodeId = UA_NODEID_NUMERIC(1, 80000);
+    bd.referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT);
+    bd.browseDirection = UA_BROWSEDIRECTION_FORWARD;
+    bd.resultMask = UA_BROWSERESULTMASK_ALL;
+
+    /* The response is too large. No continuation point is kept. */
+    connection.remoteConf.maxMessageSize = 4096;
+    retval = browseEncode(server, &session, &channel, &bd, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_BADRESPONSETOOLARGE);
+    ck_assert(LIST_EMPTY(&session.continuationPoints));
+    ck_assert_uint_eq(session.availableContinuationPoints, UA_MAXCONTINUATIONPOINTS);
+
+    /* The continuation point is behind the returned references */
+    connection.remoteConf.maxMessageSize = 0;
+    retval = browseEncode(server, &session, &channel, &bd, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ContinuationPointEntry *cp = LIST_FIRST(&session.continuationPoints);
+    ck_assert_ptr_ne(cp, NULL);
+    ck_assert_uint_eq(cp->targetIndex, BROWSE_ENCODE_MAXREFS);
+
+    /* A failed BrowseNext leaves the continuation point where it was */
+    connection.remoteConf.maxMessageSize = 4096;
+    retval = browseEncode(server, &session, &channel, NULL, &cp->identifier);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_BADRESPONSETOOLARGE);
+    ck_assert_ptr_eq(LIST_FIRST(&session.continuationPoints), cp);
+    ck_assert_uint_eq(cp->targetIndex, BROWSE_ENCODE_MAXREFS);
+
+    connection.remoteConf.maxMessageSize = 0;
+    retval = browseEncode(server, &session, &channel, NULL, &cp->identifier);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(cp->targetIndex, 2 * BROWSE_ENCODE_MAXREFS);
+
+    /* The last portion releases the continuation point */
+    retval = browseEncode(server, &session, &channel, NULL, &cp->identifier);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert(LIST_EMPTY(&session.continuationPoints));
+    ck_assert_uint_eq(session.availableContinuationPoints, UA_MAXCONTINUATIONPOINTS);
+
+    UA_Session_deleteMembersCleanup(&session, server);
+    UA_SecureChannel_deleteMembersCleanup(&channel);
+    dummyPolicy.deleteMembers(&dummyPolicy);
+    connection.close(&connection);
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+END_TEST
+
 START_TEST(Service_Browse_WithBrowseName) {
     UA_ServerConfig *config = UA_ServerConfig_new_default();
     UA_Server *server = UA_Server_new(config);
@@ -125,7 +247,83 @@ START_TEST(Service_Browse_WithBrowseName) {
 }
 END_TEST
 
-START_TEST(Service_TranslateBrowsePathsToNodeIds) {
+static UA_Boolean
+browseContains(UA_Server *server, UA_NodeId referenceTypeId,
+               UA_Boolean includeSubtypes, UA_NodeId target) {
+    UA_BrowseDescription bd;
+    UA_BrowseDescription_init(&bd);
+    bd.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+    bd.referenceTypeId = referenceTypeId;
+    bd.includeSubtypes = includeSubtypes;
+    bd.browseDirection = UA_BROWSEDIRECTION_FORWARD;
+    bd.resultMask = UA_BROWSERESULTMASK_NONE;
+    UA_BrowseResult br = UA_Server_browse(server, 0, &bd);
+    ck_assert_int_eq(br.statusCode, UA_STATUSCODE_GOOD);
+    UA_Boolean found = false;
+    for(size_t i = 0; i < br.referencesSize; i++) {
+        if(UA_NodeId_equal(&br.references[i].nodeId.nodeId, &target))
+            found = true;
+    }
+    UA_BrowseResult_deleteMembers(&br);
+    return found;
+}
+
+START_TEST(Service_Browse_ReferenceSubtypes) {
+    UA_ServerConfig *config = UA_ServerConfig_new_default();
+    UA_Server *server = UA_Server_new(config);
+
+    /* Builds the cached ReferenceType hierarchy */
+    UA_NodeId serverId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER);
+    ck_assert(browseContains(server, UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES),
+                             true, serverId));
+    ck_assert(!browseContains(server, UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                              true, serverId));
+
+    /* Add a new subtype of Organizes */
+    UA_NodeId myOrganizes = UA_NODEID_NUMERIC(1, 5000);
+    UA_ReferenceTypeAttributes rattr = UA_ReferenceTypeAttributes_default;
+    rattr.displayName = UA_LOCALIZEDTEXT("en-US", "MyOrganizes");
+    UA_StatusCode retval =
+        UA_Server_addReferenceTypeNode(server, myOrganizes,
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE),
+                                       UA_QUALIFIEDNAME(1, "MyOrganizes"),
+                                       rattr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* The new ReferenceType is known to be hierarchical */
+    UA_NodeId objectId = UA_NODEID_NUMERIC(1, 5001);
+    UA_ObjectAttributes oattr = UA_ObjectAttributes_default;
+    retval = UA_Server_addObjectNode(server, objectId,
+                                     UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                     myOrganizes, UA_QUALIFIEDNAME(1, "MyObject"),
+                                     UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                     oattr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    ck_assert(browseContains(server, UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES),
+                             true, objectId));
+    ck_assert(browseContains(server, UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                             true, objectId));
+    ck_assert(!browseContains(server, UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                              false, objectId));
+    ck_assert(!browseContains(server, UA_NODEID_NUMERIC(0, UA_NS0ID_AGGREGATES),
+                              true, objectId));
+
+    /* Remove the ReferenceType again */
+    retval = UA_Server_deleteNode(server, objectId, true);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    retval = UA_Server_deleteNode(server, myOrganizes, true);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert(browseContains(server, UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                             true, serverId));
+
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+END_TEST
+
+START_TEST(Client_TranslateBrowsePathsToNodeIds) {
     UA_Client *client = UA_Client_new(UA_ClientConfig_default);
 
     UA_StatusCode retVal = UA_Client_connect(client, "opc.tcp://localhost:4840");
@@ -178,11 +376,13 @@ static Suite *testSuite_Service_TranslateBrowsePathsToNodeIds(void) {
     TCase *tc_browse = tcase_create("Browse Service");
     tcase_add_test(tc_browse, Service_Browse_WithBrowseName);
     tcase_add_test(tc_browse, Service_Browse_WithMaxResults);
+    tcase_add_test(tc_browse, Service_Browse_ReferenceSubtypes);
+    tcase_add_test(tc_browse, Service_Browse_EncodeFailure);
     suite_add_tcase(s, tc_browse);
 
     TCase *tc_translate = tcase_create("TranslateBrowsePathsToNodeIds");
     tcase_add_unchecked_fixture(tc_translate, setup_server, teardown_server);
-    tcase_add_test(tc_translate, Service_TranslateBrowsePathsToNodeIds);
+    tcase_add_test(tc_translate, Client_TranslateBrowsePathsToNodeIds);
 
     suite_add_tcase(s, tc_translate);
     return s;
@@ -6,9 +6,29 @@
 #include <stdlib.h>
 
 #include "ua_types.h"
+#include "ua_server.h"
+#include "ua_config_default.h"
 #include "server/ua_services.h"
+#include "server/ua_server_internal.h"
+#include "testing_clock.h"
 #include "check.h"
 
+#define SESSIONS 500
+
+static UA_ServerConfig *config;
+static UA_Server *server;
+
+static void setup(void) {
+    config = UA_ServerConfig_new_default();
+    config->maxSessions = SESSIONS;
+    server = UA_Server_new(config);
+}
+
+static void teardown(void) {
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+
 START_TEST(Session_init_ShallWork) {
     UA_Session session;
     UA_Session_init(&session);
@@ -46,6 +66,70 @@ START_TEST(Session_updateLifetime_ShallWork) {
 }
 END_TEST
 
+START_TEST(SessionManager_lookup) {
+    UA_SessionManager *sm = &server->sessionManager;
+    UA_CreateSessionRequest request;
+    UA_CreateSessionRequest_init(&request);
+    request.requestedSessionTimeout = 10000;
+
+    UA_Session *sessions[SESSIONS];
+    for(size_t i = 0; i < SESSIONS; i++) {
+        UA_StatusCode retval =
+            UA_SessionManager_createSession(sm, NULL, &request, &sessions[i]);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    }
+    ck_assert_uint_eq(sm->currentSessionCount, SESSIONS);
+
+    for(size_t i = 0; i < SESSIONS; i++) {
+        ck_assert_ptr_eq(UA_SessionManager_getSessionByToken(sm,
+                             &sessions[i]->header.authenticationToken), sessions[i]);
+        ck_assert_ptr_eq(UA_SessionManager_getSessionById(sm, &sessions[i]->sessionId),
+                         sessions[i]);
+    }
+
+    /* Remove every second session */
+    for(size_t i = 0; i < SESSIONS; i += 2) {
+        UA_NodeId token = sessions[i]->header.authenticationToken;
+        ck_assert_uint_eq(UA_SessionManager_removeSession(sm, &token),
+                          UA_STATUSCODE_GOOD);
+        ck_assert_ptr_eq(UA_SessionManager_getSessionByToken(sm, &token), NULL);
+    }
+    ck_assert_uint_eq(sm->currentSessionCount, SESSIONS / 2);
+
+    for(size_t i = 1; i < SESSIONS; i += 2)
+        ck_assert_ptr_eq(UA_SessionManager_getSessionByToken(sm,
+                             &sessions[i]->header.authenticationToken), sessions[i]);
+}
+END_TEST
+
+START_TEST(SessionManager_cleanupTimedOut) {
+    UA_SessionManager *sm = &server->sessionManager;
+    UA_CreateSessionRequest request;
+    UA_CreateSessionRequest_init(&request);
+
+    /* Sessions with alternating timeouts */
+    UA_Session *sessions[SESSIONS];
+    for(size_t i = 0; i < SESSIONS; i++) {
+        request.requestedSessionTimeout = (i % 2 == 0) ? 1000 : 3000;
+        UA_SessionManager_createSession(sm, NULL, &request, &sessions[i]);
+    }
+
+    /* Extend the first session. It must survive the cleanup. */
+    UA_fakeSleep(800);
+    UA_Session_updateLifetime(sessions[0]);
+
+    UA_fakeSleep(400);
+    UA_SessionManager_cleanupTimedOut(sm, UA_DateTime_nowMonotonic());
+    ck_assert_uint_eq(sm->currentSessionCount, (SESSIONS / 2) + 1);
+    ck_assert_ptr_eq(UA_SessionManager_getSessionById(sm, &sessions[0]->sessionId),
+                     sessions[0]);
+
+    UA_fakeSleep(2000);
+    UA_SessionManager_cleanupTimedOut(sm, UA_DateTime_nowMonotonic());
+    ck_assert_uint_eq(sm->currentSessionCount, 0);
+}
+END_TEST
+
 static Suite* testSuite_Session(void) {
     Suite *s = suite_create("Session");
     TCase *tc_core = tcase_create("Core");
@@ -53,6 +137,12 @@ static Suite* testSuite_Session(void) {
     tcase_add_test(tc_core, Session_updateLifetime_ShallWork);
 
     suite_add_tcase(s,tc_core);
+
+    TCase *tc_manager = tcase_create("SessionManager");
+    tcase_add_checked_fixture(tc_manager, setup, teardown);
+    tcase_add_test(tc_manager, SessionManager_lookup);
+    tcase_add_test(tc_manager, SessionManager_cleanupTimedOut);
+    suite_add_tcase(s,tc_manager);
     return s;
 }
 
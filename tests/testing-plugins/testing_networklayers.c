@@ -9,21 +9,22 @@
 #include "ua_config_default.h"
 
 static UA_ByteString *vBuffer;
-static UA_ByteString sendBuffer;
+static size_t maxSendBufferSize;
 
 UA_StatusCode UA_Client_recvTesting_result = UA_STATUSCODE_GOOD;
 
+/* Every send buffer is allocated separately, as in the real network layers.
+ * Several buffers can be in use at the same time. */
 static UA_StatusCode
 dummyGetSendBuffer(UA_Connection *connection, size_t length, UA_ByteString *buf) {
-    if(length > sendBuffer.length)
+    if(length > maxSendBufferSize)
         return UA_STATUSCODE_BADCOMMUNICATIONERROR;
-    *buf = sendBuffer;
-    buf->length = length;
-    return UA_STATUSCODE_GOOD;
+    return UA_ByteString_allocBuffer(buf, length);
 }
 
 static void
 dummyReleaseSendBuffer(UA_Connection *connection, UA_ByteString *buf) {
+    UA_ByteString_deleteMembers(buf);
 }
 
 static UA_StatusCode
@@ -35,6 +36,7 @@ dummySend(UA_Connection *connection, UA_ByteString *buf) {
         UA_ByteString_deleteMembers(vBuffer);
         UA_ByteString_copy(buf, vBuffer);
     }
+    UA_ByteString_deleteMembers(buf);
     return UA_STATUSCODE_GOOD;
 }
 
@@ -46,13 +48,12 @@ static void
 dummyClose(UA_Connection *connection) {
     if(vBuffer)
         UA_ByteString_deleteMembers(vBuffer);
-    UA_ByteString_deleteMembers(&sendBuffer);
 }
 
 UA_Connection createDummyConnection(size_t sendBufferSize,
                                     UA_ByteString *verificationBuffer) {
     vBuffer = verificationBuffer;
-    UA_ByteString_allocBuffer(&sendBuffer, sendBufferSize);
+    maxSendBufferSize = sendBufferSize;
 
     UA_Connection c;
     c.state = UA_CONNECTION_ESTABLISHED;
@@ -55,6 +55,17 @@ builtin_overlayable = {"Boolean": "true", "SByte": "true", "Byte": "true",
                        "offsetof(UA_Guid, data3) == (sizeof(UA_UInt16) + sizeof(UA_UInt32)) && " + \
                        "offsetof(UA_Guid, data4) == (2*sizeof(UA_UInt32)))"}
 
+# Builtin types that are de-/encoded with the routines of another builtin type
+# with the same memory layout.
+builtin_encoding_alias = {"SByte": "Byte", "Int16": "UInt16", "Int32": "UInt32",
+                          "Int64": "UInt64", "DateTime": "UInt64", "StatusCode": "UInt32",
+                          "ByteString": "String", "XmlElement": "String"}
+
+# Builtin types with a constant length in the binary encoding
+builtin_encoding_size = {"Boolean": 1, "SByte": 1, "Byte": 1, "Int16": 2, "UInt16": 2,
+                         "Int32": 4, "UInt32": 4, "Int64": 8, "UInt64": 8, "Float": 4,
+                         "Double": 8, "DateTime": 8, "Guid": 16, "StatusCode": 4}
+
 ################
 # Type Classes #
 ################
@@ -105,6 +116,14 @@ class Type(object):
             "    " + binaryEncodingId + ", /* .binaryEncodingId */\n" + \
             "    %s_members" % self.name + " /* .members */\n}"
 
+    def sort_keys(self):
+        # (namespace, numeric typeId, numeric binaryEncodingId) as in datatype_c
+        if self.name in typedescriptions:
+            description = typedescriptions[self.name]
+            return (int(description.namespaceid), int(description.nodeid),
+                    int(description.binaryEncodingId))
+        return (0, 0, 0)
+
     def members_c(self):
         if len(self.members)==0:
             return "#define %s_members NULL" % (self.name)
@@ -248,6 +267,107 @@ class StructType(Type):
                 self.overlayable = "false"
             before = m
 
+    def member_routine(self, member, specialized):
+        """Returns the name of the routines for a (non-array) member and the C
+        type they take. None if the generic routines are used."""
+        t = member.memberType
+        if type(t) == OpaqueType:
+            t = types[t.baseType]
+        if type(t) == EnumerationType:
+            return ("UInt32", "UA_UInt32")
+        if type(t) == BuiltinType:
+            if t.name == "QualifiedName":
+                return None
+            name = builtin_encoding_alias.get(t.name, t.name)
+            return (name, "UA_" + name)
+        if t.name in specialized:
+            return (t.name + "_%sSpecialized", "UA_" + t.name)
+        return None
+
+    def encoding_specialized_c(self, specialized):
+        """Flattened de-/encoding and size computation. The routines of the
+        members are called directly instead of interpreting the member
+        descriptions at runtime."""
+        def typeptr(m):
+            return "&%s[%s_%s]" % (m.memberType.outname.upper(), m.memberType.outname.upper(),
+                                   m.memberType.name.upper())
+        def routine(r, op):
+            return r % op if "%s" in r else r + "_" + op
+        def cast(m, ctype, const):
+            if ctype == "UA_" + m.memberType.name:
+                return ""
+            return "(const %s*)" % ctype if const else "(%s*)" % ctype
+
+        enc = []
+        dec = []
+        calc = []
+        size = 0
+        for m in self.members:
+            if m.isArray:
+                enc.append("Array_encodeBinary(src->%s, src->%sSize,\n%s, ctx)" %
+                           (m.name, m.name, typeptr(m)))
+                dec.append("Array_decodeBinary((void *UA_RESTRICT *UA_RESTRICT)&dst->%s,\n" \
+                           "&dst->%sSize, %s, ctx)" % (m.name, m.name, typeptr(m)))
+                calc.append("Array_calcSizeBinary(src->%s, src->%sSize,\n%s)" %
+                            (m.name, m.name, typeptr(m)))
+                continue
+            r = self.member_routine(m, specialized)
+            if not r:
+                enc.append("encodeMember(&src->%s, %s,\nencodeBinaryInternal, ctx)" %
+                           (m.name, typeptr(m)))
+                dec.append("decodeBinaryInternal(&dst->%s, %s, ctx)" % (m.name, typeptr(m)))
+                calc.append("UA_calcSizeBinary(&src->%s, %s)" % (m.name, typeptr(m)))
+                continue
+            enc.append("encodeMember(&src->%s, %s,\n(encodeBinarySignature)%s, ctx)" %
+                       (m.name, typeptr(m), routine(r[0], "encodeBinary")))
+            if r[0] in ["Float", "Double"]:
+                # Can be a macro for the integer routine of the same size
+                dec.append("decodeBinaryJumpTable[UA_TYPES_%s](&dst->%s,\n%s, ctx)" %
+                           (r[0].upper(), m.name, typeptr(m)))
+            else:
+                dec.append("%s(%s&dst->%s,\n%s, ctx)" %
+                           (routine(r[0], "decodeBinary"), cast(m, r[1], False), m.name,
+                            typeptr(m)))
+            if r[0] in builtin_encoding_size:
+                size += builtin_encoding_size[r[0]]
+            else:
+                calc.append("%s(%s&src->%s,\n%s)" %
+                            (routine(r[0], "calcSizeBinary"), cast(m, r[1], True),
+                             m.name, typeptr(m)))
+
+        # Align the continued lines of a call with its arguments
+        def align(prefix, call):
+            return prefix + call.replace("\n", "\n" + " " * (len(prefix) + call.find("(") + 1))
+
+        # Stop at the first error like the generic routines
+        def chain(calls):
+            if len(calls) == 0:
+                return "    status ret = UA_STATUSCODE_GOOD;\n"
+            c = align("    status ret = ", calls[0]) + ";\n"
+            for call in calls[1:]:
+                c += "    if(ret == UA_STATUSCODE_GOOD)\n" + align("        ret = ", call) + ";\n"
+            return c
+
+        depth_begin = "    if(ctx->depth > UA_ENCODING_MAX_RECURSION)\n" \
+                      "        return UA_STATUSCODE_BADENCODINGERROR;\n" \
+                      "    ctx->depth++;\n"
+        depth_end = "    ctx->depth--;\n    return ret;\n}\n"
+        indent = " " * (len(self.name) + 26)
+        c = "static status\n%s_encodeBinarySpecialized(const UA_%s *UA_RESTRICT src,\n" \
+            "%sconst UA_DataType *type, Ctx *UA_RESTRICT ctx) {\n" % (self.name, self.name, indent)
+        c += depth_begin + chain(enc)
+        c += "    UA_assert(ret != UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED);\n" + depth_end
+        c += "\nstatic status\n%s_decodeBinarySpecialized(UA_%s *UA_RESTRICT dst,\n" \
+             "%sconst UA_DataType *type, Ctx *UA_RESTRICT ctx) {\n" % (self.name, self.name, indent)
+        c += depth_begin + chain(dec) + depth_end
+        c += "\nstatic size_t\n%s_calcSizeBinarySpecialized(const UA_%s *UA_RESTRICT src,\n" \
+             "%s const UA_DataType *type) {\n" % (self.name, self.name, indent + " ")
+        c += "    size_t s = %d;\n" % size
+        for call in calc:
+            c += align("    s += ", call) + ";\n"
+        c += "    return s;\n}"
+        return c
+
     def typedef_h(self):
         if len(self.members) == 0:
             return "typedef void * UA_%s;" % self.name
@@ -402,6 +522,15 @@ parser.add_argument('-s', '--selected-types',
                     default=[],
                     help='file with list of types (among those parsed) to be generated. If not given, all types are generated')
 
+parser.add_argument('--specialized-types',
+                    metavar="<specializedTypes>",
+                    type=argparse.FileType('r'),
+                    dest="specialized_types",
+                    action='append',
+                    default=[],
+                    help='file with list of structured types (among those generated) that get flattened ' \
+                         'de-/encoding routines in <outputFile>_generated_encoding_binary_specialized.h')
+
 parser.add_argument('--no-builtin',
                     action='store_true',
                     dest="no_builtin",
@@ -507,6 +636,13 @@ printh('''/**
 printh("#define " + outname.upper() + "_COUNT %s" % (str(len(filtered_types))))
 printh("extern UA_EXPORT const UA_DataType " + outname.upper() + "[" + outname.upper() + "_COUNT];")
 
+printh('''
+/* Indices into the array of type descriptions. Sorted by the numeric typeId
+ * and by the numeric binaryEncodingId (both after the namespace index). Used
+ * for a binary search during the type lookup. */''')
+printh("extern UA_EXPORT const UA_UInt16 " + outname.upper() + "_TYPEIDINDEX[" + outname.upper() + "_COUNT];")
+printh("extern UA_EXPORT const UA_UInt16 " + outname.upper() + "_BINARYENCODINGINDEX[" + outname.upper() + "_COUNT];")
+
 i = 0
 for t in filtered_types:
     printh("\n/**\n * " +  t.name)
@@ -586,6 +722,17 @@ for t in filtered_types:
     printc(t.datatype_c() + ",")
 printc("};\n")
 
+# Stable sort. The first type in the array wins for duplicate identifiers.
+def print_index(name, key):
+    order = sorted(range(len(filtered_types)), key=lambda i: key(filtered_types[i].sort_keys()) + (i,))
+    printc("const UA_UInt16 %s_%s[%s_COUNT] = {" % (outname.upper(), name, outname.upper()))
+    for i in range(0, len(order), 10):
+        printc("    " + ", ".join(map(str, order[i:i+10])) + ",")
+    printc("};\n")
+
+print_index("TYPEIDINDEX", lambda k: (k[0], k[1]))
+print_index("BINARYENCODINGINDEX", lambda k: (k[0], k[2]))
+
 ##################
 # Print Encoding #
 ##################
@@ -605,3 +752,53 @@ fh.close()
 ff.close()
 fc.close()
 fe.close()
+
+###############################
+# Print Specialized Encodings #
+###############################
+
+if len(args.specialized_types) > 0:
+    specialized_names = []
+    for f in args.specialized_types:
+        specialized_names += list(filter(len, [line.strip() for line in f]))
+    # The builtin types have handwritten routines
+    specialized_types = list(filter(lambda t: t.name in specialized_names and type(t) == StructType,
+                                    filtered_types))
+    specialized_names = list(map(lambda t: t.name, specialized_types))
+
+    fs = open(args.outfile + "_generated_encoding_binary_specialized.h",'w')
+    def prints(string):
+        print(string, end='\n', file=fs)
+
+    prints('''/* Generated from ''' + inname + ''' with script ''' + sys.argv[0] + '''
+ * on host ''' + platform.uname()[1] + ''' by user ''' + getpass.getuser() + \
+       ''' at ''' + time.strftime("%Y-%m-%d %I:%M:%S") + ''' */
+
+/* Flattened de-/encoding routines for selected types. This file is included at
+ * the end of ua_types_encoding_binary.c. The generic routines dispatch to them
+ * where they are available. */''')
+
+    for t in specialized_types:
+        prints("\n/* " + t.name + " */")
+        prints(t.encoding_specialized_c(specialized_names))
+
+    def print_dispatch(op, signature):
+        prints('''
+static %s
+get%sSpecialized(const UA_DataType *type) {
+    if(type->typeIndex >= %s_COUNT || type != &%s[type->typeIndex])
+        return NULL;
+    switch(type->typeIndex) {''' % (signature, op[0].upper() + op[1:],
+                                   outname.upper(), outname.upper()))
+        for t in specialized_types:
+            prints("    case %s:\n        return (%s)%s_%sSpecialized;" %
+                   (t.typeIndex, signature, t.name, op))
+        prints('''    default:
+        return NULL;
+    }
+}''')
+
+    print_dispatch("encodeBinary", "encodeBinarySignature")
+    print_dispatch("decodeBinary", "decodeBinarySignature")
+    print_dispatch("calcSizeBinary", "calcSizeBinarySignature")
+    fs.close()